@@ -37,7 +37,7 @@
  * @section DESCRIPTION
  *
   * This sketch implements the "Digital Fist Recorder" [DFR] on the
- * Arduino UNO R3. The DFR stores four separate CW messages by 
+ * Arduino UNO R3. The DFR stores many separate CW messages by 
  * recording the actual timing of the input pulse train, and reproducing
  * the exact timing on playback, thus preserving the operator's "fist".
  */
@@ -46,34 +46,66 @@
 #include <SD.h>
 
 #include <DigitalPulse.h>
+#include <SpscRing.h>
+#include <EdgeCapture.h>
+#include <PortDebouncer.h>
 #include <DigitalPin.h>
 #include <ModeSelector.h>
 #include <ChannelSelector.h>
+#include <PulseCodec.h>
 #include <PulseTrainRecorder.h>
+#include <PlaybackEngine.h>
+#include <MorseDecoder.h>
+#include <MorseSynthesizer.h>
+#include <FistAnalyzer.h>
+#include <TaskScheduler.h>
 #include "dfrconstants.h"
 
 /**
  * local constants
  * <p>
- * AUTO_RESET_CT is the maximum number of loop iterations that are
+ * AUTO_RESET_MILS is the maximum time in milliseconds that is
  * allowed in record or playback mode without any activity. This 
  * value is used to implement a "watchdog" timer to prevent the 
- * possibility of a stuck key condition. Since each loop iteration
- * is approximately one millisecond, this value may be considered to 
- * represent the operation timeout in milliseconds.
+ * possibility of a stuck key condition.
+ * <p>
+ * PLAYBACK_SERVICE_MILS is the interval in milliseconds between
+ * playback service calls. When transitions are made by the timer
+ * the loop only has to keep the edge queue full, otherwise it 
+ * must make each transition itself.
+ * <p>
+ * RECORD_SERVICE_MILS is the interval in milliseconds between 
+ * checks for staged pulses that should be committed to the card.
+ * <p>
+ * INDICATOR_TICK_MILS is the interval in milliseconds between 
+ * steps of the indicator flash patterns.
  * <p>
  * ERROR_RPT_PULSE_WIDTH is the duration in milliseconds of the flash
  * used in the error report routine. (flash three times on error).
  * <p>
  * ERROR_RPT_SPACING is the duration in milliseconds of the wait between
  * flashes used in the error report routine.
+ * <p>
+ * WELCOME_STAGE_MILS is the time taken by the welcome flashes on one 
+ * indicator; each indicator waits this long for the one before it.
  */
-#define AUTO_RESET_CT 5000
+#define AUTO_RESET_MILS       5000
+#define RECORD_SERVICE_MILS    100
+#define INDICATOR_TICK_MILS      5
+
+#if defined(TIMED_PLAYBACK) && defined(__AVR__)
+   #define PLAYBACK_SERVICE_MILS  10
+#else
+   #define PLAYBACK_SERVICE_MILS  LOOP_DELAY_MILS
+#endif
+
 #define ERROR_RPT_PULSE_WIDTH  300
 #define ERROR_RPT_SPACING       75
 
 #define WELCOME_PULSE_WIDTH  150
 #define WELCOME_SPACING       50
+#define WELCOME_STAGE_MILS   (2 * (WELCOME_PULSE_WIDTH + WELCOME_SPACING) \
+                             + STARTUP_WAIT_MILS)
                           
 /**
  * These objects represent the pinouts on the Arduino board
@@ -100,6 +132,20 @@ DigitalInputPin KeyingInput( KEY_INPUT_PIN
                            , DIGITAL_PIN_INIT_STATE_HIGH
                            , DIGITAL_PIN_INVERTING
                            , DIGITAL_PIN_WRITE_TO_SERIAL);
+
+#ifdef KEY_EDGE_CAPTURE
+/**
+ * This object captures KeyingInput edges by interrupt
+ */
+EdgeCapture KeyEdges;
+#endif
+
+#ifdef PORT_DEBOUNCE
+/**
+ * This object debounces all the input pins together
+ */
+PortDebouncer InputDebouncer(DEBOUNCE_SAMPLE_MILS);
+#endif
                          
 DigitalInputPin ModeSelectPin( MODE_SELECTOR_PIN
                              , INPUT_PULLUP
@@ -165,16 +211,252 @@ ChannelSelector ChannelSelect(ChannelSelectPin
  * This object manages recording and playback of pulses
  */
 PulseTrainRecorder PulseTrain;
+
+#ifdef CACHED_CHANNEL_HEADS
+/**
+ * These hold the first pulses of the lowest channels, 
+ * so playback can start without waiting for the card
+ */
+PulseTrainHead ChannelHeads[CACHED_CHANNELS];
+
+/**
+ * This function gets the cached head of the current channel
+ *
+ * @return head, or 0 if the channel has none in RAM
+ */
+PulseTrainHead *currentChannelHead() {
+   int ch = ChannelSelect.getCurrentChannel();
+
+   return (ch <= CACHED_CHANNELS) ? &ChannelHeads[ch - 1] : 0;
+}
+#endif
+
+#ifdef RESUME_PLAYBACK
+/**
+ * These hold where playback of the lowest channels was stopped,
+ * milliseconds from the first pulse, 0 to start over
+ */
+long ResumeOffsets[CACHED_CHANNELS];
+
+/**
+ * This function gets where playback of the current channel
+ * was stopped
+ *
+ * @return resume offset, or 0 if the channel has none in RAM
+ */
+long *currentResumeOffset() {
+   int ch = ChannelSelect.getCurrentChannel();
+
+   return (ch <= CACHED_CHANNELS) ? &ResumeOffsets[ch - 1] : 0;
+}
+#endif
+
+#ifdef MORSE_TEXT_OUTPUT
+/**
+ * This object decodes what is keyed while recording
+ */
+MorseDecoder KeyedText;
+
+/**
+ * This function writes decoded text to the serial port
+ */
+void writeKeyedText() {
+   int c;
+
+   while (-1 != (c = KeyedText.read())) {
+      Serial.print((char)c);
+   }
+}
+#endif
+
+#ifdef SERIAL_TEXT_ENTRY
+/**
+ * This object keys text entered from the serial port
+ */
+MorseSynthesizer EnteredText(TEXT_ENTRY_WPM);
+
+/**
+ * This holds the channel being loaded from the serial port, 
+ * 0 between lines, or -1 if the rest of the line is dropped
+ */
+int TextEntryChannel = 0;
+#endif
+
+#ifdef FIST_ANALYTICS
+/**
+ * This object measures the keying of each recording
+ */
+FistAnalyzer KeyedFist;
+
+/**
+ * This function keeps the measures of a recording in its
+ * channel file header, and writes them to the serial port
+ */
+void writeKeyedFist() {
+   PulseFistSummary fist;
+
+   if (KeyedFist.getSummary(fist)) {
+      PulseTrain.writeFistSummary(ChannelSelect.getCurrentChannelName(), fist);
+
+      #ifdef ALLOW_SERIAL_IO
+         Serial.print("dah/dit ");
+         Serial.print(fist.dahRatio / 32.0);
+         Serial.print(", weight ");
+         Serial.print(fist.weight);
+         Serial.print("%, jitter ");
+         Serial.print(fist.markJitter);
+         Serial.print("%/");
+         Serial.print(fist.spaceJitter);
+         Serial.print("%, drift ");
+         Serial.print(fist.drift / 100.0);
+         Serial.println(" wpm/min");
+      #endif
+   }
+}
+#endif
+
+#ifdef PLAYBACK_RATE_SELECT
+/**
+ * These are the playback rates stepped through with the channel 
+ * select button, in 256ths of the recorded speed
+ */
+const uint16_t PlaybackRates[] PROGMEM = {
+   256, 320, 384, 512, 768, 128, 192
+};
+
+/**
+ * This holds the place in the rate table of the playback rate
+ */
+uint8_t PlaybackRateIndex = 0;
+
+/**
+ * This is true if the rate scales only spaces between characters
+ */
+bool PlaybackSpacesOnly = false;
+
+/**
+ * This function changes the playback rate when the channel select
+ * button is pressed while a channel plays; a short press steps to
+ * the next rate, a long press switches spaces only scaling
+ *
+ * @return true if the rate was changed
+ */
+bool servicePlaybackRate() {
+   bool rtn = false;
+
+   if (ChannelSelectPin.readInputPulseMode()) {
+      switch (ChannelSelectPin.getCurrentPinMode()) {
+         case PIN_MODE_SHORT_PULSE:
+            PlaybackRateIndex = (PlaybackRateIndex + 1) 
+                   % (sizeof(PlaybackRates) / sizeof(PlaybackRates[0]));
+            rtn = true;
+            break;
+
+         case PIN_MODE_LONG_PULSE:
+            PlaybackSpacesOnly = !PlaybackSpacesOnly;
+            rtn = true;
+            break;
+
+         default:
+            break;
+      };
+
+      // once a press is taken, reset pin mode 
+      // so the next press is seen
+      if (rtn) {
+         ChannelSelectPin.setCurrentPinMode(PIN_MODE_IDLE);
+      }
+   }
+
+   if (rtn) {
+      PulseTrain.setPlaybackRate(
+         pgm_read_word(&PlaybackRates[PlaybackRateIndex])
+        ,PlaybackSpacesOnly);
+
+      #ifdef ALLOW_SERIAL_IO
+         Serial.print("rate ");
+         Serial.print((PulseTrain.getPlaybackRate() * 100UL + 128) >> 8);
+         Serial.println(PlaybackSpacesOnly ? "% spaces" : "%");
+      #endif
+   }
+
+   return rtn;
+}
+#endif
+
+#ifdef TIMED_PLAYBACK
+/**
+ * These objects schedule playback transitions on a timer.
+ * Off the AVR, the timer is a virtual clock advanced from the loop.
+ */
+#ifdef __AVR__
+Timer1PlaybackClock PlaybackTimer;
+#else
+VirtualPlaybackClock PlaybackTimer;
+#endif
+
+PlaybackEngine Playback( PlaybackTimer
+                       , KeyingOutput
+                       , SpeakerOutput);
+#endif
+
+/**
+ * task functions, defined below
+ */
+void serviceModeSelect();
+void serviceChannelSelect();
+void continuePlaybackMode();
+void serviceRecording();
+void tickOutputPins();
+void expireWatchdog();
+#ifdef PORT_DEBOUNCE
+void sampleInputPins();
+#endif
+
+/**
+ * This object runs the tasks below when they fall due
+ */
+TaskScheduler Scheduler;
+
+/**
+ * These objects are the tasks run by the scheduler
+ * <p>
+ * ModeTask reads the mode select button and keeps the current 
+ * mode going. It runs in every mode.
+ * <p>
+ * ChannelTask reads the channel select button. It runs only in
+ * idle mode.
+ * <p>
+ * PlaybackTask feeds the pulse train to the keying output, and with
+ * PLAYBACK_RATE_SELECT reads the channel select button for the
+ * playback rate. It runs only in playback mode.
+ * <p>
+ * RecordTask commits staged pulses to the card during pauses. It 
+ * runs only in record mode.
+ * <p>
+ * IndicatorTask advances the flash patterns on the output pins.
+ * <p>
+ * DebounceTask samples the input pins for the port debouncer.
+ * <p>
+ * WatchdogTask runs once if nothing happens for AUTO_RESET_MILS 
+ * in playback or record mode. The operating mode is forced back 
+ * to idle, and any current activity ceases. This is basically to 
+ * prevent a "stuck key" situation from arising under unforseen 
+ * circumstances.
+ */
+ScheduledTask ModeTask(serviceModeSelect, LOOP_DELAY_MILS);
+ScheduledTask ChannelTask(serviceChannelSelect, LOOP_DELAY_MILS);
+ScheduledTask PlaybackTask(continuePlaybackMode, PLAYBACK_SERVICE_MILS);
+ScheduledTask RecordTask(serviceRecording, RECORD_SERVICE_MILS);
+ScheduledTask IndicatorTask(tickOutputPins, INDICATOR_TICK_MILS);
+ScheduledTask WatchdogTask(expireWatchdog);
+#ifdef PORT_DEBOUNCE
+ScheduledTask DebounceTask(sampleInputPins, DEBOUNCE_SAMPLE_MILS);
+#endif
                        
 /**
  * file scoped global variables
  * <p>
- * loopWatchdog counts iterations since the last action taken
- * If it reaches a preset threshold, the operating mode is 
- * forced back to idle, and any current activity ceases. This
- * is basically to prevent a "stuck key" situation from arising
- * under unforseen circumstances.
- * <p>
  * currentMode holds the current operating mode set in the 
  * execution loop. priorMode holds the operating mode carried
  * forward from the last execution loop. We determine if the 
@@ -182,20 +464,38 @@ PulseTrainRecorder PulseTrain;
  * <p>
  * modeChanged is set by the comparing of current and prior modes 
  */
-static int loopWatchdog  = 0;
 static int currentMode   = PIN_MODE_IDLE;
 static int priorMode     = currentMode;
 static bool modeChanged  = false;
                        
 /**
- * This function performs an error indication (three flashes)
- * on an output pin
+ * This function queues an error indication (three flashes)
+ * on an output pin; the flashes run on while the loop continues
  */
 void flashErrorIndication(DigitalOutputPin &op) {
-   op.outputPulse(ERROR_RPT_PULSE_WIDTH, ERROR_RPT_SPACING);
-   op.outputPulse(ERROR_RPT_PULSE_WIDTH, ERROR_RPT_SPACING);
-   op.outputPulse(ERROR_RPT_PULSE_WIDTH, ERROR_RPT_SPACING);
+   op.queuePulse(ERROR_RPT_PULSE_WIDTH, ERROR_RPT_SPACING);
+   op.queuePulse(ERROR_RPT_PULSE_WIDTH, ERROR_RPT_SPACING);
+   op.queuePulse(ERROR_RPT_PULSE_WIDTH, ERROR_RPT_SPACING);
+}
+
+/**
+ * This function advances flash patterns on all output pins
+ */
+void tickOutputPins() {
+   SpeakerOutput.tick();
+   ShortModePin.tick();
+   LongModePin.tick();
+   KeyingOutput.tick();
+}
+
+#ifdef PORT_DEBOUNCE
+/**
+ * This function samples all input pins for debouncing
+ */
+void sampleInputPins() {
+   InputDebouncer.sample();
 }
+#endif
 
 /**
  * This function performs the initialization at reset
@@ -211,17 +511,73 @@ void setup() {
 
    // initialize digital pin hardware
    KeyingInput.initialize();
+   #ifdef KEY_EDGE_CAPTURE
+      // switch keying input to interrupt edge capture
+      if (KeyEdges.begin(KEY_INPUT_PIN)) {
+         KeyingInput.attachEdgeCapture(&KeyEdges);
+      }
+   #endif
+   #ifdef ADAPTIVE_KEY_DEBOUNCE
+      // learn debounce wait from the key's bounces
+      KeyingInput.enableAdaptiveDebounce(DEBOUNCE_FLOOR_MILS
+                                        ,DEBOUNCE_WAIT_MILS);
+   #endif
    ModeSelectPin.initialize();
    ChannelSelectPin.initialize();
 
+   #ifdef PORT_DEBOUNCE
+      // debounce input pins together, from their current levels
+      InputDebouncer.begin();
+      #ifndef ADAPTIVE_KEY_DEBOUNCE
+         InputDebouncer.setKeyPin(KEY_INPUT_PIN);
+         KeyingInput.attachDebouncer(&InputDebouncer);
+      #endif
+      ModeSelectPin.attachDebouncer(&InputDebouncer);
+      ChannelSelectPin.attachDebouncer(&InputDebouncer);
+   #endif
+
    SpeakerOutput.initialize();
    ShortModePin.initialize();
    LongModePin.initialize();
    KeyingOutput.initialize();
 
+   #ifdef MORSE_CHANNEL_ENTRY
+      // channel numbers are keyed, and heard on the speaker
+      ChannelSelect.enableMorseEntry(&SpeakerOutput);
+   #endif
+
+   #if defined(TIMED_PLAYBACK) && defined(__AVR__)
+      PlaybackTimer.begin();
+   #endif
+
    // initialize SD card
    if (PulseTrain.initialize(SD_RESERVED_PIN, SD_CS_PIN)) {
       //Serial.println("SD initialized.");
+
+      #ifdef SEEK_INDEX
+         PulseTrain.setIndexInterval(PLAYBACK_INDEX_INTERVAL);
+      #endif
+
+      // channel files from before the container are copied in
+      // once; a channel already recorded in the container is kept
+      for (int ch=1; ch<=RECORDING_CHANNELS; ++ch) {
+         PulseTrain.importChannel(ChannelSelect.getChannelName(ch));
+      }
+
+      // channel reports show which channels hold a recording;
+      // only the file headers are read
+      for (int ch=1; ch<=RECORDING_CHANNELS; ++ch) {
+         ChannelSelect.setChannelEmpty(ch
+            ,PulseTrain.isChannelEmpty(ChannelSelect.getChannelName(ch)));
+      }
+
+      #ifdef CACHED_CHANNEL_HEADS
+         // cache the start of the lowest channels
+         for (int ch=1; ch<=CACHED_CHANNELS; ++ch) {
+            PulseTrain.loadHead(ChannelSelect.getChannelName(ch)
+                               ,ChannelHeads[ch - 1]);
+         }
+      #endif
    }
    else {
       #ifdef ALLOW_SERIAL_IO
@@ -237,16 +593,24 @@ void setup() {
    
    delay(STARTUP_WAIT_MILS);
    
-   // flash "welcome" indication
-   SpeakerOutput.outputPulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
-   SpeakerOutput.outputPulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
-   delay(STARTUP_WAIT_MILS);
-   LongModePin.outputPulse(WELCOME_PULSE_WIDTH,  WELCOME_SPACING);
-   LongModePin.outputPulse(WELCOME_PULSE_WIDTH,  WELCOME_SPACING);
-   delay(STARTUP_WAIT_MILS);
-   ShortModePin.outputPulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
-   ShortModePin.outputPulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
-   delay(STARTUP_WAIT_MILS);
+   // queue "welcome" indication, each pin 
+   // waits for the one before it to finish
+   SpeakerOutput.queuePulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
+   SpeakerOutput.queuePulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
+   LongModePin.queueStep(LOW, WELCOME_STAGE_MILS);
+   LongModePin.queuePulse(WELCOME_PULSE_WIDTH,  WELCOME_SPACING);
+   LongModePin.queuePulse(WELCOME_PULSE_WIDTH,  WELCOME_SPACING);
+   ShortModePin.queueStep(LOW, 2 * WELCOME_STAGE_MILS);
+   ShortModePin.queuePulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
+   ShortModePin.queuePulse(WELCOME_PULSE_WIDTH, WELCOME_SPACING);
+
+   // start tasks that run in idle mode
+   Scheduler.schedule(ModeTask,      0);
+   Scheduler.schedule(ChannelTask,   0);
+   Scheduler.schedule(IndicatorTask, 0);
+   #ifdef PORT_DEBOUNCE
+      Scheduler.schedule(DebounceTask, 0);
+   #endif
 }
                        
 /**
@@ -255,10 +619,68 @@ void setup() {
 void transitToIdleMode() {
    // prior mode does not affect transition to idle
    //Serial.println("IDLE");           
-   loopWatchdog = 0;
+   #if defined(ADAPTIVE_KEY_DEBOUNCE) && defined(ALLOW_SERIAL_IO)
+      Serial.print("debounce ");
+      Serial.print(KeyingInput.getDebounceThreshold());
+      Serial.print(" ms, bounce ");
+      Serial.print(KeyingInput.getBounceEstimate());
+      Serial.println(" us");
+   #endif
+
+   // stop tasks for playback and record, 
+   // channel selection runs again
+   Scheduler.cancel(WatchdogTask);
+   Scheduler.cancel(PlaybackTask);
+   Scheduler.cancel(RecordTask);
+   Scheduler.schedule(ChannelTask, 0);
+
+   #ifdef TIMED_PLAYBACK
+      // cancel any scheduled playback transitions
+      Playback.stop();
+   #endif
+
+   #ifdef RESUME_PLAYBACK
+      // remember where an unfinished playback was stopped
+      long *resume = currentResumeOffset();
+
+      if (resume && PulseTrain.playbackActive()) {
+         *resume = PulseTrain.getPlaybackPosition();
+      }
+   #endif
+
+   // a channel number part way keyed is dropped
+   ChannelSelect.cancelEntry();
 
-   // close any open recorder file
+   // close any open recorder file, a recording
+   // may have changed whether its channel is empty
+   bool recorded = PulseTrain.recordingActive();
    PulseTrain.close();
+
+   #ifdef SERIAL_TEXT_ENTRY
+      // a line part way entered was closed with the file
+      TextEntryChannel = 0;
+   #endif
+
+   #ifdef MORSE_TEXT_OUTPUT
+      // the last character keyed is not followed by a pulse
+      if (recorded) {
+         KeyedText.flush();
+         writeKeyedText();
+         Serial.println();
+      }
+   #endif
+
+   #ifdef FIST_ANALYTICS
+      // the header is only final once the file is closed
+      if (recorded) {
+         writeKeyedFist();
+      }
+   #endif
+
+   if (recorded) {
+      ChannelSelect.setChannelEmpty(ChannelSelect.getCurrentChannel()
+         ,PulseTrain.isChannelEmpty(ChannelSelect.getCurrentChannelName()));
+   }
       
    // re-activate all pins 
    KeyingInput.resume();
@@ -281,9 +703,28 @@ void transitToIdleMode() {
 }
 
 /**
- * This function continues operation in the IDLE mode
+ * This function restarts the inactivity timeout
  */
-void continueIdleMode() {
+void restartWatchdog() {
+   Scheduler.schedule(WatchdogTask, AUTO_RESET_MILS);
+}
+
+/**
+ * This function forces idle mode after a period without activity
+ * in playback or record mode
+ */
+void expireWatchdog() {
+   ModeSelect.forceMode(PIN_MODE_IDLE);
+   transitToIdleMode();
+}
+
+/**
+ * This function checks for channel selection in the IDLE mode
+ */
+void serviceChannelSelect() {
+   // keep any channel report or keyed channel number going
+   ChannelSelect.service();
+
    // check for channel selection request
    if (ChannelSelect.readInputPulseMode()) {
       // activity on channel select input
@@ -298,7 +739,106 @@ void continueIdleMode() {
       KeyingOutput.resume();
       KeyingInput.resume();      
    }
+}
+
+/**
+ * This function opens the current channel for recording, 
+ * refreshing the channel's cached head
+ *
+ * @return true if the channel was opened
+ */
+bool openChannelForRecording() {
+   #ifdef CACHED_CHANNEL_HEADS
+      PulseTrainHead *head = currentChannelHead();
+   #else
+      PulseTrainHead *head = 0;
+   #endif
+
+   #ifdef APPEND_RECORDING
+      bool opened = PulseTrain.openForAppend(
+                       ChannelSelect.getCurrentChannelName(), head);
+   #else
+      bool opened = PulseTrain.openForRecording(
+                       ChannelSelect.getCurrentChannelName(), head);
+   #endif
+
+   #ifdef RESUME_PLAYBACK
+      // new recording plays from the start
+      long *resume = currentResumeOffset();
+
+      if (resume) {
+         *resume = 0;
+      }
+   #endif
+
+   return opened;
+}
+
+#ifdef SERIAL_TEXT_ENTRY
+/**
+ * This function finishes the channel being loaded from the
+ * serial port, and writes back its number
+ */
+void endTextEntry() {
+   if (TextEntryChannel > 0) {
+      PulseTrain.close();
+      ChannelSelect.setChannelEmpty(TextEntryChannel
+         ,PulseTrain.isChannelEmpty(ChannelSelect.getChannelName(TextEntryChannel)));
+      Serial.println(TextEntryChannel);
+   }
+
+   TextEntryChannel = 0;
+}
+
+/**
+ * This function keys the next character entered from the serial
+ * port into the current channel; the first character of a line
+ * opens the channel, and the end of the line closes it
+ */
+void serviceTextEntry() {
+   int c = Serial.read();
+
+   if (('\n' == c) || ('\r' == c)) {
+      endTextEntry();
+   }
+   else if ((-1 != c) && (TextEntryChannel >= 0)) {
+      if (0 == TextEntryChannel) {
+         if (openChannelForRecording()) {
+            TextEntryChannel = ChannelSelect.getCurrentChannel();
+            EnteredText.setSpeed(TEXT_ENTRY_WPM
+                                ,TEXT_ENTRY_EFFECTIVE_WPM
+                                ,TEXT_ENTRY_WEIGHT);
+            EnteredText.start(millis());
+         }
+         else {
+            // drop the line
+            flashErrorIndication(ShortModePin);
+            TextEntryChannel = -1;
+         }
+      }
+
+      // characters with no code are left out
+      DigitalPulse dp;
 
+      if ((TextEntryChannel > 0) && EnteredText.putChar((char)c)) {
+         while (EnteredText.nextPulse(dp)) {
+            if (!PulseTrain.recordPulse(dp)) {
+               // drop the rest of the line
+               flashErrorIndication(ShortModePin);
+               endTextEntry();
+               TextEntryChannel = -1;
+               break;
+            }
+         }
+      }
+   }
+}
+#endif
+
+/**
+ * This function continues operation in the IDLE mode
+ */
+void continueIdleMode() {
    // continuing idle mode  
    // check keying input
    KeyingInput.determinePinState();
@@ -306,6 +846,11 @@ void continueIdleMode() {
    // set output pins based on current keying input state
    KeyingInput.indicate(KeyingOutput);
    KeyingInput.indicate(SpeakerOutput);
+
+   #ifdef SERIAL_TEXT_ENTRY
+      // load the current channel from any text entered
+      serviceTextEntry();
+   #endif
 }
 
                        
@@ -318,15 +863,61 @@ void transitToPlaybackMode() {
    if (PIN_MODE_SHORT_PULSE != priorMode) {
       //Serial.print("PLAYBACK ");  
       //Serial.println(ChannelSelect.getCurrentChannel());  
-      loopWatchdog = 0;
       
       // attempt to start recording pulses to file
-      if (PulseTrain.openForPlayback(ChannelSelect.getCurrentChannelName())) {
+      #ifdef CACHED_CHANNEL_HEADS
+         PulseTrainHead *head = currentChannelHead();
+         bool opened = head
+                     ? PulseTrain.openCachedPlayback(
+                          ChannelSelect.getCurrentChannelName(), *head)
+                     : PulseTrain.openForPlayback(
+                          ChannelSelect.getCurrentChannelName());
+      #else
+         bool opened = PulseTrain.openForPlayback(
+                          ChannelSelect.getCurrentChannelName());
+      #endif
+
+      #ifdef PLAY_LATEST_SEGMENT
+         // play only what was recorded last
+         if (opened) {
+            opened = PulseTrain.playSegment(PulseTrain.getSegmentCount() - 1);
+         }
+      #endif
+
+      #ifdef RESUME_PLAYBACK
+         // carry on from where the last playback stopped,
+         // or start over if that place can't be found
+         long *resume = currentResumeOffset();
+
+         if (resume) {
+            if (opened && (*resume > 0) && !PulseTrain.seek(*resume)) {
+               opened = PulseTrain.openForPlayback(
+                           ChannelSelect.getCurrentChannelName());
+            }
+            *resume = 0;
+         }
+      #endif
+
+      if (opened) {
          // turn off keying pass-thru 
          KeyingInput.suspend();
+
+         #ifdef TIMED_PLAYBACK
+            #ifndef __AVR__
+               // bring virtual clock up to date
+               PlaybackTimer.advanceTo(micros());
+            #endif
+
+            // hand pulse train to the timer
+            Playback.start(PulseTrain);
+         #endif
       
+         // hand over to the playback task
+         Scheduler.cancel(ChannelTask);
+         Scheduler.schedule(PlaybackTask, 0);
+
          // restart watchdog 
-         loopWatchdog = 0;
+         restartWatchdog();
       }
       else {
          // attempt to open for playback was not successful
@@ -340,21 +931,45 @@ void transitToPlaybackMode() {
  * This function continues operation in the PLAYBACK mode
  */
 void continuePlaybackMode() {
+#ifdef PLAYBACK_RATE_SELECT
+   // a rate change is activity too
+   if (servicePlaybackRate()) {
+      restartWatchdog();
+   }
+#endif
+
+#ifdef TIMED_PLAYBACK
+   #ifndef __AVR__
+      // make any transitions due on the virtual clock
+      PlaybackTimer.advanceTo(micros());
+   #endif
+
+   // continuing playback mode, transitions are made 
+   // by the timer, loop keeps the edge queue full
+   if (Playback.isActive()) {
+      if (Playback.service(PulseTrain)) {
+         // restart watchdog 
+         restartWatchdog();
+      }
+   }
+   else {
+      ModeSelect.forceMode(PIN_MODE_IDLE);
+      transitToIdleMode(); 
+   }
+#else
    // continuing playback mode 
    if (PulseTrain.playbackActive()) {
       if (PulseTrain.playBackKeying( KeyingOutput
                                    , SpeakerOutput)) {
          // restart watchdog 
-         loopWatchdog = 0;
+         restartWatchdog();
       }
-      
-      // count for auto reset 
-      ++loopWatchdog;
    }
    else {
       ModeSelect.forceMode(PIN_MODE_IDLE);
       transitToIdleMode(); 
    }
+#endif
 }
 
 /**
@@ -369,12 +984,26 @@ void transitToRecordMode() {
       //Serial.println(ChannelSelect.getCurrentChannel());  
       
       // attempt to start recording pulses to file
-      if (PulseTrain.openForRecording(ChannelSelect.getCurrentChannelName())) {
+      if (openChannelForRecording()) {
          // turn off keying pass-thru 
          KeyingOutput.suspend();
+
+         #ifdef MORSE_TEXT_OUTPUT
+            // decode from the first pulse, at the speed last keyed
+            KeyedText.reset();
+         #endif
+
+         #ifdef FIST_ANALYTICS
+            // measure this recording alone
+            KeyedFist.reset();
+         #endif
          
+         // start committing pulses in pauses
+         Scheduler.cancel(ChannelTask);
+         Scheduler.schedule(RecordTask, RECORD_SERVICE_MILS);
+
          // restart watchdog 
-         loopWatchdog = 0;
+         restartWatchdog();
       }
       else {
          // attempt to open for recording was not successful
@@ -396,17 +1025,41 @@ void continueRecordMode() {
 
    // write to file as pulses complete
    if (KeyingInput.hasChanged()&&(LOW == KeyingInput.getLogicalState())) {
-      loopWatchdog = 0;
+      restartWatchdog();
       
+      #ifdef MORSE_TEXT_OUTPUT
+         KeyedText.addPulse(KeyingInput.getLastPulse());
+      #endif
+
+      #ifdef FIST_ANALYTICS
+         KeyedFist.addPulse(KeyingInput.getLastPulse());
+      #endif
+
       // exit to idle mode if pulse write fails
       if (!PulseTrain.recordPulse(KeyingInput.getLastPulse())) {
          flashErrorIndication(ShortModePin);
          transitToIdleMode();
       }
    }
-   else {
-      // count for auto reset 
-      ++loopWatchdog;
+}
+
+/**
+ * This function commits staged pulses to card during pauses
+ * in the RECORD mode
+ */
+void serviceRecording() {
+   #ifdef MORSE_TEXT_OUTPUT
+      // characters and words end in the pauses
+      if (LOW == KeyingInput.getLogicalState()) {
+         KeyedText.checkIdle(millis());
+      }
+      writeKeyedText();
+   #endif
+
+   // exit to idle mode if the write fails
+   if (!PulseTrain.serviceRecording()) {
+      flashErrorIndication(ShortModePin);
+      transitToIdleMode();
    }
 }
 
@@ -460,7 +1113,7 @@ void selectModeTransition() {
 void selectModeContinuation() {
    switch (currentMode) {
       case PIN_MODE_SHORT_PULSE:
-         continuePlaybackMode();
+         // playback task keeps playback going
          break;
 
       case PIN_MODE_LONG_PULSE:
@@ -475,9 +1128,10 @@ void selectModeContinuation() {
 }
 
 /**
- * Main execution loop
+ * This function reads the mode selector and carries out 
+ * the current mode
  */
- void loop() {
+void serviceModeSelect() {
    // setting operational mode has highest priority
    if (modeChanged = ModeSelect.readInputPulseMode()) {
       // state has changed - change output pin to match
@@ -496,18 +1150,14 @@ void selectModeContinuation() {
       selectModeContinuation();
    }
 
-   // check watchdog counter to reset 
-   // after long idle time in playback or record mode
-   if (loopWatchdog >= AUTO_RESET_CT) {
-      transitToIdleMode();
-   }
-
    // save prior mode
    priorMode = currentMode;
-
-   // loop delay
-   delay(LOOP_DELAY_MILS);      
 }
 
-
-
+/**
+ * Main execution loop
+ */
+ void loop() {
+   // run whatever tasks are due
+   Scheduler.run();
+}
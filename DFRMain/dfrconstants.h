@@ -61,6 +61,165 @@
  
  // #define ALLOW_SERIAL_IO
  
+/**
+ * By default the keying input is polled from the main loop. If the
+ * macro KEY_EDGE_CAPTURE is defined below, the keying input is instead 
+ * watched by a pin change interrupt that timestamps every edge with
+ * micros(). Edges are then debounced by the main loop after the fact,
+ * so key timing is not disturbed by SD card writes or indicator 
+ * flashes that hold up the loop.
+ */
+
+ // #define KEY_EDGE_CAPTURE
+ 
+/**
+ * If the macro TIMED_PLAYBACK is defined below, playback transitions
+ * are scheduled on a Timer1 compare interrupt by PlaybackEngine, so 
+ * edge timing does not depend on loop latency or SD read time. 
+ * Comment it out to return to polling the clock from the main loop,
+ * which leaves Timer1 free for other uses.
+ */
+
+#define TIMED_PLAYBACK
+ 
+/**
+ * If the macro PORT_DEBOUNCE is defined below, the input pins are
+ * not debounced one at a time. Instead all pins are sampled together
+ * every DEBOUNCE_SAMPLE_MILS by PortDebouncer, and a change is taken
+ * after PORT_DEBOUNCE_SAMPLES samples in a row at the new level. An 
+ * interrupt edge source on the keying input takes precedence.
+ */
+
+#define PORT_DEBOUNCE
+ 
+/**
+ * If the macro ADAPTIVE_KEY_DEBOUNCE is defined below, the keying 
+ * input learns its debounce wait from the bounce bursts it sees,
+ * starting at DEBOUNCE_WAIT_MILS and shrinking to no less than 
+ * DEBOUNCE_FLOOR_MILS for a clean key. This cuts the delay before
+ * each change of the key is taken and heard on the side tone; edges
+ * are recorded at the first edge of their bounce burst either way.
+ * The keying input then debounces itself, rather
+ * than through the port debouncer. With ALLOW_SERIAL_IO the learned
+ * wait is printed on each return to idle.
+ */
+
+ // #define ADAPTIVE_KEY_DEBOUNCE
+ 
+/**
+ * If the macro CACHED_CHANNEL_HEADS is defined below, the first 
+ * PLAYBACK_HEAD_PULSES pulses of channels 1 to CACHED_CHANNELS are 
+ * kept in RAM, read at reset and refreshed by each recording. 
+ * Playback then starts at once from RAM, and the channel file is 
+ * opened in the first long space. This takes about 40 bytes of RAM 
+ * per cached channel; higher channels play from the card.
+ */
+
+#define CACHED_CHANNEL_HEADS
+ 
+/**
+ * If the macro SEEK_INDEX is defined below, each recording is made
+ * with a sparse seek index alongside it, in a file of the same name 
+ * with the extension .idx, holding an entry every 
+ * PLAYBACK_INDEX_INTERVAL pulses and at the start of every message. 
+ * Playback can then be moved part way into a long recording without
+ * reading the file up to there.
+ */
+
+#define SEEK_INDEX
+ 
+/**
+ * If the macro RESUME_PLAYBACK is defined below, a playback stopped
+ * part way with the mode button is remembered, and the next playback
+ * of that channel carries on from the pulse that was playing. A 
+ * playback that runs to the end, or a new recording, starts the 
+ * channel over. This is quickest with SEEK_INDEX defined.
+ */
+
+// #define RESUME_PLAYBACK
+
+/**
+ * If the macro APPEND_RECORDING is defined below, each recording is
+ * added to the end of its channel as a new segment, and what the 
+ * channel held is kept. Playback plays the segments one after 
+ * another, PLAYBACK_MESSAGE_GAP_MILS apart, or only the last one
+ * recorded if the macro PLAY_LATEST_SEGMENT is defined as well.
+ * A channel is started over once it holds PULSE_SEGMENT_MAX segments.
+ */
+
+// #define APPEND_RECORDING
+// #define PLAY_LATEST_SEGMENT
+
+/**
+ * If the macro MORSE_CHANNEL_ENTRY is defined below, a long press of
+ * the channel selector button is followed by the channel number 
+ * keyed in Morse digits on the same button, instead of waiting while
+ * each channel is blinked in turn. The keying is echoed on the 
+ * speaker, and a tone confirms the new channel, or three short tones
+ * show the number was not understood or is not a channel.
+ */
+
+#define MORSE_CHANNEL_ENTRY
+
+/**
+ * If the macro MORSE_TEXT_OUTPUT is defined below, what is keyed 
+ * while recording is decoded as it is keyed, and the text is written
+ * to the serial port, a word at a time in the pauses between pulses.
+ * The decoder follows the speed of the fist, and keeps it from one 
+ * recording to the next. This needs ALLOW_SERIAL_IO defined as well,
+ * and takes about 30 bytes of RAM.
+ */
+
+// #define MORSE_TEXT_OUTPUT
+
+#if defined(MORSE_TEXT_OUTPUT) && !defined(ALLOW_SERIAL_IO)
+   #error "MORSE_TEXT_OUTPUT needs ALLOW_SERIAL_IO"
+#endif
+ 
+/**
+ * If the macro SERIAL_TEXT_ENTRY is defined below, text sent to the
+ * serial port in idle mode is keyed into the current channel, a line
+ * at a time, as a perfect fist would key it, so a channel can be 
+ * loaded without a key. The recording is made as in record mode, 
+ * and the channel number is written back when the line ends. This
+ * needs ALLOW_SERIAL_IO defined as well, and takes about 30 bytes
+ * of RAM.
+ */
+
+// #define SERIAL_TEXT_ENTRY
+
+#if defined(SERIAL_TEXT_ENTRY) && !defined(ALLOW_SERIAL_IO)
+   #error "SERIAL_TEXT_ENTRY needs ALLOW_SERIAL_IO"
+#endif
+ 
+/**
+ * If the macro FIST_ANALYTICS is defined below, the keying of each
+ * recording is measured as it is keyed: dah to dit ratio, weight,
+ * letter and word spaces, jitter and speed drift. The measures are
+ * kept in the channel file header when recording ends, and with
+ * ALLOW_SERIAL_IO are written to the serial port as well. With
+ * APPEND_RECORDING the header describes the latest segment. This 
+ * takes about 120 bytes of RAM, and the floating point library.
+ */
+
+// #define FIST_ANALYTICS
+ 
+/**
+ * If the macro PLAYBACK_RATE_SELECT is defined below, the channel
+ * select button sets the playback rate while a channel plays. A 
+ * short press steps through the rates, from the recorded speed up 
+ * to three times it, then down to half of it and back; a long press
+ * switches between scaling the whole of the pulse train and scaling
+ * only the spaces between characters, as in Farnsworth timing. The 
+ * rate is kept for later playbacks, and a change is heard from the 
+ * next pulse read. Time is scaled in fixed point, with no floating 
+ * point. The recorder always keeps about 20 bytes of RAM for the 
+ * rate and the played pulse times, as playback runs from them at 
+ * any rate; defining this adds 2 bytes more.
+ */
+
+// #define PLAYBACK_RATE_SELECT
+ 
 /**
  * digital pin definitions
  */
@@ -87,13 +246,27 @@
  * wait time definitions
  */
 #define DEBOUNCE_WAIT_MILS    10
+#define DEBOUNCE_SAMPLE_MILS  3
+#define DEBOUNCE_FLOOR_MILS   2
 #define STARTUP_WAIT_MILS     5
 #define LOOP_DELAY_MILS       1
 
 /**
  * misc constant definitions
+ * <p>
+ * CACHED_CHANNELS is the number of channels, from channel 1, whose
+ * cached head and playback resume point are kept in RAM.
+ * <p>
+ * TEXT_ENTRY_WPM and TEXT_ENTRY_EFFECTIVE_WPM are the character and
+ * overall speeds of text entered from the serial port, the overall
+ * speed 0 for standard spacing, and TEXT_ENTRY_WEIGHT its weight in
+ * percent.
  */
 #define SERIAL_BAUD_RATE   9600
+#define CACHED_CHANNELS       4
+#define TEXT_ENTRY_WPM                20
+#define TEXT_ENTRY_EFFECTIVE_WPM       0
+#define TEXT_ENTRY_WEIGHT             50
 
 
 #endif // _DFR_CONSTANTS_
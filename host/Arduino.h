@@ -0,0 +1,172 @@
+#ifndef _HOST_ARDUINO_H_
+#define _HOST_ARDUINO_H_
+
+/**
+ * @file    Arduino.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file stands in for the Arduino core header when the DFR
+ * libraries and sketch are built on a host computer. It declares the
+ * subset of the Arduino API used by DFR; the functions are implemented
+ * by the host simulator, which runs them against a virtual clock and
+ * simulated pins. See HostSimulator.h.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+/**
+ * defined by this header, so code can tell it is running
+ * in the host simulator
+ */
+#define ARDUINO_HOST_SIM  1
+
+/**
+ * pin levels and modes
+ */
+#define HIGH          1
+#define LOW           0
+#define INPUT         0
+#define OUTPUT        1
+#define INPUT_PULLUP  2
+
+/**
+ * interrupt modes
+ */
+#define CHANGE        1
+#define FALLING       2
+#define RISING        3
+
+/**
+ * every simulated pin has its own interrupt, numbered as the pin
+ */
+#define NOT_AN_INTERRUPT           -1
+#define digitalPinToInterrupt(p)   (p)
+
+/**
+ * program memory is ordinary memory on the host
+ */
+#define PROGMEM
+#define pgm_read_byte(addr)   (*(const uint8_t *)(addr))
+#define pgm_read_word(addr)   (*(const uint16_t *)(addr))
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+/**
+ * time functions; each call moves the virtual clock
+ * on by the simulated cost of the call
+ */
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/**
+ * digital pin functions
+ */
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t val);
+int  digitalRead(uint8_t pin);
+
+/**
+ * interrupt functions
+ */
+void attachInterrupt(uint8_t irq, void (*isr)(), int mode);
+void detachInterrupt(uint8_t irq);
+void noInterrupts();
+void interrupts();
+
+/**
+ * number conversions from the AVR C library
+ */
+char *ltoa(long val, char *buf, int radix);
+char *ultoa(unsigned long val, char *buf, int radix);
+char *itoa(int val, char *buf, int radix);
+
+/**
+ * Serial port for the host simulator.
+ *
+ * Output goes to standard output. Input is whatever has been queued
+ * with HostSimulator::queueSerialInput().
+ */
+class HostSerial {
+public:
+  /**
+   * opens the port; the baud rate is ignored
+   */
+   void begin(long baud) {
+      (void)baud;
+   }
+
+  /**
+   * returns number of input characters waiting
+   */
+   int available();
+
+  /**
+   * reads one input character
+   *
+   * @return the character, or -1 if none is waiting
+   */
+   int read();
+
+  /**
+   * returns next input character without taking it
+   *
+   * @return the character, or -1 if none is waiting
+   */
+   int peek();
+
+   size_t write(uint8_t c);
+   size_t print(const char *s);
+   size_t print(char c);
+   size_t print(int val, int radix = 10);
+   size_t print(unsigned int val, int radix = 10);
+   size_t print(long val, int radix = 10);
+   size_t print(unsigned long val, int radix = 10);
+   size_t print(double val, int digits = 2);
+   size_t println();
+
+   template <typename T>
+   size_t println(T val) {
+      size_t n = print(val);
+      return n + println();
+   }
+
+   template <typename T>
+   size_t println(T val, int fmt) {
+      size_t n = print(val, fmt);
+      return n + println();
+   }
+};
+
+extern HostSerial Serial;
+
+#endif // _HOST_ARDUINO_H_
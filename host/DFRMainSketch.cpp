@@ -0,0 +1,35 @@
+/**
+ * @file    DFRMainSketch.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file builds the DFRMain sketch for the host simulator. The
+ * Arduino IDE compiles a sketch as C++ after adding its own includes;
+ * here the sketch is simply included.
+ */
+
+#include <Arduino.h>
+
+#include "DFRMain.ino"
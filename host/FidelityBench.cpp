@@ -0,0 +1,1080 @@
+/**
+ * @file    FidelityBench.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains main() for the record to playback fidelity
+ * benchmark. Each run drives a key waveform into a DigitalInputPin on
+ * the simulated board, records it with PulseTrainRecorder through the
+ * SD latency model, plays it back, and compares the keying output
+ * with the waveform that went in.
+ *
+ * Waveforms are Morse text keyed by a model fist, with timing jitter
+ * and contact bounce, or pulses read from a recorded channel file.
+ * Each waveform is run through every combination of input debounce
+ * and playback method, and the report gives for each:
+ *
+ *    pulses in and out, missed, merged and spurious pulses;
+ *    edge timing error p50, p99 and max, and an error histogram;
+ *    input latency p50 and p99;
+ *    recorder setup time, from initialize() through openForRecording(),
+ *    after which keying starts;
+ *    main loop time p99 and max, and loops over the 1 ms budget,
+ *    while recording and while playing back;
+ *    for timed playback, pulse queue underruns, the fewest pulses
+ *    left queued, and the latest transition.
+ *
+ * A late edge check follows, keying a bouncing pulse into edge
+ * capture so an edge lands after the pin reads the clock and before
+ * it takes edges from the ring; the exit status is 1 if it fails.
+ *
+ * usage: dfr_bench [-i channel_file] [-d sd_dir] [-x seed]
+ *                  [-w write_us] [-f flush_us] [-r read_us]
+ *                  [-s stall_us] [-n stall_interval] [-q queue_depth]
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <HostSimulator.h>
+
+#include <DigitalPulse.h>
+#include <DigitalPin.h>
+#include <EdgeCapture.h>
+#include <PortDebouncer.h>
+#include <PulseCodec.h>
+#include <PulseTrainRecorder.h>
+#include <PlaybackEngine.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+/**
+ * benchmark constants
+ * <p>
+ * BENCH_KEY_PIN, BENCH_KEYING_PIN and BENCH_TONE_PIN are the pins
+ * used, as in the sketch. The keying output is not inverted here, so
+ * a HIGH level is key down.
+ * <p>
+ * BENCH_LOOP_MICROS is the main loop period, and the budget each
+ * loop pass is measured against.
+ * <p>
+ * BENCH_LEAD_MILS is the quiet time before the first key down and
+ * BENCH_TAIL_MILS the time recording runs on after the last key up,
+ * long enough for the idle flush.
+ * <p>
+ * BENCH_SERVICE_MILS, BENCH_SAMPLE_MILS and BENCH_TIMED_SERVICE_MILS
+ * are the recorder flush, port debouncer and timed playback service
+ * intervals, as in the sketch.
+ * <p>
+ * BENCH_LATE_OFFSETS is the number of one microsecond steps into a
+ * loop pass that the key down of the late edge check is moved
+ * through, so one of them lands between the pin's clock read and
+ * its taking edges from the ring. BENCH_LATE_MARK_MICROS is the key
+ * down time of that check, and BENCH_LATE_BOUNCE_MICROS the spacing
+ * of its bounce edges.
+ */
+#define BENCH_KEY_PIN              0
+#define BENCH_KEYING_PIN           7
+#define BENCH_TONE_PIN             3
+#define BENCH_SD_RESERVED_PIN     10
+#define BENCH_SD_CS_PIN            4
+
+#define BENCH_LOOP_MICROS       1000UL
+#define BENCH_LEAD_MILS          500UL
+#define BENCH_TAIL_MILS         3000UL
+#define BENCH_DEBOUNCE_MILS       10
+#define BENCH_DEBOUNCE_FLOOR       2
+#define BENCH_SERVICE_MILS       100UL
+#define BENCH_SAMPLE_MILS          3
+#define BENCH_TIMED_SERVICE_MILS  10UL
+#define BENCH_LATE_OFFSETS        16
+#define BENCH_LATE_MARK_MICROS 60000UL
+#define BENCH_LATE_BOUNCE_MICROS 300UL
+
+#define BENCH_CHANNEL_FILE     "bench.txt"
+
+/**
+ * ways of debouncing the key input
+ */
+enum BenchInput {
+    BENCH_INPUT_POLLED
+   ,BENCH_INPUT_ADAPTIVE
+   ,BENCH_INPUT_PORT
+   ,BENCH_INPUT_EDGE
+   ,BENCH_INPUT_COUNT
+};
+
+static const char *BenchInputNames[BENCH_INPUT_COUNT] = {
+   "polled", "adaptive", "port", "edge"
+};
+
+/**
+ * ways of playing back
+ */
+enum BenchPlayback {
+    BENCH_PLAYBACK_POLLED
+   ,BENCH_PLAYBACK_TIMED
+   ,BENCH_PLAYBACK_COUNT
+};
+
+static const char *BenchPlaybackNames[BENCH_PLAYBACK_COUNT] = {
+   "polled", "timed"
+};
+
+/**
+ * one key down interval, microseconds
+ */
+struct BenchPulse {
+   unsigned long startMicros;
+   unsigned long endMicros;
+};
+
+/**
+ * description of a keying hand
+ */
+struct BenchFist {
+   const char *name;
+   const char *text;
+   unsigned int wpm;
+
+  /**
+   * standard deviation of each element and space, fraction of its length
+   */
+   double jitter;
+
+  /**
+   * dah length in dits, 3.0 for perfect code
+   */
+   double dahRatio;
+
+  /**
+   * longest contact bounce burst at each edge, microseconds
+   */
+   unsigned long bounceMicros;
+};
+
+/**
+ * small repeatable random number generator
+ */
+class BenchRandom {
+protected:
+   uint32_t state;
+
+public:
+   BenchRandom(uint32_t seed)
+   : state(seed ? seed : 1)
+   {}
+
+  /**
+   * returns a uniform value in [0,1)
+   */
+   double uniform() {
+      // xorshift32
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      return (state >> 8) / 16777216.0;
+   }
+
+  /**
+   * returns an approximately normal value, mean 0, deviation 1
+   */
+   double normal() {
+      double sum = 0;
+      for (int ii=0; ii<12; ++ii) {
+         sum += uniform();
+      }
+      return sum - 6.0;
+   }
+};
+
+/**
+ * Morse code for letters and digits, dots and dashes
+ */
+static const char *morseFor(char c) {
+   static const char *letters[26] = {
+      ".-",   "-...", "-.-.", "-..",  ".",    "..-.", "--.",  "....",
+      "..",   ".---", "-.-",  ".-..", "--",   "-.",   "---",  ".--.",
+      "--.-", ".-.",  "...",  "-",    "..-",  "...-", ".--",  "-..-",
+      "-.--", "--.."
+   };
+   static const char *digits[10] = {
+      "-----", ".----", "..---", "...--", "....-",
+      ".....", "-....", "--...", "---..", "----."
+   };
+   const char *rtn = 0;
+
+   if ((c >= 'A') && (c <= 'Z')) {
+      rtn = letters[c - 'A'];
+   }
+   else if ((c >= 'a') && (c <= 'z')) {
+      rtn = letters[c - 'a'];
+   }
+   else if ((c >= '0') && (c <= '9')) {
+      rtn = digits[c - '0'];
+   }
+
+   return rtn;
+}
+
+/**
+ * returns a length scaled by a random jitter, never below a quarter
+ */
+static double jittered(double len, double jitter, BenchRandom &rnd) {
+   double rtn = len * (1.0 + jitter * rnd.normal());
+   return (rtn < len / 4) ? len / 4 : rtn;
+}
+
+/**
+ * keys Morse text with the given fist
+ */
+static std::vector<BenchPulse> keyText(const BenchFist &fist, BenchRandom &rnd) {
+   std::vector<BenchPulse> rtn;
+   double dit = 1200000.0 / fist.wpm;
+   double t = BENCH_LEAD_MILS * 1000.0;
+
+   for (const char *p = fist.text; *p; ++p) {
+      const char *code = morseFor(*p);
+
+      if (!code) {
+         // word space, less the letter space already taken
+         t += jittered(4 * dit, fist.jitter, rnd);
+         continue;
+      }
+
+      for (const char *e = code; *e; ++e) {
+         BenchPulse pulse;
+         double len = ('-' == *e) ? fist.dahRatio * dit : dit;
+
+         pulse.startMicros = (unsigned long)t;
+         t += jittered(len, fist.jitter, rnd);
+         pulse.endMicros = (unsigned long)t;
+         rtn.push_back(pulse);
+
+         // element space
+         t += jittered(dit, fist.jitter, rnd);
+      }
+
+      // letter space, less the element space already taken
+      t += jittered(2 * dit, fist.jitter, rnd);
+   }
+
+   return rtn;
+}
+
+/**
+ * decodes binary pulse records, adding the pulses to a list
+ */
+static void decodeRecords(PulseDecoder &decoder
+                         ,const uint8_t *records
+                         ,size_t len
+                         ,unsigned long lead
+                         ,std::vector<BenchPulse> &pulses) {
+   for (size_t ii=0; ii<len; ++ii) {
+      if (decoder.decodeByte(records[ii])) {
+         BenchPulse pulse;
+         pulse.startMicros = lead + decoder.getPulseStart() * 1000UL;
+         pulse.endMicros   = lead + decoder.getPulseEnd() * 1000UL;
+         pulses.push_back(pulse);
+      }
+   }
+}
+
+/**
+ * reads pulses from a recorded channel file, text or binary
+ */
+static bool readChannelFile(const char *path, std::vector<BenchPulse> &pulses) {
+   FILE *fp = fopen(path, "rb");
+   std::vector<uint8_t> data;
+   int c;
+
+   if (!fp) {
+      return false;
+   }
+
+   while (EOF != (c = fgetc(fp))) {
+      data.push_back((uint8_t)c);
+   }
+   fclose(fp);
+
+   unsigned long lead = BENCH_LEAD_MILS * 1000UL;
+   PulseFileFormat format = PulseCodec::detectFormat(data.empty() ? 0 : &data[0]
+                                                    ,data.size());
+
+   if (PULSE_FORMAT_BINARY == format) {
+      PulseDecoder decoder;
+      size_t start = PulseCodec::getHeaderSize(&data[0], data.size());
+
+      decoder.setVersion(data[3]);
+
+      if (PulseCodec::isBlocked(&data[0], data.size())) {
+         // decode each block from its own start, up to the first void one
+         PulseBlockHeader hdr;
+
+         for (size_t pos=start; pos<data.size(); pos+=PULSE_BLOCK_SIZE) {
+            const uint8_t *block = &data[pos];
+
+            if (   !PulseCodec::readBlockHeader(block, data.size() - pos, hdr)
+                || (data.size() - pos < PULSE_BLOCK_HEADER_SIZE + hdr.length)) {
+               break;
+            }
+
+            decoder.startBlock(hdr.unit);
+            decodeRecords(decoder
+                         ,block + PULSE_BLOCK_HEADER_SIZE
+                         ,hdr.length
+                         ,lead
+                         ,pulses);
+         }
+      }
+      else {
+         decodeRecords(decoder, &data[start], data.size() - start, lead, pulses);
+      }
+   }
+   else if (PULSE_FORMAT_TEXT == format) {
+      std::string text(data.begin(), data.end());
+      size_t pos = 0;
+      long first = -1;
+
+      while (pos < text.size()) {
+         size_t eol = text.find('\n', pos);
+         std::string line = text.substr(pos, eol - pos);
+         long start, end;
+
+         if (2 == sscanf(line.c_str(), "%ld|%ld", &start, &end)) {
+            if (first < 0) {
+               first = start;
+            }
+            BenchPulse pulse;
+            pulse.startMicros = lead + (start - first) * 1000UL;
+            pulse.endMicros   = lead + (end - first) * 1000UL;
+            pulses.push_back(pulse);
+         }
+
+         pos = (std::string::npos == eol) ? text.size() : eol + 1;
+      }
+   }
+
+   return !pulses.empty();
+}
+
+/**
+ * schedules the key waveform on the input pin, its times counted
+ * from start_us; the key pulls the pin LOW, and each edge may be
+ * followed by a burst of contact bounce
+ */
+static void scheduleKeying(const std::vector<BenchPulse> &pulses
+                          ,unsigned long start_us
+                          ,unsigned long bounce_us
+                          ,BenchRandom &rnd) {
+   HostSimulator::setInput(BENCH_KEY_PIN, HIGH);
+
+   for (size_t ii=0; ii<pulses.size(); ++ii) {
+      for (int edge=0; edge<2; ++edge) {
+         unsigned long t = start_us + (edge ? pulses[ii].endMicros : pulses[ii].startMicros);
+         uint8_t level = edge ? HIGH : LOW;
+
+         HostSimulator::scheduleInput(BENCH_KEY_PIN, t, level);
+
+         if (bounce_us > 0) {
+            // bounce burst settles at the new level
+            int bounces = (int)(rnd.uniform() * 4);
+            unsigned long bt = t;
+
+            for (int b=0; b<bounces; ++b) {
+               bt += 1 + (unsigned long)(rnd.uniform() * bounce_us / (2 * bounces));
+               HostSimulator::scheduleInput(BENCH_KEY_PIN, bt, !level);
+               bt += 1 + (unsigned long)(rnd.uniform() * bounce_us / (2 * bounces));
+               HostSimulator::scheduleInput(BENCH_KEY_PIN, bt, level);
+            }
+         }
+      }
+   }
+}
+
+/**
+ * main loop time statistics
+ */
+class BenchLoopStats {
+protected:
+   std::vector<unsigned long> times;
+
+public:
+   void add(unsigned long us) {
+      times.push_back(us);
+   }
+
+   unsigned long percentile(double p) {
+      if (times.empty()) {
+         return 0;
+      }
+      std::sort(times.begin(), times.end());
+      size_t idx = (size_t)(p * (times.size() - 1) + 0.5);
+      return times[idx];
+   }
+
+   unsigned long overruns() const {
+      unsigned long rtn = 0;
+      for (size_t ii=0; ii<times.size(); ++ii) {
+         if (times[ii] > BENCH_LOOP_MICROS) {
+            ++rtn;
+         }
+      }
+      return rtn;
+   }
+};
+
+/**
+ * result of comparing the output with the input
+ */
+struct BenchResult {
+   size_t pulsesIn;
+   size_t pulsesOut;
+   size_t missed;
+   size_t merged;
+   size_t spurious;
+   std::vector<long> edgeErrors;
+   BenchLoopStats inputLatency;
+   unsigned long setupMicros;
+   BenchLoopStats recordLoop;
+   BenchLoopStats playbackLoop;
+   uint16_t underruns;
+   uint8_t lowWaterMark;
+   unsigned long maxLateMicros;
+   bool ok;
+};
+
+/**
+ * playback clock driven by the simulator's one shot timer, so
+ * transitions are made at their exact due times as with Timer1
+ */
+class BenchTimerClock : public PlaybackClock {
+protected:
+   static BenchTimerClock *activeClock;
+
+   static void handleInterrupt() {
+      if (activeClock && activeClock->engine) {
+         activeClock->engine->onTimer();
+      }
+   }
+
+public:
+   BenchTimerClock() {
+      activeClock = this;
+   }
+
+   ~BenchTimerClock() {
+      HostSimulator::cancelTimer();
+      activeClock = 0;
+   }
+
+   virtual unsigned long nowMicros() {
+      return HostSimulator::now();
+   }
+
+   virtual void scheduleAt(unsigned long due_us) {
+      HostSimulator::setTimer(due_us, handleInterrupt);
+   }
+
+   virtual void cancel() {
+      HostSimulator::cancelTimer();
+   }
+};
+
+BenchTimerClock *BenchTimerClock::activeClock = 0;
+
+/**
+ * card directory and latencies, applied after each simulator reset
+ */
+static std::string   BenchSdRoot = "bench_sd";
+static HostSdLatency BenchLatency;
+
+/**
+ * pulses read ahead by timed playback
+ */
+static uint8_t BenchQueueDepth = PLAYBACK_PULSE_QUEUE_SIZE - 1;
+
+/**
+ * waits for the next loop period, noting how long the pass took
+ */
+static void endLoopPass(unsigned long pass_start, BenchLoopStats &stats) {
+   unsigned long used = HostSimulator::now() - pass_start;
+
+   stats.add(used);
+   if (used < BENCH_LOOP_MICROS) {
+      HostSimulator::advanceTo(pass_start + BENCH_LOOP_MICROS);
+   }
+}
+
+/**
+ * gets the time of a key edge, key down and key up alternately
+ */
+static unsigned long edgeMicros(const std::vector<BenchPulse> &pulses, size_t edge) {
+   return (edge & 1) ? pulses[edge / 2].endMicros : pulses[edge / 2].startMicros;
+}
+
+/**
+ * records the waveform, plays it back and returns the output pulses
+ */
+static std::vector<BenchPulse> recordAndPlay(const std::vector<BenchPulse> &pulses
+                                            ,unsigned long bounce_us
+                                            ,BenchInput input
+                                            ,BenchPlayback playback
+                                            ,BenchRandom &rnd
+                                            ,BenchResult &result) {
+   std::vector<BenchPulse> rtn;
+
+   HostSimulator::reset();
+   HostSimulator::setSdRoot(BenchSdRoot.c_str());
+   HostSimulator::setSdLatency(BenchLatency);
+
+   DigitalInputPin keyingInput( BENCH_KEY_PIN
+                              , INPUT_PULLUP
+                              , BENCH_DEBOUNCE_MILS
+                              , DIGITAL_PIN_INIT_STATE_HIGH
+                              , DIGITAL_PIN_INVERTING);
+   DigitalOutputPin keyingOutput(BENCH_KEYING_PIN, DIGITAL_PIN_INIT_STATE_LOW);
+   DigitalOutputPin sideTone(BENCH_TONE_PIN, DIGITAL_PIN_INIT_STATE_LOW);
+   EdgeCapture keyEdges;
+   PortDebouncer debouncer(BENCH_SAMPLE_MILS);
+   PulseTrainRecorder *recorder = new PulseTrainRecorder;
+   char channel[] = BENCH_CHANNEL_FILE;
+
+   keyingInput.initialize();
+   keyingOutput.initialize();
+   sideTone.initialize();
+   HostSimulator::setInput(BENCH_KEY_PIN, HIGH);
+
+   switch (input) {
+      case BENCH_INPUT_ADAPTIVE:
+         keyingInput.enableAdaptiveDebounce(BENCH_DEBOUNCE_FLOOR, BENCH_DEBOUNCE_MILS);
+         break;
+
+      case BENCH_INPUT_PORT:
+         debouncer.begin();
+         debouncer.setKeyPin(BENCH_KEY_PIN);
+         keyingInput.attachDebouncer(&debouncer);
+         break;
+
+      case BENCH_INPUT_EDGE:
+         if (keyEdges.begin(BENCH_KEY_PIN)) {
+            keyingInput.attachEdgeCapture(&keyEdges);
+         }
+         break;
+
+      default:
+         break;
+   }
+
+   // record; keying starts once the recorder is open, so setup
+   // time is reported apart from the pulses it would otherwise eat
+   unsigned long setup_start = HostSimulator::now();
+
+   result.ok =    recorder->initialize(BENCH_SD_RESERVED_PIN, BENCH_SD_CS_PIN)
+               && recorder->openForRecording(channel);
+
+   unsigned long key_start = HostSimulator::now();
+   result.setupMicros = key_start - setup_start;
+   scheduleKeying(pulses, key_start, bounce_us, rnd);
+
+   unsigned long record_end = key_start + pulses.back().endMicros + BENCH_TAIL_MILS * 1000UL;
+   unsigned long last_service = 0;
+   unsigned long last_sample = 0;
+   size_t edge_count = 2 * pulses.size();
+   size_t next_edge = 0;
+
+   while (result.ok && (HostSimulator::now() < record_end)) {
+      unsigned long pass_start = HostSimulator::now();
+
+      if (   (BENCH_INPUT_PORT == input)
+          && (pass_start - last_sample >= BENCH_SAMPLE_MILS * 1000UL)) {
+         debouncer.sample();
+         last_sample = pass_start;
+      }
+
+      keyingInput.determinePinState();
+
+      if (keyingInput.hasChanged()) {
+         // time from the key edge to the change being taken
+         while (   (next_edge + 1 < edge_count)
+                && (key_start + edgeMicros(pulses, next_edge + 1) <= pass_start)) {
+            ++next_edge;
+         }
+
+         if (   (next_edge < edge_count)
+             && (key_start + edgeMicros(pulses, next_edge) <= pass_start)) {
+            result.inputLatency.add(pass_start - key_start - edgeMicros(pulses, next_edge));
+            ++next_edge;
+         }
+      }
+
+      if (keyingInput.hasChanged() && (LOW == keyingInput.getLogicalState())) {
+         result.ok = recorder->recordPulse(keyingInput.getLastPulse());
+      }
+      else if (pass_start - last_service >= BENCH_SERVICE_MILS * 1000UL) {
+         result.ok = recorder->serviceRecording();
+         last_service = pass_start;
+      }
+
+      endLoopPass(pass_start, result.recordLoop);
+   }
+
+   recorder->close();
+   keyEdges.end();
+
+   // play back
+   HostSimulator::clearOutputTrace();
+
+   if (result.ok) {
+      result.ok = recorder->openForPlayback(channel);
+   }
+
+   if (result.ok && (BENCH_PLAYBACK_TIMED == playback)) {
+      BenchTimerClock clock;
+      PlaybackEngine engine(clock, keyingOutput, sideTone);
+
+      engine.setQueueDepth(BenchQueueDepth);
+      engine.start(*recorder);
+      last_service = HostSimulator::now();
+
+      while (engine.isActive()) {
+         unsigned long pass_start = HostSimulator::now();
+
+         if (pass_start - last_service >= BENCH_TIMED_SERVICE_MILS * 1000UL) {
+            engine.service(*recorder);
+            last_service = pass_start;
+         }
+
+         endLoopPass(pass_start, result.playbackLoop);
+      }
+
+      result.underruns = engine.getUnderrunCount();
+      result.lowWaterMark = engine.getLowWaterMark();
+      result.maxLateMicros = engine.getMaxLateMicros();
+   }
+   else if (result.ok) {
+      while (recorder->playbackActive()) {
+         unsigned long pass_start = HostSimulator::now();
+
+         recorder->playBackKeying(keyingOutput, sideTone);
+
+         endLoopPass(pass_start, result.playbackLoop);
+      }
+   }
+
+   recorder->close();
+   delete recorder;
+
+   // collect output pulses
+   const std::vector<HostPinEvent> &trace = HostSimulator::getOutputTrace();
+   BenchPulse pulse;
+   bool down = false;
+
+   for (size_t ii=0; ii<trace.size(); ++ii) {
+      if (BENCH_KEYING_PIN == trace[ii].pin) {
+         if (HIGH == trace[ii].level) {
+            pulse.startMicros = trace[ii].timeMicros;
+            down = true;
+         }
+         else if (down) {
+            pulse.endMicros = trace[ii].timeMicros;
+            rtn.push_back(pulse);
+            down = false;
+         }
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * compares output pulses with input pulses; the output is aligned on
+ * its first key down, as the recording starts at the first pulse
+ */
+static void comparePulses(const std::vector<BenchPulse> &in
+                         ,const std::vector<BenchPulse> &out
+                         ,BenchResult &result) {
+   result.pulsesIn = in.size();
+   result.pulsesOut = out.size();
+   result.missed = result.merged = result.spurious = 0;
+
+   if (in.empty() || out.empty()) {
+      result.missed = in.size();
+      result.spurious = out.size();
+      return;
+   }
+
+   long offset = (long)(out[0].startMicros - in[0].startMicros);
+
+   // count overlaps each way
+   std::vector<int> in_hits(in.size(), 0);
+   std::vector<int> out_hits(out.size(), 0);
+   std::vector<size_t> match(in.size(), 0);
+   size_t first_out = 0;
+
+   for (size_t ii=0; ii<in.size(); ++ii) {
+      long in_start = (long)in[ii].startMicros + offset;
+      long in_end   = (long)in[ii].endMicros + offset;
+
+      while (   (first_out < out.size())
+             && ((long)out[first_out].endMicros <= in_start)) {
+         ++first_out;
+      }
+
+      for (size_t jj=first_out;
+           (jj < out.size()) && ((long)out[jj].startMicros < in_end);
+           ++jj) {
+         ++in_hits[ii];
+         ++out_hits[jj];
+         match[ii] = jj;
+      }
+   }
+
+   for (size_t ii=0; ii<in.size(); ++ii) {
+      if (0 == in_hits[ii]) {
+         ++result.missed;
+      }
+      else if ((1 == in_hits[ii]) && (1 == out_hits[match[ii]])) {
+         const BenchPulse &op = out[match[ii]];
+         result.edgeErrors.push_back((long)op.startMicros - offset - (long)in[ii].startMicros);
+         result.edgeErrors.push_back((long)op.endMicros - offset - (long)in[ii].endMicros);
+      }
+   }
+
+   for (size_t jj=0; jj<out.size(); ++jj) {
+      if (0 == out_hits[jj]) {
+         ++result.spurious;
+      }
+      else if (out_hits[jj] > 1) {
+         result.merged += out_hits[jj] - 1;
+      }
+   }
+}
+
+/**
+ * prints one line of the report
+ */
+static void report(const char *waveform
+                  ,BenchInput input
+                  ,BenchPlayback playback
+                  ,BenchResult &result) {
+   // error histogram bucket limits, microseconds
+   static const long limits[] = { 250, 500, 1000, 2000, 5000, 10000 };
+   const int buckets = sizeof(limits) / sizeof(limits[0]) + 1;
+   int hist[buckets] = {0};
+   std::vector<long> abs_err;
+
+   for (size_t ii=0; ii<result.edgeErrors.size(); ++ii) {
+      long e = labs(result.edgeErrors[ii]);
+      int b = 0;
+
+      while ((b < buckets - 1) && (e > limits[b])) {
+         ++b;
+      }
+      ++hist[b];
+      abs_err.push_back(e);
+   }
+
+   std::sort(abs_err.begin(), abs_err.end());
+
+   long p50 = abs_err.empty() ? 0 : abs_err[(abs_err.size() - 1) / 2];
+   long p99 = abs_err.empty() ? 0 : abs_err[(size_t)(0.99 * (abs_err.size() - 1) + 0.5)];
+   long max = abs_err.empty() ? 0 : abs_err.back();
+
+   printf("%-12s %-8s %-6s %4s %4lu %4lu %4lu %4lu %4lu %7ld %7ld %7ld  "
+         ,waveform
+         ,BenchInputNames[input]
+         ,BenchPlaybackNames[playback]
+         ,result.ok ? "ok" : "FAIL"
+         ,(unsigned long)result.pulsesIn
+         ,(unsigned long)result.pulsesOut
+         ,(unsigned long)result.missed
+         ,(unsigned long)result.merged
+         ,(unsigned long)result.spurious
+         ,p50, p99, max);
+
+   for (int b=0; b<buckets; ++b) {
+      printf("%s%d", b ? "/" : "", hist[b]);
+   }
+
+   printf("  %6lu %6lu"
+         ,result.inputLatency.percentile(0.5)
+         ,result.inputLatency.percentile(0.99));
+
+   printf("  %6lu  %6lu %6lu %5lu  %6lu %6lu %5lu"
+         ,result.setupMicros
+         ,result.recordLoop.percentile(0.99)
+         ,result.recordLoop.percentile(1.0)
+         ,result.recordLoop.overruns()
+         ,result.playbackLoop.percentile(0.99)
+         ,result.playbackLoop.percentile(1.0)
+         ,result.playbackLoop.overruns());
+
+   if (BENCH_PLAYBACK_TIMED == playback) {
+      printf("  %4u %4u %6lu\n"
+            ,result.underruns
+            ,result.lowWaterMark
+            ,result.maxLateMicros);
+   }
+   else {
+      printf("  %4s %4s %6s\n", "-", "-", "-");
+   }
+}
+
+/**
+ * keys one bouncing pulse into edge capture, its first edge a given
+ * time into a loop pass, with clock reads returning the time they
+ * start; edges captured while the pin reads the clock are then newer
+ * than the time it read
+ *
+ * @param  offset_us  time of key down into the loop pass
+ *
+ * @return largest pulse time error, milliseconds, or -1 if the
+ *         pulse was not taken as one pulse
+ */
+static long checkLateEdge(unsigned long offset_us) {
+   HostSimulator::reset();
+   HostSimulator::setClockReadEarly(true);
+
+   DigitalInputPin keyingInput( BENCH_KEY_PIN
+                              , INPUT_PULLUP
+                              , BENCH_DEBOUNCE_MILS
+                              , DIGITAL_PIN_INIT_STATE_HIGH
+                              , DIGITAL_PIN_INVERTING);
+   EdgeCapture keyEdges;
+   BenchLoopStats stats;
+
+   keyingInput.initialize();
+   HostSimulator::setInput(BENCH_KEY_PIN, HIGH);
+
+   if (keyEdges.begin(BENCH_KEY_PIN)) {
+      keyingInput.attachEdgeCapture(&keyEdges);
+   }
+
+   unsigned long pass_start = BENCH_LEAD_MILS * 1000UL;
+   unsigned long key_down = pass_start + BENCH_LOOP_MICROS + offset_us;
+   unsigned long key_up = key_down + BENCH_LATE_MARK_MICROS;
+
+   HostSimulator::scheduleInput(BENCH_KEY_PIN, key_down, LOW);
+   HostSimulator::scheduleInput(BENCH_KEY_PIN, key_down + BENCH_LATE_BOUNCE_MICROS, HIGH);
+   HostSimulator::scheduleInput(BENCH_KEY_PIN, key_down + 2 * BENCH_LATE_BOUNCE_MICROS, LOW);
+   HostSimulator::scheduleInput(BENCH_KEY_PIN, key_up, HIGH);
+   HostSimulator::advanceTo(pass_start);
+
+   long rtn = -1;
+   int pulses = 0;
+
+   while (pass_start < key_up + BENCH_TAIL_MILS * 1000UL) {
+      keyingInput.determinePinState();
+
+      if (keyingInput.hasChanged() && (LOW == keyingInput.getLogicalState())) {
+         DigitalPulse pulse = keyingInput.getLastPulse();
+         long start_err = labs(pulse.startTime - (long)(key_down / 1000UL));
+         long end_err = labs(pulse.endTime - (long)(key_up / 1000UL));
+
+         rtn = (start_err > end_err) ? start_err : end_err;
+         ++pulses;
+      }
+
+      endLoopPass(pass_start, stats);
+      pass_start = HostSimulator::now();
+   }
+
+   keyEdges.end();
+
+   return (1 == pulses) ? rtn : -1;
+}
+
+/**
+ * runs the late edge check at every offset and prints its result
+ *
+ * @return true if every pulse was taken with its own times
+ */
+static bool runLateEdgeCheck() {
+   long worst = 0;
+
+   for (unsigned long offset=0; (worst >= 0) && (offset < BENCH_LATE_OFFSETS); ++offset) {
+      long err = checkLateEdge(offset);
+
+      if ((err < 0) || (err > worst)) {
+         worst = err;
+      }
+   }
+
+   // a pulse is stamped in whole milliseconds
+   bool rtn = (worst >= 0) && (worst <= 1);
+
+   printf("\nlate edge check: key down 0-%d us into a loop pass,"
+          " worst pulse time error %ld ms  %s\n"
+         ,BENCH_LATE_OFFSETS - 1
+         ,worst
+         ,rtn ? "ok" : "FAIL");
+
+   return rtn;
+}
+
+/**
+ * runs one waveform through every input and playback combination
+ */
+static void runWaveform(const char *name
+                       ,const std::vector<BenchPulse> &pulses
+                       ,unsigned long bounce_us
+                       ,uint32_t seed) {
+   for (int in=0; in<BENCH_INPUT_COUNT; ++in) {
+      for (int pb=0; pb<BENCH_PLAYBACK_COUNT; ++pb) {
+         BenchRandom rnd(seed);
+         BenchResult result;
+
+         result.setupMicros = 0;
+         result.underruns = 0;
+         result.lowWaterMark = 0;
+         result.maxLateMicros = 0;
+
+         std::vector<BenchPulse> out = recordAndPlay(pulses
+                                                    ,bounce_us
+                                                    ,(BenchInput)in
+                                                    ,(BenchPlayback)pb
+                                                    ,rnd
+                                                    ,result);
+         comparePulses(pulses, out, result);
+         report(name, (BenchInput)in, (BenchPlayback)pb, result);
+      }
+   }
+}
+
+int main(int argc, char **argv) {
+   const char   *channel_file = 0;
+   uint32_t      seed = 2014;
+   int           opt;
+
+   // a slow card by default
+   BenchLatency.openMicros  = 5000;
+   BenchLatency.readMicros  = 200;
+   BenchLatency.writeMicros = 3000;
+   BenchLatency.flushMicros = 3000;
+   BenchLatency.seekMicros  = 200;
+   BenchLatency.readStallMicros = 0;
+   BenchLatency.readStallInterval = 0;
+
+   while (-1 != (opt = getopt(argc, argv, "i:d:x:w:f:r:s:n:q:"))) {
+      switch (opt) {
+         case 'i':
+            channel_file = optarg;
+            break;
+
+         case 'd':
+            BenchSdRoot = optarg;
+            break;
+
+         case 'x':
+            seed = strtoul(optarg, 0, 10);
+            break;
+
+         case 'w':
+            BenchLatency.writeMicros = strtoul(optarg, 0, 10);
+            break;
+
+         case 'f':
+            BenchLatency.flushMicros = strtoul(optarg, 0, 10);
+            break;
+
+         case 'r':
+            BenchLatency.readMicros = strtoul(optarg, 0, 10);
+            break;
+
+         case 's':
+            BenchLatency.readStallMicros = strtoul(optarg, 0, 10);
+            break;
+
+         case 'n':
+            BenchLatency.readStallInterval = strtoul(optarg, 0, 10);
+            break;
+
+         case 'q':
+            BenchQueueDepth = strtoul(optarg, 0, 10);
+            break;
+
+         default:
+            fprintf(stderr
+                   ,"usage: %s [-i channel_file] [-d sd_dir] [-x seed]\n"
+                    "       [-w write_us] [-f flush_us] [-r read_us]\n"
+                    "       [-s stall_us] [-n stall_interval] [-q queue_depth]\n"
+                   ,argv[0]);
+            return 2;
+      }
+   }
+
+   printf("SD latency us: open %lu read %lu write %lu flush %lu seek %lu\n"
+         ,BenchLatency.openMicros, BenchLatency.readMicros
+         ,BenchLatency.writeMicros, BenchLatency.flushMicros
+         ,BenchLatency.seekMicros);
+   printf("read stall us: %lu every %u reads; playback queue depth %u pulses\n"
+         ,BenchLatency.readStallMicros, BenchLatency.readStallInterval
+         ,BenchQueueDepth);
+   printf("edge error us; histogram |err| <=250/500/1000/2000/5000/10000/more;"
+          " input latency us p50/p99;\nrecorder setup us; loop us p99/max/over budget;"
+          " "
+          "queue underruns, low water mark, latest transition us\n\n");
+   printf("%-12s %-8s %-6s %4s %4s %4s %4s %4s %4s %7s %7s %7s  %-15s  %6s %6s  %6s  %6s %6s %5s  %6s %6s %5s  %4s %4s %6s\n"
+         ,"waveform", "input", "play", "run", "in", "out", "miss", "merg", "spur"
+         ,"p50", "p99", "max", "histogram", "lat50", "lat99"
+         ,"setup", "rec99", "recmax", "over", "ply99", "plymax", "over"
+         ,"undr", "lowq", "late");
+
+   if (channel_file) {
+      std::vector<BenchPulse> pulses;
+
+      if (!readChannelFile(channel_file, pulses)) {
+         fprintf(stderr, "%s: no pulses in %s\n", argv[0], channel_file);
+         return 1;
+      }
+
+      runWaveform("file", pulses, 0, seed);
+   }
+   else {
+      static const BenchFist fists[] = {
+          { "clean-20",  "PARIS PARIS CQ DE N2HTT K", 20, 0.00, 3.0,    0 }
+         ,{ "hand-20",   "PARIS PARIS CQ DE N2HTT K", 20, 0.08, 3.3, 3000 }
+         ,{ "bug-30",    "PARIS PARIS CQ DE N2HTT K", 30, 0.05, 3.6, 2000 }
+         ,{ "fast-40",   "PARIS PARIS CQ DE N2HTT K", 40, 0.03, 3.0, 1500 }
+         ,{ "qso-25",    "CQ CQ CQ DE N2HTT N2HTT K "
+                         "R TNX FER CALL UR RST 599 599 NAME MIKE MIKE "
+                         "QTH NJ NJ HW CPY BK "
+                         "FB OM RIG HR 5W ANT DIPOLE WX CLDY 15C "
+                         "TNX FER QSO 73 ES GL SK", 25, 0.05, 3.2, 2000 }
+      };
+
+      for (size_t ii=0; ii<sizeof(fists)/sizeof(fists[0]); ++ii) {
+         BenchRandom rnd(seed + ii);
+         std::vector<BenchPulse> pulses = keyText(fists[ii], rnd);
+
+         runWaveform(fists[ii].name, pulses, fists[ii].bounceMicros, seed + ii);
+      }
+   }
+
+   return runLateEdgeCheck() ? 0 : 1;
+}
@@ -0,0 +1,248 @@
+/**
+ * @file    FistReport.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ * This file contains main() for the fist report. It reads recorded
+ * channels from a card directory, as the sketch would play them,
+ * measures how each one was keyed with FistAnalyzer, and prints the
+ * measures, histograms of mark and space lengths, and any summary
+ * already kept in the channel file header.
+ *
+ * Channels are given by name, or by number as for the channel
+ * selector; with none given, every channel holding a recording is
+ * measured. With -u the summary is written into each channel file
+ * header, as the sketch does with FIST_ANALYTICS defined.
+ *
+ * usage: dfr_fist [-d sd_dir] [-u] [channel ...]
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <HostSimulator.h>
+
+#include <DigitalPulse.h>
+#include <DigitalPin.h>
+#include <ChannelSelector.h>
+#include <PulseCodec.h>
+#include <PulseTrainRecorder.h>
+#include <FistAnalyzer.h>
+
+#include <ctype.h>
+#include <string>
+#include <unistd.h>
+
+/**
+ * local constants
+ * <p>
+ * FIST_SD_RESERVED_PIN and FIST_SD_CS_PIN are the card pins, as in
+ * the sketch.
+ */
+#define FIST_SD_RESERVED_PIN  10
+#define FIST_SD_CS_PIN         4
+
+/**
+ * prints a fist summary as kept in a channel file header
+ */
+static void printSummary(const char *label, const PulseFistSummary &fist) {
+   printf("   %-8s dah/dit %.2f  weight %u%%  letter %.2f  word %.2f units"
+          "  jitter %u%%/%u%%  drift %+.2f wpm/min\n"
+         ,label
+         ,fist.dahRatio / 32.0
+         ,(unsigned)fist.weight
+         ,fist.letterRatio / 32.0
+         ,fist.wordRatio / 16.0
+         ,(unsigned)fist.markJitter
+         ,(unsigned)fist.spaceJitter
+         ,fist.drift / 100.0);
+}
+
+/**
+ * prints a histogram on one line, each bin a character
+ * from blank to '#' by its count against the fullest bin
+ */
+static void printHistogram(const char *label
+                          ,const uint8_t *bins
+                          ,unsigned int per_unit) {
+   static const char shades[] = " .:-=+*%#";
+   unsigned int most = 1;
+
+   for (unsigned int ii=0; ii<FIST_HISTOGRAM_BINS; ++ii) {
+      if (bins[ii] > most) {
+         most = bins[ii];
+      }
+   }
+
+   printf("   %-8s |", label);
+   for (unsigned int ii=0; ii<FIST_HISTOGRAM_BINS; ++ii) {
+      unsigned int level = (bins[ii] * (sizeof(shades) - 2) + most - 1) / most;
+
+      printf("%c", shades[level]);
+   }
+   printf("|  1/%u unit bins\n", per_unit);
+}
+
+/**
+ * measures one channel, printing its report
+ *
+ * @return true if the channel could be played, and its summary
+ *         written if asked
+ */
+static bool reportChannel(PulseTrainRecorder &recorder
+                         ,const char *name
+                         ,bool update) {
+   FistAnalyzer fist;
+   PulseFistSummary summary;
+   PulseChannelInfo info;
+   unsigned long pulses = 0;
+   char fn[CSTORE_NAME_MAX + 1];
+   uint8_t bins[FIST_HISTOGRAM_BINS];
+
+   strncpy(fn, name, CSTORE_NAME_MAX);
+   fn[CSTORE_NAME_MAX] = 0;
+
+   recorder.getChannelInfo(fn, info);
+
+   if (!recorder.openForPlayback(fn)) {
+      return false;
+   }
+
+   // opening playback reads the first pulse
+   do {
+      fist.addPulse(recorder.getPulseStartOffset()
+                   ,recorder.getPulseEndOffset());
+      ++pulses;
+   } while (recorder.readNextPulse());
+   recorder.close();
+
+   printf("%-16s %6lu pulses %5.1f wpm\n", name, pulses, fist.getSpeed());
+   printf("   dit %6.1f ms sd %5.1f   dah %6.1f ms sd %5.1f\n"
+         ,fist.getDits().getMean(), fist.getDits().getDeviation()
+         ,fist.getDahs().getMean(), fist.getDahs().getDeviation());
+   printf("   element space %6.1f ms sd %5.1f   letter %6.1f ms   word %6.1f ms\n"
+         ,fist.getElementSpaces().getMean()
+         ,fist.getElementSpaces().getDeviation()
+         ,fist.getLetterSpaces().getMean()
+         ,fist.getWordSpaces().getMean());
+
+   for (uint8_t ii=0; ii<FIST_HISTOGRAM_BINS; ++ii) {
+      bins[ii] = fist.getMarkBin(ii);
+   }
+   printHistogram("marks", bins, FIST_MARK_BINS_PER_UNIT);
+
+   for (uint8_t ii=0; ii<FIST_HISTOGRAM_BINS; ++ii) {
+      bins[ii] = fist.getSpaceBin(ii);
+   }
+   printHistogram("spaces", bins, FIST_SPACE_BINS_PER_UNIT);
+
+   bool measured = fist.getSummary(summary);
+
+   if (measured) {
+      printSummary("measured", summary);
+   }
+   if (info.hasFist) {
+      printSummary("header", info.fist);
+   }
+
+   bool rtn = true;
+
+   if (update) {
+      rtn = measured && recorder.writeFistSummary(fn, summary);
+   }
+
+   return rtn;
+}
+
+/**
+ * makes the name of a numbered channel
+ */
+static std::string channelName(unsigned int ch) {
+   char buf[CSTORE_NAME_MAX + 1];
+
+   snprintf(buf, sizeof(buf), "chnl%u.txt", ch);
+
+   return buf;
+}
+
+int main(int argc, char **argv) {
+   bool update = false;
+   int  opt;
+   int  rtn = 0;
+
+   while (-1 != (opt = getopt(argc, argv, "d:u"))) {
+      switch (opt) {
+         case 'd':
+            HostSimulator::setSdRoot(optarg);
+            break;
+
+         case 'u':
+            update = true;
+            break;
+
+         default:
+            fprintf(stderr
+                   ,"usage: %s [-d sd_dir] [-u] [channel ...]\n"
+                   ,argv[0]);
+            return 2;
+      }
+   }
+
+   PulseTrainRecorder recorder;
+
+   if (!recorder.initialize(FIST_SD_RESERVED_PIN, FIST_SD_CS_PIN)) {
+      fprintf(stderr, "%s: can't open the card\n", argv[0]);
+      return 1;
+   }
+
+   if (optind < argc) {
+      for (int ii=optind; ii<argc; ++ii) {
+         std::string name = argv[ii];
+
+         if (isdigit((unsigned char)name[0])) {
+            name = channelName(strtoul(argv[ii], 0, 10));
+         }
+
+         if (!reportChannel(recorder, name.c_str(), update)) {
+            fprintf(stderr, "%s: can't measure %s\n", argv[0], name.c_str());
+            rtn = 1;
+         }
+      }
+   }
+   else {
+      for (unsigned int ch=1; ch<=RECORDING_CHANNELS; ++ch) {
+         std::string name = channelName(ch);
+         char fn[CSTORE_NAME_MAX + 1];
+
+         strncpy(fn, name.c_str(), CSTORE_NAME_MAX);
+         fn[CSTORE_NAME_MAX] = 0;
+
+         if (!recorder.isChannelEmpty(fn) && !reportChannel(recorder, fn, update)) {
+            fprintf(stderr, "%s: can't measure %s\n", argv[0], fn);
+            rtn = 1;
+         }
+      }
+   }
+
+   return rtn;
+}
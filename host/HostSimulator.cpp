@@ -0,0 +1,642 @@
+/**
+ * @file    HostSimulator.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the implementation of HostSimulator and of the
+ * host Arduino API declared in Arduino.h.
+ */
+
+#include <Arduino.h>
+#include <HostSimulator.h>
+
+#include <algorithm>
+#include <deque>
+
+/**
+ * state of the simulated board
+ */
+struct HostBoard {
+   unsigned long nowMicros;
+   unsigned int  callMicros;
+   bool          readEarly;
+
+   uint8_t pinModes[HOST_SIM_PIN_COUNT];
+   uint8_t outputLevels[HOST_SIM_PIN_COUNT];
+   uint8_t inputLevels[HOST_SIM_PIN_COUNT];
+   bool    inputDriven[HOST_SIM_PIN_COUNT];
+
+   void  (*isrs[HOST_SIM_PIN_COUNT])();
+   bool    isrPending[HOST_SIM_PIN_COUNT];
+   bool    interruptsEnabled;
+   bool    inInterrupt;
+
+   unsigned long timerDue;
+   void        (*timerIsr)();
+   bool          timerPending;
+
+   std::vector<HostPinEvent> inputScript;
+   size_t                    nextInput;
+   std::vector<HostPinEvent> outputTrace;
+
+   std::string   sdRoot;
+   bool          sdPresent;
+   HostSdLatency sdLatency;
+
+   std::deque<char> serialInput;
+};
+
+static HostBoard Board;
+
+/**
+ * sorts scheduled input changes by time
+ */
+static bool inputEarlier(const HostPinEvent &a, const HostPinEvent &b) {
+   return (long)(a.timeMicros - b.timeMicros) < 0;
+}
+
+/**
+ * calls an interrupt handler, or holds it until interrupts are enabled
+ */
+static void raiseInterrupt(uint8_t pin) {
+   if (Board.isrs[pin]) {
+      if (Board.interruptsEnabled && !Board.inInterrupt) {
+         Board.inInterrupt = true;
+         Board.isrs[pin]();
+         Board.inInterrupt = false;
+      }
+      else {
+         Board.isrPending[pin] = true;
+      }
+   }
+}
+
+/**
+ * calls the timer handler, or holds it until interrupts are enabled
+ */
+static void raiseTimer() {
+   void (*isr)() = Board.timerIsr;
+
+   // one shot, the handler may start it again
+   Board.timerIsr = 0;
+
+   if (isr) {
+      if (Board.interruptsEnabled && !Board.inInterrupt) {
+         Board.inInterrupt = true;
+         isr();
+         Board.inInterrupt = false;
+      }
+      else {
+         Board.timerIsr = isr;
+         Board.timerPending = true;
+      }
+   }
+}
+
+/**
+ * applies a level to an input pin, interrupting on a change
+ */
+static void applyInput(uint8_t pin, uint8_t level) {
+   if (pin < HOST_SIM_PIN_COUNT) {
+      bool changed = (digitalRead(pin) != level);
+
+      Board.inputLevels[pin] = level;
+      Board.inputDriven[pin] = true;
+
+      if (changed && (OUTPUT != Board.pinModes[pin])) {
+         raiseInterrupt(pin);
+      }
+   }
+}
+
+/**
+ * returns the simulator to its state at reset
+ */
+void HostSimulator::reset() {
+   Board.nowMicros = 0;
+   Board.callMicros = HOST_SIM_CALL_MICROS;
+   Board.readEarly = false;
+
+   for (uint8_t ii=0; ii<HOST_SIM_PIN_COUNT; ++ii) {
+      Board.pinModes[ii] = INPUT;
+      Board.outputLevels[ii] = LOW;
+      Board.inputLevels[ii] = LOW;
+      Board.inputDriven[ii] = false;
+      Board.isrs[ii] = 0;
+      Board.isrPending[ii] = false;
+   }
+
+   Board.interruptsEnabled = true;
+   Board.inInterrupt = false;
+
+   Board.timerDue = 0;
+   Board.timerIsr = 0;
+   Board.timerPending = false;
+
+   Board.inputScript.clear();
+   Board.nextInput = 0;
+   Board.outputTrace.clear();
+
+   Board.sdRoot = "sd";
+   Board.sdPresent = true;
+   memset(&Board.sdLatency, 0, sizeof(Board.sdLatency));
+
+   Board.serialInput.clear();
+}
+
+/**
+ * returns current time
+ *
+ * @return virtual microseconds since reset
+ */
+unsigned long HostSimulator::now() {
+   return Board.nowMicros;
+}
+
+/**
+ * moves the clock forward, making any scripted input changes
+ * and interrupts that fall due
+ *
+ * @param  us     time to advance, microseconds
+ */
+void HostSimulator::advance(unsigned long us) {
+   advanceTo(Board.nowMicros + us);
+}
+
+/**
+ * moves the clock forward to a given time
+ *
+ * @param  time_us  new time, virtual microseconds
+ */
+void HostSimulator::advanceTo(unsigned long time_us) {
+   // an interrupt handler sees the clock stand still
+   if (Board.inInterrupt) {
+      return;
+   }
+
+   for (;;) {
+      bool input_due = 
+             (Board.nextInput < Board.inputScript.size())
+          && ((long)(time_us - Board.inputScript[Board.nextInput].timeMicros) >= 0);
+      bool timer_due =
+             Board.timerIsr && !Board.timerPending
+          && ((long)(time_us - Board.timerDue) >= 0);
+
+      if (!input_due && !timer_due) {
+         break;
+      }
+
+      // earlier of the two goes first
+      if (   input_due && timer_due
+          && ((long)(Board.timerDue - Board.inputScript[Board.nextInput].timeMicros) < 0)) {
+         input_due = false;
+      }
+
+      unsigned long due = input_due 
+                        ? Board.inputScript[Board.nextInput].timeMicros 
+                        : Board.timerDue;
+
+      // handler runs at exactly the time of the event
+      if ((long)(due - Board.nowMicros) > 0) {
+         Board.nowMicros = due;
+      }
+
+      if (input_due) {
+         const HostPinEvent ev = Board.inputScript[Board.nextInput++];
+         applyInput(ev.pin, ev.level);
+      }
+      else {
+         raiseTimer();
+      }
+   }
+
+   if ((long)(time_us - Board.nowMicros) > 0) {
+      Board.nowMicros = time_us;
+   }
+}
+
+/**
+ * starts the one shot timer; the handler is called as an interrupt
+ * when the clock reaches the due time, replacing any timer running
+ *
+ * @param  due_us   time of interrupt, virtual microseconds
+ * @param  isr      interrupt handler
+ */
+void HostSimulator::setTimer(unsigned long due_us, void (*isr)()) {
+   Board.timerDue = due_us;
+   Board.timerIsr = isr;
+   Board.timerPending = false;
+}
+
+/**
+ * stops the one shot timer
+ */
+void HostSimulator::cancelTimer() {
+   Board.timerIsr = 0;
+   Board.timerPending = false;
+}
+
+/**
+ * sets the time taken by each call to millis() or micros()
+ *
+ * @param  us     cost of a clock read, microseconds
+ */
+void HostSimulator::setCallMicros(unsigned int us) {
+   Board.callMicros = us;
+}
+
+/**
+ * sets whether millis() and micros() return the time at the start
+ * of the call; interrupts due while the call runs are then taken
+ * after the time was read, as one landing between a clock read and
+ * the code using it would be
+ *
+ * @param  early  true to return the time at the start of the call
+ */
+void HostSimulator::setClockReadEarly(bool early) {
+   Board.readEarly = early;
+}
+
+/**
+ * drives an input pin to a level now
+ *
+ * @param  pin    pin number
+ * @param  level  level applied, in {LOW,HIGH}
+ */
+void HostSimulator::setInput(uint8_t pin, uint8_t level) {
+   applyInput(pin, (LOW == level) ? LOW : HIGH);
+}
+
+/**
+ * schedules an input pin level change
+ *
+ * @param  pin      pin number
+ * @param  time_us  time of change, virtual microseconds
+ * @param  level    level applied, in {LOW,HIGH}
+ */
+void HostSimulator::scheduleInput(uint8_t pin, unsigned long time_us, uint8_t level) {
+   HostPinEvent ev;
+
+   ev.timeMicros = time_us;
+   ev.pin = pin;
+   ev.level = (LOW == level) ? LOW : HIGH;
+
+   // keep changes not yet made in time order
+   std::vector<HostPinEvent>::iterator it =
+      std::upper_bound(Board.inputScript.begin() + Board.nextInput
+                      ,Board.inputScript.end()
+                      ,ev
+                      ,inputEarlier);
+   Board.inputScript.insert(it, ev);
+}
+
+/**
+ * loads scheduled input changes from a script file; each line
+ * holds a time in milliseconds, which may be fractional, a pin
+ * number and a level, and # starts a comment
+ *
+ * @param  path   script file name
+ *
+ * @return true if the script was read without error
+ */
+bool HostSimulator::loadInputScript(const char *path) {
+   bool rtn = false;
+   FILE *fp = fopen(path, "r");
+
+   if (fp) {
+      char line[128];
+      rtn = true;
+
+      while (fgets(line, sizeof(line), fp)) {
+         char *hash = strchr(line, '#');
+         double time_ms;
+         int pin;
+         int level;
+
+         if (hash) {
+            *hash = '\0';
+         }
+
+         int fields = sscanf(line, "%lf %d %d", &time_ms, &pin, &level);
+
+         if (3 == fields) {
+            scheduleInput(pin, (unsigned long)(time_ms * 1000.0 + 0.5), level);
+         }
+         else if (fields > 0) {
+            rtn = false;
+         }
+      }
+
+      fclose(fp);
+   }
+
+   return rtn;
+}
+
+/**
+ * returns the level changes written to output pins
+ */
+const std::vector<HostPinEvent> &HostSimulator::getOutputTrace() {
+   return Board.outputTrace;
+}
+
+/**
+ * discards the output trace
+ */
+void HostSimulator::clearOutputTrace() {
+   Board.outputTrace.clear();
+}
+
+/**
+ * sets the directory standing in for the SD card
+ *
+ * @param  path   directory name
+ */
+void HostSimulator::setSdRoot(const char *path) {
+   Board.sdRoot = path;
+}
+
+/**
+ * returns the directory standing in for the SD card
+ */
+const std::string &HostSimulator::getSdRoot() {
+   return Board.sdRoot;
+}
+
+/**
+ * sets whether SD.begin() finds a card
+ *
+ * @param  present  true if the card is there
+ */
+void HostSimulator::setSdPresent(bool present) {
+   Board.sdPresent = present;
+}
+
+/**
+ * returns whether SD.begin() finds a card
+ */
+bool HostSimulator::isSdPresent() {
+   return Board.sdPresent;
+}
+
+/**
+ * sets simulated SD card latencies
+ *
+ * @param  lat    latency of each operation
+ */
+void HostSimulator::setSdLatency(const HostSdLatency &lat) {
+   Board.sdLatency = lat;
+}
+
+/**
+ * returns simulated SD card latencies
+ */
+const HostSdLatency &HostSimulator::getSdLatency() {
+   return Board.sdLatency;
+}
+
+/**
+ * queues characters to be read from Serial
+ *
+ * @param  s      characters to queue
+ */
+void HostSimulator::queueSerialInput(const char *s) {
+   while (*s) {
+      Board.serialInput.push_back(*s++);
+   }
+}
+
+/**
+ * sets up the board before any static constructors in the
+ * libraries or sketch can use it
+ */
+static struct HostBoardInit {
+   HostBoardInit() {
+      HostSimulator::reset();
+   }
+} BoardInit;
+
+/*
+ * host Arduino API
+ */
+
+unsigned long millis() {
+   unsigned long start = Board.nowMicros;
+   HostSimulator::advance(Board.callMicros);
+   return (Board.readEarly ? start : Board.nowMicros) / 1000UL;
+}
+
+unsigned long micros() {
+   unsigned long start = Board.nowMicros;
+   HostSimulator::advance(Board.callMicros);
+   return Board.readEarly ? start : Board.nowMicros;
+}
+
+void delay(unsigned long ms) {
+   HostSimulator::advance(ms * 1000UL);
+}
+
+void delayMicroseconds(unsigned int us) {
+   HostSimulator::advance(us);
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+   if (pin < HOST_SIM_PIN_COUNT) {
+      Board.pinModes[pin] = mode;
+   }
+}
+
+void digitalWrite(uint8_t pin, uint8_t val) {
+   if (pin < HOST_SIM_PIN_COUNT) {
+      uint8_t level = (LOW == val) ? LOW : HIGH;
+
+      // trace changes on output pins only
+      if ((OUTPUT == Board.pinModes[pin]) && (level != Board.outputLevels[pin])) {
+         HostPinEvent ev;
+
+         ev.timeMicros = Board.nowMicros;
+         ev.pin = pin;
+         ev.level = level;
+         Board.outputTrace.push_back(ev);
+      }
+
+      Board.outputLevels[pin] = level;
+   }
+}
+
+int digitalRead(uint8_t pin) {
+   int rtn = LOW;
+
+   if (pin < HOST_SIM_PIN_COUNT) {
+      if (OUTPUT == Board.pinModes[pin]) {
+         rtn = Board.outputLevels[pin];
+      }
+      else if (Board.inputDriven[pin]) {
+         rtn = Board.inputLevels[pin];
+      }
+      else {
+         // nothing driving the pin, pull up decides
+         rtn = (INPUT_PULLUP == Board.pinModes[pin]) ? HIGH : LOW;
+      }
+   }
+
+   return rtn;
+}
+
+void attachInterrupt(uint8_t irq, void (*isr)(), int mode) {
+   (void)mode;
+
+   if (irq < HOST_SIM_PIN_COUNT) {
+      Board.isrs[irq] = isr;
+      Board.isrPending[irq] = false;
+   }
+}
+
+void detachInterrupt(uint8_t irq) {
+   if (irq < HOST_SIM_PIN_COUNT) {
+      Board.isrs[irq] = 0;
+      Board.isrPending[irq] = false;
+   }
+}
+
+void noInterrupts() {
+   Board.interruptsEnabled = false;
+}
+
+void interrupts() {
+   Board.interruptsEnabled = true;
+
+   // deliver anything held while interrupts were off
+   for (uint8_t ii=0; ii<HOST_SIM_PIN_COUNT; ++ii) {
+      if (Board.isrPending[ii]) {
+         Board.isrPending[ii] = false;
+         raiseInterrupt(ii);
+      }
+   }
+
+   if (Board.timerPending) {
+      Board.timerPending = false;
+      raiseTimer();
+   }
+}
+
+char *ultoa(unsigned long val, char *buf, int radix) {
+   char tmp[33];
+   int  len = 0;
+
+   do {
+      int digit = val % radix;
+      tmp[len++] = (digit < 10) ? ('0' + digit) : ('a' + digit - 10);
+      val /= radix;
+   } while (val > 0);
+
+   for (int ii=0; ii<len; ++ii) {
+      buf[ii] = tmp[len - 1 - ii];
+   }
+   buf[len] = '\0';
+
+   return buf;
+}
+
+char *ltoa(long val, char *buf, int radix) {
+   if ((val < 0) && (10 == radix)) {
+      buf[0] = '-';
+      ultoa(-(unsigned long)val, buf + 1, radix);
+   }
+   else {
+      ultoa((unsigned long)val, buf, radix);
+   }
+
+   return buf;
+}
+
+char *itoa(int val, char *buf, int radix) {
+   return ltoa(val, buf, radix);
+}
+
+/*
+ * host Serial port
+ */
+
+HostSerial Serial;
+
+int HostSerial::available() {
+   return (int)Board.serialInput.size();
+}
+
+int HostSerial::read() {
+   int rtn = -1;
+
+   if (!Board.serialInput.empty()) {
+      rtn = (uint8_t)Board.serialInput.front();
+      Board.serialInput.pop_front();
+   }
+
+   return rtn;
+}
+
+int HostSerial::peek() {
+   return Board.serialInput.empty() ? -1 : (uint8_t)Board.serialInput.front();
+}
+
+size_t HostSerial::write(uint8_t c) {
+   return (EOF == fputc(c, stdout)) ? 0 : 1;
+}
+
+size_t HostSerial::print(const char *s) {
+   return fputs(s, stdout) < 0 ? 0 : strlen(s);
+}
+
+size_t HostSerial::print(char c) {
+   return write((uint8_t)c);
+}
+
+size_t HostSerial::print(int val, int radix) {
+   return print((long)val, radix);
+}
+
+size_t HostSerial::print(unsigned int val, int radix) {
+   return print((unsigned long)val, radix);
+}
+
+size_t HostSerial::print(long val, int radix) {
+   char buf[34];
+   return print(ltoa(val, buf, radix));
+}
+
+size_t HostSerial::print(unsigned long val, int radix) {
+   char buf[34];
+   return print(ultoa(val, buf, radix));
+}
+
+size_t HostSerial::print(double val, int digits) {
+   char buf[40];
+   snprintf(buf, sizeof(buf), "%.*f", digits, val);
+   return print(buf);
+}
+
+size_t HostSerial::println() {
+   return print("\r\n");
+}
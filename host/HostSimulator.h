@@ -0,0 +1,246 @@
+#ifndef _HOST_SIMULATOR_H_
+#define _HOST_SIMULATOR_H_
+
+/**
+ * @file    HostSimulator.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class definition for HostSimulator, which
+ * controls the simulated board behind the host Arduino API: the
+ * virtual clock, scripted input waveforms, the output trace, the
+ * directory standing in for the SD card and its latency.
+ */
+
+#include <Arduino.h>
+#include <vector>
+#include <string>
+
+/**
+ * simulator constants
+ * <p>
+ * HOST_SIM_PIN_COUNT is the number of simulated digital pins, as on
+ * the Arduino UNO R3.
+ * <p>
+ * HOST_SIM_CALL_MICROS is the default time taken by each call to
+ * millis() or micros(). Code that waits by watching the clock would
+ * otherwise never see it move.
+ */
+#define HOST_SIM_PIN_COUNT     20
+#define HOST_SIM_CALL_MICROS   2
+
+/**
+ * struct describing one level change on a pin
+ */
+struct HostPinEvent {
+  /**
+   * time of the change, virtual microseconds
+   */
+   unsigned long timeMicros;
+
+  /**
+   * pin number
+   */
+   uint8_t pin;
+
+  /**
+   * pin level after the change, in {LOW,HIGH}
+   */
+   uint8_t level;
+};
+
+/**
+ * struct holding simulated SD card latencies, microseconds;
+ * each is added to the virtual clock by the matching File call.
+ * Every readStallInterval'th read of a file also stalls for
+ * readStallMicros, as a card does when it is busy; an interval
+ * of 0 means no stalls.
+ */
+struct HostSdLatency {
+   unsigned long openMicros;
+   unsigned long readMicros;
+   unsigned long writeMicros;
+   unsigned long flushMicros;
+   unsigned long seekMicros;
+   unsigned long readStallMicros;
+   unsigned int  readStallInterval;
+};
+
+/**
+ * The Host Simulator holds the state of the simulated board.
+ *
+ * Time is virtual and only moves when the code under test reads the
+ * clock, delays, or waits on the SD card, or when the simulator is
+ * told to advance it. Input pins follow scripted waveforms; when the
+ * clock passes a scripted change on a pin with an interrupt attached,
+ * the handler is called with the clock set to the time of the change,
+ * or as soon as interrupts are enabled again. A one shot timer 
+ * interrupt works the same way, standing in for a timer compare.
+ *
+ * All members are static, as there is only one board.
+ */
+class HostSimulator {
+public:
+  /**
+   * returns the simulator to its state at reset
+   */
+   static void reset();
+
+  /**
+   * returns current time
+   *
+   * @return virtual microseconds since reset
+   */
+   static unsigned long now();
+
+  /**
+   * moves the clock forward, making any scripted input changes
+   * and interrupts that fall due
+   *
+   * @param  us     time to advance, microseconds
+   */
+   static void advance(unsigned long us);
+
+  /**
+   * moves the clock forward to a given time
+   *
+   * @param  time_us  new time, virtual microseconds
+   */
+   static void advanceTo(unsigned long time_us);
+
+  /**
+   * starts the one shot timer; the handler is called as an interrupt
+   * when the clock reaches the due time, replacing any timer running
+   *
+   * @param  due_us   time of interrupt, virtual microseconds
+   * @param  isr      interrupt handler
+   */
+   static void setTimer(unsigned long due_us, void (*isr)());
+
+  /**
+   * stops the one shot timer
+   */
+   static void cancelTimer();
+
+  /**
+   * sets the time taken by each call to millis() or micros()
+   *
+   * @param  us     cost of a clock read, microseconds
+   */
+   static void setCallMicros(unsigned int us);
+
+  /**
+   * sets whether millis() and micros() return the time at the start
+   * of the call; interrupts due while the call runs are then taken
+   * after the time was read, as one landing between a clock read and
+   * the code using it would be
+   *
+   * @param  early  true to return the time at the start of the call
+   */
+   static void setClockReadEarly(bool early);
+
+  /**
+   * drives an input pin to a level now
+   *
+   * @param  pin    pin number
+   * @param  level  level applied, in {LOW,HIGH}
+   */
+   static void setInput(uint8_t pin, uint8_t level);
+
+  /**
+   * schedules an input pin level change
+   *
+   * @param  pin      pin number
+   * @param  time_us  time of change, virtual microseconds
+   * @param  level    level applied, in {LOW,HIGH}
+   */
+   static void scheduleInput(uint8_t pin, unsigned long time_us, uint8_t level);
+
+  /**
+   * loads scheduled input changes from a script file; each line
+   * holds a time in milliseconds, which may be fractional, a pin
+   * number and a level, and # starts a comment
+   *
+   * @param  path   script file name
+   *
+   * @return true if the script was read without error
+   */
+   static bool loadInputScript(const char *path);
+
+  /**
+   * returns the level changes written to output pins
+   */
+   static const std::vector<HostPinEvent> &getOutputTrace();
+
+  /**
+   * discards the output trace
+   */
+   static void clearOutputTrace();
+
+  /**
+   * sets the directory standing in for the SD card
+   *
+   * @param  path   directory name
+   */
+   static void setSdRoot(const char *path);
+
+  /**
+   * returns the directory standing in for the SD card
+   */
+   static const std::string &getSdRoot();
+
+  /**
+   * sets whether SD.begin() finds a card
+   *
+   * @param  present  true if the card is there
+   */
+   static void setSdPresent(bool present);
+
+  /**
+   * returns whether SD.begin() finds a card
+   */
+   static bool isSdPresent();
+
+  /**
+   * sets simulated SD card latencies
+   *
+   * @param  lat    latency of each operation
+   */
+   static void setSdLatency(const HostSdLatency &lat);
+
+  /**
+   * returns simulated SD card latencies
+   */
+   static const HostSdLatency &getSdLatency();
+
+  /**
+   * queues characters to be read from Serial
+   *
+   * @param  s      characters to queue
+   */
+   static void queueSerialInput(const char *s);
+};
+
+#endif // _HOST_SIMULATOR_H_
@@ -0,0 +1,300 @@
+/**
+ * @file    MorseSynth.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ * This file contains main() for the Morse text synthesizer. It keys
+ * lines of text with MorseSynthesizer and records each one to a
+ * channel of a card directory, as if it had been keyed in record
+ * mode, so channels can be loaded without a key.
+ *
+ * Each text argument, or each line of the text file, goes to a
+ * channel of its own, numbered up from the first channel given.
+ * Lines past the last channel of a card go on to the next card,
+ * a directory named after the first with a card number added, so
+ * a large library of beacon or practice texts can be made at once.
+ *
+ * usage: dfr_synth [-d sd_dir] [-c channel] [-w wpm] [-f effective_wpm]
+ *                  [-g weight] [-i text_file] [text ...]
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <HostSimulator.h>
+
+#include <DigitalPulse.h>
+#include <DigitalPin.h>
+#include <ChannelSelector.h>
+#include <PulseCodec.h>
+#include <PulseTrainRecorder.h>
+#include <MorseSynthesizer.h>
+
+#include <stdio.h>
+#include <string>
+#include <sys/time.h>
+#include <unistd.h>
+#include <vector>
+
+/**
+ * local constants
+ * <p>
+ * SYNTH_SD_RESERVED_PIN and SYNTH_SD_CS_PIN are the card pins, as in
+ * the sketch.
+ * <p>
+ * SYNTH_START_MILS is when the first pulse of each channel starts;
+ * recordings only keep times from their first pulse.
+ */
+#define SYNTH_SD_RESERVED_PIN  10
+#define SYNTH_SD_CS_PIN         4
+#define SYNTH_START_MILS     1000
+
+/**
+ * prints how the synthesizer is run
+ *
+ * @return exit status for a bad command line
+ */
+static int usage(const char *name) {
+   fprintf(stderr
+          ,"usage: %s [-d sd_dir] [-c channel] [-w wpm] [-f effective_wpm]\n"
+           "       %*s [-g weight] [-i text_file] [text ...]\n"
+          ,name, (int)strlen(name), "");
+
+   return 2;
+}
+
+/**
+ * gets the wall clock time
+ *
+ * @return time, seconds
+ */
+static double wallSeconds() {
+   struct timeval tv;
+
+   gettimeofday(&tv, 0);
+
+   return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+/**
+ * makes the name of a numbered channel
+ */
+static std::string channelName(unsigned int ch) {
+   char buf[CSTORE_NAME_MAX + 1];
+
+   snprintf(buf, sizeof(buf), "chnl%u.txt", ch);
+
+   return buf;
+}
+
+/**
+ * makes the directory name of a numbered card; the first card is
+ * the directory given
+ */
+static std::string cardName(const std::string &root, unsigned int card) {
+   char buf[16];
+
+   if (card < 2) {
+      return root;
+   }
+
+   snprintf(buf, sizeof(buf), "-%u", card);
+
+   return root + buf;
+}
+
+/**
+ * keys one line of text to an open channel
+ *
+ * @param  skipped   incremented for each character with no code
+ *
+ * @return number of pulses recorded, or -1 if a write failed
+ */
+static long recordText(PulseTrainRecorder &recorder
+                      ,MorseSynthesizer &synth
+                      ,const std::string &text
+                      ,unsigned long &skipped) {
+   DigitalPulse dp;
+   long pulses = 0;
+
+   synth.start(SYNTH_START_MILS);
+
+   for (size_t ii=0; ii<text.size(); ++ii) {
+      if (!synth.putChar(text[ii])) {
+         ++skipped;
+      }
+
+      while (synth.nextPulse(dp)) {
+         if (!recorder.recordPulse(dp)) {
+            return -1;
+         }
+         ++pulses;
+      }
+   }
+
+   return pulses;
+}
+
+int main(int argc, char **argv) {
+   std::string root = HostSimulator::getSdRoot();
+   unsigned int first = 1;
+   uint8_t wpm = MORSE_WPM_DEFAULT;
+   uint8_t effective_wpm = 0;
+   uint8_t weight = MORSE_WEIGHT_DEFAULT;
+   const char *text_file = 0;
+   int opt;
+
+   while (-1 != (opt = getopt(argc, argv, "d:c:w:f:g:i:"))) {
+      switch (opt) {
+         case 'd':
+            root = optarg;
+            break;
+
+         case 'c':
+            first = strtoul(optarg, 0, 10);
+            break;
+
+         case 'w':
+            wpm = (uint8_t)strtoul(optarg, 0, 10);
+            break;
+
+         case 'f':
+            effective_wpm = (uint8_t)strtoul(optarg, 0, 10);
+            break;
+
+         case 'g':
+            weight = (uint8_t)strtoul(optarg, 0, 10);
+            break;
+
+         case 'i':
+            text_file = optarg;
+            break;
+
+         default:
+            return usage(argv[0]);
+      }
+   }
+
+   if ((first < 1) || (first > RECORDING_CHANNELS)) {
+      return usage(argv[0]);
+   }
+
+   // one line of text to each channel
+   std::vector<std::string> lines;
+
+   for (int ii=optind; ii<argc; ++ii) {
+      lines.push_back(argv[ii]);
+   }
+
+   if (text_file) {
+      FILE *f = fopen(text_file, "r");
+      char buf[1024];
+
+      if (!f) {
+         fprintf(stderr, "%s: can't read %s\n", argv[0], text_file);
+         return 1;
+      }
+
+      while (fgets(buf, sizeof(buf), f)) {
+         std::string line = buf;
+
+         while (!line.empty() && ((unsigned char)line[line.size() - 1] <= ' ')) {
+            line.erase(line.size() - 1);
+         }
+
+         if (!line.empty()) {
+            lines.push_back(line);
+         }
+      }
+      fclose(f);
+   }
+
+   MorseSynthesizer synth;
+   synth.setSpeed(wpm, effective_wpm, weight);
+
+   double began = wallSeconds();
+   PulseTrainRecorder *recorder = 0;
+   unsigned int card = 0;
+   unsigned int ch = RECORDING_CHANNELS;
+   unsigned long channels = 0;
+   unsigned long pulses = 0;
+   unsigned long skipped = 0;
+   int rtn = 0;
+
+   for (size_t ii=0; (0 == rtn) && (ii<lines.size()); ++ii) {
+      // a full card goes on to the next
+      if ((0 == recorder) || (ch >= RECORDING_CHANNELS)) {
+         delete recorder;
+         recorder = new PulseTrainRecorder;
+
+         ch = (0 == card) ? first : 1;
+         ++card;
+         HostSimulator::setSdRoot(cardName(root, card).c_str());
+
+         if (!recorder->initialize(SYNTH_SD_RESERVED_PIN, SYNTH_SD_CS_PIN)) {
+            fprintf(stderr, "%s: can't open the card %s\n"
+                   ,argv[0], cardName(root, card).c_str());
+            rtn = 1;
+            break;
+         }
+
+         // recordings are indexed as the sketch makes them
+         recorder->setIndexInterval(PLAYBACK_INDEX_INTERVAL);
+      }
+      else {
+         ++ch;
+      }
+
+      std::string name = channelName(ch);
+      char fn[CSTORE_NAME_MAX + 1];
+      long count = -1;
+
+      strncpy(fn, name.c_str(), CSTORE_NAME_MAX);
+      fn[CSTORE_NAME_MAX] = 0;
+
+      if (recorder->openForRecording(fn)) {
+         count = recordText(*recorder, synth, lines[ii], skipped);
+      }
+      recorder->close();
+
+      if (count < 0) {
+         fprintf(stderr, "%s: can't record %s on %s\n"
+                ,argv[0], fn, cardName(root, card).c_str());
+         rtn = 1;
+      }
+      else {
+         ++channels;
+         pulses += count;
+      }
+   }
+
+   delete recorder;
+
+   double took = wallSeconds() - began;
+
+   printf("%lu channels on %u cards, %lu pulses, %lu characters skipped"
+          ", %.3f s\n"
+         ,channels, card, pulses, skipped, took);
+
+   return rtn;
+}
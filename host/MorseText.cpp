@@ -0,0 +1,188 @@
+/**
+ * @file    MorseText.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains main() for the Morse text decoder. It reads
+ * recorded channels from a card directory, as the sketch would play
+ * them, and prints the text each one spells, decoded by MorseDecoder
+ * with the speed it settled on.
+ *
+ * Channels are given by name, or by number as for the channel
+ * selector; with none given, every channel holding a recording is
+ * decoded.
+ *
+ * usage: dfr_text [-d sd_dir] [-w wpm] [channel ...]
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <HostSimulator.h>
+
+#include <DigitalPulse.h>
+#include <DigitalPin.h>
+#include <ChannelSelector.h>
+#include <PulseCodec.h>
+#include <PulseTrainRecorder.h>
+#include <MorseDecoder.h>
+
+#include <ctype.h>
+#include <string>
+#include <unistd.h>
+
+/**
+ * local constants
+ * <p>
+ * TEXT_SD_RESERVED_PIN and TEXT_SD_CS_PIN are the card pins, as in
+ * the sketch.
+ */
+#define TEXT_SD_RESERVED_PIN  10
+#define TEXT_SD_CS_PIN         4
+
+/**
+ * moves decoded text from the decoder to a string
+ */
+static void takeText(MorseDecoder &decoder, std::string &text) {
+   int c;
+
+   while (-1 != (c = decoder.read())) {
+      text += (char)c;
+   }
+}
+
+/**
+ * decodes one channel, printing its text
+ *
+ * @return true if the channel could be played
+ */
+static bool decodeChannel(PulseTrainRecorder &recorder
+                         ,const char *name
+                         ,uint8_t wpm) {
+   MorseDecoder decoder(wpm);
+   std::string text;
+   unsigned long pulses = 0;
+   char fn[CSTORE_NAME_MAX + 1];
+
+   strncpy(fn, name, CSTORE_NAME_MAX);
+   fn[CSTORE_NAME_MAX] = 0;
+
+   if (!recorder.openForPlayback(fn)) {
+      return false;
+   }
+
+   // opening playback reads the first pulse
+   do {
+      decoder.addPulse(recorder.getPulseStartOffset()
+                      ,recorder.getPulseEndOffset());
+      takeText(decoder, text);
+      ++pulses;
+   } while (recorder.readNextPulse());
+   recorder.close();
+
+   decoder.flush();
+   takeText(decoder, text);
+
+   // no trailing word space
+   if (!text.empty() && (' ' == text[text.size() - 1])) {
+      text.erase(text.size() - 1);
+   }
+
+   printf("%-16s %6lu pulses %3u wpm: %s\n"
+         ,name, pulses, (unsigned)decoder.getSpeed(), text.c_str());
+
+   return true;
+}
+
+/**
+ * makes the name of a numbered channel
+ */
+static std::string channelName(unsigned int ch) {
+   char buf[CSTORE_NAME_MAX + 1];
+
+   snprintf(buf, sizeof(buf), "chnl%u.txt", ch);
+
+   return buf;
+}
+
+int main(int argc, char **argv) {
+   uint8_t wpm = MORSE_WPM_DEFAULT;
+   int     opt;
+   int     rtn = 0;
+
+   while (-1 != (opt = getopt(argc, argv, "d:w:"))) {
+      switch (opt) {
+         case 'd':
+            HostSimulator::setSdRoot(optarg);
+            break;
+
+         case 'w':
+            wpm = (uint8_t)strtoul(optarg, 0, 10);
+            break;
+
+         default:
+            fprintf(stderr
+                   ,"usage: %s [-d sd_dir] [-w wpm] [channel ...]\n"
+                   ,argv[0]);
+            return 2;
+      }
+   }
+
+   PulseTrainRecorder recorder;
+
+   if (!recorder.initialize(TEXT_SD_RESERVED_PIN, TEXT_SD_CS_PIN)) {
+      fprintf(stderr, "%s: can't open the card\n", argv[0]);
+      return 1;
+   }
+
+   if (optind < argc) {
+      for (int ii=optind; ii<argc; ++ii) {
+         std::string name = argv[ii];
+
+         if (isdigit((unsigned char)name[0])) {
+            name = channelName(strtoul(argv[ii], 0, 10));
+         }
+
+         if (!decodeChannel(recorder, name.c_str(), wpm)) {
+            fprintf(stderr, "%s: can't play %s\n", argv[0], name.c_str());
+            rtn = 1;
+         }
+      }
+   }
+   else {
+      for (unsigned int ch=1; ch<=RECORDING_CHANNELS; ++ch) {
+         std::string name = channelName(ch);
+         char fn[CSTORE_NAME_MAX + 1];
+
+         strncpy(fn, name.c_str(), CSTORE_NAME_MAX);
+         fn[CSTORE_NAME_MAX] = 0;
+
+         if (!recorder.isChannelEmpty(fn)) {
+            decodeChannel(recorder, fn, wpm);
+         }
+      }
+   }
+
+   return rtn;
+}
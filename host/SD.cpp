@@ -0,0 +1,328 @@
+/**
+ * @file    SD.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the implementation of the simulated SD card
+ * used when DFR is built on a host computer.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+#include <HostSimulator.h>
+
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * open file shared by copies of a File
+ */
+struct HostFileHandle {
+   FILE          *fp;
+   std::string    name;
+   int            refs;
+   unsigned long  reads;
+};
+
+SDClass SD;
+
+/**
+ * returns the host path of a file on the card
+ */
+static std::string hostPath(const char *path) {
+   std::string rtn = HostSimulator::getSdRoot();
+
+   if ('/' != *path) {
+      rtn += '/';
+   }
+
+   return rtn + path;
+}
+
+/**
+ * adds simulated latency to the virtual clock
+ */
+static void waitFor(unsigned long us) {
+   if (us > 0) {
+      HostSimulator::advance(us);
+   }
+}
+
+File::File(HostFileHandle *h)
+: handle(h)
+{
+   if (handle) {
+      ++handle->refs;
+   }
+}
+
+File::File(const File &other)
+: handle(other.handle)
+{
+   if (handle) {
+      ++handle->refs;
+   }
+}
+
+File &File::operator=(const File &other) {
+   if (this != &other) {
+      release();
+      handle = other.handle;
+      if (handle) {
+         ++handle->refs;
+      }
+   }
+
+   return *this;
+}
+
+File::~File() {
+   release();
+}
+
+/**
+ * drops this File's share of the open file
+ */
+void File::release() {
+   if (handle && (0 == --handle->refs)) {
+      if (handle->fp) {
+         fclose(handle->fp);
+      }
+      delete handle;
+   }
+
+   handle = 0;
+}
+
+size_t File::write(uint8_t b) {
+   return write(&b, 1);
+}
+
+size_t File::write(const uint8_t *buf, size_t size) {
+   size_t rtn = 0;
+
+   if (handle && handle->fp) {
+      waitFor(HostSimulator::getSdLatency().writeMicros);
+
+      // reads and writes may be mixed on the same stream
+      fseek(handle->fp, 0, SEEK_CUR);
+      rtn = fwrite(buf, 1, size, handle->fp);
+   }
+
+   return rtn;
+}
+
+size_t File::write(const char *s) {
+   return write((const uint8_t *)s, strlen(s));
+}
+
+int File::read() {
+   uint8_t b;
+   return (1 == read(&b, 1)) ? b : -1;
+}
+
+int File::read(void *buf, uint16_t nbyte) {
+   int rtn = -1;
+
+   if (handle && handle->fp) {
+      const HostSdLatency &lat = HostSimulator::getSdLatency();
+
+      waitFor(lat.readMicros);
+      if (   (lat.readStallInterval > 0)
+          && (0 == (++handle->reads % lat.readStallInterval))) {
+         waitFor(lat.readStallMicros);
+      }
+
+      fseek(handle->fp, 0, SEEK_CUR);
+      rtn = (int)fread(buf, 1, nbyte, handle->fp);
+   }
+
+   return rtn;
+}
+
+int File::peek() {
+   int rtn = -1;
+
+   if (handle && handle->fp) {
+      long pos = ftell(handle->fp);
+      int c = fgetc(handle->fp);
+
+      fseek(handle->fp, pos, SEEK_SET);
+      rtn = (EOF == c) ? -1 : c;
+   }
+
+   return rtn;
+}
+
+int File::available() {
+   long rtn = 0;
+
+   if (handle && handle->fp) {
+      rtn = (long)size() - (long)position();
+      if (rtn > 0x7FFF) {
+         // as on the AVR, where int is 16 bits
+         rtn = 0x7FFF;
+      }
+   }
+
+   return (rtn > 0) ? (int)rtn : 0;
+}
+
+void File::flush() {
+   if (handle && handle->fp) {
+      waitFor(HostSimulator::getSdLatency().flushMicros);
+      fflush(handle->fp);
+   }
+}
+
+bool File::seek(uint32_t pos) {
+   bool rtn = false;
+
+   if (handle && handle->fp && (pos <= size())) {
+      waitFor(HostSimulator::getSdLatency().seekMicros);
+      rtn = (0 == fseek(handle->fp, pos, SEEK_SET));
+   }
+
+   return rtn;
+}
+
+uint32_t File::position() {
+   return (handle && handle->fp) ? (uint32_t)ftell(handle->fp) : 0;
+}
+
+uint32_t File::size() {
+   uint32_t rtn = 0;
+
+   if (handle && handle->fp) {
+      long pos = ftell(handle->fp);
+
+      fseek(handle->fp, 0, SEEK_END);
+      rtn = (uint32_t)ftell(handle->fp);
+      fseek(handle->fp, pos, SEEK_SET);
+   }
+
+   return rtn;
+}
+
+void File::close() {
+   if (handle && handle->fp) {
+      // closes for every copy, as on the Arduino
+      fclose(handle->fp);
+      handle->fp = 0;
+   }
+
+   release();
+}
+
+const char *File::name() const {
+   return handle ? handle->name.c_str() : "";
+}
+
+/**
+ * initializes the card
+ *
+ * @param  cs_pin   chip select pin, ignored
+ *
+ * @return true if the card is present
+ */
+bool SDClass::begin(uint8_t cs_pin) {
+   (void)cs_pin;
+
+   if (HostSimulator::isSdPresent()) {
+      // card directory is made on first use
+      ::mkdir(HostSimulator::getSdRoot().c_str(), 0777);
+   }
+
+   return HostSimulator::isSdPresent();
+}
+
+/**
+ * opens a file, positioned at the end if opened for writing
+ *
+ * @param  path     file name
+ * @param  mode     combination of O_x flags
+ *
+ * @return the open file, which tests false if it could not be opened
+ */
+File SDClass::open(const char *path, uint8_t mode) {
+   File rtn;
+
+   if (HostSimulator::isSdPresent()) {
+      std::string host_path = hostPath(path);
+      bool found = exists(path);
+      FILE *fp = 0;
+
+      waitFor(HostSimulator::getSdLatency().openMicros);
+
+      if (mode & O_WRITE) {
+         if (found && (mode & O_EXCL) && (mode & O_CREAT)) {
+            // must not exist
+         }
+         else if (found && !(mode & O_TRUNC)) {
+            fp = fopen(host_path.c_str(), "r+b");
+         }
+         else if (found || (mode & O_CREAT)) {
+            fp = fopen(host_path.c_str(), "w+b");
+         }
+
+         if (fp) {
+            fseek(fp, 0, SEEK_END);
+         }
+      }
+      else if (found) {
+         fp = fopen(host_path.c_str(), "rb");
+      }
+
+      if (fp) {
+         HostFileHandle *h = new HostFileHandle;
+
+         h->fp = fp;
+         h->name = path;
+         h->refs = 0;
+         h->reads = 0;
+         rtn = File(h);
+      }
+   }
+
+   return rtn;
+}
+
+bool SDClass::exists(const char *path) {
+   struct stat st;
+   return 0 == stat(hostPath(path).c_str(), &st);
+}
+
+bool SDClass::remove(const char *path) {
+   return 0 == unlink(hostPath(path).c_str());
+}
+
+bool SDClass::mkdir(const char *path) {
+   return 0 == ::mkdir(hostPath(path).c_str(), 0777);
+}
+
+bool SDClass::rmdir(const char *path) {
+   return 0 == ::rmdir(hostPath(path).c_str());
+}
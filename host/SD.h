@@ -0,0 +1,145 @@
+#ifndef _HOST_SD_H_
+#define _HOST_SD_H_
+
+/**
+ * @file    SD.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file stands in for the Arduino SD library when DFR is built on
+ * a host computer. Files live in a directory on disk, set with
+ * HostSimulator::setSdRoot(), and each operation adds its simulated
+ * latency to the virtual clock.
+ */
+
+#include <Arduino.h>
+
+/**
+ * file open flags, with the values used by the Arduino SD library
+ */
+#define O_READ    0x01
+#define O_RDONLY  O_READ
+#define O_WRITE   0x02
+#define O_WRONLY  O_WRITE
+#define O_RDWR    (O_READ | O_WRITE)
+#define O_APPEND  0x04
+#define O_SYNC    0x08
+#define O_CREAT   0x10
+#define O_EXCL    0x20
+#define O_TRUNC   0x40
+
+#define FILE_READ   O_READ
+#define FILE_WRITE  (O_READ | O_WRITE | O_CREAT)
+
+struct HostFileHandle;
+
+/**
+ * An open file on the simulated SD card.
+ *
+ * As with the Arduino library, copies of a File share one open file,
+ * and a File that failed to open tests false.
+ */
+class File {
+protected:
+  /**
+   * shared open file, or 0
+   */
+   HostFileHandle *handle;
+
+  /**
+   * drops this File's share of the open file
+   */
+   void release();
+
+public:
+   File()
+   : handle(0)
+   {}
+
+   File(HostFileHandle *h);
+   File(const File &other);
+   File &operator=(const File &other);
+   ~File();
+
+   operator bool() const {
+      return 0 != handle;
+   }
+
+   size_t write(uint8_t b);
+   size_t write(const uint8_t *buf, size_t size);
+   size_t write(const char *s);
+   int read();
+   int read(void *buf, uint16_t nbyte);
+   int peek();
+   int available();
+   void flush();
+   bool seek(uint32_t pos);
+   uint32_t position();
+   uint32_t size();
+   void close();
+   const char *name() const;
+
+   size_t print(const char *s) {
+      return write(s);
+   }
+
+   size_t println(const char *s) {
+      return write(s) + write("\r\n");
+   }
+};
+
+/**
+ * The simulated SD card.
+ */
+class SDClass {
+public:
+  /**
+   * initializes the card
+   *
+   * @param  cs_pin   chip select pin, ignored
+   *
+   * @return true if the card is present
+   */
+   bool begin(uint8_t cs_pin = 10);
+
+  /**
+   * opens a file, positioned at the end if opened for writing
+   *
+   * @param  path     file name
+   * @param  mode     combination of O_x flags
+   *
+   * @return the open file, which tests false if it could not be opened
+   */
+   File open(const char *path, uint8_t mode = FILE_READ);
+
+   bool exists(const char *path);
+   bool remove(const char *path);
+   bool mkdir(const char *path);
+   bool rmdir(const char *path);
+};
+
+extern SDClass SD;
+
+#endif // _HOST_SD_H_
@@ -0,0 +1,126 @@
+/**
+ * @file    main.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains main() for running the DFRMain sketch in the
+ * host simulator. It plays an input script into the simulated pins,
+ * runs setup() and loop() on the virtual clock for a given time, and
+ * writes the trace of output pin changes.
+ *
+ * usage: dfr_host [-s script] [-d sd_dir] [-t run_ms] [-o trace_file]
+ */
+
+#include <Arduino.h>
+#include <HostSimulator.h>
+
+#include <unistd.h>
+
+/**
+ * sketch entry points
+ */
+void setup();
+void loop();
+
+/**
+ * local constants
+ * <p>
+ * HOST_DEFAULT_RUN_MILS is the virtual time the sketch runs for if
+ * none is given.
+ */
+#define HOST_DEFAULT_RUN_MILS  10000UL
+
+/**
+ * writes the output trace, one change per line: 
+ * time in microseconds, pin number, level
+ */
+static void writeTrace(FILE *fp) {
+   const std::vector<HostPinEvent> &trace = HostSimulator::getOutputTrace();
+
+   for (size_t ii=0; ii<trace.size(); ++ii) {
+      fprintf(fp, "%lu %u %u\n"
+             ,trace[ii].timeMicros
+             ,(unsigned)trace[ii].pin
+             ,(unsigned)trace[ii].level);
+   }
+}
+
+int main(int argc, char **argv) {
+   const char   *script = 0;
+   const char   *trace_name = 0;
+   unsigned long run_mils = HOST_DEFAULT_RUN_MILS;
+   int           opt;
+
+   while (-1 != (opt = getopt(argc, argv, "s:d:t:o:"))) {
+      switch (opt) {
+         case 's':
+            script = optarg;
+            break;
+
+         case 'd':
+            HostSimulator::setSdRoot(optarg);
+            break;
+
+         case 't':
+            run_mils = strtoul(optarg, 0, 10);
+            break;
+
+         case 'o':
+            trace_name = optarg;
+            break;
+
+         default:
+            fprintf(stderr
+                   ,"usage: %s [-s script] [-d sd_dir] [-t run_ms] [-o trace_file]\n"
+                   ,argv[0]);
+            return 2;
+      }
+   }
+
+   if (script && !HostSimulator::loadInputScript(script)) {
+      fprintf(stderr, "%s: can't read input script %s\n", argv[0], script);
+      return 1;
+   }
+
+   setup();
+
+   while (HostSimulator::now() < run_mils * 1000UL) {
+      loop();
+   }
+
+   if (trace_name) {
+      FILE *fp = fopen(trace_name, "w");
+
+      if (!fp) {
+         fprintf(stderr, "%s: can't write trace %s\n", argv[0], trace_name);
+         return 1;
+      }
+
+      writeTrace(fp);
+      fclose(fp);
+   }
+
+   return 0;
+}
@@ -37,26 +37,97 @@
 #define INNER_LOOP_COUNT       20
 
 /**
- * flashes the channel number on the specified output pin
+ * starts a report of the channel number on the specified output pin;
+ * the flashes are queued by service() as the pin has room, and 
+ * performed by the output pin's tick() method.
+ * Flashes are short if the channel is empty.
  * 
  * @param  channel  the channel number to flash 
  * @param  channel  the output pin to flash on
+ * @param  pause    time to wait before the first flash, milliseconds
  */
-void ChannelSelector::reportChannel(int channel, DigitalOutputPin &outputPin) const
+void ChannelSelector::reportChannel(int channel
+                                   ,DigitalOutputPin &outputPin
+                                   ,unsigned int pause)
 {
      if ((channel > 0)&&(channel <= RECORDING_CHANNELS)){
-         outputPin.writeValue(LOW);
-         for (int ii=0; ii<channel; ++ii) {
-            outputPin.outputPulse(CSELCT_DISPLAY_CHANNEL_PULSE_WIDTH_MILS
-                                 ,CSELCT_DISPLAY_CHANNEL_SPACING_WIDTH_MILS
-                                 ,CSELCT_DISPLAY_CHANNEL_LEAD_MILS);
+         reportWidth = isChannelEmpty(channel)
+                     ? CSELCT_DISPLAY_EMPTY_PULSE_WIDTH_MILS
+                     : CSELCT_DISPLAY_CHANNEL_PULSE_WIDTH_MILS;
+
+         // a report already running on another pin is dropped
+         reportPin = &outputPin;
+         reportValue = channel;
+         reportBlinks = 0;
+         reportLead = CSELCT_DISPLAY_CHANNEL_LEAD_MILS;
+
+         // start with the highest digit
+         for (reportPlace=1; reportPlace * 10 <= reportValue; reportPlace *= 10) {
          }
+
+         outputPin.writeValue(LOW);
+         outputPin.queueStep(LOW, pause);
+         serviceReport();
      }
 }
 
+/**
+ * queues as much of the report in progress as its pin has room for
+ */
+void ChannelSelector::serviceReport()
+{
+   bool room = true;
+
+   while (reportPin && room) {
+      if (0 == reportBlinks) {
+         if (0 == reportPlace) {
+            // report is all queued
+            reportPin = 0;
+            break;
+         }
+
+         // a zero digit is one long blink
+         uint8_t digit = (reportValue / reportPlace) % 10;
+         reportPlace /= 10;
+         reportZero = (0 == digit);
+         reportBlinks = reportZero ? 1 : digit;
+      }
+
+      unsigned int width = reportZero
+                         ? reportWidth * CSELCT_DISPLAY_ZERO_WIDTH_FACTOR
+                         : reportWidth;
+      unsigned int hang = ((1 == reportBlinks) && (reportPlace > 0))
+                        ? CSELCT_DISPLAY_DIGIT_SPACING_MILS
+                        : CSELCT_DISPLAY_CHANNEL_SPACING_WIDTH_MILS;
+
+      room = reportPin->queuePulse(width, hang, reportLead);
+      if (room) {
+         --reportBlinks;
+      }
+   }
+}
+
+/**
+ * waits for the report in progress to be performed
+ */
+void ChannelSelector::finishReport()
+{
+   DigitalOutputPin *pin = reportPin;
+
+   while (reportPin) {
+      reportPin->finishPattern();
+      serviceReport();
+   }
+
+   if (pin) {
+      pin->finishPattern();
+   }
+}
+
 /**
  * Invokes readInputPulseMode method of DigitalInputPin
- * on the input pin.
+ * on the input pin. While a channel number is keyed in Morse,
+ * every press and release is reported instead.
  * 
  * @see DigitalInputPin::readInputPulseMode() 
  * 
@@ -64,7 +135,17 @@ void ChannelSelector::reportChannel(int channel, DigitalOutputPin &outputPin) co
  */
 bool ChannelSelector::readInputPulseMode()
 {
-   return inputPin.readInputPulseMode();
+   bool rtn = false;
+
+   if (entryActive) {
+      inputPin.determinePinState();
+      rtn = inputPin.hasChanged();
+   }
+   else {
+      rtn = inputPin.readInputPulseMode();
+   }
+
+   return rtn;
 }
 
 /**
@@ -76,29 +157,53 @@ void ChannelSelector::processInputPulseMode()
     int newChannel = currentChannel;
     bool keep_reporting = true;
     
+    // keyed digits are taken as they come
+    if (entryActive) {
+      processEntry();
+    }
+    
     // test for new state
-    if (inputPin.hasChanged()) {
+    else if (inputPin.hasChanged()) {
 
       // do something based on change of mode
       pinMode = inputPin.getCurrentPinMode();
       
       switch (pinMode) {
          case  PIN_MODE_SHORT_PULSE:
-            delay(CSELCT_PAUSE_BEFORE_REPORT_MILS);
-            reportChannel(currentChannel, shortPulseOutputPin);
+            // report runs on while the caller carries on
+            reportChannel(currentChannel
+                         ,shortPulseOutputPin
+                         ,CSELCT_PAUSE_BEFORE_REPORT_MILS);
             inputPin.setCurrentPinMode(PIN_MODE_IDLE);
             break;
             
          case PIN_MODE_LONG_PULSE:
             newChannel = currentChannel;
-            keep_reporting = true;
+            keep_reporting = !morseEntry;
             
             // reset pin mode so we can detect user selection
             inputPin.setCurrentPinMode(PIN_MODE_IDLE);
+
+            if (morseEntry) {
+               // one blink shows the number can be keyed;
+               // the caller carries on while it is
+               entryActive = true;
+               entryValue = 0;
+               entryDigits = 0;
+               entryPattern = 0;
+               entryElements = 0;
+               entryTime = millis();
+
+               longPulseOutputPin.writeValue(LOW);
+               longPulseOutputPin.queuePulse(CSELCT_DISPLAY_CHANNEL_PULSE_WIDTH_MILS
+                                            ,CSELCT_DISPLAY_CHANNEL_SPACING_WIDTH_MILS);
+            }
           
             while(keep_reporting) {
                 // report proposed new channel
+                // and wait for it to finish
                 reportChannel(newChannel, longPulseOutputPin);
+                finishReport();
                 
                 // give user chance to select it
                 for (int ii=0; ii<INNER_LOOP_COUNT; ii++) {
@@ -110,8 +215,9 @@ void ChannelSelector::processInputPulseMode()
                       currentChannel = newChannel;
                       
                       // report new channel on report pin
-                      delay(CSELCT_PAUSE_BEFORE_REPORT_MILS);
-                      reportChannel(currentChannel, shortPulseOutputPin);
+                      reportChannel(currentChannel
+                                   ,shortPulseOutputPin
+                                   ,CSELCT_PAUSE_BEFORE_REPORT_MILS);
                       break;
                    }
                 }
@@ -132,22 +238,212 @@ void ChannelSelector::processInputPulseMode()
       }; 
    } 
 }
+
+/**
+ * queues more of any channel report, and ends a digit or channel
+ * number keyed in Morse once the button has been up long enough;
+ * called from the main loop
+ */
+void ChannelSelector::service()
+{
+   serviceReport();
+
+   // gaps are timed from the button coming up
+   if (entryActive && (LOW == inputPin.getLogicalState())) {
+      long gap = millis() - entryTime;
+
+      if ((entryElements > 0) && (gap >= CSELCT_ENTRY_DIGIT_GAP_MILS)) {
+         if (!endEntryDigit()) {
+            // give up on a number with a mistake in it
+            entryValue = 0;
+            endEntry();
+         }
+      }
+      else if ((0 == entryElements) && (gap >= CSELCT_ENTRY_END_MILS)) {
+         endEntry();
+      }
+   }
+}
+
+/**
+ * takes a press or release of the input pin while a channel 
+ * number is keyed
+ */
+void ChannelSelector::processEntry()
+{
+   if (tonePin) {
+      // keying is heard as it is made
+      tonePin->writeLogicalValue(inputPin.getLogicalState());
+   }
+
+   if (LOW == inputPin.getLogicalState()) {
+      unsigned long width = inputPin.getLastPulse().duration;
+
+      // a digit longer than any Morse digit
+      // is kept invalid until it ends
+      if (entryElements <= CSELCT_MORSE_DIGIT_ELEMENTS) {
+         entryPattern = (entryPattern << 1) 
+                      | ((width >= CSELCT_ENTRY_DAH_MILS) ? 1 : 0);
+         ++entryElements;
+      }
+
+      entryTime = millis();
+   }
+}
+
+/**
+ * ends the digit being keyed
+ *
+ * @return  false if the elements keyed are not a digit
+ */
+bool ChannelSelector::endEntryDigit()
+{
+   int digit = decodeMorseDigit(entryPattern, entryElements);
+
+   // digits past the highest channel only keep the number too big
+   if ((digit >= 0) && (entryValue <= RECORDING_CHANNELS)) {
+      entryValue = entryValue * 10 + digit;
+   }
+
+   ++entryDigits;
+   entryPattern = 0;
+   entryElements = 0;
+
+   return (digit >= 0);
+}
+
+/**
+ * ends Morse entry, selecting the channel keyed if it is one
+ */
+void ChannelSelector::endEntry()
+{
+   bool accepted = (entryValue >= 1) && (entryValue <= RECORDING_CHANNELS);
+
+   entryActive = false;
+
+   if (accepted) {
+      currentChannel = entryValue;
+   }
+
+   // nothing keyed leaves the channel as it was, without a tone
+   if (tonePin && (entryDigits > 0)) {
+      tonePin->writeValue(LOW);
+
+      if (accepted) {
+         tonePin->queuePulse(CSELCT_TONE_ACCEPT_MILS, CSELCT_TONE_REJECT_MILS);
+      }
+      else {
+         for (uint8_t ii=0; ii<3; ++ii) {
+            tonePin->queuePulse(CSELCT_TONE_REJECT_MILS, CSELCT_TONE_REJECT_MILS);
+         }
+      }
+   }
+
+   // selected channel is reported either way
+   reportChannel(currentChannel
+                ,shortPulseOutputPin
+                ,CSELCT_PAUSE_BEFORE_REPORT_MILS);
+}
+
+/**
+ * decodes a Morse digit
+ * <p>
+ * Digits 0 to 5 are dits then dahs, as many dits as the digit, and
+ * digits 6 to 9 are dahs then dits, as many dahs as the digit less 5.
+ * 
+ * @param  pattern    elements, first in the highest bit, dah bits set
+ * @param  elements   number of elements
+ * 
+ * @return  the digit, or -1 if the elements are not a digit
+ */
+int ChannelSelector::decodeMorseDigit(uint8_t pattern, uint8_t elements)
+{
+   int rtn = -1;
+
+   if (CSELCT_MORSE_DIGIT_ELEMENTS == elements) {
+      for (uint8_t ii=0; (rtn < 0) && (ii<=CSELCT_MORSE_DIGIT_ELEMENTS); ++ii) {
+         uint8_t dahs_after  = 0x1F >> ii;
+         uint8_t dahs_before = (0x1F << (CSELCT_MORSE_DIGIT_ELEMENTS - ii)) & 0x1F;
+
+         if (pattern == dahs_after) {
+            rtn = ii;
+         }
+         else if ((ii > 0) && (ii < CSELCT_MORSE_DIGIT_ELEMENTS) && (pattern == dahs_before)) {
+            rtn = 5 + ii;
+         }
+      }
+   }
+
+   return rtn;
+}
    
 /**
  * Gets the text string associated with the specified channel
  * These strings correspond to the channel file names on the 
- * storage card.
+ * storage card. The name is made up in a buffer shared by all
+ * channels, and holds until the next call.
  * 
  * @param  ch       the channel number
  * 
  * @return  text string associated with current channel
  */
 char * ChannelSelector::getChannelName(unsigned int ch) const {
+    channelName[0] = 0;
+
     if ((1 <= ch ) && (ch <= RECORDING_CHANNELS)) {
-        return channelName[ch - 1];
-    }
-    else {
-        return "";
+        char digits[6];
+        uint8_t count = 0;
+
+        // digits come out lowest first
+        do {
+           digits[count++] = '0' + (ch % 10);
+           ch /= 10;
+        } while (ch > 0);
+
+        strcpy(channelName, CSELCT_CHANNEL_NAME_PREFIX);
+        char *cp = channelName + strlen(channelName);
+        while (count > 0) {
+           *cp++ = digits[--count];
+        }
+        strcpy(cp, CSELCT_CHANNEL_NAME_SUFFIX);
     }
+
+    return channelName;
 }
  
+
+/**
+ * marks a channel as holding a recording or not
+ * 
+ * @param  ch       the channel number
+ * @param  empty    true if the channel holds no recording
+ */
+void ChannelSelector::setChannelEmpty(unsigned int ch, bool empty) {
+    if ((1 <= ch ) && (ch <= RECORDING_CHANNELS)) {
+        uint8_t bit = 1 << ((ch - 1) % 8);
+
+        if (empty) {
+            emptyChannels[(ch - 1) / 8] |= bit;
+        }
+        else {
+            emptyChannels[(ch - 1) / 8] &= ~bit;
+        }
+    }
+}
+
+/**
+ * tests whether a channel was marked as holding no recording
+ * 
+ * @param  ch       the channel number
+ * 
+ * @return  true if the channel is marked empty
+ */
+bool ChannelSelector::isChannelEmpty(unsigned int ch) const {
+    bool rtn = false;
+
+    if ((1 <= ch ) && (ch <= RECORDING_CHANNELS)) {
+        rtn = (emptyChannels[(ch - 1) / 8] & (1 << ((ch - 1) % 8))) != 0;
+    }
+
+    return rtn;
+}
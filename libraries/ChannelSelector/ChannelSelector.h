@@ -37,12 +37,55 @@
 #include <DigitalPin.h>
 #include <DigitalPulse.h>
 
-#define RECORDING_CHANNELS                           4 
+/**
+ * channel selector constants
+ * <p>
+ * RECORDING_CHANNELS is the number of channels. Each channel takes
+ * two streams of the channel store, its recording and its seek 
+ * index, and the recording journal one more, so it can be at most
+ * (CSTORE_ENTRIES_MAX - 1) / 2, 41 with the store as laid out; the
+ * recorder will not build with more.
+ */
+#define RECORDING_CHANNELS                          40 
 #define CSELCT_DISPLAY_CHANNEL_PULSE_WIDTH_MILS    200
+#define CSELCT_DISPLAY_EMPTY_PULSE_WIDTH_MILS       40
 #define CSELCT_DISPLAY_CHANNEL_SPACING_WIDTH_MILS   80
 #define CSELCT_DISPLAY_CHANNEL_LEAD_MILS            20
+#define CSELCT_DISPLAY_DIGIT_SPACING_MILS          600
+#define CSELCT_DISPLAY_ZERO_WIDTH_FACTOR             3
 #define CSELCT_PAUSE_BEFORE_REPORT_MILS            400
 
+/**
+ * channel name constants
+ * <p>
+ * Channel names are made up when asked for, as the prefix, the
+ * channel number in decimal, and the suffix, so channels 1 to 4 keep
+ * the names chnl1.txt to chnl4.txt. CSELCT_CHANNEL_NAME_MAX holds the 
+ * longest name and its terminator.
+ */
+#define CSELCT_CHANNEL_NAME_PREFIX   "chnl"
+#define CSELCT_CHANNEL_NAME_SUFFIX   ".txt"
+#define CSELCT_CHANNEL_NAME_MAX      16
+
+/**
+ * Morse channel entry constants
+ * <p>
+ * A press of the selector button shorter than CSELCT_ENTRY_DAH_MILS
+ * is a dit, and a longer one a dah. A digit ends when the button has
+ * been up for CSELCT_ENTRY_DIGIT_GAP_MILS, and the channel number 
+ * when it has been up for CSELCT_ENTRY_END_MILS.
+ * <p>
+ * CSELCT_TONE_ACCEPT_MILS is the tone confirming a new channel, and
+ * CSELCT_TONE_REJECT_MILS the length of each of the three tones 
+ * sounded when a number is not understood or is not a channel.
+ */
+#define CSELCT_ENTRY_DAH_MILS          250
+#define CSELCT_ENTRY_DIGIT_GAP_MILS    700
+#define CSELCT_ENTRY_END_MILS         2000
+#define CSELCT_MORSE_DIGIT_ELEMENTS      5
+#define CSELCT_TONE_ACCEPT_MILS        300
+#define CSELCT_TONE_REJECT_MILS         60
+
 /**
   The Channel Selector uses one digital input pin, and two digital
   output pins.
@@ -57,8 +100,12 @@
   currently selected channel by blinking the short pulse 
   output pin for the number of times corresponding to the
   current channel number. For example, it will blink once
-  for channel 1, twice for channel 2 etc. After reporting
-  the current channel, CS returns to the idle mode.
+  for channel 1, twice for channel 2 etc. Channels above 9 are
+  blinked a decimal digit at a time, a zero digit as one long blink.
+  After reporting the current channel, CS returns to the idle mode. 
+  The blinks are queued on the output pin as it has room for them,
+  so the caller must keep calling the pin's tick() method and the 
+  CS service() method for them to appear.
 
   When CS enters the long pulse mode, it begin a loop where it
   reports to the long pulse output pin, starting with the currently
@@ -69,6 +116,15 @@
   last reported channel is made the new currently selected 
   channel, and the CS returns to an idle mode.
 
+  If Morse entry is enabled, the long pulse mode instead waits for
+  the channel number to be keyed in Morse digits on the input pin,
+  which the CS decodes as the caller carries on. The new channel 
+  is reported on the short pulse output pin, and confirmed by a 
+  tone if a tone pin was given.
+
+  Channels the caller has marked empty are reported with short
+  blinks, so the user can tell which channels hold a message.
+
   The CS can also report the current mode to any caller using 
   the gettCurrentChannel() method.
 
@@ -88,19 +144,84 @@ class ChannelSelector {
    DigitalOutputPin  &longPulseOutputPin; /** reference to long mode output pin */
    
    /** 
-    * stores the currently selected channel number 
+    * holds the last channel name made up by getChannelName()
     */
-   char *channelName[RECORDING_CHANNELS];
+   mutable char channelName[CSELCT_CHANNEL_NAME_MAX];
     
    int currentChannel; /** stores the currently selected channel number */
+
+   /** 
+    * bit (n-1)%8 of byte (n-1)/8 is set if channel n holds no recording 
+    */
+   uint8_t emptyChannels[(RECORDING_CHANNELS + 7) / 8];
+
+   DigitalOutputPin  *reportPin;  /** pin the report is queued on, 0 if none */
+   unsigned int reportValue;   /** channel being reported */
+   unsigned int reportPlace;   /** place value of the next digit, 0 after the last */
+   unsigned int reportWidth;   /** blink width for the channel reported */
+   unsigned int reportLead;    /** time before the next blink */
+   uint8_t reportBlinks;       /** blinks of the current digit not yet queued */
+   bool reportZero;            /** flag is true if the current digit is zero */
+
+   DigitalOutputPin  *tonePin;   /** pin echoing Morse entry, 0 if none */
+   bool morseEntry;     /** flag is true if channels are keyed in Morse */
+   bool entryActive;    /** flag is true while a channel number is keyed */
+   unsigned int entryValue;    /** digits decoded so far */
+   uint8_t entryDigits;        /** number of digits decoded */
+   uint8_t entryPattern;       /** elements of the digit being keyed, dah bits set */
+   uint8_t entryElements;      /** number of elements of the digit being keyed */
+   long entryTime;             /** time the button last came up */
    
   /**
-   * flashes the channel number on the specified output pin
+   * starts a report of the channel number on the specified output pin;
+   * the flashes are queued by service() as the pin has room, and 
+   * performed by the output pin's tick() method
    * 
    * @param  channel  the channel number to flash 
    * @param  channel  the output pin to flash on
+   * @param  pause    time to wait before the first flash, milliseconds
+   */
+   void reportChannel(int channel
+                     ,DigitalOutputPin &outputPin
+                     ,unsigned int pause = 0);
+
+  /**
+   * queues as much of the report in progress as its pin has room for
+   */
+   void serviceReport();
+
+  /**
+   * waits for the report in progress to be performed
+   */
+   void finishReport();
+
+  /**
+   * takes a press or release of the input pin while a channel 
+   * number is keyed
+   */
+   void processEntry();
+
+  /**
+   * ends the digit being keyed
+   *
+   * @return  false if the elements keyed are not a digit
+   */
+   bool endEntryDigit();
+
+  /**
+   * ends Morse entry, selecting the channel keyed if it is one
+   */
+   void endEntry();
+
+  /**
+   * decodes a Morse digit
+   * 
+   * @param  pattern    elements, first in the highest bit, dah bits set
+   * @param  elements   number of elements
+   * 
+   * @return  the digit, or -1 if the elements are not a digit
    */
-   void reportChannel(int channel, DigitalOutputPin &outputPin) const;
+   static int decodeMorseDigit(uint8_t pattern, uint8_t elements);
     
 public:
   /**
@@ -117,11 +238,24 @@ public:
    , shortPulseOutputPin(sp)
    , longPulseOutputPin(lp)
    , currentChannel(1)
+   , reportPin(0)
+   , reportValue(0)
+   , reportPlace(0)
+   , reportWidth(0)
+   , reportLead(0)
+   , reportBlinks(0)
+   , reportZero(false)
+   , tonePin(0)
+   , morseEntry(false)
+   , entryActive(false)
+   , entryValue(0)
+   , entryDigits(0)
+   , entryPattern(0)
+   , entryElements(0)
+   , entryTime(0)
    {
-      channelName[0] = "chnl1.txt";
-      channelName[1] = "chnl2.txt";
-      channelName[2] = "chnl3.txt";
-      channelName[3] = "chnl4.txt";
+      channelName[0] = 0;
+      memset(emptyChannels, 0, sizeof(emptyChannels));
    }
  
   /**
@@ -132,7 +266,8 @@ public:
   /**
    * Gets the text string associated with the specified channel
    * These strings correspond to the channel file names on the 
-   * storage card.
+   * storage card. The name is made up in a buffer shared by all
+   * channels, and holds until the next call.
    * 
    * @param  ch       the channel number
    * 
@@ -154,7 +289,8 @@ public:
  
   /**
    * Invokes readInputPulseMode method of DigitalInputPin
-   * on the input pin.
+   * on the input pin. While a channel number is keyed in Morse,
+   * every press and release is reported instead.
    * 
    * @see DigitalInputPin::readInputPulseMode() 
    * 
@@ -167,6 +303,41 @@ public:
    * updates pulse mode
    */
     void processInputPulseMode();
+
+  /**
+   * queues more of any channel report, and ends a digit or channel
+   * number keyed in Morse once the button has been up long enough;
+   * called from the main loop
+   */
+    void service();
+
+  /**
+   * makes the long pulse mode take a channel number keyed in Morse
+   * digits, rather than stepping through the channels
+   * 
+   * @param  tone     if not 0, the output pin echoing the keying 
+   *                  and sounding the confirmation
+   */
+    void enableMorseEntry(DigitalOutputPin *tone = 0) {
+       morseEntry = true;
+       tonePin = tone;
+    }
+
+  /**
+   * abandons any channel number being keyed
+   */
+    void cancelEntry() {
+       entryActive = false;
+    }
+
+  /**
+   * tests whether a channel number is being keyed
+   * 
+   * @return  true if Morse entry is in progress
+   */
+    bool isEntryActive() const {
+       return entryActive;
+    }
     
 
    /**
@@ -177,6 +348,23 @@ public:
    int getCurrentChannel() {
     return currentChannel;
    }
+
+  /**
+   * marks a channel as holding a recording or not
+   * 
+   * @param  ch       the channel number
+   * @param  empty    true if the channel holds no recording
+   */
+   void setChannelEmpty(unsigned int ch, bool empty);
+
+  /**
+   * tests whether a channel was marked as holding no recording
+   * 
+   * @param  ch       the channel number
+   * 
+   * @return  true if the channel is marked empty
+   */
+   bool isChannelEmpty(unsigned int ch) const;
 };
 
 #endif // _CHANNELSELECTOR_H_
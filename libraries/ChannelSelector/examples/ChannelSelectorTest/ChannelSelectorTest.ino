@@ -101,6 +101,10 @@ void loop() {
         Serial.println(ChannelSelect.getCurrentChannelName());
     }
    
+   // advance channel report flashes
+   ShortModePin.tick();
+   LongModePin.tick();
+   
    
    // delay in between reads for stability
    delay(LOOP_DELAY_MILS);      
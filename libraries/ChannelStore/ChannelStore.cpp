@@ -0,0 +1,597 @@
+/**
+ * @file    ChannelStore.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class implementations for ChannelStore and
+ * ChannelStream. The store keeps every channel in one container
+ * file on the SD card, opened once at reset, so starting a recording
+ * or playback needs no directory lookup or file open on the card.
+ */
+
+#include <Arduino.h>
+#include <ChannelStore.h>
+
+/**
+ * gets the container file position of a directory entry;
+ * entries do not cross sector boundaries
+ */
+static unsigned long entryAddress(uint8_t entry) {
+   return CSTORE_DIR_START
+        + (unsigned long)(entry / CSTORE_ENTRIES_PER_SECTOR) * CSTORE_SECTOR_SIZE
+        + (entry % CSTORE_ENTRIES_PER_SECTOR) * CSTORE_ENTRY_SIZE;
+}
+
+/**
+ * reads a little-endian field from a buffer
+ */
+static unsigned long getField(const uint8_t *buf, uint8_t size) {
+   unsigned long value = 0;
+
+   while (size-- > 0) {
+      value = (value << 8) | buf[size];
+   }
+
+   return value;
+}
+
+/**
+ * writes a little-endian field to a buffer
+ */
+static void setField(uint8_t *buf, unsigned long value, uint8_t size) {
+   for (uint8_t ii=0; ii<size; ++ii) {
+      buf[ii] = value & 0xFF;
+      value >>= 8;
+   }
+}
+
+/**
+ * opens the container, creating it if the card has none, and
+ * readies its spare extents; SD.begin() must have succeeded
+ *
+ * @param  name   container file name
+ * @param  buf    scratch buffer, kept to grow the container from;
+ *                it is zeroed when a container is created
+ * @param  len    size of buf, a whole number of sectors
+ *
+ * @return true if the container is ready
+ */
+bool ChannelStore::begin(const char *name, uint8_t *buf, unsigned int len) {
+   bool rtn = false;
+   uint8_t header[CSTORE_HEADER_EXTENTS + 2];
+
+   if (container) {
+      container.close();
+   }
+   extentCount = 0;
+   scratch = buf;
+   scratchSize = len;
+
+   if (SD.exists(name)) {
+      container = SD.open(name, O_READ | O_WRITE);
+      int len = container ? transfer(0, header, sizeof(header), false) : 0;
+
+      // only a container laid out as this one is used
+      rtn =  (sizeof(header) == len)
+          && (CSTORE_MAGIC_0 == header[0])
+          && (CSTORE_MAGIC_1 == header[1])
+          && (CSTORE_MAGIC_2 == header[2])
+          && (CSTORE_VERSION == header[3])
+          && (CSTORE_EXTENT_SECTORS == header[CSTORE_HEADER_EXTENT_SECTORS])
+          && (CSTORE_DIR_SECTORS    == header[CSTORE_HEADER_DIR_SECTORS])
+          && (CSTORE_LINK_SECTORS   == header[CSTORE_HEADER_LINK_SECTORS]);
+
+      if (rtn) {
+         extentCount = getField(header + CSTORE_HEADER_EXTENTS, 2);
+      }
+   }
+   else {
+      container = SD.open(name, O_READ | O_WRITE | O_CREAT);
+
+      if (container) {
+         memset(header, 0, sizeof(header));
+         header[0] = CSTORE_MAGIC_0;
+         header[1] = CSTORE_MAGIC_1;
+         header[2] = CSTORE_MAGIC_2;
+         header[3] = CSTORE_VERSION;
+         header[CSTORE_HEADER_EXTENT_SECTORS] = CSTORE_EXTENT_SECTORS;
+         header[CSTORE_HEADER_DIR_SECTORS]    = CSTORE_DIR_SECTORS;
+         header[CSTORE_HEADER_LINK_SECTORS]   = CSTORE_LINK_SECTORS;
+
+         // directory and link table start out as zeros,
+         // written a sector at a time before the header
+         memset(scratch, 0, scratchSize);
+         rtn =  extendTo(CSTORE_EXTENT_START)
+             && (transfer(0, header, sizeof(header), true) == sizeof(header));
+         container.flush();
+      }
+   }
+
+   // a file that is not a container is left alone
+   if (container && !rtn) {
+      container.close();
+   }
+
+   return rtn && reserve();
+}
+
+/**
+ * writes extents to the card until CSTORE_SPARE_EXTENTS are
+ * ready past the last one allocated; called when nothing is
+ * being recorded, as it may take several sector writes
+ *
+ * @return true if the spare extents are ready
+ */
+bool ChannelStore::reserve() {
+   bool rtn = false;
+
+   if (container) {
+      unsigned long extents = extentCount + CSTORE_SPARE_EXTENTS;
+      if (extents > CSTORE_EXTENTS_MAX) {
+         extents = CSTORE_EXTENTS_MAX;
+      }
+
+      unsigned long size = CSTORE_EXTENT_START + extents * CSTORE_EXTENT_SIZE;
+      rtn = (container.size() >= size);
+
+      if (!rtn) {
+         rtn = extendTo(size);
+         container.flush();
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * tests whether a stream holds any bytes
+ *
+ * @param  name   stream name
+ *
+ * @return true if the stream exists and is not empty
+ */
+bool ChannelStore::exists(const char *name) {
+   uint8_t free;
+   uint16_t first;
+   unsigned long len = 0;
+   uint8_t entry = findEntry(name, free);
+
+   return (CSTORE_ENTRY_NONE != entry) && readEntry(entry, first, len) && (len > 0);
+}
+
+/**
+ * opens a stream; O_CREAT creates it if need be, O_TRUNC empties
+ * it, and a stream opened with O_WRITE starts at its end
+ *
+ * @param  name   stream name, at most CSTORE_NAME_MAX characters
+ * @param  mode   combination of O_x flags
+ *
+ * @return the open stream, which tests false if it could not be opened
+ */
+ChannelStream ChannelStore::open(const char *name, uint8_t mode) {
+   ChannelStream rtn;
+   uint8_t free = CSTORE_ENTRY_NONE;
+   uint8_t entry = findEntry(name, free);
+
+   // a new stream takes the first free entry, whose
+   // extent and length fields have never been written
+   if (   (CSTORE_ENTRY_NONE == entry)
+       && (CSTORE_ENTRY_NONE != free)
+       && (mode & O_CREAT)
+       && (strlen(name) <= CSTORE_NAME_MAX)) {
+      char entry_name[CSTORE_NAME_MAX];
+      memset(entry_name, 0, CSTORE_NAME_MAX);
+      strncpy(entry_name, name, CSTORE_NAME_MAX);
+
+      if (transfer(entryAddress(free), (uint8_t *)entry_name, CSTORE_NAME_MAX, true) == CSTORE_NAME_MAX) {
+         entry = free;
+      }
+   }
+
+   if (   (CSTORE_ENTRY_NONE != entry)
+       && readEntry(entry, rtn.firstExtent, rtn.length)) {
+      rtn.store = this;
+      rtn.entry = entry;
+      rtn.writable = (0 != (mode & O_WRITE));
+
+      if (rtn.writable && (mode & O_TRUNC)) {
+         rtn.length = 0;
+         rtn.entryChanged = true;
+      }
+
+      // as SD.open(), writing starts at the end
+      if (rtn.writable) {
+         rtn.position_ = rtn.length;
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * empties a stream; it keeps its extents for reuse
+ *
+ * @param  name   stream name
+ *
+ * @return true if the stream was found
+ */
+bool ChannelStore::remove(const char *name) {
+   uint8_t free;
+   uint16_t first;
+   unsigned long len;
+   uint8_t entry = findEntry(name, free);
+
+   bool rtn =  (CSTORE_ENTRY_NONE != entry)
+            && readEntry(entry, first, len)
+            && writeEntry(entry, first, 0);
+   container.flush();
+
+   return rtn;
+}
+
+/**
+ * copies a file from the card into a stream of the same name,
+ * unless the stream already holds bytes; the file is left as it is
+ *
+ * @param  name   file name
+ * @param  buf    scratch buffer
+ * @param  len    size of buf
+ *
+ * @return true if a file was copied
+ */
+bool ChannelStore::importFile(const char *name, uint8_t *buf, unsigned int len) {
+   bool rtn = false;
+
+   if (container && !exists(name) && SD.exists(name)) {
+      File file = SD.open(name, O_READ);
+      ChannelStream stream = open(name, O_WRITE | O_CREAT | O_TRUNC);
+      int count = 0;
+
+      rtn = file && stream;
+      while (rtn && ((count = file.read(buf, len)) > 0)) {
+         rtn = (stream.write(buf, count) == (size_t)count);
+      }
+
+      stream.close();
+      file.close();
+   }
+
+   return rtn;
+}
+
+/**
+ * looks up a directory entry by name
+ *
+ * @param  name   stream name
+ * @param  free   if the name is not found, receives the first
+ *                free entry, or CSTORE_ENTRY_NONE
+ *
+ * @return entry number, or CSTORE_ENTRY_NONE if not found
+ */
+uint8_t ChannelStore::findEntry(const char *name, uint8_t &free) {
+   uint8_t rtn = CSTORE_ENTRY_NONE;
+   char entry_name[CSTORE_NAME_MAX];
+
+   free = CSTORE_ENTRY_NONE;
+
+   // entries are taken in order and never given back,
+   // so the first free entry ends the directory
+   for (uint8_t ii=0;
+        container && (CSTORE_ENTRY_NONE == rtn) && (CSTORE_ENTRY_NONE == free) && (ii<CSTORE_ENTRIES_MAX);
+        ++ii) {
+      if (transfer(entryAddress(ii), (uint8_t *)entry_name, CSTORE_NAME_MAX, false) == CSTORE_NAME_MAX) {
+         if (0 == entry_name[0]) {
+            free = ii;
+         }
+         else if (0 == strncmp(entry_name, name, CSTORE_NAME_MAX)) {
+            rtn = ii;
+         }
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * reads the first extent and length of a directory entry
+ *
+ * @param  entry  entry number
+ * @param  first  receives the first extent, or CSTORE_EXTENT_NONE
+ * @param  len    receives the length
+ *
+ * @return true if read
+ */
+bool ChannelStore::readEntry(uint8_t entry, uint16_t &first, unsigned long &len) {
+   uint8_t buf[CSTORE_ENTRY_LENGTH - CSTORE_ENTRY_FIRST + 4];
+   bool rtn = (transfer(entryAddress(entry) + CSTORE_ENTRY_FIRST, buf, sizeof(buf), false) == sizeof(buf));
+
+   if (rtn) {
+      // stored plus one, zero for none
+      first = getField(buf, 2) - 1;
+      len = getField(buf + CSTORE_ENTRY_LENGTH - CSTORE_ENTRY_FIRST, 4);
+   }
+
+   return rtn;
+}
+
+/**
+ * writes the first extent and length of a directory entry
+ *
+ * @param  entry  entry number
+ * @param  first  first extent, or CSTORE_EXTENT_NONE
+ * @param  len    length
+ *
+ * @return true if written
+ */
+bool ChannelStore::writeEntry(uint8_t entry, uint16_t first, unsigned long len) {
+   uint8_t buf[CSTORE_ENTRY_LENGTH - CSTORE_ENTRY_FIRST + 4];
+
+   // both fields in one write, as it is made on every flush
+   setField(buf, (uint16_t)(first + 1), 2);
+   setField(buf + CSTORE_ENTRY_LENGTH - CSTORE_ENTRY_FIRST, len, 4);
+
+   return (transfer(entryAddress(entry) + CSTORE_ENTRY_FIRST, buf, sizeof(buf), true) == sizeof(buf));
+}
+
+/**
+ * gets the extent following one in its stream
+ *
+ * @param  extent extent number
+ *
+ * @return next extent, or CSTORE_EXTENT_NONE
+ */
+uint16_t ChannelStore::getLink(uint16_t extent) {
+   uint8_t buf[2];
+   uint16_t rtn = CSTORE_EXTENT_NONE;
+
+   // stored plus one, zero for none
+   if (transfer(CSTORE_LINK_START + 2UL * extent, buf, 2, false) == 2) {
+      rtn = getField(buf, 2) - 1;
+   }
+
+   return rtn;
+}
+
+/**
+ * allocates an extent at the end of the container
+ *
+ * @param  prev   extent to link it after, or CSTORE_EXTENT_NONE
+ *
+ * @return new extent, or CSTORE_EXTENT_NONE if the store is full
+ */
+uint16_t ChannelStore::allocateExtent(uint16_t prev) {
+   uint16_t rtn = CSTORE_EXTENT_NONE;
+
+   // a new extent's own link is still zero; its bytes are
+   // spare ones written by reserve(), or are written as the
+   // gap before the next write beyond them
+   if (   (extentCount < CSTORE_EXTENTS_MAX)
+       && putField(CSTORE_HEADER_EXTENTS, extentCount + 1, 2)) {
+      rtn = extentCount++;
+
+      if (CSTORE_EXTENT_NONE != prev) {
+         putField(CSTORE_LINK_START + 2UL * prev, rtn + 1, 2);
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * grows the container to a size, writing the scratch buffer
+ * over and over; chunks end on sector boundaries
+ *
+ * @param  size     new container size
+ *
+ * @return true if the container is at least that size
+ */
+bool ChannelStore::extendTo(unsigned long size) {
+   unsigned long end = container.size();
+   bool rtn = (end >= size) || ((scratchSize > 0) && container.seek(end));
+
+   while (rtn && (end < size)) {
+      unsigned int chunk = scratchSize - end % scratchSize;
+      if (size - end < chunk) {
+         chunk = size - end;
+      }
+
+      rtn = (container.write(scratch, chunk) == chunk);
+      end += chunk;
+   }
+
+   return rtn;
+}
+
+/**
+ * reads or writes bytes of the container; a write past the end
+ * of the container first grows it to the write
+ *
+ * @param  address  container file position
+ * @param  buf      bytes to write, or destination of bytes read
+ * @param  len      number of bytes
+ * @param  write    true to write
+ *
+ * @return number of bytes read or written
+ */
+unsigned int ChannelStore::transfer(unsigned long address, uint8_t *buf, unsigned int len, bool write) {
+   unsigned int rtn = 0;
+   bool ready = (container.position() == address);
+
+   if (write && !ready && (address > container.size())) {
+      extendTo(address);
+   }
+
+   // the SD library only seeks within the file
+   ready = ready || container.seek(address);
+
+   if (ready && write) {
+      rtn = container.write(buf, len);
+   }
+   else if (ready) {
+      int count = container.read(buf, len);
+      rtn = (count > 0) ? count : 0;
+   }
+
+   return rtn;
+}
+
+/**
+ * writes a little-endian field of the container
+ *
+ * @param  address  container file position
+ * @param  value    value to write
+ * @param  size     bytes in the field
+ *
+ * @return true if written
+ */
+bool ChannelStore::putField(unsigned long address, unsigned long value, uint8_t size) {
+   uint8_t buf[4];
+
+   setField(buf, value, size);
+
+   return (transfer(address, buf, size, true) == size);
+}
+
+/**
+ * finds the extent holding the current position, following links
+ * from the cached extent, or from the first if it is behind
+ *
+ * @param  extend  true to allocate extents up to the position
+ *
+ * @return true if the position is in an extent
+ */
+bool ChannelStream::locate(bool extend) {
+   // links only lead forward
+   if ((CSTORE_EXTENT_NONE == currentExtent) || (position_ < extentStart)) {
+      currentExtent = firstExtent;
+      extentStart = 0;
+   }
+
+   if ((CSTORE_EXTENT_NONE == currentExtent) && extend) {
+      currentExtent = store->allocateExtent(CSTORE_EXTENT_NONE);
+      firstExtent = currentExtent;
+      entryChanged = true;
+   }
+
+   while (   (CSTORE_EXTENT_NONE != currentExtent)
+          && (position_ >= extentStart + CSTORE_EXTENT_SIZE)) {
+      uint16_t next = store->getLink(currentExtent);
+
+      if ((CSTORE_EXTENT_NONE == next) && extend) {
+         next = store->allocateExtent(currentExtent);
+      }
+
+      currentExtent = next;
+      extentStart += CSTORE_EXTENT_SIZE;
+   }
+
+   return (CSTORE_EXTENT_NONE != currentExtent);
+}
+
+/**
+ * reads or writes bytes at the current position
+ *
+ * @param  buf    bytes to write, or destination of bytes read
+ * @param  len    number of bytes
+ * @param  write  true to write
+ *
+ * @return number of bytes read or written
+ */
+unsigned int ChannelStream::transfer(uint8_t *buf, unsigned int len, bool write) {
+   unsigned int rtn = 0;
+   bool more = store && (writable || !write);
+
+   // reads stop at the end of the stream
+   if (more && !write && (len > length - position_)) {
+      len = length - position_;
+   }
+
+   // each pass stays within one extent
+   while (more && (rtn < len) && locate(write)) {
+      unsigned long offset = position_ - extentStart;
+      unsigned int chunk = len - rtn;
+
+      if (chunk > CSTORE_EXTENT_SIZE - offset) {
+         chunk = CSTORE_EXTENT_SIZE - offset;
+      }
+
+      unsigned int count = store->transfer(CSTORE_EXTENT_START
+                                             + (unsigned long)currentExtent * CSTORE_EXTENT_SIZE
+                                             + offset
+                                          ,buf + rtn
+                                          ,chunk
+                                          ,write);
+      rtn += count;
+      position_ += count;
+      more = (count == chunk);
+   }
+
+   if (position_ > length) {
+      length = position_;
+      entryChanged = true;
+   }
+
+   return rtn;
+}
+
+/**
+ * moves the current position
+ *
+ * @param  pos    new position, not past the end of the stream
+ *
+ * @return true if the stream holds the position
+ */
+bool ChannelStream::seek(unsigned long pos) {
+   bool rtn = store && (pos <= length);
+
+   if (rtn) {
+      position_ = pos;
+   }
+
+   return rtn;
+}
+
+/**
+ * records any change of length in the directory, and commits
+ * the container to the card
+ */
+void ChannelStream::flush() {
+   if (store) {
+      if (entryChanged) {
+         store->writeEntry(entry, firstExtent, length);
+         entryChanged = false;
+      }
+
+      store->container.flush();
+   }
+}
+
+/**
+ * flushes and closes the stream
+ */
+void ChannelStream::close() {
+   flush();
+   store = 0;
+}
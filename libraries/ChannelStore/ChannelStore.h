@@ -0,0 +1,449 @@
+#ifndef _CHANNEL_STORE_H_
+#define _CHANNEL_STORE_H_
+
+/**
+ * @file    ChannelStore.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class definitions for ChannelStore and
+ * ChannelStream. The store keeps every channel in one container
+ * file on the SD card, opened once at reset, so starting a recording
+ * or playback needs no directory lookup or file open on the card.
+ */
+
+#include <Arduino.h>
+#include <SD.h>
+
+/**
+ * container file layout
+ * <p>
+ * The container starts with a header sector: the magic bytes 'D' 'F'
+ * 'C', a version byte, the number of sectors in each extent, in the
+ * directory and in the link table, and the number of extents
+ * allocated, 16 bits little-endian at EXTENTS.
+ * <p>
+ * The directory follows, CSTORE_DIR_SECTORS sectors of
+ * CSTORE_ENTRY_SIZE byte entries, each naming a stream: a channel,
+ * its seek index, or the recording journal. An entry holds the name,
+ * zero padded, then little-endian the first extent of the stream and
+ * its length in bytes. An entry whose name starts with 0 is free.
+ * <p>
+ * The link table follows, 16 bits for each extent giving the next
+ * extent of its stream. Extents follow the link table, in the order
+ * they were allocated. Extent numbers are stored plus one, so a zero
+ * link or first extent means none, and a new table needs no setting up.
+ * <p>
+ * A stream keeps its extents when it is emptied, and the next
+ * recording under the same name writes over them in place.
+ * <p>
+ * The bytes of an extent past the end of its stream are never read,
+ * so the container is grown with whatever the scratch buffer holds,
+ * a sector at a time. CSTORE_SPARE_EXTENTS extents past the last one
+ * allocated are kept written to the card, when the container is
+ * begun and by reserve(), so allocating an extent only links it.
+ */
+#define CSTORE_MAGIC_0          'D'
+#define CSTORE_MAGIC_1          'F'
+#define CSTORE_MAGIC_2          'C'
+#define CSTORE_VERSION           1
+#define CSTORE_HEADER_EXTENT_SECTORS  4
+#define CSTORE_HEADER_DIR_SECTORS     5
+#define CSTORE_HEADER_LINK_SECTORS    6
+#define CSTORE_HEADER_EXTENTS         8
+
+#define CSTORE_SECTOR_SIZE     512
+#define CSTORE_EXTENT_SECTORS   16
+#define CSTORE_DIR_SECTORS       4
+#define CSTORE_LINK_SECTORS      4
+
+#define CSTORE_NAME_MAX         16
+#define CSTORE_ENTRY_FIRST      16
+#define CSTORE_ENTRY_LENGTH     18
+#define CSTORE_ENTRY_SIZE       24
+#define CSTORE_ENTRIES_PER_SECTOR  (CSTORE_SECTOR_SIZE / CSTORE_ENTRY_SIZE)
+#define CSTORE_ENTRIES_MAX      (CSTORE_DIR_SECTORS * CSTORE_ENTRIES_PER_SECTOR)
+
+#define CSTORE_EXTENT_SIZE      ((unsigned long)CSTORE_EXTENT_SECTORS * CSTORE_SECTOR_SIZE)
+#define CSTORE_EXTENTS_MAX      (CSTORE_LINK_SECTORS * CSTORE_SECTOR_SIZE / 2)
+#define CSTORE_DIR_START        CSTORE_SECTOR_SIZE
+#define CSTORE_LINK_START       (CSTORE_DIR_START + CSTORE_DIR_SECTORS * CSTORE_SECTOR_SIZE)
+#define CSTORE_EXTENT_START     ((unsigned long)CSTORE_LINK_START + CSTORE_LINK_SECTORS * CSTORE_SECTOR_SIZE)
+
+#define CSTORE_SPARE_EXTENTS     4
+
+#define CSTORE_EXTENT_NONE      0xFFFF
+#define CSTORE_ENTRY_NONE       0xFF
+
+class ChannelStore;
+
+/**
+ * A stream held in a channel store.
+ *
+ * Streams are used as File objects are, and only the File calls
+ * used by the recorder are provided. As with a File opened for
+ * writing, a stream opened for writing starts at its end, and
+ * cannot be positioned past its end.
+ */
+class ChannelStream {
+protected:
+  /** store holding the stream, 0 if not open  */
+   ChannelStore *store;
+
+  /** directory entry of the stream  */
+   uint8_t entry;
+
+  /** flag is true if the stream may be written  */
+   bool writable;
+
+  /** flag is true if the first extent or length has changed
+   *  since the directory entry was written
+   */
+   bool entryChanged;
+
+  /** first extent of the stream, or CSTORE_EXTENT_NONE  */
+   uint16_t firstExtent;
+
+  /** extent holding the last position located  */
+   uint16_t currentExtent;
+
+  /** stream position of the start of currentExtent  */
+   unsigned long extentStart;
+
+  /** length of the stream, bytes  */
+   unsigned long length;
+
+  /** current position in the stream  */
+   unsigned long position_;
+
+  /**
+   * finds the extent holding the current position, following links
+   * from the cached extent, or from the first if it is behind
+   *
+   * @param  extend  true to allocate extents up to the position
+   *
+   * @return true if the position is in an extent
+   */
+   bool locate(bool extend);
+
+  /**
+   * reads or writes bytes at the current position
+   *
+   * @param  buf    bytes to write, or destination of bytes read
+   * @param  len    number of bytes
+   * @param  write  true to write
+   *
+   * @return number of bytes read or written
+   */
+   unsigned int transfer(uint8_t *buf, unsigned int len, bool write);
+
+   friend class ChannelStore;
+
+public:
+  /**
+   * ChannelStream constructor
+   * creates stream that is not open
+   */
+   ChannelStream()
+   : store(0)
+   , entry(CSTORE_ENTRY_NONE)
+   , writable(false)
+   , entryChanged(false)
+   , firstExtent(CSTORE_EXTENT_NONE)
+   , currentExtent(CSTORE_EXTENT_NONE)
+   , extentStart(0)
+   , length(0)
+   , position_(0)
+   {}
+
+  /**
+   * tests whether the stream is open
+   */
+   operator bool() const {
+      return 0 != store;
+   }
+
+  /**
+   * reads bytes from the current position
+   *
+   * @param  buf    destination
+   * @param  len    number of bytes wanted
+   *
+   * @return number of bytes read, 0 at the end of the stream
+   */
+   int read(void *buf, uint16_t len) {
+      return transfer((uint8_t *)buf, len, false);
+   }
+
+  /**
+   * writes bytes at the current position, extending the stream
+   *
+   * @param  buf    bytes to write
+   * @param  len    number of bytes
+   *
+   * @return number of bytes written
+   */
+   size_t write(const uint8_t *buf, size_t len) {
+      return transfer((uint8_t *)buf, len, true);
+   }
+
+  /**
+   * writes one byte at the current position
+   *
+   * @param  b      byte to write
+   *
+   * @return number of bytes written
+   */
+   size_t write(uint8_t b) {
+      return transfer(&b, 1, true);
+   }
+
+  /**
+   * moves the current position
+   *
+   * @param  pos    new position, not past the end of the stream
+   *
+   * @return true if the stream holds the position
+   */
+   bool seek(unsigned long pos);
+
+  /**
+   * returns current position
+   */
+   unsigned long position() const {
+      return position_;
+   }
+
+  /**
+   * returns length of the stream
+   */
+   unsigned long size() const {
+      return length;
+   }
+
+  /**
+   * returns number of bytes after the current position, at most
+   * 0x7FFF as for a File
+   */
+   int available() const {
+      unsigned long rtn = length - position_;
+      return (rtn > 0x7FFF) ? 0x7FFF : (int)rtn;
+   }
+
+  /**
+   * records any change of length in the directory, and commits
+   * the container to the card
+   */
+   void flush();
+
+  /**
+   * flushes and closes the stream
+   */
+   void close();
+};
+
+/**
+ * The Channel Store keeps named streams in one container file.
+ *
+ * Names, and the open, exists and remove calls, are as for the SD
+ * library, so the store can stand in for it. The container is
+ * created when the store is begun on a card without one.
+ */
+class ChannelStore {
+protected:
+  /** container file, open from begin()  */
+   File container;
+
+  /** number of extents allocated  */
+   uint16_t extentCount;
+
+  /** buffer the container is grown from, given to begin()  */
+   uint8_t *scratch;
+
+  /** size of the scratch buffer, a whole number of sectors  */
+   unsigned int scratchSize;
+
+  /**
+   * looks up a directory entry by name
+   *
+   * @param  name   stream name
+   * @param  free   if the name is not found, receives the first
+   *                free entry, or CSTORE_ENTRY_NONE
+   *
+   * @return entry number, or CSTORE_ENTRY_NONE if not found
+   */
+   uint8_t findEntry(const char *name, uint8_t &free);
+
+  /**
+   * reads the first extent and length of a directory entry
+   *
+   * @param  entry  entry number
+   * @param  first  receives the first extent, or CSTORE_EXTENT_NONE
+   * @param  len    receives the length
+   *
+   * @return true if read
+   */
+   bool readEntry(uint8_t entry, uint16_t &first, unsigned long &len);
+
+  /**
+   * writes the first extent and length of a directory entry
+   *
+   * @param  entry  entry number
+   * @param  first  first extent, or CSTORE_EXTENT_NONE
+   * @param  len    length
+   *
+   * @return true if written
+   */
+   bool writeEntry(uint8_t entry, uint16_t first, unsigned long len);
+
+  /**
+   * gets the extent following one in its stream
+   *
+   * @param  extent extent number
+   *
+   * @return next extent, or CSTORE_EXTENT_NONE
+   */
+   uint16_t getLink(uint16_t extent);
+
+  /**
+   * allocates an extent at the end of the container
+   *
+   * @param  prev   extent to link it after, or CSTORE_EXTENT_NONE
+   *
+   * @return new extent, or CSTORE_EXTENT_NONE if the store is full
+   */
+   uint16_t allocateExtent(uint16_t prev);
+
+  /**
+   * grows the container to a size, writing the scratch buffer
+   * over and over
+   *
+   * @param  size     new container size
+   *
+   * @return true if the container is at least that size
+   */
+   bool extendTo(unsigned long size);
+
+  /**
+   * reads or writes bytes of the container; a write past the end
+   * of the container first grows it to the write
+   *
+   * @param  address  container file position
+   * @param  buf      bytes to write, or destination of bytes read
+   * @param  len      number of bytes
+   * @param  write    true to write
+   *
+   * @return number of bytes read or written
+   */
+   unsigned int transfer(unsigned long address, uint8_t *buf, unsigned int len, bool write);
+
+  /**
+   * writes a little-endian field of the container
+   *
+   * @param  address  container file position
+   * @param  value    value to write
+   * @param  size     bytes in the field
+   *
+   * @return true if written
+   */
+   bool putField(unsigned long address, unsigned long value, uint8_t size);
+
+   friend class ChannelStream;
+
+public:
+  /**
+   * ChannelStore constructor
+   */
+   ChannelStore()
+   : extentCount(0)
+   , scratch(0)
+   , scratchSize(0)
+   {}
+
+  /**
+   * opens the container, creating it if the card has none, and
+   * readies its spare extents; SD.begin() must have succeeded
+   *
+   * @param  name   container file name
+   * @param  buf    scratch buffer, kept to grow the container from;
+   *                it is zeroed when a container is created
+   * @param  len    size of buf, a whole number of sectors
+   *
+   * @return true if the container is ready
+   */
+   bool begin(const char *name, uint8_t *buf, unsigned int len);
+
+  /**
+   * writes extents to the card until CSTORE_SPARE_EXTENTS are
+   * ready past the last one allocated; called when nothing is
+   * being recorded, as it may take several sector writes
+   *
+   * @return true if the spare extents are ready
+   */
+   bool reserve();
+
+  /**
+   * tests whether a stream holds any bytes
+   *
+   * @param  name   stream name
+   *
+   * @return true if the stream exists and is not empty
+   */
+   bool exists(const char *name);
+
+  /**
+   * opens a stream; O_CREAT creates it if need be, O_TRUNC empties
+   * it, and a stream opened with O_WRITE starts at its end
+   *
+   * @param  name   stream name, at most CSTORE_NAME_MAX characters
+   * @param  mode   combination of O_x flags
+   *
+   * @return the open stream, which tests false if it could not be opened
+   */
+   ChannelStream open(const char *name, uint8_t mode);
+
+  /**
+   * empties a stream; it keeps its extents for reuse
+   *
+   * @param  name   stream name
+   *
+   * @return true if the stream was found
+   */
+   bool remove(const char *name);
+
+  /**
+   * copies a file from the card into a stream of the same name,
+   * unless the stream already holds bytes; the file is left as it is
+   *
+   * @param  name   file name
+   * @param  buf    scratch buffer
+   * @param  len    size of buf
+   *
+   * @return true if a file was copied
+   */
+   bool importFile(const char *name, uint8_t *buf, unsigned int len);
+};
+
+#endif // _CHANNEL_STORE_H_
@@ -72,13 +72,15 @@ void DigitalOutputPin::initialize() {
  */
 void DigitalOutputPin::suspend() {
    setState(initialState);
+   cancelPattern();
    DigitalPin::suspend(); 
 }
    
 /**
  * performs an output pulse on the pin
  * restoring the pin to the state it was in
- * before the pulse 
+ * before the pulse; returns when the pulse 
+ * and hang time are complete
  * 
  * @param  pulse_width_mils  width of pulse in milliseconds
  * @param  hang_time_mils    time to wait in intial state
@@ -96,53 +98,163 @@ void DigitalOutputPin::outputPulse(unsigned int pulse_width_mils
                                   ,int initial_state) {
 
    if (enabled) {
-      int init_state;
-      int pulse_state;
+      // let anything already queued finish first
+      finishPattern();
       
-      // save current state of pin for restoration later
-      int saved_state = state;
+      queuePulse(pulse_width_mils
+                ,hang_time_mils
+                ,lead_time_mils
+                ,initial_state);
       
-      // set up initial and pulsed state
-      switch (initial_state) {
-         default:
-               init_state  = LOW;
-         case  LOW:
-               pulse_state = HIGH;
-               break;
-               
-         case  HIGH:
-               pulse_state = LOW;
-               break;
-      };
+      // pin is left the way we found it when the pattern ends
+      finishPattern();
+   }
+}
+   
+/**
+ * queues an output pulse on the pin and returns at once;
+ * the pulse is performed by later calls to tick()
+ * 
+ * @param  pulse_width_mils  width of pulse in milliseconds
+ * @param  hang_time_mils    time to wait in intial state
+ *                           after pulse is performed, milliseconds
+ * @param  lead_time_mils    time to wait in intial state
+ *                           before pulse is performed, milliseconds
+ * @param  initial_state     pin is set to this state before pulse
+ *                           is performed; the pulse itself is 
+ *                           performed by raising the pin to the
+ *                           complementary state. Default value LOW.
+ * 
+ * @return true if the pulse was queued
+ */
+bool DigitalOutputPin::queuePulse(unsigned int pulse_width_mils
+                                 ,unsigned int hang_time_mils
+                                 ,unsigned int lead_time_mils
+                                 ,int initial_state) {
+   bool rtn = false;
+   
+   // a pulse takes at most three steps; it is queued whole or not at all
+   if (enabled && (patternCount + 3 <= DIGITAL_PIN_PATTERN_STEPS)) {
+      int init_state  = (HIGH == initial_state) ? HIGH : LOW;
+      int pulse_state = invertState(init_state);
       
-      // set pin to initial state
-      writeValue(initial_state);
+      queueStep(init_state,  lead_time_mils);
+      queueStep(pulse_state, pulse_width_mils);
+      queueStep(init_state,  hang_time_mils);
+      rtn = true;
+   }
+   
+   return rtn;
+}
+   
+/**
+ * queues one pattern step on the pin
+ * 
+ * @param  st        physical pin state during the step
+ * @param  mils      length of step, milliseconds
+ * 
+ * @return true if the step was queued
+ */
+bool DigitalOutputPin::queueStep(int st, unsigned int mils) {
+   bool rtn = false;
+   
+   if (enabled) {
+      uint16_t level = (LOW == st) ? 0 : DIGITAL_PIN_PATTERN_LEVEL;
+      
+      if (mils > DIGITAL_PIN_PATTERN_MAX_MILS) {
+         mils = DIGITAL_PIN_PATTERN_MAX_MILS;
+      }
       
-      // lead time if any
-      if (lead_time_mils > 0) {
-         delay(lead_time_mils);
+      if (0 == mils) {
+         // nothing to output
+         rtn = true;
       }
+      else if (0 == patternCount) {
+         // pattern starts now
+         patternHead = 0;
+         patternSteps[0] = level | mils;
+         patternCount = 1;
+         stepStartTime = millis();
+         digitalWrite(pinNumber, st);
+         rtn = true;
+      }
+      else {
+         uint8_t tail = (patternHead + patternCount - 1) 
+                      % DIGITAL_PIN_PATTERN_STEPS;
+         uint16_t tail_mils = patternSteps[tail] & DIGITAL_PIN_PATTERN_MAX_MILS;
          
-      // set pin to pulsed state
-      writeValue(pulse_state);
+         if (   ((patternSteps[tail] & DIGITAL_PIN_PATTERN_LEVEL) == level)
+             && (tail_mils + mils <= DIGITAL_PIN_PATTERN_MAX_MILS)) {
+            // same level as the last step, just make it longer
+            patternSteps[tail] = level | (tail_mils + mils);
+            rtn = true;
+         }
+         else if (patternCount < DIGITAL_PIN_PATTERN_STEPS) {
+            tail = (tail + 1) % DIGITAL_PIN_PATTERN_STEPS;
+            patternSteps[tail] = level | mils;
+            ++patternCount;
+            rtn = true;
+         }
+      }
+   }
+   
+   return rtn;
+}
+   
+/**
+ * advances any running pattern; called from the main loop
+ */
+void DigitalOutputPin::tick() {
+   if (patternCount > 0) {
+      unsigned long tm = millis();
       
-      // pulse time
-      if (pulse_width_mils > 0) {
-         delay(pulse_width_mils);
+      // move through every step that has run its time
+      while (   (patternCount > 0)
+             && (  (tm - stepStartTime) 
+                 >= (patternSteps[patternHead] & DIGITAL_PIN_PATTERN_MAX_MILS))) {
+         stepStartTime += patternSteps[patternHead] & DIGITAL_PIN_PATTERN_MAX_MILS;
+         patternHead = (patternHead + 1) % DIGITAL_PIN_PATTERN_STEPS;
+         --patternCount;
+         
+         if (patternCount > 0) {
+            digitalWrite(pinNumber
+                        ,(patternSteps[patternHead] & DIGITAL_PIN_PATTERN_LEVEL) 
+                        ? HIGH : LOW);
+         }
       }
-
-      // return pin to init state
-      writeValue(initial_state);
       
-      // hang time if any
-      if (hang_time_mils > 0) {
-         delay(hang_time_mils);
+      // pattern complete, stored state shows through again;
+      // the state may be set from an interrupt, so it is not
+      // let change between reading and writing it
+      if (0 == patternCount) {
+         noInterrupts();
+         writeState();
+         interrupts();
       }
-
-      // leave it the way we found it
-      writeValue(saved_state);
    }
 }
+   
+/**
+ * runs any queued pattern to completion before returning
+ */
+void DigitalOutputPin::finishPattern() {
+   while (patternCount > 0) {
+      tick();
+   }
+}
+   
+/**
+ * discards any queued pattern and restores the stored state
+ */
+void DigitalOutputPin::cancelPattern() {
+   if (patternCount > 0) {
+      noInterrupts();
+      patternCount = 0;
+      writeState();
+      interrupts();
+   }
+}
+
 /**
  * sets pulse mode on pin
  * 
@@ -220,7 +332,15 @@ void DigitalInputPin::processPinState(long tm, int priorState) {
  * reads physical pin state and applies debounce logic
  */
 void DigitalInputPin::determinePinState() {
-   if (enabled) {
+   if (enabled && edgeSource) {
+      // edges are captured by interrupt
+      determinePinStateFromEdges();
+   }
+   else if (enabled && debouncer) {
+      // pins are debounced together by port
+      determinePinStateFromDebouncer();
+   }
+   else if (enabled) {
       // save current pin state
       int priorState = state;
       
@@ -234,6 +354,12 @@ void DigitalInputPin::determinePinState() {
          // pin input has changed
          // - start debounce timing
          lastReadTime = tm;
+         
+         // first change starts a burst
+         if (!burstActive) {
+            burstStartTime = tm;
+            burstActive = true;
+         }
       }
       else {
          // pin input has not changed
@@ -242,6 +368,18 @@ void DigitalInputPin::determinePinState() {
             // age exceeds debounce threshold
             // - accept new  state
             setState(reading);
+            
+            // burst has settled, learn from its length
+            if (burstActive) {
+               burstActive = false;
+               learnBounce((lastReadTime - burstStartTime) * 1000UL);
+
+               // a change is stamped with the first edge of its 
+               // burst, so the wait adds no error to pulse times
+               if (state != priorState) {
+                  tm = burstStartTime;
+               }
+            }
          }
       } 
 
@@ -253,6 +391,182 @@ void DigitalInputPin::determinePinState() {
    }
 }
    
+/**
+ * takes edges from the edge source and applies debounce logic
+ * 
+ * The edges of a bounce burst are all in the ring, so the burst is 
+ * judged after the fact: once the level following the last edge has 
+ * held for the debounce threshold, the new state is accepted and 
+ * stamped with the time of the first edge of the burst. At most one 
+ * state change is accepted per call, so that callers see every pulse.
+ */
+void DigitalInputPin::determinePinStateFromEdges() {
+   // save current pin state
+   int priorState = state;
+   
+   // note both clocks together, so edge times
+   // can be converted to milliseconds
+   long tm = millis();
+   unsigned long now_us = micros();
+   unsigned long threshold_us = debounceThreshold * 1000UL;
+   bool settled = false;
+
+   while (!settled) {
+      const CapturedEdge *edge = edgeSource->peekEdge();
+
+      // an edge captured after the clocks were read is left for
+      // the next call, so no edge taken is later than now_us
+      if (edge && ((long)(edge->timeMicros - now_us) > 0)) {
+         edge = 0;
+      }
+
+      // has the level after the last edge held for the debounce
+      // threshold, either until the next edge or until now?
+      if (edgePending) {
+         unsigned long held_until = edge ? edge->timeMicros : now_us;
+         
+         if ((long)(held_until - lastEdgeMicros) > (long)threshold_us) {
+            edgePending = false;
+            learnBounce(lastEdgeMicros - burstStartMicros);
+            
+            if (lastReading != state) {
+               // accept new state
+               setState(lastReading);
+               tm -= (now_us - burstStartMicros) / 1000UL;
+               settled = true;
+            }
+         }
+      }
+
+      if (settled || !edge) {
+         break;
+      }
+
+      // take edge from source, first edge starts a burst
+      if (!edgePending) {
+         burstStartMicros = edge->timeMicros;
+         edgePending = true;
+      }
+      lastEdgeMicros = edge->timeMicros;
+      lastReading = edge->level;
+      edgeSource->dropEdge();
+   }
+
+   // process pin state
+   processPinState(tm, priorState);
+}
+
+/**
+ * takes debounced state from the port debouncer
+ * 
+ * The debouncer flags each pin whose debounced level has changed;
+ * the pin only has to look at its own flag.
+ */
+void DigitalInputPin::determinePinStateFromDebouncer() {
+   // save current pin state
+   int priorState = state;
+   long tm = millis();
+   
+   if (debouncer->takeChange(pinNumber)) {
+      // accept new state, stamped when it was first seen
+      setState(debouncer->readState(pinNumber));
+      tm = debouncer->getChangeTime(pinNumber);
+   }
+
+   // process pin state
+   processPinState(tm, priorState);
+}
+
+/**
+ * updates bounce estimate and debounce threshold 
+ * from the length of a settled burst
+ * 
+ * The estimate is a decaying maximum: a long burst raises it at once,
+ * and it then shrinks a little with each burst that follows, so one
+ * quiet spell does not undo what a bouncy one has shown.
+ * 
+ * @param  burst_us   time from first to last edge of the burst,
+ *                    microseconds
+ */
+void DigitalInputPin::learnBounce(unsigned long burst_us) {
+   if (adaptiveDebounce) {
+      unsigned long ceiling_us = debounceCeiling * 1000UL;
+      
+      // a pin chattering for longer than this is not bouncing
+      if (burst_us > ceiling_us) {
+         burst_us = ceiling_us;
+      }
+      
+      bounceEstimate -= bounceEstimate >> DIGITAL_PIN_BOUNCE_DECAY_SHIFT;
+      if (burst_us > bounceEstimate) {
+         bounceEstimate = burst_us;
+      }
+      
+      // wait must cover the estimate plus a margin, 
+      // rounded up to whole milliseconds
+      unsigned long wait_us = bounceEstimate 
+                            + (bounceEstimate >> DIGITAL_PIN_BOUNCE_MARGIN_SHIFT);
+      long wait = (wait_us + 999UL) / 1000UL;
+      
+      if (wait < (long)debounceFloor) {
+         wait = debounceFloor;
+      }
+      else if (wait > (long)debounceCeiling) {
+         wait = debounceCeiling;
+      }
+      
+      debounceThreshold = wait;
+   }
+}
+
+/**
+ * starts learning the debounce threshold from the bounce bursts 
+ * seen on the pin, polled or from an edge source; the threshold 
+ * is at the ceiling until the first burst has settled, is then
+ * learned from it, and is kept between the limits
+ * 
+ * @param  floor_mils     shortest debounce threshold, milliseconds
+ * @param  ceiling_mils   longest debounce threshold, milliseconds
+ */
+void DigitalInputPin::enableAdaptiveDebounce(unsigned int floor_mils
+                                            ,unsigned int ceiling_mils) {
+   adaptiveDebounce = true;
+   debounceFloor = floor_mils;
+   debounceCeiling = (ceiling_mils < floor_mils) ? floor_mils : ceiling_mils;
+   debounceThreshold = debounceCeiling;
+   bounceEstimate = 0;
+}
+
+/**
+ * switches the pin from polling to an interrupt edge source
+ * 
+ * @param  ec    edge source already capturing this pin, 
+ *               or 0 to return to polling
+ */
+void DigitalInputPin::attachEdgeCapture(EdgeCapture *ec) {
+   edgeSource = ec;
+   edgePending = false;
+   
+   if (edgeSource) {
+      edgeSource->discardEdges();
+   }
+}
+   
+/**
+ * switches the pin from its own debounce logic to a shared
+ * port debouncer; the pin's debounce threshold is then unused
+ * 
+ * @param  pd    debouncer sampling this pin, 
+ *               or 0 to return to polling
+ */
+void DigitalInputPin::attachDebouncer(PortDebouncer *pd) {
+   debouncer = pd;
+   
+   if (debouncer) {
+      debouncer->takeChange(pinNumber);
+   }
+}
+   
 /**
  * forces pin state to value, and performs logic as though
  * the forced state had just been read
@@ -347,10 +661,31 @@ bool DigitalInputPin::readInputPulseMode() {
  */
 void DigitalInputPin::suspend() {
    setState(initialState);
+   burstActive = false;
    setCurrentPinMode(PIN_MODE_IDLE);
    DigitalPin::suspend();
 }
 
+/**
+ * enables all pin behaviors
+ */
+void DigitalInputPin::resume() {
+   if (edgeSource && !enabled) {
+      // edges seen while suspended are stale, 
+      // start again from the current pin level
+      edgeSource->discardEdges();
+      lastReading = digitalRead(pinNumber);
+      burstStartMicros = lastEdgeMicros = micros();
+      edgePending = (lastReading != state);
+   }
+   else if (debouncer && !enabled) {
+      // changes seen while suspended are stale
+      debouncer->takeChange(pinNumber);
+   }
+   
+   DigitalPin::resume();
+}
+
 /**
  * writes pulse description to the serial port
  */
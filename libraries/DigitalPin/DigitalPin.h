@@ -35,6 +35,8 @@
  
 #include <Arduino.h> 
 #include <DigitalPulse.h>
+#include <EdgeCapture.h>
+#include <PortDebouncer.h>
 
 /**
  * defined constants used by DigitalPin classes
@@ -48,6 +50,34 @@
 #define DIGITAL_PIN_WRITE_TO_SERIAL  true
 #define DIGITAL_PIN_SUPPRESS_SERIAL  false
 
+/**
+ * output pattern constants
+ * <p>
+ * DIGITAL_PIN_PATTERN_STEPS is the number of steps an output pin
+ * can hold queued. Adjacent steps at the same level are merged, so
+ * a train of N pulses takes about 2N steps.
+ * <p>
+ * Each step is stored in 16 bits, the top bit holding the physical 
+ * pin level and the rest the step length, so the longest single
+ * step is DIGITAL_PIN_PATTERN_MAX_MILS.
+ */
+#define DIGITAL_PIN_PATTERN_STEPS     12
+#define DIGITAL_PIN_PATTERN_LEVEL     0x8000
+#define DIGITAL_PIN_PATTERN_MAX_MILS  0x7FFF
+
+/**
+ * adaptive debounce constants
+ * <p>
+ * DIGITAL_PIN_BOUNCE_DECAY_SHIFT sets how quickly the bounce estimate
+ * forgets a long burst: each new burst first takes 1/2^shift off the 
+ * estimate, so it falls by about half every eleven bursts.
+ * <p>
+ * DIGITAL_PIN_BOUNCE_MARGIN_SHIFT sets the safety margin added to the
+ * bounce estimate to give the debounce wait, 1/2^shift of the estimate.
+ */
+#define DIGITAL_PIN_BOUNCE_DECAY_SHIFT   4
+#define DIGITAL_PIN_BOUNCE_MARGIN_SHIFT  1
+
 /**
  * enum for defined input pin pulse modes
  * 
@@ -208,6 +238,26 @@ public:
 class DigitalOutputPin : public DigitalPin {
 protected:
    
+  /**
+   * queued pattern steps, level in top bit, length in milliseconds
+   */
+   uint16_t patternSteps[DIGITAL_PIN_PATTERN_STEPS];
+   
+  /**
+   * index of the step being output
+   */
+   uint8_t patternHead;
+   
+  /**
+   * number of steps queued, including the one being output
+   */
+   uint8_t patternCount;
+   
+  /**
+   * time the current step started, milliseconds since reset
+   */
+   unsigned long stepStartTime;
+   
 public:   
 
   /**
@@ -225,6 +275,10 @@ public:
    * stores input value to pin logical state
    * writes stored logical state to pin
    * 
+   * May be called from an interrupt handler, as PlaybackEngine does
+   * from Timer1; the main loop then only writes the stored state, in
+   * tick() and cancelPattern(), with interrupts off.
+   * 
    * @param  val      value to set/write
    */
    void writeLogicalValue(int val) {
@@ -233,10 +287,15 @@ public:
    }
    
   /**
-   * writes stored physical state to pin
+   * writes stored physical state to pin; while a pattern is 
+   * running the state is only stored, and is written when the
+   * pattern finishes. Callers in the main loop of a pin also
+   * written from an interrupt must turn interrupts off around it.
    */
    void writeState() {
-      digitalWrite(pinNumber, getState());
+      if (0 == patternCount) {
+         digitalWrite(pinNumber, getState());
+      }
    }
    
   /**
@@ -254,7 +313,8 @@ public:
   /**
    * performs an output pulse on the pin
    * restoring the pin to the state it was in
-   * before the pulse 
+   * before the pulse; returns when the pulse 
+   * and hang time are complete
    * 
    * @param  pulse_width_mils  width of pulse in milliseconds
    * @param  hang_time_mils    time to wait in intial state
@@ -270,6 +330,61 @@ public:
                    ,unsigned int hang_time_mils = 0
                    ,unsigned int lead_time_mils = 0
                    ,int initial_state = LOW);
+   
+  /**
+   * queues an output pulse on the pin and returns at once;
+   * the pulse is performed by later calls to tick()
+   * 
+   * @param  pulse_width_mils  width of pulse in milliseconds
+   * @param  hang_time_mils    time to wait in intial state
+   *                           after pulse is performed, milliseconds
+   * @param  lead_time_mils    time to wait in intial state
+   *                           before pulse is performed, milliseconds
+   * @param  initial_state     pin is set to this state before pulse
+   *                           is performed; the pulse itself is 
+   *                           performed by raising the pin to the
+   *                           complementary state. Default value LOW.
+   * 
+   * @return true if the pulse was queued
+   */
+   bool queuePulse(unsigned int pulse_width_mils
+                  ,unsigned int hang_time_mils = 0
+                  ,unsigned int lead_time_mils = 0
+                  ,int initial_state = LOW);
+   
+  /**
+   * queues one pattern step on the pin
+   * 
+   * @param  st        physical pin state during the step
+   * @param  mils      length of step, milliseconds
+   * 
+   * @return true if the step was queued
+   */
+   bool queueStep(int st, unsigned int mils);
+   
+  /**
+   * advances any running pattern; called from the main loop
+   */
+   void tick();
+   
+  /**
+   * runs any queued pattern to completion before returning
+   */
+   void finishPattern();
+   
+  /**
+   * discards any queued pattern and restores the stored state
+   */
+   void cancelPattern();
+   
+  /**
+   * returns pattern state
+   * 
+   * @return true while a pattern is running
+   */
+   bool patternActive() const {
+      return patternCount > 0;
+   }
                                   
   /**
    * DigitalPin Constructor
@@ -281,6 +396,9 @@ public:
                    , int ini_st
                    , bool invert = DIGITAL_PIN_NON_INVERTING)
    : DigitalPin(pn, OUTPUT, ini_st, invert)
+   , patternHead(0)
+   , patternCount(0)
+   , stepStartTime(0)
    {}
 };
 
@@ -326,22 +444,144 @@ protected:
    */
    bool writeToSerial;
 	
+  /**
+   * interrupt edge source, or 0 if the pin is polled
+   */
+   EdgeCapture *edgeSource;
+	
+  /**
+   * time of first edge of the burst being debounced, microseconds
+   */
+   unsigned long burstStartMicros;
+	
+  /**
+   * time of last edge taken from the edge source, microseconds
+   */
+   unsigned long lastEdgeMicros;
+	
+  /**
+   * flag is true while a burst of edges has not yet settled
+   */
+   bool edgePending;
+	
+  /**
+   * shared port debouncer, or 0 if the pin debounces itself
+   */
+   PortDebouncer *debouncer;
+	
+  /**
+   * time of first reading change of the burst being debounced
+   */
+   long burstStartTime;
+	
+  /**
+   * flag is true while polled readings have not yet settled
+   */
+   bool burstActive;
+	
+  /**
+   * flag is true if the debounce threshold is learned from bursts
+   */
+   bool adaptiveDebounce;
+	
+  /**
+   * limits on the learned debounce threshold, milliseconds
+   */
+   unsigned int debounceFloor;
+   unsigned int debounceCeiling;
+	
+  /**
+   * decaying maximum of observed burst lengths, microseconds
+   */
+   unsigned long bounceEstimate;
+	
   /**
    * updates stored pulse on a state change
    */
    void processPinState(long tm, int priorState);
    
+  /**
+   * takes edges from the edge source and applies debounce logic
+   */
+   void determinePinStateFromEdges();
+   
+  /**
+   * takes debounced state from the port debouncer
+   */
+   void determinePinStateFromDebouncer();
+   
+  /**
+   * updates bounce estimate and debounce threshold 
+   * from the length of a settled burst
+   * 
+   * @param  burst_us   time from first to last edge of the burst,
+   *                    microseconds
+   */
+   void learnBounce(unsigned long burst_us);
+   
 public:   
   /**
    * disables all pin behaviors
    */
    virtual void suspend();
    
+  /**
+   * enables all pin behaviors
+   */
+   virtual void resume();
+   
   /**
    * reads physical pin state and applies debounce logic
    */
    void determinePinState();
    
+  /**
+   * switches the pin from polling to an interrupt edge source
+   * 
+   * @param  ec    edge source already capturing this pin, 
+   *               or 0 to return to polling
+   */
+   void attachEdgeCapture(EdgeCapture *ec);
+   
+  /**
+   * switches the pin from its own debounce logic to a shared
+   * port debouncer; the pin's debounce threshold is then unused
+   * 
+   * @param  pd    debouncer sampling this pin, 
+   *               or 0 to return to polling
+   */
+   void attachDebouncer(PortDebouncer *pd);
+   
+  /**
+   * starts learning the debounce threshold from the bounce bursts 
+   * seen on the pin, polled or from an edge source; the threshold 
+   * is at the ceiling until the first burst has settled, is then
+   * learned from it, and is kept between the limits
+   * 
+   * @param  floor_mils     shortest debounce threshold, milliseconds
+   * @param  ceiling_mils   longest debounce threshold, milliseconds
+   */
+   void enableAdaptiveDebounce(unsigned int floor_mils
+                              ,unsigned int ceiling_mils);
+   
+  /**
+   * returns debounce threshold, learned or fixed
+   * 
+   * @return  debounce threshold, milliseconds
+   */
+   long getDebounceThreshold() const {
+      return debounceThreshold;
+   }
+   
+  /**
+   * returns learned upper bound on bounce burst length
+   * 
+   * @return  bounce estimate, microseconds
+   */
+   unsigned long getBounceEstimate() const {
+      return bounceEstimate;
+   }
+   
   /**
    * forces pin state to value, and performs logic as though
    * the forced state had just been read
@@ -446,6 +686,17 @@ public:
    , stateChanged(false)
    , currentPinMode(PIN_MODE_IDLE)
    , writeToSerial(write_to_ser)
+   , edgeSource(0)
+   , burstStartMicros(0)
+   , lastEdgeMicros(0)
+   , edgePending(false)
+   , debouncer(0)
+   , burstStartTime(0L)
+   , burstActive(false)
+   , adaptiveDebounce(false)
+   , debounceFloor(dbt)
+   , debounceCeiling(dbt)
+   , bounceEstimate(0)
    { 
       setState(state); 
    }
@@ -0,0 +1,126 @@
+/**
+ * @file    EdgeCapture.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class implementation for EdgeCapture. This
+ * class timestamps every level change on an input pin from an interrupt
+ * handler, and queues the edges for the main loop to process.
+ */
+
+#include <Arduino.h>
+#include <EdgeCapture.h>
+
+#ifdef __AVR__
+   #include <avr/interrupt.h>
+#endif
+
+/**
+ * object receiving interrupts, if any
+ */
+EdgeCapture *EdgeCapture::activeCapture = 0;
+
+#ifdef __AVR__
+/**
+ * pin change interrupt vectors; each port has one vector shared by
+ * all of its pins, but only the captured pin is enabled in the mask
+ */
+#ifdef PCINT0_vect
+ISR(PCINT0_vect) { EdgeCapture::dispatchInterrupt(); }
+#endif
+#ifdef PCINT1_vect
+ISR(PCINT1_vect) { EdgeCapture::dispatchInterrupt(); }
+#endif
+#ifdef PCINT2_vect
+ISR(PCINT2_vect) { EdgeCapture::dispatchInterrupt(); }
+#endif
+#endif // __AVR__
+
+/**
+ * starts capturing edges on the pin
+ *
+ * @param  pn       pin number, already configured as an input
+ *
+ * @return true if an interrupt could be attached to the pin
+ */
+bool EdgeCapture::begin(uint8_t pn) {
+   bool rtn = false;
+
+   // only one pin can be captured at a time
+   end();
+
+   pinNumber = pn;
+   edges.discard();
+   activeCapture = this;
+
+#if defined(__AVR__)
+   if (NOT_AN_INTERRUPT != digitalPinToInterrupt(pn)) {
+      // external interrupt pin
+      attachInterrupt(digitalPinToInterrupt(pn)
+                     ,EdgeCapture::dispatchInterrupt
+                     ,CHANGE);
+      rtn = true;
+   }
+   else if (digitalPinToPCICR(pn)) {
+      // pin change interrupt, enable pin in mask then port group
+      *digitalPinToPCMSK(pn) |= _BV(digitalPinToPCMSKbit(pn));
+      *digitalPinToPCICR(pn) |= _BV(digitalPinToPCICRbit(pn));
+      rtn = true;
+   }
+#elif defined(ARDUINO) || defined(ARDUINO_HOST_SIM)
+   attachInterrupt(digitalPinToInterrupt(pn)
+                  ,EdgeCapture::dispatchInterrupt
+                  ,CHANGE);
+   rtn = true;
+#else
+   // plain host build: a test calls captureEdge() directly
+   rtn = true;
+#endif
+
+   if (!rtn) {
+      activeCapture = 0;
+   }
+
+   return rtn;
+}
+
+/**
+ * stops capturing edges
+ */
+void EdgeCapture::end() {
+   if (this == activeCapture) {
+#if defined(__AVR__)
+      if (NOT_AN_INTERRUPT != digitalPinToInterrupt(pinNumber)) {
+         detachInterrupt(digitalPinToInterrupt(pinNumber));
+      }
+      else if (digitalPinToPCICR(pinNumber)) {
+         *digitalPinToPCMSK(pinNumber) &= ~_BV(digitalPinToPCMSKbit(pinNumber));
+      }
+#elif defined(ARDUINO) || defined(ARDUINO_HOST_SIM)
+      detachInterrupt(digitalPinToInterrupt(pinNumber));
+#endif
+      activeCapture = 0;
+   }
+}
@@ -0,0 +1,180 @@
+#ifndef _EDGE_CAPTURE_H_
+#define _EDGE_CAPTURE_H_
+
+/**
+ * @file    EdgeCapture.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class definition for EdgeCapture. This class
+ * timestamps every level change on an input pin from an interrupt
+ * handler, and queues the edges for the main loop to process.
+ */
+
+#include <Arduino.h>
+#include <SpscRing.h>
+
+/**
+ * number of ring slots for captured edges, must be a power of two;
+ * one slot is always left empty
+ */
+#define EDGE_CAPTURE_RING_SIZE  16
+
+/**
+ * struct describing one captured pin level change
+ */
+struct CapturedEdge {
+  /**
+   * time of edge, microseconds since reset
+   */
+   unsigned long timeMicros;
+
+  /**
+   * physical pin level after the edge, in {LOW,HIGH}
+   */
+   uint8_t level;
+};
+
+/**
+ * The Edge Capture object watches one input pin with a pin change
+ * interrupt. The interrupt handler reads the pin level and stamps it
+ * with micros(), so edges are captured accurately even when the main
+ * loop is busy writing to the SD card or flashing indicators.
+ *
+ * Edges are passed to the main loop through a lock-free ring; the
+ * interrupt handler is the only producer and the main loop the only
+ * consumer. Debouncing is left to the consumer, which can see the
+ * whole burst of edges after the fact.
+ *
+ * On the AVR, pins with an external interrupt use attachInterrupt(),
+ * and all others use the pin change interrupt of their port. On a
+ * host build there is no hardware to attach; a simulator feeds edges
+ * in by calling captureEdge() directly.
+ *
+ * Only one EdgeCapture object can be active at a time.
+ */
+class EdgeCapture {
+protected:
+  /**
+   * captured edges waiting for the main loop
+   */
+   SpscRing<CapturedEdge, EDGE_CAPTURE_RING_SIZE> edges;
+
+  /**
+   * pin being watched
+   */
+   uint8_t pinNumber;
+
+  /**
+   * object receiving interrupts, if any
+   */
+   static EdgeCapture *activeCapture;
+
+public:
+  /**
+   * EdgeCapture constructor
+   */
+   EdgeCapture()
+   : pinNumber(0)
+   {}
+
+  /**
+   * starts capturing edges on the pin
+   *
+   * @param  pn       pin number, already configured as an input
+   *
+   * @return true if an interrupt could be attached to the pin
+   */
+   bool begin(uint8_t pn);
+
+  /**
+   * stops capturing edges
+   */
+   void end();
+
+  /**
+   * queues an edge; called from the interrupt handler, or by a
+   * simulator injecting edge timings on a host build
+   *
+   * @param  time_us  time of edge, microseconds since reset
+   * @param  level    physical pin level after the edge
+   */
+   void captureEdge(unsigned long time_us, uint8_t level) {
+      CapturedEdge edge;
+      edge.timeMicros = time_us;
+      edge.level = level;
+      edges.push(edge);
+   }
+
+  /**
+   * body of the interrupt handler; reads and queues pin level
+   */
+   void handleInterrupt() {
+      captureEdge(micros(), digitalRead(pinNumber));
+   }
+
+  /**
+   * dispatches an interrupt to the active capture object
+   */
+   static void dispatchInterrupt() {
+      if (activeCapture) {
+         activeCapture->handleInterrupt();
+      }
+   }
+
+  /**
+   * returns pointer to oldest queued edge without removing it
+   *
+   * @return pointer to edge, or 0 if no edges are queued
+   */
+   const CapturedEdge *peekEdge() const {
+      return edges.peek();
+   }
+
+  /**
+   * removes oldest queued edge
+   */
+   void dropEdge() {
+      edges.drop();
+   }
+
+  /**
+   * removes all queued edges
+   */
+   void discardEdges() {
+      edges.discard();
+   }
+
+  /**
+   * returns number of edges lost because the ring was full
+   *
+   * @return overrun count
+   */
+   uint16_t getOverrunCount() const {
+      return edges.getOverrunCount();
+   }
+};
+
+#endif // _EDGE_CAPTURE_H_
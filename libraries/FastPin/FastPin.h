@@ -0,0 +1,281 @@
+#ifndef _FAST_PIN_H_
+#define _FAST_PIN_H_
+
+/**
+ * @file    FastPin.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains template class definitions for FastPinPort,
+ * FastOutputPin and FastInputPin. These classes are compile time
+ * versions of DigitalOutputPin and DigitalInputPin: the pin number,
+ * inversion and mode are template parameters, so each access is
+ * reduced to a single port register instruction, with none of the
+ * table lookups done by digitalRead() and digitalWrite().
+ */
+
+#include <Arduino.h>
+
+/**
+ * port numbers used by FastPinPort
+ * <p>
+ * The Arduino UNO R3 maps digital pins 0-7 to port D, pins 8-13 to
+ * port B and pins 14-19 (analog pins A0-A5) to port C.
+ */
+#define FAST_PIN_PORT_D      0
+#define FAST_PIN_PORT_B      1
+#define FAST_PIN_PORT_C      2
+#define FAST_PIN_PORT_COUNT  3
+
+#ifndef __AVR__
+/**
+ * struct describing one simulated i/o port
+ * <p>
+ * Off the AVR the port registers are ordinary memory, so pin
+ * behavior can be run and checked on a host computer. The input
+ * register holds the level driven onto each pin from outside.
+ */
+struct FastPinRegisters {
+  /**
+   * input levels applied to the port pins
+   */
+   volatile uint8_t input;
+
+  /**
+   * data direction register, bit set for an output
+   */
+   volatile uint8_t ddr;
+
+  /**
+   * output register, or pull up enable for an input
+   */
+   volatile uint8_t port;
+};
+
+/**
+ * simulated port register file, indexed by FAST_PIN_PORT_x
+ */
+extern FastPinRegisters FastPinPortFile[FAST_PIN_PORT_COUNT];
+#endif
+
+/**
+ * Register access for one pin, resolved at compile time.
+ *
+ * Every function is inline and every register address is a constant,
+ * so on the AVR a set or clear compiles to one sbi or cbi instruction
+ * and a read to one sbic or sbis.
+ */
+template <uint8_t PIN>
+class FastPinPort {
+public:
+  /**
+   * port holding this pin, one of FAST_PIN_PORT_x
+   */
+   static const uint8_t port = (PIN < 8)  ? FAST_PIN_PORT_D
+                             : (PIN < 14) ? FAST_PIN_PORT_B
+                             :              FAST_PIN_PORT_C;
+
+  /**
+   * bit for this pin within its port
+   */
+   static const uint8_t mask = 1 << ((PIN < 8)  ? PIN
+                                   : (PIN < 14) ? PIN - 8
+                                   :              PIN - 14);
+
+#ifdef __AVR__
+  /**
+   * returns output register for the pin
+   */
+   static volatile uint8_t &outputRegister() {
+      return (FAST_PIN_PORT_D == port) ? PORTD
+           : (FAST_PIN_PORT_B == port) ? PORTB
+           :                             PORTC;
+   }
+
+  /**
+   * returns data direction register for the pin
+   */
+   static volatile uint8_t &directionRegister() {
+      return (FAST_PIN_PORT_D == port) ? DDRD
+           : (FAST_PIN_PORT_B == port) ? DDRB
+           :                             DDRC;
+   }
+
+  /**
+   * returns true if the pin is at a HIGH level
+   */
+   static bool readLevel() {
+      return 0 != (((FAST_PIN_PORT_D == port) ? PIND
+                  : (FAST_PIN_PORT_B == port) ? PINB
+                  :                             PINC) & mask);
+   }
+#else
+  /**
+   * returns output register for the pin
+   */
+   static volatile uint8_t &outputRegister() {
+      return FastPinPortFile[port].port;
+   }
+
+  /**
+   * returns data direction register for the pin
+   */
+   static volatile uint8_t &directionRegister() {
+      return FastPinPortFile[port].ddr;
+   }
+
+  /**
+   * returns true if the pin is at a HIGH level; like the hardware,
+   * an output reads back the level it is driving
+   */
+   static bool readLevel() {
+      const FastPinRegisters &regs = FastPinPortFile[port];
+      return 0 != (((regs.input & ~regs.ddr) | (regs.port & regs.ddr)) & mask);
+   }
+#endif
+
+  /**
+   * sets the pin's bit in its output register
+   */
+   static void setOutputBit() {
+      outputRegister() |= mask;
+   }
+
+  /**
+   * clears the pin's bit in its output register
+   */
+   static void clearOutputBit() {
+      outputRegister() &= ~mask;
+   }
+};
+
+/**
+ * This class represents an output hardware pin fixed at compile time.
+ *
+ * It holds no data; the pin state is kept in the port output register
+ * and read back from there, so an object takes no RAM and all of its
+ * functions are static. Unlike DigitalOutputPin there are no flash
+ * patterns and no suspend or resume.
+ */
+template <uint8_t PIN, bool INVERT = false>
+class FastOutputPin {
+public:
+  /**
+   * performs hardware pin initializations
+   *
+   * @param  ini_st   initial physical pin state
+   */
+   static void initialize(int ini_st = LOW) {
+      writeValue(ini_st);
+      FastPinPort<PIN>::directionRegister() |= FastPinPort<PIN>::mask;
+   }
+
+  /**
+   * writes physical state to pin
+   *
+   * @param  val      value to write, LOW or other
+   */
+   static void writeValue(int val) {
+      if (LOW == val) {
+         FastPinPort<PIN>::clearOutputBit();
+      }
+      else {
+         FastPinPort<PIN>::setOutputBit();
+      }
+   }
+
+  /**
+   * writes logical state to pin considering the inversion flag
+   *
+   * @param  val      value to write, LOW or other
+   */
+   static void writeLogicalValue(int val) {
+      writeValue(INVERT ? (LOW == val) : (LOW != val));
+   }
+
+  /**
+   * returns physical state of pin
+   *
+   * @return a physical state value from {LOW,HIGH}
+   */
+   static int getState() {
+      return (FastPinPort<PIN>::outputRegister() & FastPinPort<PIN>::mask)
+             ? HIGH : LOW;
+   }
+
+  /**
+   * returns logical state of pin
+   *
+   * @return a logical state value from {LOW,HIGH}
+   */
+   static int getLogicalState() {
+      return ((HIGH == getState()) != INVERT) ? HIGH : LOW;
+   }
+};
+
+/**
+ * This class represents an input hardware pin fixed at compile time.
+ *
+ * Like FastOutputPin it holds no data and all of its functions are
+ * static. Reads are not debounced; debounce logic is left to the
+ * caller, as the pin may be read from an interrupt handler.
+ */
+template <uint8_t PIN, uint8_t MODE = INPUT_PULLUP, bool INVERT = false>
+class FastInputPin {
+public:
+  /**
+   * performs hardware pin initializations
+   */
+   static void initialize() {
+      FastPinPort<PIN>::directionRegister() &= ~FastPinPort<PIN>::mask;
+
+      if (INPUT_PULLUP == MODE) {
+         FastPinPort<PIN>::setOutputBit();
+      }
+      else {
+         FastPinPort<PIN>::clearOutputBit();
+      }
+   }
+
+  /**
+   * reads physical state of pin
+   *
+   * @return a physical state value from {LOW,HIGH}
+   */
+   static int readValue() {
+      return FastPinPort<PIN>::readLevel() ? HIGH : LOW;
+   }
+
+  /**
+   * reads logical state of pin considering the inversion flag
+   *
+   * @return a logical state value from {LOW,HIGH}
+   */
+   static int readLogicalValue() {
+      return (FastPinPort<PIN>::readLevel() != INVERT) ? HIGH : LOW;
+   }
+};
+
+#endif // _FAST_PIN_H_
@@ -0,0 +1,69 @@
+/**
+ * @file    FastPinTest.ino
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the 
+ * Free Software Foundation, Inc., 
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This an example sketch using the FastInputPin and FastOutputPin
+ * templates. The state of a key on the input pin is copied to an
+ * output pin on every pass through the loop, each read and write
+ * taking a single port instruction.
+ */
+ 
+#include <FastPin.h>
+
+/**
+ * local constants
+ */
+#define KEY_INPUT_PIN         2
+#define KEYING_OUTPUT_PIN     9
+#define SPEAKER_OUTPUT_PIN    7
+
+/**
+ * pin representations
+ */
+typedef FastInputPin<KEY_INPUT_PIN, INPUT_PULLUP, true> KeyingInput;
+typedef FastOutputPin<KEYING_OUTPUT_PIN, true>          KeyingOutput;
+typedef FastOutputPin<SPEAKER_OUTPUT_PIN>               SpeakerOutput;
+
+/**
+ * initialization performed at reset
+ */
+void setup() {
+  // initialize digital pin hardware
+  KeyingInput::initialize();
+  KeyingOutput::initialize(HIGH);
+  SpeakerOutput::initialize(LOW);
+}
+
+/**
+ * main loop
+ */
+void loop() {
+   // pass key state through, no debounce
+   int st = KeyingInput::readLogicalValue();
+   
+   KeyingOutput::writeLogicalValue(st);
+   SpeakerOutput::writeLogicalValue(st);
+}
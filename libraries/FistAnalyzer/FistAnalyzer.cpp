@@ -0,0 +1,356 @@
+/**
+ * @file    FistAnalyzer.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class implementations for FistAccumulator
+ * and FistAnalyzer. These classes measure how a pulse train was
+ * keyed, in fixed memory, as the pulses arrive.
+ */
+
+#include <Arduino.h>
+#include <FistAnalyzer.h>
+#include <math.h>
+
+/**
+ * counts a length in a histogram, halving every bin if the
+ * one counted is full
+ *
+ * @param  bins   histogram, FIST_HISTOGRAM_BINS bins
+ * @param  bin    bin number, the last bin if over
+ */
+static void countBin(uint8_t *bins, unsigned long bin) {
+   if (bin >= FIST_HISTOGRAM_BINS) {
+      bin = FIST_HISTOGRAM_BINS - 1;
+   }
+
+   if (0xFF == bins[bin]) {
+      for (uint8_t ii=0; ii<FIST_HISTOGRAM_BINS; ++ii) {
+         bins[ii] >>= 1;
+      }
+   }
+
+   ++bins[bin];
+}
+
+/**
+ * rounds a ratio to a header field byte
+ *
+ * @param  value  ratio, in the units of the field
+ *
+ * @return value rounded, held between 0 and 255
+ */
+static uint8_t toField(float value) {
+   uint8_t rtn = 0xFF;
+
+   if (value < 0) {
+      rtn = 0;
+   }
+   else if (value < 254.5) {
+      rtn = (uint8_t)(value + 0.5);
+   }
+
+   return rtn;
+}
+
+/**
+ * adds a length to the series; the count stops at its limit,
+ * after which later lengths weigh a little more than earlier ones
+ *
+ * @param  len    length, milliseconds
+ */
+void FistAccumulator::add(float len) {
+   if (count < 0xFFFF) {
+      ++count;
+   }
+
+   float delta = len - mean;
+
+   mean += delta / count;
+   m2   += delta * (len - mean);
+}
+
+/**
+ * gets the standard deviation of the lengths
+ *
+ * @return standard deviation, milliseconds
+ */
+float FistAccumulator::getDeviation() const {
+   float rtn = 0;
+
+   if (count > 1) {
+      rtn = sqrt(m2 / (count - 1));
+   }
+
+   return rtn;
+}
+
+/**
+ * empties every measure, ready for a new pulse train
+ */
+void FistAnalyzer::reset() {
+   ditMarks.reset();
+   dahMarks.reset();
+   elementSpaces.reset();
+   letterSpaces.reset();
+   wordSpaces.reset();
+
+   speedCount = 0;
+   timeMean = 0;
+   speedMean = 0;
+   timeM2 = 0;
+   coMoment = 0;
+
+   memset(markBins, 0, sizeof(markBins));
+   memset(spaceBins, 0, sizeof(spaceBins));
+
+   unit = (uint16_t)FIST_UNIT_DEFAULT_MILS << 4;
+   letter = 3UL * unit;
+   heldSpace = 0;
+   firstStart = 0;
+   lastEnd = 0;
+   lastLength = 0;
+   lastDah = false;
+   started = false;
+}
+
+/**
+ * sets the running unit length, keeping it within range
+ *
+ * @param  unit16 unit length, sixteenths of a millisecond
+ */
+void FistAnalyzer::setUnit(unsigned long unit16) {
+   if (unit16 < ((unsigned long)FIST_UNIT_MIN_MILS << 4)) {
+      unit16 = (unsigned long)FIST_UNIT_MIN_MILS << 4;
+   }
+   else if (unit16 > ((unsigned long)FIST_UNIT_MAX_MILS << 4)) {
+      unit16 = (unsigned long)FIST_UNIT_MAX_MILS << 4;
+   }
+
+   unit = unit16;
+}
+
+/**
+ * adds a speed sample to the drift fit
+ *
+ * @param  minutes  time from the first pulse
+ * @param  wpm      speed implied by an element and its space
+ */
+void FistAnalyzer::addSpeed(float minutes, float wpm) {
+   if (speedCount < 0xFFFF) {
+      ++speedCount;
+   }
+
+   // the co-moment takes the time difference from the old mean
+   // and the speed difference from the new
+   float dt = minutes - timeMean;
+
+   timeMean  += dt / speedCount;
+   speedMean += (wpm - speedMean) / speedCount;
+   coMoment  += dt * (wpm - speedMean);
+   timeM2    += dt * (minutes - timeMean);
+}
+
+/**
+ * takes a space between characters, sorting it against the
+ * running letter space
+ *
+ * @param  space  space length, milliseconds
+ */
+void FistAnalyzer::addCharacterSpace(long space) {
+   unsigned long space16 = (unsigned long)space << 4;
+
+   // letter spaces run a little long, so one over half as
+   // long again as the running letter space is a word space
+   if ((space16 << 1) < 3 * letter) {
+      releaseHeldSpace();
+      letterSpaces.add(space);
+      letter = (unsigned long)((long)letter + ((long)space16 - (long)letter) / 8);
+      countBin(spaceBins, space16 * FIST_SPACE_BINS_PER_UNIT / unit);
+   }
+   else if ((heldSpace > 0) && ((labs(space - (long)heldSpace) << 2) <= (long)heldSpace)) {
+      // two like spaces running are stretched letter spaces
+      letterSpaces.add(heldSpace);
+      letterSpaces.add(space);
+      letter = ((unsigned long)heldSpace + space) << 3;
+      countBin(spaceBins, ((unsigned long)heldSpace << 4) * FIST_SPACE_BINS_PER_UNIT / unit);
+      countBin(spaceBins, space16 * FIST_SPACE_BINS_PER_UNIT / unit);
+      heldSpace = 0;
+   }
+   else {
+      releaseHeldSpace();
+      heldSpace = space;
+   }
+}
+
+/**
+ * counts the held space as a word space, unless it is a pause
+ */
+void FistAnalyzer::releaseHeldSpace() {
+   if ((heldSpace > 0) && isWordSpace(heldSpace)) {
+      wordSpaces.add(heldSpace);
+      countBin(spaceBins, ((unsigned long)heldSpace << 4) * FIST_SPACE_BINS_PER_UNIT / unit);
+   }
+
+   heldSpace = 0;
+}
+
+/**
+ * takes the next pulse; pulses must be given in order
+ *
+ * @param  start_time   pulse start, milliseconds
+ * @param  end_time     pulse end, milliseconds
+ */
+void FistAnalyzer::addPulse(long start_time, long end_time) {
+   long len = end_time - start_time;
+
+   if (len > 0) {
+      // anything much over the longest dah is as good as a dah
+      if (len > 8L * FIST_UNIT_MAX_MILS) {
+         len = 8L * FIST_UNIT_MAX_MILS;
+      }
+
+      if (started) {
+         long space = start_time - lastEnd;
+
+         // pauses are not keying, and are left out
+         unsigned long space16 = (unsigned long)space << 4;
+
+         if (   (space > 0) 
+             && (space < (long)FIST_PAUSE_UNITS * FIST_UNIT_MAX_MILS)) {
+            if (space16 < (unsigned long)FIST_LETTER_UNITS * unit) {
+               elementSpaces.add(space);
+               countBin(spaceBins, space16 * FIST_SPACE_BINS_PER_UNIT / unit);
+
+               // a PARIS dit and its space are 2400 ms divided by
+               // the speed, and a dah and its space twice that
+               addSpeed((lastEnd - firstStart) / 60000.0
+                       ,(lastDah ? 4800.0 : 2400.0) / (lastLength + space));
+            }
+            else {
+               addCharacterSpace(space);
+            }
+         }
+         else if (space > 0) {
+            releaseHeldSpace();
+         }
+      }
+      else {
+         firstStart = start_time;
+         started = true;
+      }
+
+      // the mark is measured against the unit before it moves
+      unsigned long len16 = (unsigned long)len << 4;
+      bool is_dah = (len16 > (unsigned long)FIST_DAH_UNITS * unit);
+      unsigned long target = is_dah ? (len16 / 3) : len16;
+
+      countBin(markBins, len16 * FIST_MARK_BINS_PER_UNIT / unit);
+
+      if (is_dah) {
+         dahMarks.add(len);
+      }
+      else {
+         ditMarks.add(len);
+      }
+
+      if (   (is_dah && (target > ((unsigned long)unit << 1)))
+          || (!is_dah && (target < ((unsigned long)unit >> 1)))) {
+         // much slower or faster, go halfway at once
+         setUnit((unit + target) >> 1);
+      }
+      else {
+         setUnit((unsigned long)((long)unit + ((long)target - (long)unit) / 8));
+      }
+
+      lastEnd = end_time;
+      lastLength = len;
+      lastDah = is_dah;
+   }
+}
+
+/**
+ * gets the speed drift
+ *
+ * @return change of speed, words per minute each minute
+ */
+float FistAnalyzer::getDrift() const {
+   float rtn = 0;
+
+   if (timeM2 > 0) {
+      rtn = coMoment / timeM2;
+   }
+
+   return rtn;
+}
+
+/**
+ * fills in the summary kept in a channel file header
+ *
+ * @param  fist   receives the summary
+ *
+ * @return true if enough was keyed to measure, at least a dit,
+ *         a dah and an element space
+ */
+bool FistAnalyzer::getSummary(PulseFistSummary &fist) const {
+   bool rtn =  (ditMarks.getCount() > 0)
+            && (dahMarks.getCount() > 0)
+            && (elementSpaces.getCount() > 0);
+
+   fist = PulseFistSummary();
+
+   if (rtn) {
+      float dit  = ditMarks.getMean();
+      float elem = elementSpaces.getMean();
+
+      // weight moves time between marks and spaces,
+      // so a unit is taken as the mean of the two
+      float unit_len = (dit + elem) / 2;
+
+      fist.dahRatio    = toField(32 * dahMarks.getMean() / dit);
+      fist.weight      = toField(100 * dit / (dit + elem));
+      // with no letter spaces to go by, the spaces between
+      // characters are not known well enough to give ratios
+      if (letterSpaces.getCount() > 0) {
+         fist.letterRatio = toField(32 * letterSpaces.getMean() / unit_len);
+         fist.wordRatio   = toField(16 * getWordSpaces().getMean() / unit_len);
+      }
+      fist.markJitter  = toField(100 * ditMarks.getDeviation() / unit_len);
+      fist.spaceJitter = toField(100 * elementSpaces.getDeviation() / unit_len);
+
+      float drift = 100 * getDrift();
+
+      if (drift > 32767) {
+         drift = 32767;
+      }
+      else if (drift < -32767) {
+         drift = -32767;
+      }
+
+      fist.drift = (int16_t)((drift < 0) ? (drift - 0.5) : (drift + 0.5));
+   }
+
+   return rtn;
+}
@@ -0,0 +1,397 @@
+#ifndef _FIST_ANALYZER_H_
+#define _FIST_ANALYZER_H_
+
+/**
+ * @file    FistAnalyzer.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class definitions for FistAccumulator and
+ * FistAnalyzer. These classes measure how a pulse train was keyed,
+ * in fixed memory, as the pulses arrive.
+ */
+
+#include <Arduino.h>
+#include <DigitalPulse.h>
+#include <PulseCodec.h>
+
+/**
+ * analyzer constants
+ * <p>
+ * Marks and spaces are measured against a running unit length, which
+ * starts at FIST_UNIT_DEFAULT_MILS, about 20 words per minute, and is
+ * kept between FIST_UNIT_MIN_MILS and FIST_UNIT_MAX_MILS.
+ * <p>
+ * A mark over FIST_DAH_UNITS units is a dah. A space under
+ * FIST_LETTER_UNITS units is an element space. Longer spaces are
+ * measured against a running letter space, which starts at three
+ * units: one under half as long again is a letter space, and one 
+ * under FIST_PAUSE_LETTERS letter spaces a word space. Longer spaces,
+ * and any over FIST_PAUSE_UNITS of the longest unit, are pauses, and
+ * are not counted.
+ * <p>
+ * Marks and spaces are also counted in FIST_HISTOGRAM_BINS bins, 
+ * marks a quarter of a unit wide and spaces half a unit, the last 
+ * bin taking anything longer short of a pause. A full bin halves 
+ * every bin of its histogram, so the histograms favour recent keying.
+ */
+#define FIST_UNIT_DEFAULT_MILS    60
+#define FIST_UNIT_MIN_MILS        10
+#define FIST_UNIT_MAX_MILS       400
+#define FIST_DAH_UNITS             2
+#define FIST_LETTER_UNITS          2
+#define FIST_PAUSE_LETTERS         5
+#define FIST_PAUSE_UNITS          14
+#define FIST_HISTOGRAM_BINS       16
+#define FIST_MARK_BINS_PER_UNIT    4
+#define FIST_SPACE_BINS_PER_UNIT   2
+
+/**
+ * Keeps the count, mean and variance of a series of lengths, one
+ * length at a time, by Welford's method, which stays accurate in
+ * single precision however long the series.
+ */
+class FistAccumulator {
+protected:
+  /** number of lengths added */
+   uint16_t count;
+
+  /** mean length */
+   float mean;
+
+  /** sum of squared differences from the mean */
+   float m2;
+
+public:
+  /**
+   * FistAccumulator constructor
+   */
+   FistAccumulator() {
+      reset();
+   }
+
+  /**
+   * empties the series
+   */
+   void reset() {
+      count = 0;
+      mean = 0;
+      m2 = 0;
+   }
+
+  /**
+   * adds a length to the series; the count stops at its limit,
+   * after which later lengths weigh a little more than earlier ones
+   *
+   * @param  len    length, milliseconds
+   */
+   void add(float len);
+
+  /**
+   * gets number of lengths added
+   *
+   * @return length count
+   */
+   uint16_t getCount() const {
+      return count;
+   }
+
+  /**
+   * gets the mean length
+   *
+   * @return mean, milliseconds, 0 if none were added
+   */
+   float getMean() const {
+      return mean;
+   }
+
+  /**
+   * gets the standard deviation of the lengths
+   *
+   * @return standard deviation, milliseconds
+   */
+   float getDeviation() const;
+};
+
+/**
+ * The Fist Analyzer measures the keying of a pulse train, from the
+ * keying input while recording or from a recorded channel: the dah 
+ * to dit ratio, weight, letter and word space ratios, timing jitter
+ * and speed drift, with histograms of mark and space lengths.
+ * <p>
+ * Each kind of mark and space has an accumulator. The speed is taken
+ * from each element and the element space after it, two units for a
+ * dit and four for a dah whatever the weight, and speed drift is the
+ * slope of that speed against time, fitted as the elements arrive.
+ * Memory does not grow with the pulse train, and each pulse costs a
+ * few floating point operations.
+ * <p>
+ * The running unit follows the dits, and the dahs taken as three 
+ * units, an eighth of the way at a time. A dit under half the unit,
+ * or a dah over twice three units, moves it halfway at once, so a
+ * change of speed is soon followed and one stray mark does little
+ * harm.
+ * <p>
+ * The letter space follows the letter spaces the same way. Spaces
+ * between characters stretched well past it, as with Farnsworth 
+ * timing, would all be taken as word spaces, so a word space is held
+ * until the next space between characters: if that one is as long 
+ * to within a quarter, both are letter spaces, and the letter space
+ * is taken from them at once.
+ */
+class FistAnalyzer {
+protected:
+  /** dit lengths */
+   FistAccumulator ditMarks;
+
+  /** dah lengths */
+   FistAccumulator dahMarks;
+
+  /** spaces between the elements of a character */
+   FistAccumulator elementSpaces;
+
+  /** spaces between characters */
+   FistAccumulator letterSpaces;
+
+  /** spaces between words */
+   FistAccumulator wordSpaces;
+
+  /** number of speed samples fitted */
+   uint16_t speedCount;
+
+  /** mean time of the speed samples, minutes from the first pulse */
+   float timeMean;
+
+  /** mean speed, words per minute */
+   float speedMean;
+
+  /** sum of squared differences of the times from their mean */
+   float timeM2;
+
+  /** sum of products of time and speed differences from their means */
+   float coMoment;
+
+  /** mark length histogram */
+   uint8_t markBins[FIST_HISTOGRAM_BINS];
+
+  /** space length histogram */
+   uint8_t spaceBins[FIST_HISTOGRAM_BINS];
+
+  /** running unit length, sixteenths of a millisecond */
+   uint16_t unit;
+
+  /** running letter space, sixteenths of a millisecond */
+   unsigned long letter;
+
+  /** word space held until the next space, milliseconds, 0 if none */
+   uint16_t heldSpace;
+
+  /** start time of the first pulse, milliseconds */
+   long firstStart;
+
+  /** end time of the latest pulse, milliseconds */
+   long lastEnd;
+
+  /** length of the latest mark, milliseconds */
+   uint16_t lastLength;
+
+  /** flag is true if the latest mark was a dah */
+   bool lastDah;
+
+  /** flag is true once a pulse has been taken */
+   bool started;
+
+  /**
+   * sets the running unit length, keeping it within range
+   *
+   * @param  unit16 unit length, sixteenths of a millisecond
+   */
+   void setUnit(unsigned long unit16);
+
+  /**
+   * adds a speed sample to the drift fit
+   *
+   * @param  minutes  time from the first pulse
+   * @param  wpm      speed implied by an element and its space
+   */
+   void addSpeed(float minutes, float wpm);
+
+  /**
+   * takes a space between characters, sorting it against the
+   * running letter space
+   *
+   * @param  space  space length, milliseconds
+   */
+   void addCharacterSpace(long space);
+
+  /**
+   * counts the held space as a word space, unless it is a pause
+   */
+   void releaseHeldSpace();
+
+  /**
+   * tests whether a space is a word space rather than a pause
+   *
+   * @param  space  space length, milliseconds
+   *
+   * @return true if a word space
+   */
+   bool isWordSpace(long space) const {
+      return ((unsigned long)space << 4) < (unsigned long)FIST_PAUSE_LETTERS * letter;
+   }
+
+public:
+  /**
+   * FistAnalyzer constructor
+   */
+   FistAnalyzer() {
+      reset();
+   }
+
+  /**
+   * empties every measure, ready for a new pulse train
+   */
+   void reset();
+
+  /**
+   * takes the next pulse; pulses must be given in order
+   *
+   * @param  start_time   pulse start, milliseconds
+   * @param  end_time     pulse end, milliseconds
+   */
+   void addPulse(long start_time, long end_time);
+
+  /**
+   * takes the next pulse; pulses must be given in order
+   *
+   * @param  dp     pulse, ignored if not valid
+   */
+   void addPulse(const DigitalPulse &dp) {
+      if (dp.isValid) {
+         addPulse(dp.startTime, dp.endTime);
+      }
+   }
+
+  /**
+   * fills in the summary kept in a channel file header
+   *
+   * @param  fist   receives the summary
+   *
+   * @return true if enough was keyed to measure, at least a dit,
+   *         a dah and an element space
+   */
+   bool getSummary(PulseFistSummary &fist) const;
+
+  /**
+   * gets the dit lengths
+   *
+   * @return dit accumulator
+   */
+   const FistAccumulator &getDits() const {
+      return ditMarks;
+   }
+
+  /**
+   * gets the dah lengths
+   *
+   * @return dah accumulator
+   */
+   const FistAccumulator &getDahs() const {
+      return dahMarks;
+   }
+
+  /**
+   * gets the spaces between the elements of a character
+   *
+   * @return element space accumulator
+   */
+   const FistAccumulator &getElementSpaces() const {
+      return elementSpaces;
+   }
+
+  /**
+   * gets the spaces between characters
+   *
+   * @return letter space accumulator
+   */
+   const FistAccumulator &getLetterSpaces() const {
+      return letterSpaces;
+   }
+
+  /**
+   * gets the spaces between words, with any still held
+   *
+   * @return word space accumulator
+   */
+   FistAccumulator getWordSpaces() const {
+      FistAccumulator rtn = wordSpaces;
+
+      if ((heldSpace > 0) && isWordSpace(heldSpace)) {
+         rtn.add(heldSpace);
+      }
+
+      return rtn;
+   }
+
+  /**
+   * gets the mean speed implied by the elements
+   *
+   * @return words per minute, PARIS timing
+   */
+   float getSpeed() const {
+      return speedMean;
+   }
+
+  /**
+   * gets the speed drift
+   *
+   * @return change of speed, words per minute each minute
+   */
+   float getDrift() const;
+
+  /**
+   * gets one bin of the mark length histogram
+   *
+   * @param  bin    bin number, FIST_MARK_BINS_PER_UNIT to a unit
+   *
+   * @return relative count of marks
+   */
+   uint8_t getMarkBin(uint8_t bin) const {
+      return (bin < FIST_HISTOGRAM_BINS) ? markBins[bin] : 0;
+   }
+
+  /**
+   * gets one bin of the space length histogram
+   *
+   * @param  bin    bin number, FIST_SPACE_BINS_PER_UNIT to a unit
+   *
+   * @return relative count of spaces
+   */
+   uint8_t getSpaceBin(uint8_t bin) const {
+      return (bin < FIST_HISTOGRAM_BINS) ? spaceBins[bin] : 0;
+   }
+};
+
+#endif // _FIST_ANALYZER_H_
@@ -0,0 +1,377 @@
+/**
+ * @file    MorseDecoder.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class implementation for MorseDecoder. This
+ * class turns keyed pulses into text as they arrive, following the
+ * speed of the fist that keyed them.
+ */
+
+#include <Arduino.h>
+#include <MorseDecoder.h>
+
+/**
+ * Morse trie, one row for each number of elements; a dit goes from
+ * node n to node 2n and a dah to node 2n + 1. Node 0 is not used,
+ * and a 0 entry is not a character.
+ */
+static const char MorseTrie[MORSE_TRIE_SIZE] PROGMEM = {
+     0,
+     0,
+   'E', 'T',
+   'I', 'A', 'N', 'M',
+   'S', 'U', 'R', 'W', 'D', 'K', 'G', 'O',
+   'H', 'V', 'F',   0, 'L',   0, 'P', 'J',
+   'B', 'X', 'C', 'Y', 'Z', 'Q',   0,   0,
+   '5', '4',   0, '3',   0,   0,   0, '2',
+   '&',   0, '+',   0,   0,   0,   0, '1',
+   '6', '=', '/',   0,   0,   0, '(',   0,
+   '7',   0,   0,   0, '8',   0, '9', '0',
+     0,   0,   0,   0,   0,   0,   0,   0,
+     0,   0,   0,   0, '?', '_',   0,   0,
+     0,   0, '"',   0,   0, '.',   0,   0,
+     0,   0, '@',   0,   0,   0, '\'',  0,
+     0, '-',   0,   0,   0,   0,   0,   0,
+     0,   0, ';', '!',   0, ')',   0,   0,
+     0,   0,   0, ',',   0,   0,   0,   0,
+   ':',   0,   0,   0,   0,   0,   0,   0
+};
+
+/**
+ * moves a mean an eighth of the way towards a length,
+ * taking the length as no less than half the mean and no
+ * more than twice it
+ *
+ * @param  mean   mean length
+ * @param  len    new length
+ *
+ * @return new mean
+ */
+static unsigned long stepMean(unsigned long mean, unsigned long len) {
+   unsigned long target = len;
+
+   if (target < (mean >> 1)) {
+      target = mean >> 1;
+   }
+   else if (target > (mean << 1)) {
+      target = mean << 1;
+   }
+
+   return (unsigned long)((long)mean + ((long)target - (long)mean) / 8);
+}
+
+/**
+ * drops any character being keyed and any text not read,
+ * ready for a new pulse train; the speed estimate is kept
+ */
+void MorseDecoder::reset() {
+   wordSpace = 0;
+   node = 1;
+   started = false;
+   wordPending = false;
+   text.discard();
+}
+
+/**
+ * sets the speed estimate
+ *
+ * @param  wpm    words per minute, PARIS timing
+ */
+void MorseDecoder::setSpeed(uint8_t wpm) {
+   if (0 == wpm) {
+      wpm = MORSE_WPM_DEFAULT;
+   }
+
+   // a PARIS dit is 1200 ms divided by the speed,
+   // and a letter space three dits
+   seed((1200UL << 4) / wpm);
+   limitLetterMean(3UL * ditMean);
+}
+
+/**
+ * gets the speed estimate
+ *
+ * @return words per minute, PARIS timing
+ */
+uint8_t MorseDecoder::getSpeed() const {
+   return (uint8_t)(((1200UL << 4) + (ditMean >> 1)) / ditMean);
+}
+
+/**
+ * starts both means over from a dit length; the letter space
+ * mean is scaled with the dit
+ *
+ * @param  dit16  dit length, sixteenths of a millisecond
+ */
+void MorseDecoder::seed(unsigned long dit16) {
+   if (dit16 < ((unsigned long)MORSE_DIT_MIN_MILS << 4)) {
+      dit16 = (unsigned long)MORSE_DIT_MIN_MILS << 4;
+   }
+   else if (dit16 > ((unsigned long)MORSE_DIT_MAX_MILS << 4)) {
+      dit16 = (unsigned long)MORSE_DIT_MAX_MILS << 4;
+   }
+
+   if (0 != ditMean) {
+      letterMean = (unsigned long)letterMean * dit16 / ditMean;
+   }
+
+   ditMean = dit16;
+   dahMean = 3 * dit16;
+   limitLetterMean(letterMean);
+}
+
+/**
+ * sets the letter space mean, keeping it over the longest
+ * element space and within range
+ *
+ * @param  letter16  letter space, sixteenths of a millisecond
+ */
+void MorseDecoder::limitLetterMean(unsigned long letter16) {
+   unsigned long least = ((unsigned long)ditMean + dahMean) >> 1;
+
+   if (letter16 < least) {
+      letter16 = least;
+   }
+   else if (letter16 > 0xFFFFUL) {
+      letter16 = 0xFFFFUL;
+   }
+
+   letterMean = letter16;
+}
+
+/**
+ * takes a mark, adding its element to the character and
+ * moving the speed estimate
+ *
+ * @param  len16  mark length, sixteenths of a millisecond
+ */
+void MorseDecoder::addMark(unsigned long len16) {
+   unsigned long dit = ditMean;
+   unsigned long dah = dahMean;
+   bool is_dah = ((len16 << 1) > (dit + dah));
+
+   if (is_dah && (len16 > (dah << 1))) {
+      // much slower, start over halfway to the dah
+      seed((dah + len16) / 6);
+   }
+   else if (!is_dah && ((len16 << 1) < dit)) {
+      // much faster, start over halfway to the dit
+      seed((dit + len16) >> 1);
+   }
+   else {
+      if (is_dah) {
+         dah = stepMean(dah, len16);
+      }
+      else {
+         dit = stepMean(dit, len16);
+      }
+
+      // keep the dit in range, and the dah within two to four dits
+      if (dit < ((unsigned long)MORSE_DIT_MIN_MILS << 4)) {
+         dit = (unsigned long)MORSE_DIT_MIN_MILS << 4;
+      }
+      else if (dit > ((unsigned long)MORSE_DIT_MAX_MILS << 4)) {
+         dit = (unsigned long)MORSE_DIT_MAX_MILS << 4;
+      }
+
+      if (dah < (dit << 1)) {
+         dah = dit << 1;
+      }
+      else if (dah > (dit << 2)) {
+         dah = dit << 2;
+      }
+
+      // letter spaces scale with the dit
+      unsigned long letter = (unsigned long)letterMean * dit / ditMean;
+
+      ditMean = dit;
+      dahMean = dah;
+      limitLetterMean(letter);
+   }
+
+   // step down the trie, leaving it for good past the last row
+   if (node >= (MORSE_TRIE_SIZE >> 1)) {
+      node = 0;
+   }
+   else if (0 != node) {
+      node = (node << 1) | (is_dah ? 1 : 0);
+   }
+}
+
+/**
+ * takes a space that ended a character, moving the letter space
+ * mean; word spaces only nudge it up, but in a run of spaces over
+ * three letter spaces, one as long as the shortest of the run to
+ * within a quarter shows letter spaces stretched past the word
+ * threshold, and the mean starts over from the two
+ *
+ * @param  space16 space length, sixteenths of a millisecond
+ */
+void MorseDecoder::addLetterSpace(unsigned long space16) {
+   unsigned long letter = letterMean;
+   unsigned long prior = wordSpace;
+
+   wordSpace = 0;
+
+   if ((space16 << 1) <= 3 * letter) {
+      letter = stepMean(letter, space16);
+   }
+   else if (   (0 != prior)
+            && ((((space16 > prior) ? space16 - prior : prior - space16) << 2) <= prior)) {
+      letter = (prior + space16) >> 1;
+   }
+   else {
+      unsigned long target = (space16 > (letter << 1)) ? (letter << 1) : space16;
+
+      // words keyed as usual are about two letter spaces
+      // apart, and one letter words may run, so only spaces
+      // well past that are taken as stretched letters
+      if ((space16 > 3 * letter) && (space16 <= 0xFFFFUL)) {
+         wordSpace = ((0 != prior) && (prior < space16)) ? prior : space16;
+      }
+
+      letter += (target - letter) / 16;
+   }
+
+   limitLetterMean(letter);
+}
+
+/**
+ * ends the character or word a space closes
+ *
+ * @param  space16 space length, sixteenths of a millisecond
+ */
+void MorseDecoder::addSpace(unsigned long space16) {
+   if ((space16 << 1) > ((unsigned long)ditMean + dahMean)) {
+      endCharacter();
+
+      // words are 7 units apart and letters 3; the letter space
+      // mean runs a little long, so a space over half as long
+      // again ends a word
+      if ((space16 << 1) > 3UL * letterMean) {
+         endWord();
+      }
+   }
+}
+
+/**
+ * queues the character being keyed, if there is one
+ */
+void MorseDecoder::endCharacter() {
+   if (1 != node) {
+      char c = node ? (char)pgm_read_byte(&MorseTrie[node]) : 0;
+
+      text.push(c ? c : MORSE_UNKNOWN_CHAR);
+      node = 1;
+      wordPending = true;
+   }
+}
+
+/**
+ * queues a word space, unless one ends the text already
+ */
+void MorseDecoder::endWord() {
+   if (wordPending) {
+      text.push(' ');
+      wordPending = false;
+   }
+}
+
+/**
+ * takes the next pulse; pulses must be given in order
+ *
+ * @param  start_time   pulse start, milliseconds
+ * @param  end_time     pulse end, milliseconds
+ */
+void MorseDecoder::addPulse(long start_time, long end_time) {
+   long len = end_time - start_time;
+
+   if (len > 0) {
+      if (started) {
+         long space = start_time - lastEnd;
+
+         checkIdle(start_time);
+
+         if ((space > 0) && (space < 0x0FFFFFFL)
+          && (((unsigned long)space << 5) > ((unsigned long)ditMean + dahMean))) {
+            addLetterSpace((unsigned long)space << 4);
+         }
+      }
+
+      // anything much over the longest dah is as good as a dah
+      if (len > 8L * MORSE_DIT_MAX_MILS) {
+         len = 8L * MORSE_DIT_MAX_MILS;
+      }
+
+      addMark((unsigned long)len << 4);
+      lastEnd = end_time;
+      started = true;
+   }
+}
+
+/**
+ * ends the character or word being keyed if the key has been up
+ * long enough; called from time to time while the key is up
+ *
+ * @param  now    current time, milliseconds, as the pulses
+ */
+void MorseDecoder::checkIdle(long now) {
+   long space = now - lastEnd;
+
+   if (started && (space > 0)) {
+      // spaces are only compared, so very long ones are cut short
+      if (space > 0x0FFFFFFL) {
+         space = 0x0FFFFFFL;
+      }
+
+      addSpace((unsigned long)space << 4);
+   }
+}
+
+/**
+ * ends the character and word being keyed, as at the end
+ * of a pulse train
+ */
+void MorseDecoder::flush() {
+   endCharacter();
+   endWord();
+}
+
+/**
+ * takes the next character of decoded text
+ *
+ * @return character, or -1 if none is waiting
+ */
+int MorseDecoder::read() {
+   char c;
+   int rtn = -1;
+
+   if (text.pop(c)) {
+      rtn = (uint8_t)c;
+   }
+
+   return rtn;
+}
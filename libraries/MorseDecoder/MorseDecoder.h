@@ -0,0 +1,304 @@
+#ifndef _MORSE_DECODER_H_
+#define _MORSE_DECODER_H_
+
+/**
+ * @file    MorseDecoder.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class definition for MorseDecoder. This
+ * class turns keyed pulses into text as they arrive, following the
+ * speed of the fist that keyed them.
+ */
+
+#include <Arduino.h>
+#include <DigitalPulse.h>
+#include <SpscRing.h>
+
+/**
+ * decoder constants
+ * <p>
+ * MORSE_ELEMENTS_MAX is the most elements in a character that can be
+ * decoded. Characters are looked up in a binary trie held in program
+ * memory, MORSE_TRIE_SIZE entries laid out as a heap: the root is
+ * node 1, and the dit and dah children of node n are nodes 2n and
+ * 2n + 1. A longer character, or one not in the trie, is decoded as
+ * MORSE_UNKNOWN_CHAR.
+ * <p>
+ * MORSE_TEXT_QUEUE is the size of the queue holding decoded text
+ * until it is read; it holds one character less than its size.
+ * <p>
+ * MORSE_WPM_DEFAULT is the speed assumed before any pulse is seen.
+ * The dit length followed is kept between MORSE_DIT_MIN_MILS and
+ * MORSE_DIT_MAX_MILS, about 120 and 3 words per minute.
+ */
+#define MORSE_ELEMENTS_MAX       6
+#define MORSE_TRIE_SIZE         (2 << MORSE_ELEMENTS_MAX)
+#define MORSE_UNKNOWN_CHAR      '*'
+#define MORSE_TEXT_QUEUE        16
+#define MORSE_WPM_DEFAULT       20
+#define MORSE_DIT_MIN_MILS      10
+#define MORSE_DIT_MAX_MILS     400
+
+/**
+ * The Morse Decoder takes pulses one at a time, from the keying
+ * input while recording or from a recorded channel, and queues the
+ * characters they spell.
+ *
+ * Marks are told apart by running means of the dit and dah lengths,
+ * a mark longer than halfway between them being a dah. Each mark
+ * moves the mean of its own kind an eighth of the way towards it,
+ * so a change of speed is followed within a few characters, at a
+ * fixed cost per element. The dah mean is held between two and four
+ * dits. A dit under half the mean dit, or a dah over twice the mean
+ * dah, is taken as a change of speed, and both means start over
+ * from halfway to it, so one stray mark does little harm.
+ * <p>
+ * A space longer than halfway between a dit and a dah ends a
+ * character. Spaces that end characters are followed by a running
+ * mean of their own, scaled with the dit mean as it moves, and one
+ * over half as long again as the mean ends a word as well, words
+ * being 7 units apart and letters 3. Spaces taken as words only
+ * nudge the mean up. Letter spaces stretched out, as in Farnsworth
+ * timing, are all taken as words at first, so when a run of 
+ * spaces over three times the mean holds two as long to within a 
+ * quarter, the shortest of the run and the latest, the mean starts
+ * over from them, and the following ones are counted as letters
+ * again.
+ * <p>
+ * Since the last space of a transmission is not followed by a mark,
+ * checkIdle() ends the character or word once the key has been up
+ * long enough.
+ * <p>
+ * Lengths are held in sixteenths of a millisecond.
+ */
+class MorseDecoder {
+protected:
+  /**
+   * mean dit length
+   */
+   uint16_t ditMean;
+
+  /**
+   * mean dah length
+   */
+   uint16_t dahMean;
+
+  /**
+   * mean length of spaces that end characters
+   */
+   uint16_t letterMean;
+
+  /**
+   * shortest of the spaces ending characters since the latest
+   * one under three letter spaces, 0 if none
+   */
+   uint16_t wordSpace;
+
+  /**
+   * end time of the latest mark, milliseconds
+   */
+   long lastEnd;
+
+  /**
+   * trie node reached by the character being keyed; 1 if none
+   * has been started, 0 if it has run past the trie
+   */
+   uint8_t node;
+
+  /**
+   * flag is true once a mark has been taken
+   */
+   bool started;
+
+  /**
+   * flag is true if a character has been queued since the last
+   * word space
+   */
+   bool wordPending;
+
+  /**
+   * decoded text waiting to be read
+   */
+   SpscRing<char, MORSE_TEXT_QUEUE> text;
+
+  /**
+   * starts both means over from a dit length; the letter space
+   * mean is scaled with the dit
+   *
+   * @param  dit16  dit length, sixteenths of a millisecond
+   */
+   void seed(unsigned long dit16);
+
+  /**
+   * sets the letter space mean, keeping it over the longest
+   * element space and within range
+   *
+   * @param  letter16  letter space, sixteenths of a millisecond
+   */
+   void limitLetterMean(unsigned long letter16);
+
+  /**
+   * takes a mark, adding its element to the character and
+   * moving the speed estimate
+   *
+   * @param  len16  mark length, sixteenths of a millisecond
+   */
+   void addMark(unsigned long len16);
+
+  /**
+   * ends the character or word a space closes
+   *
+   * @param  space16 space length, sixteenths of a millisecond
+   */
+   void addSpace(unsigned long space16);
+
+  /**
+   * takes a space that ended a character, moving the letter
+   * space mean
+   *
+   * @param  space16 space length, sixteenths of a millisecond
+   */
+   void addLetterSpace(unsigned long space16);
+
+  /**
+   * queues the character being keyed, if there is one
+   */
+   void endCharacter();
+
+  /**
+   * queues a word space, unless one ends the text already
+   */
+   void endWord();
+
+public:
+  /**
+   * MorseDecoder constructor
+   *
+   * @param  wpm    speed assumed until pulses are seen
+   */
+   MorseDecoder(uint8_t wpm = MORSE_WPM_DEFAULT)
+   : ditMean(0)
+   , dahMean(0)
+   , letterMean(0)
+   , wordSpace(0)
+   , lastEnd(0)
+   , node(1)
+   , started(false)
+   , wordPending(false)
+   {
+      setSpeed(wpm);
+   }
+
+  /**
+   * drops any character being keyed and any text not read,
+   * ready for a new pulse train; the speed estimate is kept
+   */
+   void reset();
+
+  /**
+   * sets the speed estimate
+   *
+   * @param  wpm    words per minute, PARIS timing
+   */
+   void setSpeed(uint8_t wpm);
+
+  /**
+   * takes the next pulse; pulses must be given in order
+   *
+   * @param  start_time   pulse start, milliseconds
+   * @param  end_time     pulse end, milliseconds
+   */
+   void addPulse(long start_time, long end_time);
+
+  /**
+   * takes the next pulse; pulses must be given in order
+   *
+   * @param  dp     pulse, ignored if not valid
+   */
+   void addPulse(const DigitalPulse &dp) {
+      if (dp.isValid) {
+         addPulse(dp.startTime, dp.endTime);
+      }
+   }
+
+  /**
+   * ends the character or word being keyed if the key has been up
+   * long enough; called from time to time while the key is up
+   *
+   * @param  now    current time, milliseconds, as the pulses
+   */
+   void checkIdle(long now);
+
+  /**
+   * ends the character and word being keyed, as at the end
+   * of a pulse train
+   */
+   void flush();
+
+  /**
+   * takes the next character of decoded text
+   *
+   * @return character, or -1 if none is waiting
+   */
+   int read();
+
+  /**
+   * gets number of decoded characters waiting
+   *
+   * @return character count
+   */
+   uint8_t available() const {
+      return text.count();
+   }
+
+  /**
+   * gets number of characters lost because text was not read
+   * quickly enough
+   *
+   * @return lost character count
+   */
+   uint16_t getOverrunCount() const {
+      return text.getOverrunCount();
+   }
+
+  /**
+   * gets the mean dit length
+   *
+   * @return dit length, milliseconds
+   */
+   unsigned int getDitLength() const {
+      return (ditMean + 8) >> 4;
+   }
+
+  /**
+   * gets the speed estimate
+   *
+   * @return words per minute, PARIS timing
+   */
+   uint8_t getSpeed() const;
+};
+
+#endif // _MORSE_DECODER_H_
@@ -0,0 +1,166 @@
+/**
+ * @file    MorseSynthesizer.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class implementation for MorseSynthesizer.
+ * This class turns text into the pulses a fist would key, with the
+ * timing of an ideal one.
+ */
+
+#include <Arduino.h>
+#include <MorseSynthesizer.h>
+
+/**
+ * Morse codes of the characters from MORSE_CODE_FIRST to
+ * MORSE_CODE_LAST, eight to a row; the first element is in the
+ * lowest bit, a dah is a 1, and the highest 1 bit ends the code.
+ * A 0 entry is not a character.
+ */
+static const uint8_t MorseCodes[MORSE_CODE_LAST - MORSE_CODE_FIRST + 1] PROGMEM = {
+   0x00, 0x75, 0x52, 0x00, 0x00, 0x00, 0x22, 0x5E,   //  ! " # $ % & '
+   0x2D, 0x6D, 0x00, 0x2A, 0x73, 0x61, 0x6A, 0x29,   // ( ) * + , - . /
+   0x3F, 0x3E, 0x3C, 0x38, 0x30, 0x20, 0x21, 0x23,   // 0 1 2 3 4 5 6 7
+   0x27, 0x2F, 0x47, 0x55, 0x00, 0x31, 0x00, 0x4C,   // 8 9 : ; < = > ?
+   0x56, 0x06, 0x11, 0x15, 0x09, 0x02, 0x14, 0x0B,   // @ A B C D E F G
+   0x10, 0x04, 0x1E, 0x0D, 0x12, 0x07, 0x05, 0x0F,   // H I J K L M N O
+   0x16, 0x1B, 0x0A, 0x08, 0x03, 0x0C, 0x18, 0x0E,   // P Q R S T U V W
+   0x19, 0x1D, 0x13, 0x00, 0x00, 0x00, 0x00, 0x6C    // X Y Z [ \ ] ^ _
+};
+
+/**
+ * sets the timing of the pulses; takes effect with the
+ * next character
+ *
+ * @param  wpm            character speed, words per minute
+ * @param  effective_wpm  overall speed, words per minute, if
+ *                        lower; 0 for standard spacing
+ * @param  weight         mark weight, percent
+ */
+void MorseSynthesizer::setSpeed(uint8_t wpm
+                               ,uint8_t effective_wpm
+                               ,uint8_t weight) {
+   if (0 == wpm) {
+      wpm = MORSE_WPM_DEFAULT;
+   }
+
+   if (weight < MORSE_WEIGHT_MIN) {
+      weight = MORSE_WEIGHT_MIN;
+   }
+   else if (weight > MORSE_WEIGHT_MAX) {
+      weight = MORSE_WEIGHT_MAX;
+   }
+
+   // a PARIS dit is 1200 ms divided by the speed; weight
+   // moves time from each space to the mark before it
+   unsigned long dit = (1200UL << 4) / wpm;
+   long delta = (long)dit * ((int)weight - MORSE_WEIGHT_DEFAULT) / 50;
+
+   ditMark      = dit + delta;
+   dahMark      = 3 * dit + delta;
+   elementSpace = dit - delta;
+
+   // letters are 3 units apart and words 7, unless spread out to
+   // the effective speed; PARIS and its word space take 50 units,
+   // 19 of them in the spaces between letters and words
+   unsigned long unit19 = 19 * dit;
+
+   if ((0 != effective_wpm) && (effective_wpm < wpm)) {
+      unit19 = ((60000UL << 4) * wpm - (37200UL << 4) * effective_wpm)
+             / ((unsigned long)wpm * effective_wpm);
+   }
+
+   letterSpace = 3 * unit19 / 19 - delta;
+   wordSpace   = 4 * unit19 / 19;
+}
+
+/**
+ * starts a new text, dropping any character not yet sent
+ *
+ * @param  time   start of the first pulse, milliseconds
+ */
+void MorseSynthesizer::start(long time) {
+   origin = time;
+   cursor = 0;
+   code   = 1;
+}
+
+/**
+ * starts sending a character; a space ends a word
+ *
+ * @param  c      character
+ *
+ * @return true if taken, false if the last character has pulses
+ *         left or c has no code
+ */
+bool MorseSynthesizer::putChar(char c) {
+   bool rtn = false;
+
+   if (!isBusy()) {
+      if ((c >= 'a') && (c <= 'z')) {
+         c -= 'a' - 'A';
+      }
+
+      if (' ' == c) {
+         // the letter space is already behind the last character
+         cursor += wordSpace;
+         rtn = true;
+      }
+      else if ((c > MORSE_CODE_FIRST) && (c <= MORSE_CODE_LAST)) {
+         code = pgm_read_byte(&MorseCodes[c - MORSE_CODE_FIRST]);
+         rtn = (0 != code);
+
+         if (!rtn) {
+            code = 1;
+         }
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * gets the next pulse of the character being sent
+ *
+ * @param  dp     set to the pulse
+ *
+ * @return true if there was a pulse
+ */
+bool MorseSynthesizer::nextPulse(DigitalPulse &dp) {
+   bool rtn = false;
+
+   if (isBusy()) {
+      dp.setStart(toMillis(cursor));
+      cursor += (code & 1) ? dahMark : ditMark;
+      dp.setEnd(toMillis(cursor));
+
+      // the space after the last element ends the character
+      code >>= 1;
+      cursor += isBusy() ? elementSpace : letterSpace;
+      rtn = true;
+   }
+
+   return rtn;
+}
@@ -0,0 +1,209 @@
+#ifndef _MORSE_SYNTHESIZER_H_
+#define _MORSE_SYNTHESIZER_H_
+
+/**
+ * @file    MorseSynthesizer.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class definition for MorseSynthesizer. This
+ * class turns text into the pulses a fist would key, with the
+ * timing of an ideal one.
+ */
+
+#include <Arduino.h>
+#include <DigitalPulse.h>
+#include <MorseDecoder.h>
+
+/**
+ * synthesizer constants
+ * <p>
+ * Characters are looked up in a table held in program memory, one
+ * entry for each character from MORSE_CODE_FIRST to MORSE_CODE_LAST;
+ * lower case letters are sent as upper case. An entry holds the
+ * elements of its character, the first in the lowest bit and a dah
+ * as a 1, under a single 1 bit that marks the end. A 0 entry is not
+ * a character.
+ * <p>
+ * MORSE_WEIGHT_DEFAULT is the weight of standard timing, marks and
+ * spaces within a character being equal. Weights between
+ * MORSE_WEIGHT_MIN and MORSE_WEIGHT_MAX percent of a dit and the
+ * element space after it are used.
+ */
+#define MORSE_CODE_FIRST      ' '
+#define MORSE_CODE_LAST       '_'
+#define MORSE_WEIGHT_DEFAULT   50
+#define MORSE_WEIGHT_MIN       10
+#define MORSE_WEIGHT_MAX       90
+
+/**
+ * The Morse Synthesizer takes text one character at a time and gives
+ * the pulses that key it, as a recording of a perfect fist would
+ * hold them, to be handed to PulseTrainRecorder::recordPulse() or
+ * played.
+ * <p>
+ * Speed is in words per minute, PARIS timing, a dit being 1200 ms
+ * divided by the speed. Given a lower effective speed, characters
+ * are still sent at the full speed but the spaces between them are
+ * stretched, as in Farnsworth timing, so the text as a whole goes
+ * at the lower speed. Weight above 50 lengthens every mark, and
+ * shortens the space after it, by the same amount.
+ * <p>
+ * Times are kept in sixteenths of a millisecond from the start of
+ * the text, so rounding does not build up over a long text; each
+ * pulse edge is rounded to the millisecond on its own.
+ */
+class MorseSynthesizer {
+protected:
+  /**
+   * dit mark length
+   */
+   unsigned long ditMark;
+
+  /**
+   * dah mark length
+   */
+   unsigned long dahMark;
+
+  /**
+   * space between the elements of a character
+   */
+   unsigned long elementSpace;
+
+  /**
+   * space after the last element of a character
+   */
+   unsigned long letterSpace;
+
+  /**
+   * space added to a letter space to end a word
+   */
+   unsigned long wordSpace;
+
+  /**
+   * time the text started, milliseconds
+   */
+   long origin;
+
+  /**
+   * time of the next mark, sixteenths of a millisecond from origin
+   */
+   unsigned long cursor;
+
+  /**
+   * elements of the character being sent, the next in the lowest
+   * bit; 1 if none are left
+   */
+   uint8_t code;
+
+  /**
+   * converts a time from the start of the text to milliseconds
+   *
+   * @param  time16    sixteenths of a millisecond from origin
+   *
+   * @return time, milliseconds
+   */
+   long toMillis(unsigned long time16) const {
+      return origin + (long)((time16 + 8) >> 4);
+   }
+
+public:
+  /**
+   * MorseSynthesizer constructor
+   *
+   * @param  wpm    speed, words per minute
+   */
+   MorseSynthesizer(uint8_t wpm = MORSE_WPM_DEFAULT)
+   : ditMark(0)
+   , dahMark(0)
+   , elementSpace(0)
+   , letterSpace(0)
+   , wordSpace(0)
+   , origin(0)
+   , cursor(0)
+   , code(1)
+   {
+      setSpeed(wpm);
+   }
+
+  /**
+   * sets the timing of the pulses; takes effect with the
+   * next character
+   *
+   * @param  wpm            character speed, words per minute
+   * @param  effective_wpm  overall speed, words per minute, if
+   *                        lower; 0 for standard spacing
+   * @param  weight         mark weight, percent
+   */
+   void setSpeed(uint8_t wpm
+                ,uint8_t effective_wpm = 0
+                ,uint8_t weight = MORSE_WEIGHT_DEFAULT);
+
+  /**
+   * starts a new text, dropping any character not yet sent
+   *
+   * @param  time   start of the first pulse, milliseconds
+   */
+   void start(long time);
+
+  /**
+   * starts sending a character; a space ends a word
+   *
+   * @param  c      character
+   *
+   * @return true if taken, false if the last character has pulses
+   *         left or c has no code
+   */
+   bool putChar(char c);
+
+  /**
+   * gets the next pulse of the character being sent
+   *
+   * @param  dp     set to the pulse
+   *
+   * @return true if there was a pulse
+   */
+   bool nextPulse(DigitalPulse &dp);
+
+  /**
+   * checks for pulses left of the character being sent
+   *
+   * @return true if nextPulse() has a pulse
+   */
+   bool isBusy() const {
+      return code > 1;
+   }
+
+  /**
+   * gets the time the next character would start
+   *
+   * @return time, milliseconds
+   */
+   long getTime() const {
+      return toMillis(cursor);
+   }
+};
+
+#endif // _MORSE_SYNTHESIZER_H_
@@ -0,0 +1,380 @@
+/**
+ * @file    PlaybackEngine.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class implementations for PlaybackEngine and the
+ * PlaybackClock timer abstraction. The engine plays back a pulse
+ * train by scheduling each keying transition on a timer compare,
+ * rather than polling the clock from the main loop.
+ */
+
+#include <Arduino.h>
+#include <PlaybackEngine.h>
+
+#ifdef __AVR__
+   #include <avr/interrupt.h>
+
+/**
+ * Timer1 constants
+ * <p>
+ * PLAYBACK_TIMER_TICK_MICROS is the length of one Timer1 count with
+ * a prescaler of 64.
+ * <p>
+ * PLAYBACK_TIMER_MIN_TICKS keeps a compare from being set so close
+ * to the current count that the timer passes it before it is written.
+ * <p>
+ * PLAYBACK_TIMER_MAX_TICKS is the longest single wait; longer waits
+ * are made up of several compares.
+ */
+#define PLAYBACK_TIMER_TICK_MICROS  (64 / (F_CPU / 1000000L))
+#define PLAYBACK_TIMER_MIN_TICKS    2
+#define PLAYBACK_TIMER_MAX_TICKS    0xFF00
+
+/**
+ * clock whose engine is called back from the interrupt, if any
+ */
+Timer1PlaybackClock *Timer1PlaybackClock::activeClock = 0;
+
+/**
+ * Timer1 output compare A interrupt vector
+ */
+ISR(TIMER1_COMPA_vect) {
+   Timer1PlaybackClock::handleInterrupt();
+}
+
+/**
+ * configures Timer1 for use by this clock
+ */
+void Timer1PlaybackClock::begin() {
+   noInterrupts();
+
+   // normal counting mode, prescaler 64, compare interrupt off
+   TCCR1A = 0;
+   TCCR1B = _BV(CS11) | _BV(CS10);
+   TIMSK1 &= ~_BV(OCIE1A);
+   activeClock = this;
+
+   interrupts();
+}
+
+/**
+ * sets output compare for the pending call back time
+ */
+void Timer1PlaybackClock::setCompare() {
+   long remaining = dueMicros - micros();
+   unsigned long ticks = (remaining > 0)
+                       ? remaining / PLAYBACK_TIMER_TICK_MICROS
+                       : 0;
+
+   if (ticks < PLAYBACK_TIMER_MIN_TICKS) {
+      ticks = PLAYBACK_TIMER_MIN_TICKS;
+   }
+   else if (ticks > PLAYBACK_TIMER_MAX_TICKS) {
+      ticks = PLAYBACK_TIMER_MAX_TICKS;
+   }
+
+   // clear any stale match before enabling the interrupt
+   OCR1A = TCNT1 + ticks;
+   TIFR1 = _BV(OCF1A);
+   TIMSK1 |= _BV(OCIE1A);
+}
+
+/**
+ * requests a call back to the engine
+ *
+ * @param  due_us   time of call back, microseconds since reset
+ */
+void Timer1PlaybackClock::scheduleAt(unsigned long due_us) {
+   uint8_t saved_sreg = SREG;
+   noInterrupts();
+
+   dueMicros = due_us;
+   setCompare();
+
+   SREG = saved_sreg;
+}
+
+/**
+ * cancels any pending call back
+ */
+void Timer1PlaybackClock::cancel() {
+   TIMSK1 &= ~_BV(OCIE1A);
+}
+
+/**
+ * body of the compare interrupt handler
+ */
+void Timer1PlaybackClock::handleInterrupt() {
+   Timer1PlaybackClock *clk = activeClock;
+
+   if (clk) {
+      if ((long)(micros() - clk->dueMicros) >= 0) {
+         // due, engine will reschedule if it has more to do
+         TIMSK1 &= ~_BV(OCIE1A);
+         if (clk->engine) {
+            clk->engine->onTimer();
+         }
+      }
+      else {
+         // part way through a long wait
+         clk->setCompare();
+      }
+   }
+}
+#endif // __AVR__
+
+/**
+ * moves virtual time forward, making any call backs that fall due
+ *
+ * @param  time_us  new virtual time, microseconds
+ */
+void VirtualPlaybackClock::advanceTo(unsigned long time_us) {
+   while (armed && ((long)(time_us - dueMicros) >= 0)) {
+      // call back is made at exactly the time it was due
+      currentMicros = dueMicros;
+      armed = false;
+
+      if (engine) {
+         engine->onTimer();
+      }
+   }
+
+   currentMicros = time_us;
+}
+
+/**
+ * starts playback of the pulse train open in the recorder,
+ * cancelling any pattern on the keying and side tone pins
+ *
+ * @param  ptr    recorder open for playback, first pulse loaded
+ *
+ * @return true if playback started
+ */
+bool PlaybackEngine::start(PulseTrainRecorder &ptr) {
+   stop();
+
+   // a pattern would hide the transitions until it ended
+   keyingPin.cancelPattern();
+   sideTonePin.cancelPattern();
+
+   if (ptr.playbackActive()) {
+      // first pulse starts after the recorder's playback delay
+      trainStartMicros = clock.nowMicros() + ptr.getPlaybackDelay() * 1000UL;
+      pulsePending = true;
+      keyDown = false;
+      edgeCount = 0;
+      lastEdgeCount = 0;
+      underrunCount = 0;
+      maxLateMicros = 0;
+      running = true;
+
+      clock.attach(this);
+      service(ptr);
+
+      // queue is full at the start
+      lowWaterMark = pulses.count();
+   }
+
+   return running;
+}
+
+/**
+ * reads upcoming pulses into the queue; called from the main loop
+ *
+ * @param  ptr    recorder supplying pulses
+ *
+ * @return true if any transitions were made since the last call
+ */
+bool PlaybackEngine::service(PulseTrainRecorder &ptr) {
+   bool rtn = false;
+
+   if (running) {
+      uint8_t queued = pulses.count();
+
+      if (pulsePending && (queued < lowWaterMark)) {
+         lowWaterMark = queued;
+      }
+
+      // read ahead up to the queue depth; the timer is started
+      // as soon as there is a pulse, as the next read may have
+      // to wait for the card
+      while (pulsePending && (queued < queueDepth)) {
+         queuePulse(ptr);
+         armTimer();
+         pulsePending = ptr.readNextPulse();
+         ++queued;
+      }
+
+      // queued transitions cover the card read, so top up
+      // the recorder's read-ahead while they play
+      if (pulsePending) {
+         ptr.serviceReadAhead();
+      }
+
+      noInterrupts();
+      uint16_t count = edgeCount;
+      interrupts();
+
+      rtn = (count != lastEdgeCount);
+      lastEdgeCount = count;
+
+      // done when nothing is left to decode or to play
+      if (!pulsePending && !timerArmed && (0 == pulses.count())) {
+         running = false;
+         clock.attach(0);
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * starts the timer if it has gone idle, for the oldest queued pulse
+ */
+void PlaybackEngine::armTimer() {
+   noInterrupts();
+
+   if (!timerArmed) {
+      const PlaybackPulse *pulse = pulses.peek();
+      if (pulse) {
+         timerArmed = true;
+         clock.scheduleAt(keyDown ? pulse->endMicros : pulse->startMicros);
+      }
+   }
+
+   interrupts();
+}
+
+/**
+ * stops playback and releases the keying pins
+ */
+void PlaybackEngine::stop() {
+   noInterrupts();
+
+   clock.cancel();
+   clock.attach(0);
+   timerArmed = false;
+
+   interrupts();
+
+   pulses.discard();
+   pulsePending = false;
+   keyDown = false;
+
+   if (running) {
+      keyingPin.writeLogicalValue(LOW);
+      sideTonePin.writeLogicalValue(LOW);
+      running = false;
+   }
+}
+
+/**
+ * makes all transitions that have fallen due, and schedules the
+ * next; called back by the clock, possibly from an interrupt
+ */
+void PlaybackEngine::onTimer() {
+   unsigned long now = clock.nowMicros();
+   const PlaybackPulse *pulse = pulses.peek();
+
+   while (pulse) {
+      unsigned long due = keyDown ? pulse->endMicros : pulse->startMicros;
+      unsigned long late = now - due;
+
+      if ((long)late < 0) {
+         break;
+      }
+
+      if (late > maxLateMicros) {
+         maxLateMicros = late;
+      }
+
+      keyDown = !keyDown;
+      keyingPin.writeLogicalValue(keyDown ? HIGH : LOW);
+      sideTonePin.writeLogicalValue(keyDown ? HIGH : LOW);
+      ++edgeCount;
+
+      // pulse is done with at key up
+      if (!keyDown) {
+         pulses.drop();
+         pulse = pulses.peek();
+      }
+   }
+
+   if (pulse) {
+      clock.scheduleAt(keyDown ? pulse->endMicros : pulse->startMicros);
+   }
+   else {
+      timerArmed = false;
+   }
+}
+
+/**
+ * queues the recorder's current pulse
+ *
+ * @param  ptr    recorder supplying pulses
+ */
+void PlaybackEngine::queuePulse(PulseTrainRecorder &ptr) {
+   PlaybackPulse pulse;
+
+   pulse.startMicros = trainStartMicros + ptr.getPulseStartOffset() * 1000UL;
+   pulse.endMicros   = trainStartMicros + ptr.getPulseEndOffset() * 1000UL;
+
+   // reader fell behind, key down will be late
+   if ((long)(clock.nowMicros() - pulse.startMicros) > 0) {
+      ++underrunCount;
+   }
+
+   pulses.push(pulse);
+}
+
+/**
+ * sets number of pulses to read ahead
+ *
+ * @param  depth  pulses, from 1 to PLAYBACK_PULSE_QUEUE_SIZE - 1
+ */
+void PlaybackEngine::setQueueDepth(uint8_t depth) {
+   if (depth < 1) {
+      depth = 1;
+   }
+   else if (depth > PLAYBACK_PULSE_QUEUE_SIZE - 1) {
+      depth = PLAYBACK_PULSE_QUEUE_SIZE - 1;
+   }
+
+   queueDepth = depth;
+}
+
+/**
+ * gets latest transition made since playback started
+ *
+ * @return microseconds past due
+ */
+unsigned long PlaybackEngine::getMaxLateMicros() const {
+   noInterrupts();
+   unsigned long rtn = maxLateMicros;
+   interrupts();
+
+   return rtn;
+}
@@ -0,0 +1,478 @@
+#ifndef _PLAYBACK_ENGINE_H_
+#define _PLAYBACK_ENGINE_H_
+
+/**
+ * @file    PlaybackEngine.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class definitions for PlaybackEngine and the
+ * PlaybackClock timer abstraction. The engine plays back a pulse
+ * train by scheduling each keying transition on a timer compare,
+ * rather than polling the clock from the main loop.
+ */
+
+#include <Arduino.h>
+
+#include <SpscRing.h>
+#include <DigitalPin.h>
+#include <PulseTrainRecorder.h>
+
+/**
+ * number of ring slots for decoded pulses, must be a power of two;
+ * one slot is always left empty, so up to 7 pulses are read ahead.
+ * setQueueDepth() reads ahead fewer, to size the queue for a card.
+ */
+#define PLAYBACK_PULSE_QUEUE_SIZE  8
+
+/**
+ * struct describing one decoded pulse, scheduled for playback
+ */
+struct PlaybackPulse {
+  /**
+   * time of key down, microseconds since reset
+   */
+   unsigned long startMicros;
+
+  /**
+   * time of key up, microseconds since reset
+   */
+   unsigned long endMicros;
+};
+
+class PlaybackEngine;
+
+/**
+ * Timer abstraction used by the playback engine.
+ *
+ * A clock reports the current time and calls back the attached
+ * engine's onTimer() method at, or as soon as possible after, a
+ * requested time. The callback may come from an interrupt handler.
+ */
+class PlaybackClock {
+protected:
+  /**
+   * engine to call back when the timer expires
+   */
+   PlaybackEngine *engine;
+
+public:
+  /**
+   * PlaybackClock constructor
+   */
+   PlaybackClock()
+   : engine(0)
+   {}
+
+  /**
+   * sets engine to call back when the timer expires
+   *
+   * @param  pe     engine to call back, or 0 for none
+   */
+   void attach(PlaybackEngine *pe) {
+      engine = pe;
+   }
+
+  /**
+   * returns current time
+   *
+   * @return microseconds since reset
+   */
+   virtual unsigned long nowMicros() = 0;
+
+  /**
+   * requests a call back to the engine
+   *
+   * @param  due_us   time of call back, microseconds since reset
+   */
+   virtual void scheduleAt(unsigned long due_us) = 0;
+
+  /**
+   * cancels any pending call back
+   */
+   virtual void cancel() = 0;
+};
+
+#ifdef __AVR__
+/**
+ * Playback clock using the Timer1 output compare A interrupt.
+ *
+ * Timer1 runs free with a prescaler of 64, so compares can be set
+ * with a resolution of 4 microseconds on a 16 MHz board. Waits longer
+ * than one timer period are broken into several compares. Using this
+ * clock takes Timer1 away from analogWrite() on its PWM pins.
+ */
+class Timer1PlaybackClock : public PlaybackClock {
+protected:
+  /**
+   * clock whose engine is called back from the interrupt, if any
+   */
+   static Timer1PlaybackClock *activeClock;
+
+  /**
+   * time of pending call back, microseconds since reset
+   */
+   volatile unsigned long dueMicros;
+
+  /**
+   * sets output compare for the pending call back time
+   */
+   void setCompare();
+
+public:
+  /**
+   * Timer1PlaybackClock constructor
+   */
+   Timer1PlaybackClock()
+   : dueMicros(0)
+   {}
+
+  /**
+   * configures Timer1 for use by this clock
+   */
+   void begin();
+
+  /**
+   * returns current time
+   *
+   * @return microseconds since reset
+   */
+   virtual unsigned long nowMicros() {
+      return micros();
+   }
+
+  /**
+   * requests a call back to the engine
+   *
+   * @param  due_us   time of call back, microseconds since reset
+   */
+   virtual void scheduleAt(unsigned long due_us);
+
+  /**
+   * cancels any pending call back
+   */
+   virtual void cancel();
+
+  /**
+   * body of the compare interrupt handler
+   */
+   static void handleInterrupt();
+};
+#endif // __AVR__
+
+/**
+ * Playback clock driven by a virtual time base.
+ *
+ * Time only moves when advanceTo() is called, and any call back
+ * falling due is made at exactly its scheduled time. This allows
+ * the engine to be run and measured on a host computer.
+ */
+class VirtualPlaybackClock : public PlaybackClock {
+protected:
+  /**
+   * current virtual time, microseconds
+   */
+   unsigned long currentMicros;
+
+  /**
+   * time of pending call back, microseconds
+   */
+   unsigned long dueMicros;
+
+  /**
+   * flag is true if a call back is pending
+   */
+   bool armed;
+
+public:
+  /**
+   * VirtualPlaybackClock constructor
+   */
+   VirtualPlaybackClock()
+   : currentMicros(0)
+   , dueMicros(0)
+   , armed(false)
+   {}
+
+  /**
+   * returns current time
+   *
+   * @return virtual microseconds
+   */
+   virtual unsigned long nowMicros() {
+      return currentMicros;
+   }
+
+  /**
+   * requests a call back to the engine
+   *
+   * @param  due_us   time of call back, virtual microseconds
+   */
+   virtual void scheduleAt(unsigned long due_us) {
+      dueMicros = due_us;
+      armed = true;
+   }
+
+  /**
+   * cancels any pending call back
+   */
+   virtual void cancel() {
+      armed = false;
+   }
+
+  /**
+   * moves virtual time forward, making any call backs that fall due
+   *
+   * @param  time_us  new virtual time, microseconds
+   */
+   void advanceTo(unsigned long time_us);
+};
+
+/**
+ * The Playback Engine reproduces a recorded pulse train on the keying
+ * and side tone pins with timer accuracy.
+ *
+ * Playback is a two stage pipeline. The main loop calls service(),
+ * which reads pulses from the recorder ahead of time and queues them.
+ * The clock call back takes pulses from the queue and makes each
+ * transition when it falls due, so edge timing does not depend on
+ * loop latency or on how long the SD card takes to deliver the next
+ * pulse, as long as the queue holds enough pulses to cover a stall.
+ *
+ * A pulse queued after its key down was due is an underrun, and the
+ * transition is made late. The underrun count, the least number of
+ * pulses found queued ahead, and the latest transition are kept for
+ * each playback to help choose the queue depth.
+ *
+ * The queue is a lock-free ring; the main loop is the only producer
+ * and the clock call back the only consumer.
+ * <p>
+ * The call back writes the keying and side tone pins, from the
+ * Timer1 interrupt. Any pattern still queued on them, such as a 
+ * channel entry tone, is cancelled when playback starts, so it does
+ * not hold back the keying.
+ */
+class PlaybackEngine {
+protected:
+  /**
+   * timer used to schedule transitions
+   */
+   PlaybackClock &clock;
+
+  /**
+   * keying output pin
+   */
+   DigitalOutputPin &keyingPin;
+
+  /**
+   * side tone output pin
+   */
+   DigitalOutputPin &sideTonePin;
+
+  /**
+   * pulses decoded but not yet played
+   */
+   SpscRing<PlaybackPulse, PLAYBACK_PULSE_QUEUE_SIZE> pulses;
+
+  /**
+   * most pulses to read ahead
+   */
+   uint8_t queueDepth;
+
+  /**
+   * flag is true if the oldest queued pulse has keyed down,
+   * written by clock call back
+   */
+   volatile bool keyDown;
+
+  /**
+   * time of the start of the pulse train, microseconds since reset
+   */
+   unsigned long trainStartMicros;
+
+  /**
+   * number of transitions made, written by clock call back
+   */
+   volatile uint16_t edgeCount;
+
+  /**
+   * value of edgeCount at the last service() call
+   */
+   uint16_t lastEdgeCount;
+
+  /**
+   * flag is true while a clock call back is pending
+   */
+   volatile bool timerArmed;
+
+  /**
+   * flag is true if the recorder's current pulse has not been queued
+   */
+   bool pulsePending;
+
+  /**
+   * flag is true while playback is in progress
+   */
+   bool running;
+
+  /**
+   * number of pulses queued after their key down was due
+   */
+   uint16_t underrunCount;
+
+  /**
+   * least number of pulses found queued while more were to come
+   */
+   uint8_t lowWaterMark;
+
+  /**
+   * latest transition made, microseconds past due,
+   * written by clock call back
+   */
+   volatile unsigned long maxLateMicros;
+
+  /**
+   * queues the recorder's current pulse
+   *
+   * @param  ptr    recorder supplying pulses
+   */
+   void queuePulse(PulseTrainRecorder &ptr);
+
+  /**
+   * starts the timer if it has gone idle, for the oldest queued pulse
+   */
+   void armTimer();
+
+public:
+  /**
+   * PlaybackEngine constructor
+   *
+   * @param  clk    timer used to schedule transitions
+   * @param  kp     keying output pin
+   * @param  stp    side tone output pin
+   */
+   PlaybackEngine(PlaybackClock &clk
+                 ,DigitalOutputPin &kp
+                 ,DigitalOutputPin &stp)
+   : clock(clk)
+   , keyingPin(kp)
+   , sideTonePin(stp)
+   , queueDepth(PLAYBACK_PULSE_QUEUE_SIZE - 1)
+   , keyDown(false)
+   , trainStartMicros(0)
+   , edgeCount(0)
+   , lastEdgeCount(0)
+   , timerArmed(false)
+   , pulsePending(false)
+   , running(false)
+   , underrunCount(0)
+   , lowWaterMark(0)
+   , maxLateMicros(0)
+   {}
+
+  /**
+   * starts playback of the pulse train open in the recorder,
+   * cancelling any pattern on the keying and side tone pins
+   *
+   * @param  ptr    recorder open for playback, first pulse loaded
+   *
+   * @return true if playback started
+   */
+   bool start(PulseTrainRecorder &ptr);
+
+  /**
+   * reads upcoming pulses into the queue; called from the main loop
+   *
+   * @param  ptr    recorder supplying pulses
+   *
+   * @return true if any transitions were made since the last call
+   */
+   bool service(PulseTrainRecorder &ptr);
+
+  /**
+   * stops playback and releases the keying pins
+   */
+   void stop();
+
+  /**
+   * gets playback state
+   *
+   * @return true while playback is in progress
+   */
+   bool isActive() const {
+      return running;
+   }
+
+  /**
+   * makes all transitions that have fallen due, and schedules the
+   * next; called back by the clock, possibly from an interrupt
+   */
+   void onTimer();
+
+  /**
+   * sets number of pulses to read ahead
+   *
+   * @param  depth  pulses, from 1 to PLAYBACK_PULSE_QUEUE_SIZE - 1
+   */
+   void setQueueDepth(uint8_t depth);
+
+  /**
+   * gets number of pulses read ahead
+   *
+   * @return queue depth in pulses
+   */
+   uint8_t getQueueDepth() const {
+      return queueDepth;
+   }
+
+  /**
+   * gets number of pulses queued after their key down was due,
+   * since playback started
+   *
+   * @return underrun count
+   */
+   uint16_t getUnderrunCount() const {
+      return underrunCount;
+   }
+
+  /**
+   * gets least number of pulses found queued ahead while more
+   * were to come, since playback started
+   *
+   * @return pulses queued at the lowest point
+   */
+   uint8_t getLowWaterMark() const {
+      return lowWaterMark;
+   }
+
+  /**
+   * gets latest transition made since playback started
+   *
+   * @return microseconds past due
+   */
+   unsigned long getMaxLateMicros() const;
+};
+
+#endif // _PLAYBACK_ENGINE_H_
@@ -0,0 +1,124 @@
+/**
+ * @file    PortDebouncer.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class implementation for PortDebouncer. This
+ * class samples every digital input pin at once and debounces them
+ * all together with vertical counters.
+ */
+
+#include <Arduino.h>
+#include <PortDebouncer.h>
+
+/**
+ * reads the level of every pin
+ *
+ * @return pin levels, pin n in bit n
+ */
+uint32_t PortDebouncer::readPins() {
+   uint32_t rtn = 0;
+
+#ifdef __AVR__
+   // one read per port, pins 0-7 on D, 8-13 on B, 14-19 on C
+   rtn  = (uint32_t)PIND;
+   rtn |= (uint32_t)(PINB & 0x3F) << 8;
+   rtn |= (uint32_t)(PINC & 0x3F) << 14;
+#else
+   for (uint8_t pin=0; pin<PORT_DEBOUNCE_PIN_COUNT; ++pin) {
+      if (HIGH == digitalRead(pin)) {
+         rtn |= (uint32_t)1 << pin;
+      }
+   }
+#endif
+
+   return rtn;
+}
+
+/**
+ * takes the current pin levels as debounced; called once the pins
+ * have been initialized
+ */
+void PortDebouncer::begin() {
+   stableState = readPins();
+   count0 = count1 = ~(uint32_t)0;
+   changedMask = 0;
+}
+
+/**
+ * samples all pins and steps every counter; called once 
+ * each sample period
+ *
+ * @return pins whose debounced level changed on this sample
+ */
+uint32_t PortDebouncer::sample() {
+   // pins that differ from their debounced level
+   uint32_t delta = readPins() ^ stableState;
+
+   // counters count down through 3,2,1,0 while the pin differs,
+   // and go back to 3 as soon as it agrees again
+   count0 = ~(count0 & delta);
+   count1 = count0 ^ (count1 & delta);
+
+   // a counter rolling over to 3 while the pin still 
+   // differs means the new level has held long enough
+   uint32_t toggle = delta & count0 & count1;
+
+   if (toggle) {
+      unsigned long tm = millis() 
+                 - (unsigned long)samplePeriod * (PORT_DEBOUNCE_SAMPLES - 1);
+
+      stableState ^= toggle;
+      changedMask |= toggle;
+
+      // the key keeps its own time, buttons share the other
+      if (toggle & keyMask) {
+         keyChangeTime = tm;
+      }
+
+      if (toggle & ~keyMask) {
+         changeTime = tm;
+      }
+   }
+
+   return toggle;
+}
+
+/**
+ * takes a pin's changed flag, clearing it
+ *
+ * @param  pin    pin number
+ *
+ * @return true if the pin's debounced level has changed
+ *         since the flag was last taken
+ */
+bool PortDebouncer::takeChange(uint8_t pin) {
+   uint32_t bit = (uint32_t)1 << pin;
+   bool rtn = (0 != (changedMask & bit));
+
+   changedMask &= ~bit;
+
+   return rtn;
+}
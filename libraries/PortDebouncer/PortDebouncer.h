@@ -0,0 +1,197 @@
+#ifndef _PORT_DEBOUNCER_H_
+#define _PORT_DEBOUNCER_H_
+
+/**
+ * @file    PortDebouncer.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the class definition for PortDebouncer. This
+ * class samples every digital input pin at once and debounces them
+ * all together with vertical counters.
+ */
+
+#include <Arduino.h>
+
+/**
+ * debouncer constants
+ * <p>
+ * PORT_DEBOUNCE_SAMPLES is the number of samples in a row a pin must
+ * hold a new level before the change is accepted. It is fixed by the
+ * two bit vertical counter.
+ * <p>
+ * PORT_DEBOUNCE_PIN_COUNT is the number of digital pins sampled, 
+ * pins 0-19 on the Arduino UNO R3. Pin n is held in bit n of each
+ * sample.
+ */
+#define PORT_DEBOUNCE_SAMPLES    4
+#define PORT_DEBOUNCE_PIN_COUNT  20
+
+/**
+ * The Port Debouncer reads all three i/o ports in one pass and 
+ * debounces every pin at the same time.
+ *
+ * Each pin has a two bit counter, but the counters are stored
+ * "vertically": bit n of count0 and count1 together make the counter
+ * for pin n. A handful of bitwise operations on the whole sample 
+ * then steps all twenty counters at once, so watching more pins 
+ * costs no extra time per sample.
+ *
+ * A pin's counter runs while its sampled level differs from its 
+ * debounced level and is reset whenever they agree. When the counter
+ * rolls over the debounced level is flipped and the pin's bit is set
+ * in the changed mask, where it stays until taken by the pin.
+ * <p>
+ * The time of a change is kept for the keying pin on its own, so a
+ * button changing before the key's change has been taken does not
+ * move the key's edge. The other pins share one time.
+ */
+class PortDebouncer {
+protected:
+  /**
+   * debounced level of every pin
+   */
+   uint32_t stableState;
+
+  /**
+   * low bits of the vertical counters
+   */
+   uint32_t count0;
+
+  /**
+   * high bits of the vertical counters
+   */
+   uint32_t count1;
+
+  /**
+   * pins whose debounced level has changed and not been taken
+   */
+   uint32_t changedMask;
+
+  /**
+   * estimated time of the latest accepted change of any pin
+   * but the keying pin, milliseconds
+   */
+   unsigned long changeTime;
+
+  /**
+   * estimated time of the latest accepted change of the 
+   * keying pin, milliseconds
+   */
+   unsigned long keyChangeTime;
+
+  /**
+   * keying pin, as a bit in a sample; 0 if there is none
+   */
+   uint32_t keyMask;
+
+  /**
+   * time between samples, milliseconds
+   */
+   unsigned int samplePeriod;
+
+  /**
+   * reads the level of every pin
+   *
+   * @return pin levels, pin n in bit n
+   */
+   static uint32_t readPins();
+
+public:
+  /**
+   * PortDebouncer constructor
+   *
+   * @param  period_mils  time between calls to sample(), milliseconds
+   */
+   PortDebouncer(unsigned int period_mils)
+   : stableState(0)
+   , count0(0)
+   , count1(0)
+   , changedMask(0)
+   , changeTime(0)
+   , keyChangeTime(0)
+   , keyMask(0)
+   , samplePeriod(period_mils)
+   {}
+
+  /**
+   * takes the current pin levels as debounced; called once the pins
+   * have been initialized
+   */
+   void begin();
+
+  /**
+   * sets the pin whose changes are timed on their own
+   *
+   * @param  pin    keying pin number
+   */
+   void setKeyPin(uint8_t pin) {
+      keyMask = (uint32_t)1 << pin;
+   }
+
+  /**
+   * samples all pins and steps every counter; called once 
+   * each sample period
+   *
+   * @return pins whose debounced level changed on this sample
+   */
+   uint32_t sample();
+
+  /**
+   * returns debounced level of a pin
+   *
+   * @param  pin    pin number
+   *
+   * @return a physical state value from {LOW,HIGH}
+   */
+   int readState(uint8_t pin) const {
+      return (stableState & ((uint32_t)1 << pin)) ? HIGH : LOW;
+   }
+
+  /**
+   * takes a pin's changed flag, clearing it
+   *
+   * @param  pin    pin number
+   *
+   * @return true if the pin's debounced level has changed
+   *         since the flag was last taken
+   */
+   bool takeChange(uint8_t pin);
+
+  /**
+   * returns estimated time of the latest accepted change of a pin,
+   * taken as the first of the samples that confirmed it; pins other
+   * than the keying pin share one time
+   *
+   * @param  pin    pin number
+   *
+   * @return milliseconds since reset
+   */
+   unsigned long getChangeTime(uint8_t pin) const {
+      return (keyMask & ((uint32_t)1 << pin)) ? keyChangeTime : changeTime;
+   }
+};
+
+#endif // _PORT_DEBOUNCER_H_
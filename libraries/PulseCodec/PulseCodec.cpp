@@ -0,0 +1,1021 @@
+/**
+ * @file    PulseCodec.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class implementations for PulseCodec, 
+ * PulseSymbolModel, PulseEncoder and PulseDecoder. These classes
+ * convert pulse trains to and from the compact binary channel file
+ * format.
+ */
+
+#include <Arduino.h>
+#include <PulseCodec.h>
+
+/**
+ * stores a little-endian field in a header
+ */
+static void putField(uint8_t *buf, unsigned long value, uint8_t size) {
+   for (uint8_t ii=0; ii<size; ++ii) {
+      buf[ii] = value & 0xFF;
+      value >>= 8;
+   }
+}
+
+/**
+ * fetches a little-endian field from a header
+ */
+static unsigned long getField(const uint8_t *buf, uint8_t size) {
+   unsigned long rtn = 0;
+
+   while (size-- > 0) {
+      rtn = (rtn << 8) | buf[size];
+   }
+
+   return rtn;
+}
+
+/**
+ * appends bits to a record, most significant first; the
+ * record must start out zeroed
+ */
+static void putBits(uint8_t *buf, unsigned int &pos, unsigned long value, uint8_t count) {
+   while (count-- > 0) {
+      if ((value >> count) & 1) {
+         buf[pos >> 3] |= 0x80 >> (pos & 7);
+      }
+      ++pos;
+   }
+}
+
+/**
+ * fetches bits from a record, most significant first
+ *
+ * @return false if the record ends first
+ */
+static bool getBits(const uint8_t *buf, unsigned int limit, unsigned int &pos, uint8_t count, unsigned long &value) {
+   bool rtn = (pos + count <= limit);
+
+   value = 0;
+   while (rtn && (count-- > 0)) {
+      value = (value << 1) | ((buf[pos >> 3] >> (7 - (pos & 7))) & 1);
+      ++pos;
+   }
+
+   return rtn;
+}
+
+/**
+ * appends an Exp-Golomb code of a given order to a record
+ */
+static void putExpGolomb(uint8_t *buf, unsigned int &pos, unsigned long value, uint8_t order) {
+   unsigned long word = value + (1UL << order);
+   uint8_t width = order + 1;
+
+   while ((width < 32) && (word >> width)) {
+      ++width;
+   }
+
+   // a zero for each bit the value needs over the order,
+   // then the value offset so its top bit is set
+   putBits(buf, pos, 0, width - 1 - order);
+   putBits(buf, pos, word, width);
+}
+
+/**
+ * fetches an Exp-Golomb code of a given order from a record
+ *
+ * @return false if the record ends first, or the code is
+ *         longer than 32 bits
+ */
+static bool getExpGolomb(const uint8_t *buf, unsigned int limit, unsigned int &pos, uint8_t order, unsigned long &value) {
+   uint8_t zeros = 0;
+   unsigned long bit = 0;
+   bool rtn = getBits(buf, limit, pos, 1, bit);
+
+   while (rtn && !bit) {
+      ++zeros;
+      rtn = (zeros + order < 32) && getBits(buf, limit, pos, 1, bit);
+   }
+
+   rtn = rtn && getBits(buf, limit, pos, zeros + order, value);
+   if (rtn) {
+      value = (value | (1UL << (zeros + order))) - (1UL << order);
+   }
+
+   return rtn;
+}
+
+/**
+ * folds a residual to unsigned, 0, -1, 1, -2 ...
+ */
+static unsigned long foldResidual(long residual) {
+   return (residual < 0) ? ((unsigned long)(-residual) << 1) - 1 
+                         : ((unsigned long)residual << 1);
+}
+
+/**
+ * unfolds a residual folded by foldResidual()
+ */
+static long unfoldResidual(unsigned long folded) {
+   return (folded & 1) ? -(long)((folded >> 1) + 1) : (long)(folded >> 1);
+}
+
+/**
+ * writes empty binary channel file header to buffer
+ *
+ * @param  buf    destination, at least PULSE_FILE_HEADER_SIZE bytes
+ *
+ * @return number of bytes written
+ */
+uint8_t PulseCodec::writeHeader(uint8_t *buf) {
+   memset(buf, 0, PULSE_FILE_HEADER_SIZE);
+
+   buf[0] = PULSE_FILE_MAGIC_0;
+   buf[1] = PULSE_FILE_MAGIC_1;
+   buf[2] = PULSE_FILE_MAGIC_2;
+   buf[3] = PULSE_FILE_VERSION;
+
+   return PULSE_FILE_HEADER_SIZE;
+}
+
+/**
+ * writes binary channel file header holding a channel summary
+ *
+ * @param  buf    destination, at least PULSE_FILE_HEADER_SIZE bytes
+ * @param  info   channel summary; a version of 0 is taken as
+ *                PULSE_FILE_VERSION
+ *
+ * @return number of bytes written
+ */
+uint8_t PulseCodec::writeHeader(uint8_t *buf, const PulseChannelInfo &info) {
+   writeHeader(buf);
+
+   // a recording repaired keeps the version it was made in
+   if (info.version) {
+      buf[3] = info.version;
+   }
+
+   buf[PULSE_HEADER_FLAGS] = PULSE_HEADER_FLAG_FINAL;
+   if (info.recovered) {
+      buf[PULSE_HEADER_FLAGS] |= PULSE_HEADER_FLAG_RECOVERED;
+   }
+   if (info.hasFist) {
+      buf[PULSE_HEADER_FLAGS] |= PULSE_HEADER_FLAG_FIST;
+      buf[PULSE_HEADER_FIST_DAH_RATIO]    = info.fist.dahRatio;
+      buf[PULSE_HEADER_FIST_WEIGHT]       = info.fist.weight;
+      buf[PULSE_HEADER_FIST_LETTER_RATIO] = info.fist.letterRatio;
+      buf[PULSE_HEADER_FIST_WORD_RATIO]   = info.fist.wordRatio;
+      buf[PULSE_HEADER_FIST_MARK_JITTER]  = info.fist.markJitter;
+      buf[PULSE_HEADER_FIST_SPACE_JITTER] = info.fist.spaceJitter;
+      putField(buf + PULSE_HEADER_FIST_DRIFT, (uint16_t)info.fist.drift, 2);
+   }
+   putField(buf + PULSE_HEADER_WPM,         info.wpm,            2);
+   putField(buf + PULSE_HEADER_PULSE_COUNT, info.pulseCount,     4);
+   putField(buf + PULSE_HEADER_DURATION,    info.durationMillis, 4);
+   putField(buf + PULSE_HEADER_DATA_LENGTH, info.dataLength,     4);
+   putField(buf + PULSE_HEADER_DATA_CRC,    info.dataCrc,        2);
+
+   uint16_t crc = updateCrc(PULSE_CODEC_CRC_INIT, buf, PULSE_HEADER_CRC);
+   putField(buf + PULSE_HEADER_CRC, crc, 2);
+
+   return PULSE_FILE_HEADER_SIZE;
+}
+
+/**
+ * reads the channel summary from a binary channel file header
+ *
+ * @param  buf    bytes read from the start of the file
+ * @param  len    number of bytes available in buf
+ * @param  info   receives the summary; version is set for any
+ *                binary file, the rest only if finalized
+ *
+ * @return true if the header holds a finalized summary
+ */
+bool PulseCodec::readHeader(const uint8_t *buf, int len, PulseChannelInfo &info) {
+   info = PulseChannelInfo();
+
+   if (PULSE_FORMAT_BINARY == detectFormat(buf, len)) {
+      info.version = buf[3];
+
+      if (   (PULSE_FILE_VERSION_1 != info.version)
+          && (len >= PULSE_FILE_HEADER_SIZE)
+          && (buf[PULSE_HEADER_FLAGS] & PULSE_HEADER_FLAG_FINAL)
+          && (   updateCrc(PULSE_CODEC_CRC_INIT, buf, PULSE_HEADER_CRC)
+              == getField(buf + PULSE_HEADER_CRC, 2))) {
+         info.finalized      = true;
+         info.recovered      = (buf[PULSE_HEADER_FLAGS] & PULSE_HEADER_FLAG_RECOVERED) != 0;
+         info.wpm            = getField(buf + PULSE_HEADER_WPM,         2);
+         info.pulseCount     = getField(buf + PULSE_HEADER_PULSE_COUNT, 4);
+         info.durationMillis = getField(buf + PULSE_HEADER_DURATION,    4);
+         info.dataLength     = getField(buf + PULSE_HEADER_DATA_LENGTH, 4);
+         info.dataCrc        = getField(buf + PULSE_HEADER_DATA_CRC,    2);
+         info.hasFist        = (buf[PULSE_HEADER_FLAGS] & PULSE_HEADER_FLAG_FIST) != 0;
+      }
+
+      if (info.hasFist) {
+         info.fist.dahRatio    = buf[PULSE_HEADER_FIST_DAH_RATIO];
+         info.fist.weight      = buf[PULSE_HEADER_FIST_WEIGHT];
+         info.fist.letterRatio = buf[PULSE_HEADER_FIST_LETTER_RATIO];
+         info.fist.wordRatio   = buf[PULSE_HEADER_FIST_WORD_RATIO];
+         info.fist.markJitter  = buf[PULSE_HEADER_FIST_MARK_JITTER];
+         info.fist.spaceJitter = buf[PULSE_HEADER_FIST_SPACE_JITTER];
+         info.fist.drift       = (int16_t)getField(buf + PULSE_HEADER_FIST_DRIFT, 2);
+      }
+   }
+
+   return info.finalized;
+}
+
+/**
+ * gets size of the header at the start of a binary channel file,
+ * with any padding; the first pulse record or block follows it
+ *
+ * @param  buf    bytes read from the start of the file
+ * @param  len    number of bytes available in buf
+ *
+ * @return header size, 0 if not a binary file
+ */
+unsigned int PulseCodec::getHeaderSize(const uint8_t *buf, int len) {
+   unsigned int rtn = 0;
+
+   if (PULSE_FORMAT_BINARY == detectFormat(buf, len)) {
+      switch (buf[3]) {
+         case PULSE_FILE_VERSION_1:
+            rtn = PULSE_FILE_HEADER_SIZE_1;
+            break;
+
+         case PULSE_FILE_VERSION_2:
+            rtn = PULSE_FILE_HEADER_SIZE;
+            break;
+
+         default:
+            rtn = PULSE_BLOCK_SIZE;
+            break;
+      };
+   }
+
+   return rtn;
+}
+
+/**
+ * tests whether a binary channel file holds its pulse records
+ * in blocks
+ *
+ * @param  buf    bytes read from the start of the file
+ * @param  len    number of bytes available in buf
+ *
+ * @return true for version 3 and later files
+ */
+bool PulseCodec::isBlocked(const uint8_t *buf, int len) {
+   return (   (PULSE_FORMAT_BINARY == detectFormat(buf, len))
+           && (PULSE_FILE_VERSION_3 <= buf[3]));
+}
+
+/**
+ * writes a block header over the start of a block, completing 
+ * its CRC; the pulse records must already be in place after it
+ *
+ * @param  block  block, header then pulse records
+ * @param  hdr    header to write
+ */
+void PulseCodec::writeBlockHeader(uint8_t *block, const PulseBlockHeader &hdr) {
+   block[PULSE_BLOCK_MARK] = PULSE_BLOCK_COMMITTED;
+   block[PULSE_BLOCK_UNIT] = hdr.unit;
+   putField(block + PULSE_BLOCK_LENGTH,      hdr.length,     2);
+   putField(block + PULSE_BLOCK_PULSE_COUNT, hdr.pulseCount, 4);
+   putField(block + PULSE_BLOCK_RESUME_TIME, hdr.resumeTime, 4);
+   putField(block + PULSE_BLOCK_DATA_LENGTH, hdr.dataLength, 4);
+   putField(block + PULSE_BLOCK_DATA_CRC,    hdr.dataCrc,    2);
+
+   uint16_t crc = updateCrc(PULSE_CODEC_CRC_INIT, block, PULSE_BLOCK_CRC);
+   crc = updateCrc(crc, block + PULSE_BLOCK_HEADER_SIZE, hdr.length);
+   putField(block + PULSE_BLOCK_CRC, crc, 2);
+}
+
+/**
+ * reads a block header; the mark and length are checked, 
+ * but not the CRC
+ *
+ * @param  block  bytes read from the start of a block
+ * @param  len    number of bytes available in block
+ * @param  hdr    receives the header
+ *
+ * @return true if the header is committed and its length fits
+ */
+bool PulseCodec::readBlockHeader(const uint8_t *block, int len, PulseBlockHeader &hdr) {
+   bool rtn = false;
+
+   if (   (len >= PULSE_BLOCK_HEADER_SIZE)
+       && (PULSE_BLOCK_COMMITTED == block[PULSE_BLOCK_MARK])) {
+      hdr.unit       = block[PULSE_BLOCK_UNIT];
+      hdr.length     = getField(block + PULSE_BLOCK_LENGTH,      2);
+      hdr.pulseCount = getField(block + PULSE_BLOCK_PULSE_COUNT, 4);
+      hdr.resumeTime = getField(block + PULSE_BLOCK_RESUME_TIME, 4);
+      hdr.dataLength = getField(block + PULSE_BLOCK_DATA_LENGTH, 4);
+      hdr.dataCrc    = getField(block + PULSE_BLOCK_DATA_CRC,    2);
+
+      rtn = (hdr.length <= PULSE_BLOCK_PAYLOAD_MAX);
+   }
+
+   return rtn;
+}
+
+/**
+ * checks the CRC of a whole block
+ *
+ * @param  block  block, header then pulse records
+ * @param  hdr    header read from the block
+ *
+ * @return true if the block is intact
+ */
+bool PulseCodec::checkBlock(const uint8_t *block, const PulseBlockHeader &hdr) {
+   uint16_t crc = updateCrc(PULSE_CODEC_CRC_INIT, block, PULSE_BLOCK_CRC);
+   crc = updateCrc(crc, block + PULSE_BLOCK_HEADER_SIZE, hdr.length);
+
+   return crc == getField(block + PULSE_BLOCK_CRC, 2);
+}
+
+/**
+ * gets number of segments in a channel file
+ *
+ * @param  buf    bytes read from the start of the file
+ * @param  len    number of bytes available in buf
+ *
+ * @return number of segments, 1 if the file has no segment table
+ */
+unsigned int PulseCodec::getSegmentCount(const uint8_t *buf, int len) {
+   unsigned int rtn = 1;
+
+   if (isBlocked(buf, len) && (len >= PULSE_SEGMENT_TABLE)) {
+      unsigned int count = getField(buf + PULSE_SEGMENT_COUNT, 2);
+
+      if ((count > 0) && (count <= PULSE_SEGMENT_MAX)) {
+         rtn = count;
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * adds a segment to the segment table of a version 3 or 4 file
+ *
+ * @param  sector   header sector of the file
+ * @param  position file position of the first block of the segment
+ *
+ * @return true if added, false if the table is full
+ */
+bool PulseCodec::addSegment(uint8_t *sector, unsigned long position) {
+   bool rtn = false;
+   unsigned int count = getField(sector + PULSE_SEGMENT_COUNT, 2);
+
+   // a file without a table has one segment, after the header
+   if ((0 == count) || (count > PULSE_SEGMENT_MAX)) {
+      putField(sector + PULSE_SEGMENT_TABLE, PULSE_BLOCK_SIZE, PULSE_SEGMENT_ENTRY_SIZE);
+      count = 1;
+   }
+
+   uint8_t *last = sector + PULSE_SEGMENT_TABLE + (count - 1) * PULSE_SEGMENT_ENTRY_SIZE;
+
+   // a segment cut off before its first block was written is
+   // replaced, as the new one starts in the same place
+   if (getField(last, PULSE_SEGMENT_ENTRY_SIZE) >= position) {
+      putField(last, position, PULSE_SEGMENT_ENTRY_SIZE);
+      rtn = true;
+   }
+   else if (count < PULSE_SEGMENT_MAX) {
+      putField(last + PULSE_SEGMENT_ENTRY_SIZE, position, PULSE_SEGMENT_ENTRY_SIZE);
+      ++count;
+      rtn = true;
+   }
+
+   putField(sector + PULSE_SEGMENT_COUNT, count, 2);
+
+   return rtn;
+}
+
+/**
+ * reads one segment table entry
+ *
+ * @param  buf    PULSE_SEGMENT_ENTRY_SIZE bytes read from the table
+ *
+ * @return file position of the first block of the segment
+ */
+unsigned long PulseCodec::readSegmentEntry(const uint8_t *buf) {
+   return getField(buf, PULSE_SEGMENT_ENTRY_SIZE);
+}
+
+/**
+ * writes seek index file header to buffer
+ *
+ * @param  buf    destination, at least PULSE_INDEX_HEADER_SIZE bytes
+ *
+ * @return number of bytes written
+ */
+uint8_t PulseCodec::writeIndexHeader(uint8_t *buf) {
+   buf[0] = PULSE_FILE_MAGIC_0;
+   buf[1] = PULSE_FILE_MAGIC_1;
+   buf[2] = PULSE_INDEX_MAGIC_2;
+   buf[3] = PULSE_INDEX_VERSION;
+
+   return PULSE_INDEX_HEADER_SIZE;
+}
+
+/**
+ * tests for a seek index file header
+ *
+ * @param  buf    bytes read from the start of the file
+ * @param  len    number of bytes available in buf
+ *
+ * @return true if the header is one this version can read
+ */
+bool PulseCodec::isIndexHeader(const uint8_t *buf, int len) {
+   return (   (len >= PULSE_INDEX_HEADER_SIZE)
+           && (PULSE_FILE_MAGIC_0  == buf[0])
+           && (PULSE_FILE_MAGIC_1  == buf[1])
+           && (PULSE_INDEX_MAGIC_2 == buf[2])
+           && (PULSE_INDEX_VERSION == buf[3]));
+}
+
+/**
+ * writes seek index entry to buffer
+ *
+ * @param  buf    destination, at least PULSE_INDEX_ENTRY_SIZE bytes
+ * @param  entry  entry to write
+ *
+ * @return number of bytes written
+ */
+uint8_t PulseCodec::writeIndexEntry(uint8_t *buf, const PulseIndexEntry &entry) {
+   putField(buf + PULSE_INDEX_POSITION,    entry.position,   4);
+   putField(buf + PULSE_INDEX_RESUME_TIME, entry.resumeTime, 4);
+   putField(buf + PULSE_INDEX_START_TIME,  entry.startTime,  4);
+   buf[PULSE_INDEX_FLAGS] = entry.flags;
+
+   return PULSE_INDEX_ENTRY_SIZE;
+}
+
+/**
+ * reads seek index entry from buffer
+ *
+ * @param  buf    PULSE_INDEX_ENTRY_SIZE bytes read from the index
+ * @param  entry  receives the entry
+ */
+void PulseCodec::readIndexEntry(const uint8_t *buf, PulseIndexEntry &entry) {
+   entry.position   = getField(buf + PULSE_INDEX_POSITION,    4);
+   entry.resumeTime = getField(buf + PULSE_INDEX_RESUME_TIME, 4);
+   entry.startTime  = getField(buf + PULSE_INDEX_START_TIME,  4);
+   entry.flags      = buf[PULSE_INDEX_FLAGS];
+}
+
+/**
+ * updates a CRC-16/CCITT with more bytes
+ *
+ * @param  crc    CRC so far, PULSE_CODEC_CRC_INIT to start
+ * @param  buf    bytes to add
+ * @param  len    number of bytes in buf
+ *
+ * @return updated CRC
+ */
+uint16_t PulseCodec::updateCrc(uint16_t crc, const uint8_t *buf, unsigned int len) {
+   while (len-- > 0) {
+      crc ^= ((uint16_t)*buf++) << 8;
+
+      for (uint8_t bit=0; bit<8; ++bit) {
+         crc = (crc & 0x8000) ? (crc << 1) ^ PULSE_CODEC_CRC_POLY : (crc << 1);
+      }
+   }
+
+   return crc;
+}
+
+/**
+ * determines file format from the first bytes of a channel file
+ *
+ * @param  buf    bytes read from the start of the file
+ * @param  len    number of bytes available in buf
+ *
+ * @return file format, value in {UNKNOWN, TEXT, BINARY}
+ */
+PulseFileFormat PulseCodec::detectFormat(const uint8_t *buf, int len) {
+   PulseFileFormat rtn = PULSE_FORMAT_UNKNOWN;
+
+   if (   (len >= PULSE_FILE_HEADER_SIZE_1)
+       && (PULSE_FILE_MAGIC_0 == buf[0])
+       && (PULSE_FILE_MAGIC_1 == buf[1])
+       && (PULSE_FILE_MAGIC_2 == buf[2])) {
+      // only versions we know how to read are accepted
+      if (   (PULSE_FILE_VERSION_1 == buf[3])
+          || (   (PULSE_FILE_VERSION_2 <= buf[3])
+              && (PULSE_FILE_VERSION   >= buf[3])
+              && (len >= PULSE_FILE_HEADER_SIZE))) {
+         rtn = PULSE_FORMAT_BINARY;
+      }
+   }
+   else if ((len > 0) && (buf[0] >= '0') && (buf[0] <= '9')) {
+      // legacy files start with the first pulse start time
+      rtn = PULSE_FORMAT_TEXT;
+   }
+
+   return rtn;
+}
+
+/**
+ * starts the model afresh
+ *
+ * @param  unit   unit length, milliseconds; 0 for the default
+ */
+void PulseSymbolModel::reset(uint8_t unit) {
+   seed((unsigned long)(unit ? unit : PULSE_SYMBOL_UNIT_DEFAULT) << 4);
+
+   for (uint8_t ii=0; ii<PULSE_SYMBOL_CLASSES; ++ii) {
+      residualTotal[ii] = PULSE_SYMBOL_ORDER_SEED;
+      residualCount[ii] = 1;
+   }
+}
+
+/**
+ * sets every class mean from a unit length
+ *
+ * @param  unit   unit length, sixteenths of a millisecond
+ */
+void PulseSymbolModel::seed(unsigned long unit) {
+   static const uint8_t units[PULSE_SYMBOL_CLASSES] = { 1, 3, 1, 3, 7 };
+
+   // a word space must fit its mean
+   if (unit > PULSE_SYMBOL_MEAN_MAX / 7) {
+      unit = PULSE_SYMBOL_MEAN_MAX / 7;
+   }
+   else if (unit < 16) {
+      unit = 16;
+   }
+
+   for (uint8_t ii=0; ii<PULSE_SYMBOL_CLASSES; ++ii) {
+      mean[ii] = unit * units[ii];
+   }
+}
+
+/**
+ * gets the unit length the model has come to, for starting
+ * the next block
+ *
+ * @return mean dit length, milliseconds, at least 1
+ */
+uint8_t PulseSymbolModel::getUnit() const {
+   unsigned int rtn = (mean[PULSE_SYMBOL_DIT] + 8) >> 4;
+
+   if (rtn > PULSE_SYMBOL_UNIT_MAX) {
+      rtn = PULSE_SYMBOL_UNIT_MAX;
+   }
+
+   return (rtn > 0) ? rtn : 1;
+}
+
+/**
+ * classifies a mark or space by the nearest class mean
+ *
+ * @param  kind   PULSE_SYMBOL_MARK or PULSE_SYMBOL_SPACE
+ * @param  len    length, milliseconds
+ *
+ * @return symbol class
+ */
+uint8_t PulseSymbolModel::classify(uint8_t kind, unsigned long len) const {
+   uint8_t rtn = PULSE_SYMBOL_DIT;
+
+   // twice the length in sixteenths, against the sum of
+   // the means either side, is the length against the 
+   // point half way between them
+   unsigned long twice = (len < (PULSE_SYMBOL_MEAN_MAX >> 4)) 
+                       ? (len << 5) : (PULSE_SYMBOL_MEAN_MAX << 1);
+
+   if (PULSE_SYMBOL_MARK == kind) {
+      if (twice >= (unsigned long)mean[PULSE_SYMBOL_DIT] + mean[PULSE_SYMBOL_DAH]) {
+         rtn = PULSE_SYMBOL_DAH;
+      }
+   }
+   else if (twice < (unsigned long)mean[PULSE_SYMBOL_ELEMENT] + mean[PULSE_SYMBOL_LETTER]) {
+      rtn = PULSE_SYMBOL_ELEMENT;
+   }
+   else if (twice < (unsigned long)mean[PULSE_SYMBOL_LETTER] + mean[PULSE_SYMBOL_WORD]) {
+      rtn = PULSE_SYMBOL_LETTER;
+   }
+   else {
+      rtn = PULSE_SYMBOL_WORD;
+   }
+
+   return rtn;
+}
+
+/**
+ * gets the order of the Exp-Golomb code for the next residual
+ * of a class
+ *
+ * @param  cls    symbol class
+ *
+ * @return order, at most PULSE_SYMBOL_ORDER_MAX
+ */
+uint8_t PulseSymbolModel::getOrder(uint8_t cls) const {
+   uint8_t rtn = 0;
+
+   // least order whose values reach the mean folded residual
+   while (   (rtn < PULSE_SYMBOL_ORDER_MAX)
+          && (((unsigned long)residualCount[cls] << rtn) < residualTotal[cls])) {
+      ++rtn;
+   }
+
+   return rtn;
+}
+
+/**
+ * moves the model on after a mark or space has been coded
+ *
+ * @param  cls    symbol class
+ * @param  len    length, milliseconds
+ * @param  folded folded residual
+ */
+void PulseSymbolModel::update(uint8_t cls, unsigned long len, unsigned long folded) {
+   residualTotal[cls] = (folded < 0xFFFFUL - residualTotal[cls]) ? residualTotal[cls] + folded : 0xFFFF;
+   if (++residualCount[cls] >= PULSE_SYMBOL_ORDER_RESET) {
+      residualTotal[cls] >>= 1;
+      residualCount[cls] >>= 1;
+   }
+
+   unsigned long target = (len < (PULSE_SYMBOL_MEAN_MAX >> 4)) ? (len << 4) : PULSE_SYMBOL_MEAN_MAX;
+
+   // a dit well short of the mean, or a dah well over it, means
+   // the sending is faster or slower than the model, or that dits
+   // and dahs have been taken for one class; start again from it
+   if ((PULSE_SYMBOL_DIT == cls) && (3 * target < 2UL * mean[cls])) {
+      seed(target);
+   }
+   else if ((PULSE_SYMBOL_DAH == cls) && (target > 2UL * mean[cls])) {
+      seed(target / 3);
+   }
+   else {
+      // otherwise move an eighth of the way to the length,
+      // no more than half or twice the mean
+      if (target < (unsigned long)(mean[cls] >> 1)) {
+         target = mean[cls] >> 1;
+      }
+      else if (target > 2UL * mean[cls]) {
+         target = 2UL * mean[cls];
+      }
+
+      long moved = (long)mean[cls] + ((long)target - (long)mean[cls]) / 8;
+      mean[cls] = (moved < 16) ? 16 : ((moved > (long)PULSE_SYMBOL_MEAN_MAX) ? PULSE_SYMBOL_MEAN_MAX : moved);
+   }
+}
+
+/**
+ * codes a pulse or a segment marker as a symbol record
+ *
+ * @param  buf    destination, at least PULSE_SYMBOL_RECORD_MAX bytes
+ * @param  space  space length, milliseconds
+ * @param  mark   mark length, milliseconds, ignored for a marker
+ * @param  marker true for a segment marker
+ *
+ * @return number of bytes written
+ */
+uint8_t PulseSymbolModel::encode(uint8_t *buf, unsigned long space, unsigned long mark, bool marker) {
+   unsigned int pos = 0;
+
+   // hours long lengths are cut short
+   if (space > PULSE_SYMBOL_SPACE_MAX) {
+      space = PULSE_SYMBOL_SPACE_MAX;
+   }
+   if (mark > PULSE_SYMBOL_MARK_MAX) {
+      mark = PULSE_SYMBOL_MARK_MAX;
+   }
+
+   uint8_t space_class = classify(PULSE_SYMBOL_SPACE, space);
+   unsigned long space_folded = 0;
+   bool escaped = marker || (space > ((unsigned long)mean[PULSE_SYMBOL_WORD] >> 3));
+
+   memset(buf, 0, PULSE_SYMBOL_RECORD_MAX);
+
+   if (escaped) {
+      // 111, then the space whole
+      putBits(buf, pos, 7, 3);
+      putExpGolomb(buf, pos, space, PULSE_SYMBOL_ESCAPE_ORDER);
+      putBits(buf, pos, marker ? 1 : 0, 1);
+   }
+   else {
+      // 0, 10 or 110, then the residual
+      uint8_t width = space_class - PULSE_SYMBOL_ELEMENT + 1;
+      space_folded = foldResidual((long)space - (long)((mean[space_class] + 8) >> 4));
+
+      putBits(buf, pos, ((1 << width) - 1) & ~1, width);
+      putExpGolomb(buf, pos, space_folded, getOrder(space_class));
+   }
+
+   if (!marker) {
+      uint8_t mark_class = classify(PULSE_SYMBOL_MARK, mark);
+      unsigned long mark_folded = foldResidual((long)mark - (long)((mean[mark_class] + 8) >> 4));
+
+      putBits(buf, pos, (PULSE_SYMBOL_DAH == mark_class) ? 1 : 0, 1);
+      putExpGolomb(buf, pos, mark_folded, getOrder(mark_class));
+
+      update(mark_class, mark, mark_folded);
+   }
+
+   if (!escaped) {
+      update(space_class, space, space_folded);
+   }
+
+   return (pos + 7) >> 3;
+}
+
+/**
+ * decodes a symbol record; the model only moves on once the
+ * record is complete
+ *
+ * @param  buf    bytes of the record so far
+ * @param  len    number of bytes in buf
+ * @param  space  receives the space length, milliseconds
+ * @param  mark   receives the mark length, milliseconds
+ * @param  marker receives true for a segment marker
+ *
+ * @return true if buf holds a complete record
+ */
+bool PulseSymbolModel::decode(const uint8_t *buf, uint8_t len, unsigned long &space, unsigned long &mark, bool &marker) {
+   unsigned int limit = (unsigned int)len << 3;
+   unsigned int pos = 0;
+   unsigned long bits = 0;
+   unsigned long space_folded = 0;
+   unsigned long mark_folded = 0;
+   uint8_t space_class = PULSE_SYMBOL_ELEMENT;
+   uint8_t mark_class = PULSE_SYMBOL_DIT;
+   uint8_t ones = 0;
+
+   space = 0;
+   mark = 0;
+   marker = false;
+
+   // space class is the count of ones before a zero, 3 for escape
+   bool rtn = getBits(buf, limit, pos, 1, bits);
+   while (rtn && bits && (++ones < 3)) {
+      rtn = getBits(buf, limit, pos, 1, bits);
+   }
+
+   if (rtn && (3 == ones)) {
+      rtn =  getExpGolomb(buf, limit, pos, PULSE_SYMBOL_ESCAPE_ORDER, space)
+          && getBits(buf, limit, pos, 1, bits);
+      marker = rtn && bits;
+   }
+   else if (rtn) {
+      space_class = PULSE_SYMBOL_ELEMENT + ones;
+      rtn = getExpGolomb(buf, limit, pos, getOrder(space_class), space_folded);
+      space = (long)((mean[space_class] + 8) >> 4) + unfoldResidual(space_folded);
+   }
+
+   if (rtn && !marker) {
+      rtn = getBits(buf, limit, pos, 1, bits);
+      mark_class = bits ? PULSE_SYMBOL_DAH : PULSE_SYMBOL_DIT;
+      rtn = rtn && getExpGolomb(buf, limit, pos, getOrder(mark_class), mark_folded);
+      mark = (long)((mean[mark_class] + 8) >> 4) + unfoldResidual(mark_folded);
+   }
+
+   // a length no encoder could have written is malformed, and
+   // is left for the caller to give up on as too long
+   rtn = rtn && (space <= PULSE_SYMBOL_SPACE_MAX) && (mark <= PULSE_SYMBOL_MARK_MAX);
+
+   // move the model on just as the encoder did
+   if (rtn && !marker) {
+      update(mark_class, mark, mark_folded);
+   }
+
+   if (rtn && (3 != ones)) {
+      update(space_class, space, space_folded);
+   }
+
+   return rtn;
+}
+
+/**
+ * encodes pulse as a binary pulse record
+ *
+ * @param  dp     pulse to encode
+ * @param  buf    destination, at least PULSE_CODEC_RECORD_MAX bytes
+ *
+ * @return number of bytes written, zero if pulse is not valid
+ */
+uint8_t PulseEncoder::encode(const DigitalPulse &dp, uint8_t *buf) {
+   uint8_t len = 0;
+
+   if (dp.isValid) {
+      // first pulse of the train defines time zero
+      if (!trainStarted) {
+         lastEndTime = dp.startTime;
+         trainStarted = true;
+      }
+
+      // clock should never run backwards, but don't
+      // let a bad pulse poison the rest of the train
+      long space = dp.startTime - lastEndTime;
+      if (space < 0) {
+         space = 0;
+      }
+
+      long mark = dp.endTime - dp.startTime;
+      if (mark < 0) {
+         mark = 0;
+      }
+
+      len = model.encode(buf, space, mark, false);
+
+      lastEndTime = dp.endTime;
+   }
+
+   return len;
+}
+
+/**
+ * moves the time on by a decoded record
+ *
+ * @param  space  space length, milliseconds
+ * @param  mark   mark length, milliseconds
+ * @param  marker true for a segment marker
+ *
+ * @return true if the record was a pulse
+ */
+bool PulseDecoder::addRecord(unsigned long space, unsigned long mark, bool marker) {
+   bool rtn = false;
+
+   // a segment marker only moves the time on
+   if (marker) {
+      cursorTime += space;
+      ++markerCount;
+   }
+   else {
+      pulseStart = cursorTime + space;
+      pulseEnd   = pulseStart + mark;
+      cursorTime = pulseEnd;
+      rtn = true;
+   }
+
+   return rtn;
+}
+
+/**
+ * consumes one byte of a binary pulse record
+ *
+ * @param  b      next byte from the channel file
+ *
+ * @return true if the byte completed a pulse record
+ */
+bool PulseDecoder::decodeByte(uint8_t b) {
+   bool rtn = false;
+
+   if (version > PULSE_FILE_VERSION_3) {
+      unsigned long space;
+      unsigned long mark;
+      bool marker;
+
+      // the record is decoded again from its start 
+      // until a byte completes it
+      record[recordLength++] = b;
+
+      if (model.decode(record, recordLength, space, mark, marker)) {
+         rtn = addRecord(space, mark, marker);
+         recordLength = 0;
+      }
+      else if (recordLength >= PULSE_SYMBOL_RECORD_MAX) {
+         errorSeen = true;
+         recordLength = 0;
+      }
+   }
+   else {
+      accumulator |= ((unsigned long)(b & PULSE_CODEC_VARINT_MASK)) << shift;
+      shift += 7;
+
+      if (b & PULSE_CODEC_VARINT_MORE) {
+         // more groups to come, unless value has overrun 32 bits
+         if (shift >= 7 * PULSE_CODEC_VARINT_MAX) {
+            errorSeen = true;
+            accumulator = 0;
+            shift = 0;
+         }
+      }
+      else if (0 == field) {
+         // space length complete, mark length follows
+         spaceLength = accumulator;
+         field = 1;
+         accumulator = 0;
+         shift = 0;
+      }
+      else {
+         // a zero length mark is a segment marker
+         rtn = addRecord(spaceLength, accumulator, 0 == accumulator);
+         field = 0;
+         accumulator = 0;
+         shift = 0;
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * adds a recorded pulse
+ *
+ * @param  start_time  pulse start, milliseconds relative to train start
+ * @param  end_time    pulse end, milliseconds relative to train start
+ */
+void PulseTrainStats::addPulse(long start_time, long end_time) {
+   if (0 == pulseCount) {
+      firstStartTime = start_time;
+   }
+
+   ++pulseCount;
+   lastEndTime = end_time;
+
+   // mark length in sixteenths, moved a quarter of the
+   // way to the dit length it implies
+   unsigned long mark = (unsigned long)(end_time - start_time) << 4;
+
+   if (0 == ditEstimate) {
+      ditEstimate = mark;
+   }
+   else if (mark < 2 * ditEstimate) {
+      ditEstimate = ditEstimate - (ditEstimate >> 2) + (mark >> 2);
+   }
+   else {
+      ditEstimate = ditEstimate - (ditEstimate >> 2) + (mark / 12);
+   }
+}
+
+/**
+ * carries on from the summary kept in a block header, as if
+ * the pulses before the block had been added
+ *
+ * @param  hdr    header of the block
+ */
+void PulseTrainStats::resumeAt(const PulseBlockHeader &hdr) {
+   reset();
+
+   // block times are relative to the first pulse
+   pulseCount = hdr.pulseCount;
+   lastEndTime = hdr.resumeTime;
+   dataLength = hdr.dataLength;
+   dataCrc = hdr.dataCrc;
+}
+
+/**
+ * carries on from a finalized channel summary, as if the pulses 
+ * of the channel had been added
+ *
+ * @param  info   summary from the channel file header
+ */
+void PulseTrainStats::resumeAt(const PulseChannelInfo &info) {
+   reset();
+
+   // first pulse starts at time zero
+   pulseCount = info.pulseCount;
+   lastEndTime = info.durationMillis;
+   dataLength = info.dataLength;
+   dataCrc = info.dataCrc;
+
+   // speed estimate carries on from the summary
+   if (info.wpm > 0) {
+      ditEstimate = (1200UL << 4) / info.wpm;
+   }
+}
+
+/**
+ * fills in a channel summary from the pulses added
+ *
+ * @param  info   receives the summary
+ */
+void PulseTrainStats::getInfo(PulseChannelInfo &info) const {
+   info.version = PULSE_FILE_VERSION;
+   info.finalized = true;
+   info.pulseCount = pulseCount;
+   info.durationMillis = pulseCount ? (lastEndTime - firstStartTime) : 0;
+   info.dataLength = dataLength;
+   info.dataCrc = dataCrc;
+
+   // PARIS timing, a dit is 1200 ms divided by the speed
+   info.wpm = ditEstimate ? ((1200UL << 4) + ditEstimate / 2) / ditEstimate : 0;
+}
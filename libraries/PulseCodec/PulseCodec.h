@@ -0,0 +1,1155 @@
+#ifndef _PULSE_CODEC_H_
+#define _PULSE_CODEC_H_
+
+/**
+ * @file    PulseCodec.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class definitions for PulseCodec, PulseSymbolModel,
+ * PulseEncoder, PulseDecoder and PulseTrainStats. These classes convert
+ * pulse trains to and from the compact binary channel file format, and
+ * build the summary kept in the file header.
+ */
+
+#include <Arduino.h>
+#include <DigitalPulse.h>
+
+/**
+ * binary channel file header
+ * <p>
+ * A binary channel file starts with the three magic bytes 'D' 'F' 'R'
+ * followed by a format version byte. Legacy text channel files start
+ * with a decimal digit, so the two formats can never be confused.
+ * <p>
+ * A version 1 header is just those four bytes. A version 2 header is
+ * PULSE_FILE_HEADER_SIZE bytes, and goes on to summarize the pulse
+ * train that follows. It is written empty when recording starts and
+ * filled in when the file is closed; until then its final flag is
+ * clear and readers must not trust the summary.
+ * <p>
+ * Version 3 has the same header, padded to PULSE_BLOCK_SIZE, and
+ * keeps its segment table in the padding. Pulse records follow in 
+ * blocks, see below. Versions 1 and 2 have pulse records straight 
+ * after the header.
+ * <p>
+ * Version 4 is laid out as version 3, but its pulse records are
+ * coded as Morse symbols, see below, where earlier versions use
+ * varints.
+ */
+#define PULSE_FILE_MAGIC_0          'D'
+#define PULSE_FILE_MAGIC_1          'F'
+#define PULSE_FILE_MAGIC_2          'R'
+#define PULSE_FILE_VERSION           4
+#define PULSE_FILE_HEADER_SIZE      32
+#define PULSE_FILE_VERSION_1         1
+#define PULSE_FILE_HEADER_SIZE_1     4
+#define PULSE_FILE_VERSION_2         2
+#define PULSE_FILE_VERSION_3         3
+
+/**
+ * version 2 header layout, byte offsets of little-endian fields
+ * <p>
+ * FLAGS holds PULSE_HEADER_FLAG_FINAL once the summary is written,
+ * PULSE_HEADER_FLAG_RECOVERED if it was rebuilt after the recording
+ * was cut off, and PULSE_HEADER_FLAG_FIST if the FIST fields hold a
+ * fist summary.
+ * <p>
+ * WPM is the estimated sending speed, 16 bits. PULSE_COUNT, DURATION
+ * (first key down to last key up, milliseconds) and DATA_LENGTH 
+ * (bytes of pulse records) are 32 bits.
+ * <p>
+ * The FIST fields, 8 bits each but for FIST_DRIFT, are written zero
+ * unless the fist summary is present; see PulseFistSummary. Older
+ * versions wrote them as reserved, always zero.
+ * <p>
+ * DATA_CRC covers the pulse records, and HEADER_CRC the header bytes
+ * before it; both are CRC-16/CCITT.
+ */
+#define PULSE_HEADER_FLAGS           4
+#define PULSE_HEADER_WPM             6
+#define PULSE_HEADER_PULSE_COUNT     8
+#define PULSE_HEADER_DURATION       12
+#define PULSE_HEADER_DATA_LENGTH    16
+#define PULSE_HEADER_DATA_CRC       20
+#define PULSE_HEADER_FIST_DAH_RATIO      22
+#define PULSE_HEADER_FIST_WEIGHT         23
+#define PULSE_HEADER_FIST_LETTER_RATIO   24
+#define PULSE_HEADER_FIST_WORD_RATIO     25
+#define PULSE_HEADER_FIST_MARK_JITTER    26
+#define PULSE_HEADER_FIST_SPACE_JITTER   27
+#define PULSE_HEADER_FIST_DRIFT          28
+#define PULSE_HEADER_CRC            30
+
+#define PULSE_HEADER_FLAG_FINAL      0x01
+#define PULSE_HEADER_FLAG_RECOVERED  0x02
+#define PULSE_HEADER_FLAG_FIST       0x04
+#define PULSE_CODEC_CRC_INIT         0xFFFF
+#define PULSE_CODEC_CRC_POLY         0x1021
+
+/**
+ * version 3 block layout, byte offsets of little-endian fields
+ * <p>
+ * Each block fills one PULSE_BLOCK_SIZE card sector, so the card
+ * writes it whole. A block holds whole pulse records only, and the
+ * unused end of a block is padding.
+ * <p>
+ * MARK is PULSE_BLOCK_COMMITTED in every block written; anything 
+ * else ends the pulse train. UNIT, in version 4, is the unit length
+ * in milliseconds the symbol model starts the block from, and is
+ * zero in version 3. LENGTH is the number of bytes of pulse records
+ * after the block header.
+ * <p>
+ * PULSE_COUNT, DATA_LENGTH and DATA_CRC give the channel summary as
+ * it stood before the block, and RESUME_TIME the end time of the
+ * pulse before it. A cut off recording can then be summarized from
+ * its last block, and playback can start at any block.
+ * <p>
+ * CRC covers the block header bytes before it and the pulse records.
+ */
+#define PULSE_BLOCK_SIZE           512
+#define PULSE_BLOCK_MARK             0
+#define PULSE_BLOCK_UNIT             1
+#define PULSE_BLOCK_LENGTH           2
+#define PULSE_BLOCK_PULSE_COUNT      4
+#define PULSE_BLOCK_RESUME_TIME      8
+#define PULSE_BLOCK_DATA_LENGTH     12
+#define PULSE_BLOCK_DATA_CRC        16
+#define PULSE_BLOCK_CRC             18
+#define PULSE_BLOCK_HEADER_SIZE     20
+#define PULSE_BLOCK_PAYLOAD_MAX     (PULSE_BLOCK_SIZE - PULSE_BLOCK_HEADER_SIZE)
+
+#define PULSE_BLOCK_COMMITTED      0xC3
+#define PULSE_BLOCK_VOID           0x00
+
+/**
+ * version 3 segment table
+ * <p>
+ * A channel may be recorded in several sessions, each adding a
+ * segment to the end of the file. The header sector lists where 
+ * each segment starts: SEGMENT_COUNT is 16 bits, and the table 
+ * after it holds the file position of the first block of each 
+ * segment, 32 bits each. A file with no table has one segment.
+ * <p>
+ * Every segment starts on a new block, so blocks already written
+ * are never touched again. Each segment after the first starts with
+ * a segment marker, a pulse record whose mark length is zero. Its
+ * space length is the wait after the segment before, and the pulses
+ * of the segment are timed on from it, the first with a space of 0.
+ */
+#define PULSE_SEGMENT_COUNT         32
+#define PULSE_SEGMENT_TABLE         36
+#define PULSE_SEGMENT_ENTRY_SIZE     4
+#define PULSE_SEGMENT_MAX           ((PULSE_BLOCK_SIZE - PULSE_SEGMENT_TABLE) / PULSE_SEGMENT_ENTRY_SIZE)
+
+/**
+ * seek index file layout
+ * <p>
+ * A channel may have a sparse index alongside it, listing where in
+ * the channel file some of its pulses start. The index file starts 
+ * with the magic bytes 'D' 'F' 'X' and a version byte, followed by
+ * entries in file order.
+ * <p>
+ * Each entry holds, little-endian, the file position of a pulse 
+ * record, the end time of the pulse before it, which the decoder
+ * needs to carry on from there, the start time of the pulse, and
+ * flags. PULSE_INDEX_FLAG_MESSAGE marks the first pulse of a message.
+ */
+#define PULSE_INDEX_MAGIC_2          'X'
+#define PULSE_INDEX_VERSION           1
+#define PULSE_INDEX_HEADER_SIZE       4
+#define PULSE_INDEX_ENTRY_SIZE       13
+#define PULSE_INDEX_POSITION          0
+#define PULSE_INDEX_RESUME_TIME       4
+#define PULSE_INDEX_START_TIME        8
+#define PULSE_INDEX_FLAGS            12
+
+#define PULSE_INDEX_FLAG_MESSAGE     0x01
+
+/**
+ * version 4 pulse records
+ * <p>
+ * Each pulse is coded against a model of the sending, the mean
+ * lengths of a dit and a dah and of the element, letter and word
+ * spaces. A record holds the class of its space, the residual of
+ * the space from the mean of its class, then the class and residual
+ * of its mark, as bits, most significant first, padded with zeros
+ * to a whole byte.
+ * <p>
+ * Space classes are coded 0 element, 10 letter, 110 word and 111
+ * escape. An escaped space, one over twice the mean word space, is
+ * written whole as an Exp-Golomb code of PULSE_SYMBOL_ESCAPE_ORDER,
+ * followed by a bit that is 1 for a segment marker, which has no
+ * mark, and 0 otherwise. Mark classes are coded 0 dit and 1 dah.
+ * <p>
+ * A residual is the length less the class mean in whole
+ * milliseconds, folded to 0, -1, 1, -2 ... and written as an 
+ * Exp-Golomb code. The order of the code follows the mean of recent
+ * folded residuals of the class, the counts being halved every 
+ * PULSE_SYMBOL_ORDER_RESET residuals.
+ * <p>
+ * Each length coded moves the mean of its class an eighth of the
+ * way to it, but no further than half or twice the mean. A dit
+ * under two thirds of the mean dit, or a dah over twice the mean 
+ * dah, instead starts every mean again from it, so the model 
+ * follows a change of speed, and a fist far from the unit it
+ * started with.
+ * <p>
+ * The model starts each block afresh from the UNIT in its header,
+ * a dit, dah, element, letter and word space of 1, 3, 1, 3 and 7
+ * units, so a block can be decoded on its own. Means are kept in
+ * sixteenths of a millisecond. Mark lengths are limited to 
+ * PULSE_SYMBOL_MARK_MAX, and spaces to PULSE_SYMBOL_SPACE_MAX.
+ */
+#define PULSE_SYMBOL_DIT             0
+#define PULSE_SYMBOL_DAH             1
+#define PULSE_SYMBOL_ELEMENT         2
+#define PULSE_SYMBOL_LETTER          3
+#define PULSE_SYMBOL_WORD            4
+#define PULSE_SYMBOL_CLASSES         5
+
+#define PULSE_SYMBOL_MARK            0
+#define PULSE_SYMBOL_SPACE           1
+
+#define PULSE_SYMBOL_ESCAPE_ORDER    8
+#define PULSE_SYMBOL_ORDER_SEED      4
+#define PULSE_SYMBOL_ORDER_RESET    32
+#define PULSE_SYMBOL_ORDER_MAX      24
+#define PULSE_SYMBOL_UNIT_DEFAULT   60
+#define PULSE_SYMBOL_UNIT_MAX      255
+#define PULSE_SYMBOL_MEAN_MAX      0xFFFFUL
+#define PULSE_SYMBOL_MARK_MAX      0xFFFFFFUL
+#define PULSE_SYMBOL_SPACE_MAX     0x7FFFFFFFUL
+
+/**
+ * maximum encoded sizes, bytes
+ * <p>
+ * A 32 bit value needs at most five 7-bit groups, and each varint
+ * pulse record holds two values (space length, mark length). A
+ * symbol record of the longest lengths needs 14 bytes.
+ */
+#define PULSE_CODEC_VARINT_MAX       5
+#define PULSE_SYMBOL_RECORD_MAX     16
+#define PULSE_CODEC_RECORD_MAX      PULSE_SYMBOL_RECORD_MAX
+
+/**
+ * varint encoding constants
+ */
+#define PULSE_CODEC_VARINT_MASK      0x7F
+#define PULSE_CODEC_VARINT_MORE      0x80
+
+/**
+ * enum for channel file formats
+ *
+ * file format is UNKNOWN until the header has been examined
+ *
+ * TEXT is the legacy format, one "start|end" line per pulse
+ *
+ * BINARY is the delta format written by PulseEncoder
+ */
+enum PulseFileFormat {
+       PULSE_FORMAT_UNKNOWN
+      ,PULSE_FORMAT_TEXT
+      ,PULSE_FORMAT_BINARY
+};
+
+/**
+ * struct holding how a channel was keyed, as measured by FistAnalyzer.
+ * Lengths are compared with the unit, the mean of the dit and of the
+ * element space, which weight does not change.
+ */
+struct PulseFistSummary {
+  /**
+   * mean dah over mean dit, 32nds; 96 for standard timing
+   */
+   uint8_t dahRatio;
+
+  /**
+   * mean dit, percent of the mean dit and element space;
+   * 50 for standard timing
+   */
+   uint8_t weight;
+
+  /**
+   * mean letter space, 32nds of a unit; 96 for standard timing
+   */
+   uint8_t letterRatio;
+
+  /**
+   * mean word space, 16ths of a unit; 112 for standard timing
+   */
+   uint8_t wordRatio;
+
+  /**
+   * standard deviation of dits, percent of a unit
+   */
+   uint8_t markJitter;
+
+  /**
+   * standard deviation of element spaces, percent of a unit
+   */
+   uint8_t spaceJitter;
+
+  /**
+   * change of speed, hundredths of a word per minute each minute
+   */
+   int16_t drift;
+
+  /**
+   * PulseFistSummary constructor
+   * creates empty summary
+   */
+   PulseFistSummary()
+   : dahRatio(0)
+   , weight(0)
+   , letterRatio(0)
+   , wordRatio(0)
+   , markJitter(0)
+   , spaceJitter(0)
+   , drift(0)
+   {}
+};
+
+/**
+ * struct holding the summary of a channel from its file header
+ */
+struct PulseChannelInfo {
+  /**
+   * binary format version, 0 if not a binary file
+   */
+   uint8_t version;
+
+  /**
+   * flag is true if the summary was written and checks out
+   */
+   bool finalized;
+
+  /**
+   * flag is true if the summary was rebuilt after the recording
+   * was cut off
+   */
+   bool recovered;
+
+  /**
+   * estimated sending speed, words per minute
+   */
+   unsigned int wpm;
+
+  /**
+   * number of pulses recorded
+   */
+   unsigned long pulseCount;
+
+  /**
+   * first key down to last key up, milliseconds
+   */
+   unsigned long durationMillis;
+
+  /**
+   * bytes of pulse records following the header
+   */
+   unsigned long dataLength;
+
+  /**
+   * CRC-16/CCITT of the pulse records
+   */
+   uint16_t dataCrc;
+
+  /**
+   * flag is true if the header holds a fist summary
+   */
+   bool hasFist;
+
+  /**
+   * how the channel was keyed, if hasFist
+   */
+   PulseFistSummary fist;
+
+  /**
+   * PulseChannelInfo constructor
+   * creates empty summary
+   */
+   PulseChannelInfo()
+   : version(0)
+   , finalized(false)
+   , recovered(false)
+   , wpm(0)
+   , pulseCount(0)
+   , durationMillis(0)
+   , dataLength(0)
+   , dataCrc(0)
+   , hasFist(false)
+   {}
+};
+
+/**
+ * struct holding the header of a version 3 block
+ */
+struct PulseBlockHeader {
+  /**
+   * unit length the symbol model starts from, milliseconds
+   */
+   uint8_t unit;
+
+  /**
+   * bytes of pulse records in the block
+   */
+   unsigned int length;
+
+  /**
+   * pulses before the block
+   */
+   unsigned long pulseCount;
+
+  /**
+   * end time of the pulse before the block, relative to train start
+   */
+   long resumeTime;
+
+  /**
+   * bytes of pulse records before the block
+   */
+   unsigned long dataLength;
+
+  /**
+   * CRC-16/CCITT of pulse records before the block
+   */
+   uint16_t dataCrc;
+
+  /**
+   * PulseBlockHeader constructor
+   * creates empty header
+   */
+   PulseBlockHeader()
+   : unit(0)
+   , length(0)
+   , pulseCount(0)
+   , resumeTime(0)
+   , dataLength(0)
+   , dataCrc(PULSE_CODEC_CRC_INIT)
+   {}
+};
+
+/**
+ * struct holding one entry of a seek index
+ */
+struct PulseIndexEntry {
+  /**
+   * channel file position of the pulse record
+   */
+   unsigned long position;
+
+  /**
+   * end time of the pulse before, relative to train start
+   */
+   long resumeTime;
+
+  /**
+   * start time of the pulse, relative to train start
+   */
+   long startTime;
+
+  /**
+   * PULSE_INDEX_FLAG_ bits
+   */
+   uint8_t flags;
+
+  /**
+   * PulseIndexEntry constructor
+   * creates empty entry
+   */
+   PulseIndexEntry()
+   : position(0)
+   , resumeTime(0)
+   , startTime(0)
+   , flags(0)
+   {}
+};
+
+/**
+ * Static helpers shared by the encoder and decoder
+ */
+class PulseCodec {
+public:
+  /**
+   * writes empty binary channel file header to buffer
+   *
+   * @param  buf    destination, at least PULSE_FILE_HEADER_SIZE bytes
+   *
+   * @return number of bytes written
+   */
+   static uint8_t writeHeader(uint8_t *buf);
+
+  /**
+   * writes binary channel file header holding a channel summary
+   *
+   * @param  buf    destination, at least PULSE_FILE_HEADER_SIZE bytes
+   * @param  info   channel summary; a version of 0 is taken as
+   *                PULSE_FILE_VERSION
+   *
+   * @return number of bytes written
+   */
+   static uint8_t writeHeader(uint8_t *buf, const PulseChannelInfo &info);
+
+  /**
+   * reads the channel summary from a binary channel file header
+   *
+   * @param  buf    bytes read from the start of the file
+   * @param  len    number of bytes available in buf
+   * @param  info   receives the summary; version is set for any
+   *                binary file, the rest only if finalized
+   *
+   * @return true if the header holds a finalized summary
+   */
+   static bool readHeader(const uint8_t *buf, int len, PulseChannelInfo &info);
+
+  /**
+   * gets size of the header at the start of a binary channel file,
+   * with any padding; the first pulse record or block follows it
+   *
+   * @param  buf    bytes read from the start of the file
+   * @param  len    number of bytes available in buf
+   *
+   * @return header size, 0 if not a binary file
+   */
+   static unsigned int getHeaderSize(const uint8_t *buf, int len);
+
+  /**
+   * tests whether a binary channel file holds its pulse records
+   * in blocks
+   *
+   * @param  buf    bytes read from the start of the file
+   * @param  len    number of bytes available in buf
+   *
+   * @return true for version 3 and later files
+   */
+   static bool isBlocked(const uint8_t *buf, int len);
+
+  /**
+   * writes a block header over the start of a block, completing 
+   * its CRC; the pulse records must already be in place after it
+   *
+   * @param  block  block, header then pulse records
+   * @param  hdr    header to write
+   */
+   static void writeBlockHeader(uint8_t *block, const PulseBlockHeader &hdr);
+
+  /**
+   * reads a block header; the mark and length are checked, 
+   * but not the CRC
+   *
+   * @param  block  bytes read from the start of a block
+   * @param  len    number of bytes available in block
+   * @param  hdr    receives the header
+   *
+   * @return true if the header is committed and its length fits
+   */
+   static bool readBlockHeader(const uint8_t *block, int len, PulseBlockHeader &hdr);
+
+  /**
+   * checks the CRC of a whole block
+   *
+   * @param  block  block, header then pulse records
+   * @param  hdr    header read from the block
+   *
+   * @return true if the block is intact
+   */
+   static bool checkBlock(const uint8_t *block, const PulseBlockHeader &hdr);
+
+  /**
+   * gets number of segments in a channel file
+   *
+   * @param  buf    bytes read from the start of the file
+   * @param  len    number of bytes available in buf
+   *
+   * @return number of segments, 1 if the file has no segment table
+   */
+   static unsigned int getSegmentCount(const uint8_t *buf, int len);
+
+  /**
+   * adds a segment to the segment table of a version 3 or 4 file
+   *
+   * @param  sector   header sector of the file
+   * @param  position file position of the first block of the segment
+   *
+   * @return true if added, false if the table is full
+   */
+   static bool addSegment(uint8_t *sector, unsigned long position);
+
+  /**
+   * reads one segment table entry
+   *
+   * @param  buf    PULSE_SEGMENT_ENTRY_SIZE bytes read from the table
+   *
+   * @return file position of the first block of the segment
+   */
+   static unsigned long readSegmentEntry(const uint8_t *buf);
+
+  /**
+   * writes seek index file header to buffer
+   *
+   * @param  buf    destination, at least PULSE_INDEX_HEADER_SIZE bytes
+   *
+   * @return number of bytes written
+   */
+   static uint8_t writeIndexHeader(uint8_t *buf);
+
+  /**
+   * tests for a seek index file header
+   *
+   * @param  buf    bytes read from the start of the file
+   * @param  len    number of bytes available in buf
+   *
+   * @return true if the header is one this version can read
+   */
+   static bool isIndexHeader(const uint8_t *buf, int len);
+
+  /**
+   * writes seek index entry to buffer
+   *
+   * @param  buf    destination, at least PULSE_INDEX_ENTRY_SIZE bytes
+   * @param  entry  entry to write
+   *
+   * @return number of bytes written
+   */
+   static uint8_t writeIndexEntry(uint8_t *buf, const PulseIndexEntry &entry);
+
+  /**
+   * reads seek index entry from buffer
+   *
+   * @param  buf    PULSE_INDEX_ENTRY_SIZE bytes read from the index
+   * @param  entry  receives the entry
+   */
+   static void readIndexEntry(const uint8_t *buf, PulseIndexEntry &entry);
+
+  /**
+   * updates a CRC-16/CCITT with more bytes
+   *
+   * @param  crc    CRC so far, PULSE_CODEC_CRC_INIT to start
+   * @param  buf    bytes to add
+   * @param  len    number of bytes in buf
+   *
+   * @return updated CRC
+   */
+   static uint16_t updateCrc(uint16_t crc, const uint8_t *buf, unsigned int len);
+
+  /**
+   * determines file format from the first bytes of a channel file
+   *
+   * @param  buf    bytes read from the start of the file
+   * @param  len    number of bytes available in buf
+   *
+   * @return file format, value in {UNKNOWN, TEXT, BINARY}
+   */
+   static PulseFileFormat detectFormat(const uint8_t *buf, int len);
+};
+
+/**
+ * Models the sending of a pulse train, and codes version 4 pulse
+ * records against it.
+ *
+ * The encoder and the decoder each keep a model, and move it on 
+ * in step as records are coded, so each record is decoded against
+ * the model it was encoded with.
+ */
+class PulseSymbolModel {
+protected:
+  /** mean length of each symbol class, sixteenths of a millisecond */
+   uint16_t mean[PULSE_SYMBOL_CLASSES];
+
+  /** sum of recent folded residuals of each class, held at 0xFFFF */
+   uint16_t residualTotal[PULSE_SYMBOL_CLASSES];
+
+  /** number of recent residuals of each class */
+   uint8_t residualCount[PULSE_SYMBOL_CLASSES];
+
+  /**
+   * sets every class mean from a unit length
+   *
+   * @param  unit   unit length, sixteenths of a millisecond
+   */
+   void seed(unsigned long unit);
+
+  /**
+   * classifies a mark or space by the nearest class mean
+   *
+   * @param  kind   PULSE_SYMBOL_MARK or PULSE_SYMBOL_SPACE
+   * @param  len    length, milliseconds
+   *
+   * @return symbol class
+   */
+   uint8_t classify(uint8_t kind, unsigned long len) const;
+
+  /**
+   * gets the order of the Exp-Golomb code for the next residual
+   * of a class
+   *
+   * @param  cls    symbol class
+   *
+   * @return order, at most PULSE_SYMBOL_ORDER_MAX
+   */
+   uint8_t getOrder(uint8_t cls) const;
+
+  /**
+   * moves the model on after a mark or space has been coded
+   *
+   * @param  cls    symbol class
+   * @param  len    length, milliseconds
+   * @param  folded folded residual
+   */
+   void update(uint8_t cls, unsigned long len, unsigned long folded);
+
+public:
+  /**
+   * PulseSymbolModel constructor
+   */
+   PulseSymbolModel() {
+      reset(PULSE_SYMBOL_UNIT_DEFAULT);
+   }
+
+  /**
+   * starts the model afresh
+   *
+   * @param  unit   unit length, milliseconds; 0 for the default
+   */
+   void reset(uint8_t unit);
+
+  /**
+   * gets the unit length the model has come to, for starting
+   * the next block
+   *
+   * @return mean dit length, milliseconds, at least 1
+   */
+   uint8_t getUnit() const;
+
+  /**
+   * codes a pulse or a segment marker as a symbol record
+   *
+   * @param  buf    destination, at least PULSE_SYMBOL_RECORD_MAX bytes
+   * @param  space  space length, milliseconds
+   * @param  mark   mark length, milliseconds, ignored for a marker
+   * @param  marker true for a segment marker
+   *
+   * @return number of bytes written
+   */
+   uint8_t encode(uint8_t *buf, unsigned long space, unsigned long mark, bool marker);
+
+  /**
+   * decodes a symbol record; the model only moves on once the
+   * record is complete
+   *
+   * @param  buf    bytes of the record so far
+   * @param  len    number of bytes in buf
+   * @param  space  receives the space length, milliseconds
+   * @param  mark   receives the mark length, milliseconds
+   * @param  marker receives true for a segment marker
+   *
+   * @return true if buf holds a complete record
+   */
+   bool decode(const uint8_t *buf, uint8_t len, unsigned long &space, unsigned long &mark, bool &marker);
+};
+
+/**
+ * Converts DigitalPulse objects to binary pulse records.
+ *
+ * Each pulse is written as its space length from the end of the
+ * previous pulse to the start of this one, and its mark length,
+ * coded as version 4 symbol records. The first pulse of a train 
+ * has a space length of zero, so all times are relative to the
+ * start of the train.
+ */
+class PulseEncoder {
+protected:
+  /** end time of the last pulse encoded, milliseconds since reset */
+   long lastEndTime;
+
+  /** flag is true once the first pulse of the train has been seen */
+   bool trainStarted;
+
+  /** model of the sending in the current block */
+   PulseSymbolModel model;
+
+public:
+  /**
+   * PulseEncoder constructor
+   */
+   PulseEncoder()
+   : lastEndTime(0)
+   , trainStarted(false)
+   {}
+
+  /**
+   * prepares encoder for a new pulse train
+   */
+   void reset() {
+      lastEndTime = 0;
+      trainStarted = false;
+      model.reset(PULSE_SYMBOL_UNIT_DEFAULT);
+   }
+
+  /**
+   * starts the model afresh for a new block
+   *
+   * @param  unit   unit length written in the block header, milliseconds
+   */
+   void startBlock(uint8_t unit) {
+      model.reset(unit);
+   }
+
+  /**
+   * gets the unit length to start the next block from
+   *
+   * @return unit length, milliseconds
+   */
+   uint8_t getUnit() const {
+      return model.getUnit();
+   }
+
+  /**
+   * encodes pulse as a binary pulse record
+   *
+   * @param  dp     pulse to encode
+   * @param  buf    destination, at least PULSE_CODEC_RECORD_MAX bytes
+   *
+   * @return number of bytes written, zero if pulse is not valid
+   */
+   uint8_t encode(const DigitalPulse &dp, uint8_t *buf);
+
+  /**
+   * encodes a segment marker
+   *
+   * @param  gap_ms wait after the segment before, milliseconds
+   * @param  buf    destination, at least PULSE_CODEC_RECORD_MAX bytes
+   *
+   * @return number of bytes written
+   */
+   uint8_t encodeMarker(unsigned long gap_ms, uint8_t *buf) {
+      return model.encode(buf, gap_ms, 0, true);
+   }
+};
+
+/**
+ * Rebuilds pulse start/end times from binary pulse records.
+ *
+ * The decoder is fed one byte at a time and reports when a complete
+ * pulse record has been consumed. Pulse times are relative to the
+ * start of the train, the first pulse starting at time zero. A
+ * segment marker is not a pulse; it moves the time on by its space.
+ * Version 4 records are decoded unless another version is set.
+ */
+class PulseDecoder {
+protected:
+  /** format version of the records, kept over reset */
+   uint8_t version;
+
+  /** value being assembled from varint groups */
+   unsigned long accumulator;
+
+  /** bit position of next varint group */
+   uint8_t shift;
+
+  /** record field being decoded, 0 = space, 1 = mark */
+   uint8_t field;
+
+  /** space length of record being decoded, milliseconds */
+   unsigned long spaceLength;
+
+  /** bytes of the symbol record being decoded */
+   uint8_t record[PULSE_SYMBOL_RECORD_MAX];
+
+  /** number of bytes in record */
+   uint8_t recordLength;
+
+  /** model of the sending in the current block */
+   PulseSymbolModel model;
+
+  /** end time of last decoded pulse, relative to train start */
+   long cursorTime;
+
+  /** start time of last decoded pulse, relative to train start */
+   long pulseStart;
+
+  /** end time of last decoded pulse, relative to train start */
+   long pulseEnd;
+
+  /** flag is set if a malformed record has been seen */
+   bool errorSeen;
+
+  /** number of segment markers decoded */
+   unsigned int markerCount;
+
+  /**
+   * moves the time on by a decoded record
+   *
+   * @param  space  space length, milliseconds
+   * @param  mark   mark length, milliseconds
+   * @param  marker true for a segment marker
+   *
+   * @return true if the record was a pulse
+   */
+   bool addRecord(unsigned long space, unsigned long mark, bool marker);
+
+public:
+  /**
+   * PulseDecoder constructor
+   */
+   PulseDecoder()
+   : version(PULSE_FILE_VERSION) {
+      reset();
+   }
+
+  /**
+   * sets the format version of the records to decode
+   *
+   * @param  v      version byte from the channel file header
+   */
+   void setVersion(uint8_t v) {
+      version = v;
+   }
+
+  /**
+   * returns the format version of the records decoded
+   *
+   * @return version
+   */
+   uint8_t getVersion() const {
+      return version;
+   }
+
+  /**
+   * prepares decoder for a new pulse train
+   */
+   void reset() {
+      model.reset(PULSE_SYMBOL_UNIT_DEFAULT);
+      resumeAt(0);
+   }
+
+  /**
+   * prepares decoder to carry on part way through a pulse train,
+   * at the record following a given pulse; the symbol model is
+   * kept as it is
+   *
+   * @param  end_time   end time of the pulse before the next record,
+   *                    milliseconds relative to train start
+   */
+   void resumeAt(long end_time) {
+      accumulator = 0;
+      shift = 0;
+      field = 0;
+      spaceLength = 0;
+      recordLength = 0;
+      cursorTime = end_time;
+      pulseStart = 0;
+      pulseEnd = 0;
+      errorSeen = false;
+      markerCount = 0;
+   }
+
+  /**
+   * starts the model afresh at the start of a block
+   *
+   * @param  unit   unit length from the block header, milliseconds
+   */
+   void startBlock(uint8_t unit) {
+      model.reset(unit);
+      recordLength = 0;
+   }
+
+  /**
+   * consumes one byte of a binary pulse record
+   *
+   * @param  b      next byte from the channel file
+   *
+   * @return true if the byte completed a pulse record
+   */
+   bool decodeByte(uint8_t b);
+
+  /**
+   * returns start time of last decoded pulse
+   *
+   * @return start time, milliseconds relative to train start
+   */
+   long getPulseStart() const {
+      return pulseStart;
+   }
+
+  /**
+   * returns end time of last decoded pulse
+   *
+   * @return end time, milliseconds relative to train start
+   */
+   long getPulseEnd() const {
+      return pulseEnd;
+   }
+
+  /**
+   * returns time the next record is timed from, the end of the
+   * last pulse or the time of a segment marker after it
+   *
+   * @return time, milliseconds relative to train start
+   */
+   long getCursorTime() const {
+      return cursorTime;
+   }
+
+  /**
+   * returns number of segment markers decoded since reset
+   *
+   * @return marker count
+   */
+   unsigned int getMarkerCount() const {
+      return markerCount;
+   }
+
+  /**
+   * returns error flag
+   *
+   * @return true if a malformed record has been seen
+   */
+   bool hasError() const {
+      return errorSeen;
+   }
+};
+/**
+ * Builds the channel summary for a binary file header as pulses
+ * are recorded.
+ *
+ * Pulse times are those the decoder gives, relative to the start
+ * of the train. The speed is estimated from a running dit length. A mark shorter
+ * than two dits is taken as a dit, and a longer one as a dah of three
+ * dits; either moves the estimate a quarter of the way to the length
+ * it implies. The estimate is kept in sixteenths of a millisecond.
+ */
+class PulseTrainStats {
+protected:
+  /** number of pulses added */
+   unsigned long pulseCount;
+
+  /** start time of the first pulse, relative to train start */
+   long firstStartTime;
+
+  /** end time of the last pulse, relative to train start */
+   long lastEndTime;
+
+  /** estimated dit length, sixteenths of a millisecond */
+   unsigned long ditEstimate;
+
+  /** bytes of pulse records added */
+   unsigned long dataLength;
+
+  /** CRC of pulse records added */
+   uint16_t dataCrc;
+
+public:
+  /**
+   * PulseTrainStats constructor
+   */
+   PulseTrainStats() {
+      reset();
+   }
+
+  /**
+   * prepares for a new pulse train
+   */
+   void reset() {
+      pulseCount = 0;
+      firstStartTime = 0;
+      lastEndTime = 0;
+      ditEstimate = 0;
+      dataLength = 0;
+      dataCrc = PULSE_CODEC_CRC_INIT;
+   }
+
+  /**
+   * adds a recorded pulse
+   *
+   * @param  start_time  pulse start, milliseconds relative to train start
+   * @param  end_time    pulse end, milliseconds relative to train start
+   */
+   void addPulse(long start_time, long end_time);
+
+  /**
+   * adds bytes of pulse records written
+   *
+   * @param  buf    pulse records
+   * @param  len    number of bytes in buf
+   */
+   void addRecords(const uint8_t *buf, unsigned int len) {
+      dataLength += len;
+      dataCrc = PulseCodec::updateCrc(dataCrc, buf, len);
+   }
+
+  /**
+   * carries on from the summary kept in a block header, as if
+   * the pulses before the block had been added
+   *
+   * @param  hdr    header of the block
+   */
+   void resumeAt(const PulseBlockHeader &hdr);
+
+  /**
+   * carries on from a finalized channel summary, as if the pulses 
+   * of the channel had been added
+   *
+   * @param  info   summary from the channel file header
+   */
+   void resumeAt(const PulseChannelInfo &info);
+
+  /**
+   * gets number of pulses added
+   *
+   * @return pulses since reset
+   */
+   unsigned long getPulseCount() const {
+      return pulseCount;
+   }
+
+  /**
+   * gets number of bytes of pulse records added
+   *
+   * @return bytes since reset
+   */
+   unsigned long getDataLength() const {
+      return dataLength;
+   }
+
+  /**
+   * gets CRC of pulse records added
+   *
+   * @return CRC-16/CCITT since reset
+   */
+   uint16_t getDataCrc() const {
+      return dataCrc;
+   }
+
+  /**
+   * fills in a channel summary from the pulses added
+   *
+   * @param  info   receives the summary
+   */
+   void getInfo(PulseChannelInfo &info) const;
+};
+
+#endif // _PULSE_CODEC_H_
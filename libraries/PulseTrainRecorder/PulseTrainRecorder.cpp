@@ -27,23 +27,35 @@
  * @section DESCRIPTION
  *
  * This file contains class definitions for PulseTrainRecorder
- * This class reads and writes pulse train descriptions to text
- * files on an SD card.
+ * This class reads and writes pulse train descriptions to channel
+ * files on an SD card. New recordings use the binary format defined
+ * in PulseCodec.h; legacy text files can still be played back.
  */
  
 #include <Arduino.h>
 #include <SD.h>
 
 #include <PulseTrainRecorder.h>
+#include <ChannelSelector.h>
+
+// every channel and its seek index, and the journal,
+// must have a directory entry in the channel store
+#if (2 * RECORDING_CHANNELS + 1) > CSTORE_ENTRIES_MAX
+   #error "RECORDING_CHANNELS needs more CSTORE_DIR_SECTORS"
+#endif
 
 /**
  * local overrides of file open modes
  */
+#undef FILE_READ
+#undef FILE_WRITE
 #define FILE_READ O_READ
 #define FILE_WRITE (O_WRITE |O_CREAT | O_TRUNC)
+#define FILE_RECOVER (O_READ | O_WRITE)
 
 /**
- * initializes SD card hardware
+ * initializes SD card hardware, and repairs any recording
+ * cut off by a power failure
  *
  * @param  sd_reserved_pin       SD reserved output pin number
  * @param  sd_cs_pin             SD CS pin number
@@ -59,15 +71,42 @@ bool PulseTrainRecorder::initialize(int sd_reserved_pin, int sd_cs_pin) {
    
    // initialize card, return status 
    bool sd_okay = SD.begin(sd_cs_pin);
+
+   // channels are only reachable through the container
+   sd_okay = sd_okay && channelStore.begin(RECORD_STORE_NAME, sectorBuffer, RECORD_SECTOR_SIZE);
+
+   if (sd_okay) {
+      recoverRecording();
+   }
+
    return sd_okay;
 }
 
+/**
+ * copies a channel file left on the card by an earlier version
+ * into the channel container, unless the channel already holds
+ * a recording
+ *
+ * @param  fn     channel file name
+ *
+ * @return true if a file was copied
+ */
+bool PulseTrainRecorder::importChannel(char *fn) {
+   // sector buffer is free outside recording and playback
+   return    !isOpenForRead 
+          && !isOpenForWrite
+          && channelStore.importFile(fn, sectorBuffer, RECORD_SECTOR_SIZE);
+}
+
 /**
  * opens file for recording to SD card
  *
+ * @param  fn     channel file name
+ * @param  head   if not 0, filled with the first pulses recorded
+ *
  * @return true if file successfully opened for writing
  */
-bool PulseTrainRecorder::openForRecording(char * fn) {
+bool PulseTrainRecorder::openForRecording(char * fn, PulseTrainHead *head) {
    // close any open files and reset is open flags
    this->close();
    
@@ -75,11 +114,47 @@ bool PulseTrainRecorder::openForRecording(char * fn) {
    memset(currentFileName, 0, CHANNEL_FILENAME_MAX);
    strncpy(currentFileName, fn, CHANNEL_FILENAME_MAX - 1);
 
+   // name the file in the journal before touching it,
+   // so it can be repaired if power fails part way
+   writeJournal();
+
    // attempt open for write
-   PTRFile = SD.open(currentFileName, FILE_WRITE);
+   PTRFile = channelStore.open(currentFileName, FILE_WRITE);
    
    if (PTRFile) {
-      isOpenForWrite = true;
+      lastRecordTime = millis();
+
+      // start the file with an empty binary format header, the 
+      // summary is filled in when the file is closed; the header 
+      // has a sector to itself, so blocks line up with sectors
+      memset(sectorBuffer, 0, RECORD_SECTOR_SIZE);
+      PulseCodec::writeHeader(sectorBuffer);
+      isOpenForWrite = (   PTRFile.write(sectorBuffer, RECORD_SECTOR_SIZE) 
+                        == RECORD_SECTOR_SIZE);
+      PTRFile.flush();
+
+      recordFileSize = RECORD_SECTOR_SIZE;
+      encoder.reset();
+      decoder.setVersion(PULSE_FILE_VERSION);
+      decoder.reset();
+      recordStats.reset();
+      startRecordBlock();
+
+      // start a seek index alongside the recording, or drop
+      // any index left by an earlier one
+      openIndexForRecording(false);
+
+      // cache the first pulses as they are recorded, decoded 
+      // just as playback will decode them
+      if (head) {
+         head->count = 0;
+         head->more = false;
+         head->format = PULSE_FORMAT_BINARY;
+         head->version = PULSE_FILE_VERSION;
+         head->blocked = true;
+         head->segments = 1;
+         recordHead = head;
+      }
       //Serial.print(currentFileName);
       //Serial.println(" open for recording.");
    }
@@ -91,6 +166,129 @@ bool PulseTrainRecorder::openForRecording(char * fn) {
    return isOpenForWrite;
 }
 
+/**
+ * opens file for recording a new segment at the end of a channel,
+ * leaving what is already recorded untouched; nothing is written
+ * until the first pulse. Falls back to openForRecording() if the
+ * channel is empty, was recorded in an earlier format, or its 
+ * segment table is full.
+ *
+ * @param  fn     channel file name
+ * @param  head   if not 0, the cached head of the channel, which 
+ *                is refilled if the channel is started over
+ *
+ * @return true if file successfully opened for writing
+ */
+bool PulseTrainRecorder::openForAppend(char * fn, PulseTrainHead *head) {
+   // close any open files and reset is open flags
+   this->close();
+
+   // copy to char buffer for use with file rtns
+   memset(currentFileName, 0, CHANNEL_FILENAME_MAX);
+   strncpy(currentFileName, fn, CHANNEL_FILENAME_MAX - 1);
+
+   if (channelStore.exists(currentFileName)) {
+      PTRFile = channelStore.open(currentFileName, FILE_RECOVER);
+   }
+
+   if (PTRFile) {
+      PulseChannelInfo info;
+      int len = PTRFile.seek(0) ? PTRFile.read(sectorBuffer, RECORD_SECTOR_SIZE) : 0;
+      unsigned long size = PTRFile.size();
+
+      // new segment starts on the next block boundary
+      recordFileSize = ((size + RECORD_SECTOR_SIZE - 1) / RECORD_SECTOR_SIZE) 
+                     * RECORD_SECTOR_SIZE;
+
+      isOpenForWrite =  (RECORD_SECTOR_SIZE == len)
+                     && PulseCodec::readHeader(sectorBuffer, len, info)
+                     && (PULSE_FILE_VERSION == info.version)
+                     && (info.pulseCount > 0)
+                     && PulseCodec::addSegment(sectorBuffer, recordFileSize);
+
+      if (isOpenForWrite) {
+         // nothing is written until the first pulse
+         appendPending = true;
+         lastRecordTime = millis();
+         recordBufferCount = 0;
+         recordBlockCommitted = 0;
+
+         // carry on the summary and timing of the channel,
+         // the symbol model from its speed
+         encoder.reset();
+         if (info.wpm > 0) {
+            unsigned int unit = 1200U / info.wpm;
+            encoder.startBlock((unit > PULSE_SYMBOL_UNIT_MAX) ? PULSE_SYMBOL_UNIT_MAX : unit);
+         }
+         recordStats.resumeAt(info);
+         decoder.setVersion(PULSE_FILE_VERSION);
+         decoder.resumeAt(info.durationMillis);
+         recordHead = head;
+      }
+      else {
+         PTRFile.close();
+      }
+   }
+
+   return isOpenForWrite || openForRecording(fn, head);
+}
+
+/**
+ * writes the start of a segment opened by openForAppend() when its
+ * first pulse is recorded, so a session that records nothing leaves
+ * the channel as it was
+ *
+ * @return true if the segment was started
+ */
+bool PulseTrainRecorder::startAppendSegment() {
+   unsigned long size = PTRFile.size();
+   appendPending = false;
+
+   writeJournal();
+
+   // header is not final again until the file is closed,
+   // and lists the new segment
+   bool rtn =  PTRFile.seek(0)
+            && (PTRFile.read(sectorBuffer, RECORD_SECTOR_SIZE) == RECORD_SECTOR_SIZE)
+            && PulseCodec::addSegment(sectorBuffer, recordFileSize);
+   unsigned int segments = PulseCodec::getSegmentCount(sectorBuffer, RECORD_SECTOR_SIZE);
+
+   PulseCodec::writeHeader(sectorBuffer);
+   rtn =  rtn 
+       && PTRFile.seek(0)
+       && (PTRFile.write(sectorBuffer, RECORD_SECTOR_SIZE) == RECORD_SECTOR_SIZE);
+
+   // pad out the last block of the segment before
+   memset(sectorBuffer, 0, RECORD_SECTOR_SIZE);
+   rtn =  rtn
+       && PTRFile.seek(size)
+       && (PTRFile.write(sectorBuffer, recordFileSize - size) == recordFileSize - size);
+   PTRFile.flush();
+
+   // the segment starts a message of its own
+   uint8_t marker[PULSE_CODEC_RECORD_MAX];
+
+   startRecordBlock();
+   uint8_t len = encoder.encodeMarker(PLAYBACK_MESSAGE_GAP_MILS, marker);
+   bufferRecordBytes(marker, len);
+   recordStats.addRecords(marker, len);
+   for (uint8_t ii=0; ii<len; ++ii) {
+      decoder.decodeByte(marker[ii]);
+   }
+   rtn = commitRecordBuffer() && rtn;
+
+   openIndexForRecording(true);
+
+   // cached pulses are still the first of the channel
+   if (recordHead && (recordHead->count > 0)) {
+      recordHead->more = true;
+      recordHead->segments = segments;
+   }
+   recordHead = 0;
+
+   return rtn;
+}
+
 /**
  * opens file for playback from SD card
  *
@@ -105,20 +303,49 @@ bool PulseTrainRecorder::openForPlayback(char * fn) {
    strncpy(currentFileName, fn, CHANNEL_FILENAME_MAX - 1);
    
    // attempt open for read
-   PTRFile = SD.open(currentFileName, FILE_READ);
+   PTRFile = channelStore.open(currentFileName, FILE_READ);
+   playbackSegments = 1;
    
    if (PTRFile) {
       isOpenForRead = true;
       //Serial.print(currentFileName);
       //Serial.println(" open for playback.");
    
+      // load the whole first sector
+      readAheadHead = 0;
+      readAheadCount = 0;
+      serviceReadAhead();
+
+      // identify file format from its first bytes
+      fileFormat = PulseCodec::detectFormat(sectorBuffer, readAheadCount);
+      decoder.reset();
+
+      // text files have no header
+      if (PULSE_FORMAT_BINARY == fileFormat) {
+         decoder.setVersion(sectorBuffer[3]);
+         unsigned int start = PulseCodec::getHeaderSize(sectorBuffer, readAheadCount);
+         blockedFile = PulseCodec::isBlocked(sectorBuffer, readAheadCount);
+         playbackSegments = PulseCodec::getSegmentCount(sectorBuffer, readAheadCount);
+
+         if (start > readAheadCount) {
+            start = readAheadCount;
+         }
+
+         // ring follows file position within the sector
+         readAheadHead = start % RECORD_SECTOR_SIZE;
+         readAheadCount -= start;
+      }
+
       // load first record
       if (readNextPulse()) {
          // set playback time
-          playbackStartTime = millis() + PLAYBACK_DELAY_MILS;
+          playbackDelay = PLAYBACK_DELAY_MILS;
+          playbackStartTime = millis() + playbackDelay;
 
 		 // save first pulse start time as pulse train offset
          pulseTrainStartTime = currentPulseStartTime;
+         firstPulseStartTime = currentPulseStartTime;
+         scalePulse(true);
 
          // ready to start playback
          isPlaybackActive = true;
@@ -138,10 +365,209 @@ bool PulseTrainRecorder::openForPlayback(char * fn) {
    return isOpenForRead && isPlaybackActive;
 }
 
+/**
+ * starts playback from a cached head; the file is opened later,
+ * by serviceReadAhead() or when the cached pulses run out. 
+ * Falls back to openForPlayback() if the head is not loaded.
+ *
+ * @param  fn     channel file name
+ * @param  head   first pulses of the file
+ *
+ * @return true if playback active
+ */
+bool PulseTrainRecorder::openCachedPlayback(char * fn, const PulseTrainHead &head) {
+   if (0 == head.count) {
+      return openForPlayback(fn);
+   }
+
+   // close any open files and reset is open flags
+   this->close();
+
+   // copy to char buffer for use with file rtns
+   memset(currentFileName, 0, CHANNEL_FILENAME_MAX);
+   strncpy(currentFileName, fn, CHANNEL_FILENAME_MAX - 1);
+
+   // first pulse comes from the head, file is opened later
+   fileFormat = head.format;
+   decoder.setVersion(head.version);
+   blockedFile = head.blocked;
+   playbackSegments = head.segments;
+   playbackHead = &head;
+   playbackHeadIndex = 1;
+   playbackOpenPending = head.more;
+   isOpenForRead = true;
+
+   currentPulseStartTime = head.startTime[0];
+   currentPulseEndTime   = head.endTime[0];
+
+   // no card to wait for, start right away
+   playbackDelay = PLAYBACK_CACHED_DELAY_MILS;
+   playbackStartTime = millis() + playbackDelay;
+   pulseTrainStartTime = currentPulseStartTime;
+   firstPulseStartTime = currentPulseStartTime;
+   scalePulse(true);
+   isPlaybackActive = true;
+
+   return true;
+}
+
+/**
+ * opens the file of a playback started from a cached head,
+ * positioned after the cached pulses
+ *
+ * @return true if the file was opened
+ */
+bool PulseTrainRecorder::openDeferredPlayback() {
+   bool rtn = false;
+
+   playbackOpenPending = false;
+   PTRFile = channelStore.open(currentFileName, FILE_READ);
+
+   if (PTRFile && seekPlayback(playbackHead->resumePosition)) {
+      // carry on from the last cached pulse
+      decoder.resumeAt(playbackHead->endTime[playbackHead->count - 1]);
+      rtn = true;
+   }
+
+   return rtn;
+}
+
+/**
+ * reads the first pulses of a channel file into a head
+ *
+ * @param  fn     channel file name
+ * @param  head   receives the first pulses
+ *
+ * @return true if at least one pulse was cached
+ */
+bool PulseTrainRecorder::loadHead(char * fn, PulseTrainHead &head) {
+   head.count = 0;
+   head.more = false;
+
+   // empty channels are not an error
+   if (channelStore.exists(fn) && openForPlayback(fn)) {
+      head.format = fileFormat;
+      head.version = decoder.getVersion();
+      head.blocked = blockedFile;
+      head.segments = playbackSegments;
+
+      do {
+         head.startTime[head.count] = currentPulseStartTime;
+         head.endTime[head.count]   = currentPulseEndTime;
+         head.resumePosition = PTRFile.position() - readAheadCount;
+         ++head.count;
+      } while ((head.count < PLAYBACK_HEAD_PULSES) && readNextPulse());
+
+      head.more = (head.count == PLAYBACK_HEAD_PULSES) && readAheadAvailable();
+      close();
+   }
+
+   return head.count > 0;
+}
+
+/**
+ * reads the summary from a channel file header; only the header
+ * is read, however long the recording
+ *
+ * @param  fn     channel file name
+ * @param  info   receives the summary
+ *
+ * @return true if the file holds a finalized summary
+ */
+bool PulseTrainRecorder::getChannelInfo(char * fn, PulseChannelInfo &info) {
+   bool rtn = false;
+   info = PulseChannelInfo();
+
+   // leaves any file open for playback or recording alone
+   ChannelStream file = channelStore.open(fn, FILE_READ);
+
+   if (file) {
+      uint8_t header[PULSE_FILE_HEADER_SIZE];
+      int len = file.read(header, PULSE_FILE_HEADER_SIZE);
+      file.close();
+
+      rtn = PulseCodec::readHeader(header, len, info);
+   }
+
+   return rtn;
+}
+
+/**
+ * writes a fist summary into a channel file header, keeping the
+ * rest of the summary; the channel must not be open for recording
+ *
+ * @param  fn     channel file name
+ * @param  fist   fist summary
+ *
+ * @return true if the file held a finalized summary and was updated
+ */
+bool PulseTrainRecorder::writeFistSummary(char * fn, const PulseFistSummary &fist) {
+   bool rtn = false;
+   ChannelStream file = channelStore.open(fn, FILE_RECOVER);
+
+   if (file) {
+      PulseChannelInfo info;
+      uint8_t header[PULSE_FILE_HEADER_SIZE];
+      int len = file.seek(0) ? file.read(header, PULSE_FILE_HEADER_SIZE) : 0;
+
+      // only the header is rewritten, any segment table after it
+      // is left as it is
+      if (PulseCodec::readHeader(header, len, info)) {
+         info.hasFist = true;
+         info.fist = fist;
+         uint8_t size = PulseCodec::writeHeader(header, info);
+
+         rtn =  file.seek(0)
+             && (file.write(header, size) == size);
+         file.flush();
+      }
+      file.close();
+   }
+
+   return rtn;
+}
+
+/**
+ * tests whether a channel holds a recording; a channel without
+ * a file, or whose summary counts no pulses, is empty. Files
+ * without a summary are assumed to hold one.
+ *
+ * @param  fn     channel file name
+ *
+ * @return true if the channel is empty
+ */
+bool PulseTrainRecorder::isChannelEmpty(char * fn) {
+   bool rtn = true;
+
+   if (channelStore.exists(fn)) {
+      PulseChannelInfo info;
+      rtn = getChannelInfo(fn, info) && (0 == info.pulseCount);
+   }
+
+   return rtn;
+}
+
 /**
  * closes any file open on SD card
  */
 void PulseTrainRecorder::close() {
+   // write out anything still staged for recording,
+   // then fill in the header
+   if (isOpenForWrite && !appendPending) {
+      commitRecordBuffer();
+      finalizeRecording(false);
+
+      if (indexFile) {
+         commitIndexBuffer();
+         indexFile.close();
+      }
+
+      // recording is complete, nothing to repair; ready the
+      // extents the next recording takes while the key is idle
+      channelStore.remove(RECORD_JOURNAL_NAME);
+      channelStore.reserve();
+   }
+
    // close any file already open
    if ((isOpenForWrite) || (isOpenForRead)){
       PTRFile.close();
@@ -154,6 +580,28 @@ void PulseTrainRecorder::close() {
    isOpenForWrite = false;
    isOpenForRead = false;
    isPlaybackActive = false;
+   fileFormat = PULSE_FORMAT_UNKNOWN;
+   blockedFile = false;
+   blockRemaining = 0;
+   readAheadCount = 0;
+   recordHead = 0;
+   playbackHead = 0;
+   playbackOpenPending = false;
+   playbackSegmentOnly = false;
+   appendPending = false;
+}
+
+/**
+ * names the file being recorded in the journal, so it can be
+ * repaired if power fails part way
+ */
+void PulseTrainRecorder::writeJournal() {
+   ChannelStream journal = channelStore.open(RECORD_JOURNAL_NAME, FILE_WRITE);
+
+   if (journal) {
+      journal.write((const uint8_t *)currentFileName, CHANNEL_FILENAME_MAX);
+      journal.close();
+   }
 }
     
 /**
@@ -164,116 +612,1182 @@ void PulseTrainRecorder::close() {
 bool PulseTrainRecorder::recordPulse(DigitalPulse dp) {
    bool rtn = false;
    if ((isOpenForWrite) && PTRFile) {
+      rtn = true;
+
       if (dp.isValid) {
-         // write to card and commit immediately
-         PTRFile.println(dp.getDescription());
-         PTRFile.flush();
+         // an appended segment starts with its first pulse
+         rtn = !appendPending || startAppendSegment();
+
+         // encode pulse record; one that will not fit in the 
+         // block is coded again against the model the next 
+         // block starts with
+         uint8_t record[PULSE_CODEC_RECORD_MAX];
+         PulseEncoder prior = encoder;
+         uint8_t len = encoder.encode(dp, record);
+
+         if (recordBufferCount + len > RECORD_SECTOR_SIZE) {
+            encoder = prior;
+            rtn = completeRecordBlock() && rtn;
+            len = encoder.encode(dp, record);
+         }
+
+         // the time a decoder carries on from to read the 
+         // record, and the end of the pulse before
+         long resume_time = decoder.getCursorTime();
+         long last_end = decoder.getPulseEnd();
+
+         // stage for writing, card is only touched
+         // when a whole block is ready
+         rtn = bufferRecordBytes(record, len) && rtn;
+         recordStats.addRecords(record, len);
+
+         // where the record went in the file
+         unsigned long position = recordFileSize + recordBufferCount - len;
+
+         // decode the record just as playback will
+         bool decoded = false;
+         for (uint8_t ii=0; ii<len; ++ii) {
+            decoded = decoder.decodeByte(record[ii]);
+         }
+
+         if (decoded) {
+            recordStats.addPulse(decoder.getPulseStart(), decoder.getPulseEnd());
+         }
+
+         if (recordHead && !rtn) {
+            // head no longer matches the file
+            recordHead->count = 0;
+            recordHead = 0;
+         }
+         else if (recordHead && (recordHead->count < PLAYBACK_HEAD_PULSES)) {
+            if (decoded) {
+               recordHead->startTime[recordHead->count] = decoder.getPulseStart();
+               recordHead->endTime[recordHead->count]   = decoder.getPulseEnd();
+               recordHead->resumePosition = recordFileSize + recordBufferCount;
+               ++recordHead->count;
+            }
+         }
+         else if (recordHead) {
+            recordHead->more = true;
+         }
+
+         if (decoded && indexFile) {
+            indexPulse(position, resume_time, last_end);
+         }
       }
+   }
 
-      rtn = true;
+   return rtn;
+}
+
+/**
+ * commits staged pulses to the card if no pulse
+ * has been recorded for RECORD_IDLE_FLUSH_MILS
+ *
+ * @return false if writing is not possible, otherwise true
+ */
+bool PulseTrainRecorder::serviceRecording() {
+   bool rtn = true;
+
+   if (    isOpenForWrite 
+       && (getPendingByteCount() > 0)
+       && ((millis() - lastRecordTime) >= RECORD_IDLE_FLUSH_MILS)) {
+      rtn = commitRecordBuffer();
    }
 
    return rtn;
 }
 
 /**
- * reads next pulse description from SD card
+ * copies a pulse record to the block being recorded; a block
+ * is written to the card when the next record will not fit
  *
- * @return true if pulse successfully read and playback active
+ * @param  buf    pulse record
+ * @param  len    number of bytes in buf
+ *
+ * @return true if the record was staged and any write succeeded
  */
-bool PulseTrainRecorder::readNextPulse(){
-   // set up parsing buffers
-   int buf_idx[] = {0,0};
-   int buf_sel = 0;
-   char input_char = 0;
-   
-   char nextPulseBuffer[PULSE_VALUE_BUFFER_CT][PULSE_VALUE_BUFFER_MAX];
-   memset(nextPulseBuffer, 0, PULSE_VALUE_BUFFER_CT*PULSE_VALUE_BUFFER_MAX);
-   
-   if (isOpenForRead && PTRFile && PTRFile.available()) {
-      while (    PTRFile.available() 
-              && (         buf_sel < PULSE_VALUE_BUFFER_CT)
-              && (buf_idx[buf_sel] < PULSE_VALUE_BUFFER_MAX)) {
-         input_char = PTRFile.read();
-         
-         if ('\n' == input_char) {
-            // end of line we are done
-            break;
-         }
-         else if (PULSE_DESCRIPTION_VALUE_DELIMITER == input_char) {
-            // hit the value delimiter - switch buffers
-            ++buf_sel;
-         }
-         else {
-            // put character into correct buffer
-            // and increment buffer index
-            nextPulseBuffer[buf_sel][buf_idx[buf_sel]++] = input_char;
-         }
-      }
-      
-      currentPulseStartTime = atol(nextPulseBuffer[0]);
-      currentPulseEndTime   = atol(nextPulseBuffer[1]);
-      
-      // reading a bad pulse description cancels playback
-       isPlaybackActive = (   (currentPulseEndTime>currentPulseStartTime) 
-                           && (currentPulseStartTime >= 0));
-
-      /* 
-      Serial.print("pulse: ");
-      Serial.print(currentPulseStartTime);
-      Serial.print(" ");
-      Serial.print(currentPulseEndTime);
-      Serial.println("!");
-      */
-    }
-    else {
-       // failure to read the next pulse cancels playback
-       isPlaybackActive = false;
-    }
-   
-   return isPlaybackActive;
+bool PulseTrainRecorder::bufferRecordBytes(const uint8_t *buf, unsigned int len) {
+   bool rtn = true;
+
+   lastRecordTime = millis();
+   bytesBuffered += len;
+
+   // records are never split between blocks
+   if (recordBufferCount + len > RECORD_SECTOR_SIZE) {
+      rtn = completeRecordBlock();
+   }
+
+   memcpy(sectorBuffer + recordBufferCount, buf, len);
+   recordBufferCount += len;
+
+   return rtn;
 }
 
 /**
- * determines state of keying output by comparing 
- * time since playback started to 
- * offset from beginning and ending of the current pulse description
+ * writes staged bytes to the card and commits the file
  *
- * @return keying output state value in {LOW,HIGH}
+ * @return true if the write succeeded
  */
-int PulseTrainRecorder::getPlaybackLogicalState() {
-   int rtnState = LOW;
+bool PulseTrainRecorder::commitRecordBuffer() {
+   bool rtn = true;
 
-   if (isPlaybackActive) {
-      // key down for this pulse is the playback start time
-      // plus the offset from the start of the first pulse
-      // to the start of the current pulse
-      long keyStartTime = playbackStartTime 
-                        + currentPulseStartTime - pulseTrainStartTime;
+   if ((getPendingByteCount() > 0) && PTRFile) {
+      rtn = writeRecordBlock(recordBufferCount);
+      recordBlockCommitted = recordBufferCount;
+   }
+
+   return rtn;
+}
 
+/**
+ * starts a new block, taking the summary so far for its header
+ */
+void PulseTrainRecorder::startRecordBlock() {
+   // the symbol model starts over from the speed so far
+   recordBlock.unit = encoder.getUnit();
+   encoder.startBlock(recordBlock.unit);
+   decoder.startBlock(recordBlock.unit);
 
-      // key up for this pulse is the playback start time
-      // plus the offset from the start of the first pulse
-      // to the start of the current pulse
-      long keyEndTime = playbackStartTime 
-                      + currentPulseEndTime - pulseTrainStartTime;
-                      
-      long timeNow = millis();
-                      
-      // past the end of the current pulse?
-      // get the next pulse
-      if (timeNow >= keyEndTime){
-         rtnState = LOW;
-         readNextPulse();
-      }
-      // after the start of the current pulse
-      // key should be high
-      else if ((timeNow >= keyStartTime)) {
-        rtnState = HIGH;
-      }
-      // current pulse hasn't started yet
-      else {
-          rtnState = LOW;
+   recordBlock.length = 0;
+   recordBlock.pulseCount = recordStats.getPulseCount();
+   recordBlock.resumeTime = decoder.getCursorTime();
+   recordBlock.dataLength = recordStats.getDataLength();
+   recordBlock.dataCrc = recordStats.getDataCrc();
+
+   // header is filled in as the block is written
+   recordBufferCount = PULSE_BLOCK_HEADER_SIZE;
+   recordBlockCommitted = PULSE_BLOCK_HEADER_SIZE;
+}
+
+/**
+ * writes the start of the block being recorded to the card,
+ * with its header
+ *
+ * @param  count  bytes of the block to write
+ *
+ * @return true if the write succeeded
+ */
+bool PulseTrainRecorder::writeRecordBlock(unsigned int count) {
+   recordBlock.length = recordBufferCount - PULSE_BLOCK_HEADER_SIZE;
+   PulseCodec::writeBlockHeader(sectorBuffer, recordBlock);
+
+   // a block committed early is written again from its start
+   bool rtn = (PTRFile.position() == recordFileSize) || PTRFile.seek(recordFileSize);
+   rtn = rtn && (PTRFile.write(sectorBuffer, count) == count);
+   PTRFile.flush();
+   ++flushCount;
+
+   return rtn;
+}
+
+/**
+ * pads out the block being recorded, writes it whole 
+ * and starts the next
+ *
+ * @return true if the write succeeded
+ */
+bool PulseTrainRecorder::completeRecordBlock() {
+   memset(sectorBuffer + recordBufferCount, 0, RECORD_SECTOR_SIZE - recordBufferCount);
+   bool rtn = writeRecordBlock(RECORD_SECTOR_SIZE);
+
+   recordFileSize += RECORD_SECTOR_SIZE;
+   startRecordBlock();
+
+   return rtn;
+}
+
+/**
+ * writes the summary of the recording in progress over the
+ * empty header written when the file was opened
+ *
+ * @param  recovered  true if the recording was cut off
+ *
+ * @return true if the header was written
+ */
+bool PulseTrainRecorder::finalizeRecording(bool recovered) {
+   bool rtn = false;
+
+   if (PTRFile && PTRFile.seek(0)) {
+      PulseChannelInfo info;
+      uint8_t header[PULSE_FILE_HEADER_SIZE];
+
+      recordStats.getInfo(info);
+      info.version = decoder.getVersion();
+      info.recovered = recovered;
+      uint8_t len = PulseCodec::writeHeader(header, info);
+
+      rtn = (PTRFile.write(header, len) == len);
+      PTRFile.flush();
+   }
+
+   return rtn;
+}
+
+/**
+ * repairs any recording cut off by a power failure, named in
+ * the journal
+ *
+ * @return false if a recording could not be repaired
+ */
+bool PulseTrainRecorder::recoverRecording() {
+   bool rtn = true;
+
+   if (channelStore.exists(RECORD_JOURNAL_NAME)) {
+      ChannelStream journal = channelStore.open(RECORD_JOURNAL_NAME, FILE_READ);
+
+      memset(currentFileName, 0, CHANNEL_FILENAME_MAX);
+      if (journal) {
+         journal.read(currentFileName, CHANNEL_FILENAME_MAX - 1);
+         journal.close();
+      }
+
+      if (currentFileName[0] && channelStore.exists(currentFileName)) {
+         PTRFile = channelStore.open(currentFileName, FILE_RECOVER);
+
+         if (PTRFile) {
+            rtn = repairRecording();
+            PTRFile.close();
+         }
+      }
+
+      currentFileName[0] = 0;
+      channelStore.remove(RECORD_JOURNAL_NAME);
+   }
+
+   return rtn;
+}
+
+/**
+ * summarizes the recording open in PTRFile from its last good 
+ * block, and voids any torn block after it; only the end of the 
+ * file is read, however long the recording
+ *
+ * @return true if the header was written
+ */
+bool PulseTrainRecorder::repairRecording() {
+   bool rtn = false;
+   PulseChannelInfo info;
+
+   int len = PTRFile.seek(0) ? PTRFile.read(sectorBuffer, PULSE_FILE_HEADER_SIZE) : 0;
+
+   if (PulseCodec::readHeader(sectorBuffer, len, info)) {
+      // cut off after the header was written
+      rtn = true;
+   }
+   else if (PulseCodec::isBlocked(sectorBuffer, len)) {
+      unsigned long size = PTRFile.size();
+      decoder.setVersion(sectorBuffer[3]);
+      unsigned long block = ((size - 1) / RECORD_SECTOR_SIZE) * RECORD_SECTOR_SIZE;
+      PulseBlockHeader hdr;
+      bool found = false;
+
+      // only the last block is ever written more than once,
+      // so only it can be torn
+      for (uint8_t tries=0; !found && (tries<2) && (block>=RECORD_SECTOR_SIZE); ++tries) {
+         len = PTRFile.seek(block) ? PTRFile.read(sectorBuffer, RECORD_SECTOR_SIZE) : 0;
+         found = PulseCodec::readBlockHeader(sectorBuffer, len, hdr)
+              && (len >= (int)(PULSE_BLOCK_HEADER_SIZE + hdr.length))
+              && PulseCodec::checkBlock(sectorBuffer, hdr);
+
+         if (!found) {
+            // playback stops before a void block
+            PTRFile.seek(block);
+            PTRFile.write((uint8_t)PULSE_BLOCK_VOID);
+            block -= RECORD_SECTOR_SIZE;
+         }
+      }
+
+      // summary up to the block from its header, then add
+      // the pulses in the block
+      recordStats.reset();
+
+      if (found) {
+         unsigned int start = PULSE_BLOCK_HEADER_SIZE;
+         unsigned int end = PULSE_BLOCK_HEADER_SIZE + hdr.length;
+
+         recordStats.resumeAt(hdr);
+         recordStats.addRecords(sectorBuffer + start, end - start);
+         decoder.resumeAt(hdr.resumeTime);
+         decoder.startBlock(hdr.unit);
+
+         for (unsigned int ii=start; ii<end; ++ii) {
+            if (decoder.decodeByte(sectorBuffer[ii])) {
+               recordStats.addPulse(decoder.getPulseStart(), decoder.getPulseEnd());
+            }
+         }
+      }
+
+      rtn = finalizeRecording(true);
+   }
+
+   return rtn;
+}
+
+/**
+ * makes the name of the seek index of the current channel file,
+ * the file name with its extension replaced by .idx
+ *
+ * @param  name   destination, CHANNEL_FILENAME_MAX characters
+ */
+void PulseTrainRecorder::makeIndexName(char *name) const {
+   // leave room for the new extension and the terminator
+   size_t len = strlen(currentFileName);
+
+   if (len > CHANNEL_FILENAME_MAX - 5) {
+      len = CHANNEL_FILENAME_MAX - 5;
+   }
+
+   memcpy(name, currentFileName, len);
+   name[len] = 0;
+
+   char *ext = strrchr(name, '.');
+   if (!ext) {
+      ext = name + strlen(name);
+   }
+
+   strcpy(ext, ".idx");
+}
+
+/**
+ * starts the seek index for a new recording, or removes the
+ * index of an earlier recording if indexing is off
+ *
+ * @param  append   true to add to the index of the channel; a
+ *                  channel without one is left without
+ */
+void PulseTrainRecorder::openIndexForRecording(bool append) {
+   char name[CHANNEL_FILENAME_MAX];
+   makeIndexName(name);
+
+   indexBufferCount = 0;
+   pulsesSinceIndex = 0;
+
+   if ((indexInterval > 0) && append) {
+      if (channelStore.exists(name)) {
+         indexFile = channelStore.open(name, FILE_RECOVER);
+      }
+
+      // entries added after a torn one would never be found
+      unsigned long size = indexFile ? indexFile.size() : 0;
+
+      if (   indexFile 
+          && (   (size < PULSE_INDEX_HEADER_SIZE)
+              || ((size - PULSE_INDEX_HEADER_SIZE) % PULSE_INDEX_ENTRY_SIZE)
+              || !indexFile.seek(size))) {
+         indexFile.close();
+      }
+   }
+   else if (indexInterval > 0) {
+      indexFile = channelStore.open(name, FILE_WRITE);
+
+      if (indexFile) {
+         uint8_t header[PULSE_INDEX_HEADER_SIZE];
+         uint8_t len = PulseCodec::writeIndexHeader(header);
+
+         if (indexFile.write(header, len) != len) {
+            indexFile.close();
+         }
+      }
+   }
+
+   // an index must never be used with the wrong recording
+   if (!indexFile && channelStore.exists(name)) {
+      channelStore.remove(name);
+   }
+}
+
+/**
+ * adds the pulse just recorded to the seek index, if it starts
+ * a message or is due an entry
+ *
+ * @param  position     file position of the pulse record
+ * @param  resume_time  time the decoder carries on from to read it
+ * @param  last_end     end time of the pulse before
+ */
+void PulseTrainRecorder::indexPulse(unsigned long position, long resume_time, long last_end) {
+   PulseIndexEntry entry;
+
+   entry.position   = position;
+   entry.resumeTime = resume_time;
+   entry.startTime  = decoder.getPulseStart();
+
+   // first pulse of the train, or after a long space
+   if (   (1 == recordStats.getPulseCount())
+       || ((entry.startTime - last_end) >= PLAYBACK_MESSAGE_GAP_MILS)) {
+      entry.flags = PULSE_INDEX_FLAG_MESSAGE;
+   }
+
+   if (entry.flags || (++pulsesSinceIndex >= indexInterval)) {
+      pulsesSinceIndex = 0;
+      indexBufferCount += PulseCodec::writeIndexEntry(indexBuffer + indexBufferCount
+                                                     ,entry);
+
+      if (indexBufferCount >= sizeof(indexBuffer)) {
+         commitIndexBuffer();
+      }
+   }
+}
+
+/**
+ * writes staged seek index entries to the index file
+ *
+ * @return true if the write succeeded
+ */
+bool PulseTrainRecorder::commitIndexBuffer() {
+   bool rtn = true;
+
+   if ((indexBufferCount > 0) && indexFile) {
+      rtn = (indexFile.write(indexBuffer, indexBufferCount) == indexBufferCount);
+      indexBufferCount = 0;
+
+      // a partial entry would spoil the rest of the index
+      if (!rtn) {
+         char name[CHANNEL_FILENAME_MAX];
+         makeIndexName(name);
+
+         indexFile.close();
+         channelStore.remove(name);
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * looks up the seek index of the current channel file
+ *
+ * @param  time_ms  if message is negative, find the last entry
+ *                  starting at or before this time
+ * @param  message  if not negative, find the first pulse of this
+ *                  message, counting from 0
+ * @param  entry    receives the entry found
+ *
+ * @return true if an entry was found
+ */
+bool PulseTrainRecorder::findIndexEntry(long time_ms, int message, PulseIndexEntry &entry) {
+   bool rtn = false;
+   char name[CHANNEL_FILENAME_MAX];
+   makeIndexName(name);
+
+   ChannelStream index = channelStore.open(name, FILE_READ);
+
+   if (index) {
+      uint8_t buf[PULSE_INDEX_ENTRY_SIZE];
+      int len = index.read(buf, PULSE_INDEX_HEADER_SIZE);
+
+      if (PulseCodec::isIndexHeader(buf, len)) {
+         PulseIndexEntry next;
+         int messages = 0;
+         bool searching = true;
+
+         // entries are in time order
+         while (searching && (index.read(buf, PULSE_INDEX_ENTRY_SIZE) == PULSE_INDEX_ENTRY_SIZE)) {
+            PulseCodec::readIndexEntry(buf, next);
+
+            if (message < 0) {
+               searching = (next.startTime <= time_ms);
+               if (searching) {
+                  entry = next;
+                  rtn = true;
+               }
+            }
+            else if (next.flags & PULSE_INDEX_FLAG_MESSAGE) {
+               if (messages++ == message) {
+                  entry = next;
+                  rtn = true;
+                  searching = false;
+               }
+            }
+         }
+      }
+
+      index.close();
+   }
+
+   return rtn;
+}
+
+/**
+ * moves playback to the pulse of a seek index entry
+ *
+ * @param  entry  seek index entry
+ *
+ * @return true if the pulse was read
+ */
+bool PulseTrainRecorder::resumeFromIndex(const PulseIndexEntry &entry) {
+   bool rtn = false;
+
+   // seek fails for an entry past the end of the file
+   if (   (PULSE_FORMAT_BINARY == fileFormat) 
+       && PTRFile 
+       && seekPlayback(entry.position)) {
+      decoder.resumeAt(entry.resumeTime);
+      rtn = readNextBinaryPulse();
+      isPlaybackActive = rtn;
+   }
+
+   return rtn;
+}
+
+/**
+ * prepares to move playback; opens the file if playback started
+ * from a cached head, and stops using the head
+ *
+ * @return true if playback had been using a cached head
+ */
+bool PulseTrainRecorder::leaveCachedPlayback() {
+   bool rtn = (0 != playbackHead);
+
+   if (playbackOpenPending) {
+      openDeferredPlayback();
+   }
+
+   playbackHead = 0;
+
+   return rtn;
+}
+
+/**
+ * reopens the file open for playback at its first pulse
+ *
+ * @return true if playback active
+ */
+bool PulseTrainRecorder::rewindPlayback() {
+   // close() clears the current name
+   char fn[CHANNEL_FILENAME_MAX];
+   strncpy(fn, currentFileName, CHANNEL_FILENAME_MAX);
+
+   return openForPlayback(fn);
+}
+
+/**
+ * starts playback timing over at the current pulse
+ */
+void PulseTrainRecorder::restartPlayback() {
+   pulseTrainStartTime = currentPulseStartTime;
+   playbackStartTime = millis() + playbackDelay;
+   scalePulse(true);
+}
+
+/**
+ * sets the playback rate; takes effect from the next pulse,
+ * so it can be changed while playing
+ *
+ * @param  rate         256ths of the recorded speed
+ * @param  spaces_only  true to scale only the spaces between
+ *                      characters, as in Farnsworth timing
+ */
+void PulseTrainRecorder::setPlaybackRate(uint16_t rate, bool spaces_only) {
+   if (rate < PLAYBACK_RATE_MIN) {
+      rate = PLAYBACK_RATE_MIN;
+   }
+   else if (rate > PLAYBACK_RATE_MAX) {
+      rate = PLAYBACK_RATE_MAX;
+   }
+
+   // lengths are multiplied by the inverse of the rate, 
+   // so no pulse needs a division
+   playbackRate = rate;
+   playbackScale = ((unsigned long)PLAYBACK_RATE_UNITY * PLAYBACK_RATE_UNITY
+                    + (rate >> 1)) / rate;
+   playbackSpacesOnly = spaces_only;
+}
+
+/**
+ * scales a recorded length to the playback rate, carrying
+ * the part of a millisecond left over to the next length
+ *
+ * @param  len    length as recorded, milliseconds
+ *
+ * @return length as played, milliseconds
+ */
+long PulseTrainRecorder::scaleLength(long len) {
+   long rtn = len;
+
+   if ((PLAYBACK_RATE_UNITY != playbackScale) && (len > 0)) {
+      // over two hours, a space is as good as a pause
+      if (len > 0x7FFFFFL) {
+         len = 0x7FFFFFL;
+      }
+
+      unsigned long scaled = (unsigned long)len * playbackScale + playedFraction;
+
+      playedFraction = scaled & 0xFF;
+      rtn = scaled >> 8;
+   }
+
+   return rtn;
+}
+
+/**
+ * works out when the current pulse plays, from the space before
+ * it and its length scaled to the playback rate
+ *
+ * @param  first  true if the pulse starts the pulse train
+ */
+void PulseTrainRecorder::scalePulse(bool first) {
+   long mark = currentPulseEndTime - currentPulseStartTime;
+
+   if (first) {
+      playedStartTime = 0;
+      playedFraction = 0;
+      playbackDit = 0;
+   }
+   else {
+      long space = currentPulseStartTime - priorPulseEndTime;
+      long least = (long)PLAYBACK_SPACE_DITS * playbackDit;
+
+      if (!playbackSpacesOnly) {
+         space = scaleLength(space);
+      }
+      else if (space > least) {
+         // spaces within characters are about a dit long and
+         // play as recorded; those between characters are kept 
+         // a dit over them when sped up, and those between words
+         // are kept a word space long
+         long played = scaleLength(space);
+         long kept = (space > (long)PLAYBACK_WORD_DITS * playbackDit)
+                   ? (long)PLAYBACK_WORD_SPACE_DITS * playbackDit
+                   : least + playbackDit;
+
+         if (space > kept) {
+            space = kept;
+         }
+
+         if (played > space) {
+            space = played;
+         }
+      }
+
+      playedStartTime = playedEndTime + space;
+   }
+
+   playedEndTime = playedStartTime 
+                 + (playbackSpacesOnly ? mark : scaleLength(mark));
+   priorPulseEndTime = currentPulseEndTime;
+
+   // follow the dit, taking a mark much shorter than it as a 
+   // dit, one under two dits as a dit and anything longer as
+   // a dah of three
+   if ((mark > 0) && (mark < 0xFFFFL)) {
+      if ((0 == playbackDit) || ((mark << 1) < playbackDit)) {
+         playbackDit = mark;
+      }
+      else if (mark < 2L * playbackDit) {
+         playbackDit += (mark - (long)playbackDit) / 4;
+      }
+      else {
+         playbackDit += (mark / 3 - (long)playbackDit) / 4;
+      }
+   }
+}
+
+/**
+ * moves playback to the first pulse ending after a given time,
+ * which then plays after the usual delay. The seek index is used
+ * if there is one, otherwise the file is read up to the place.
+ *
+ * @param  offset_ms  milliseconds from the first pulse of the file
+ *
+ * @return true if playback active at the new place
+ */
+bool PulseTrainRecorder::seek(long offset_ms) {
+   bool rtn = false;
+
+   if (isOpenForRead) {
+      long target = firstPulseStartTime + offset_ms;
+      bool cached = leaveCachedPlayback();
+      PulseIndexEntry entry;
+      playbackSegmentOnly = false;
+
+      rtn = findIndexEntry(target, -1, entry) && resumeFromIndex(entry);
+
+      // no index, read on from the current pulse; start over if
+      // the place has been passed, or the file is not in step
+      if (!rtn) {
+         rtn = (cached || !isPlaybackActive || (currentPulseStartTime > target))
+             ? rewindPlayback()
+             : true;
+      }
+
+      while (rtn && (currentPulseEndTime <= target)) {
+         rtn = readNextPulse();
+      }
+
+      if (rtn) {
+         restartPlayback();
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * moves playback to the first pulse of a message, which then
+ * plays after the usual delay. Messages are separated by spaces of
+ * at least PLAYBACK_MESSAGE_GAP_MILS. The seek index is used if 
+ * there is one, otherwise the file is read up to the message.
+ *
+ * @param  message  message number, counting from 0
+ *
+ * @return true if playback active at the new place
+ */
+bool PulseTrainRecorder::skipToMessage(unsigned int message) {
+   bool rtn = false;
+
+   if (isOpenForRead) {
+      PulseIndexEntry entry;
+      leaveCachedPlayback();
+      playbackSegmentOnly = false;
+
+      rtn = findIndexEntry(0, message, entry) && resumeFromIndex(entry);
+
+      // no index, count long spaces from the start
+      if (!rtn && rewindPlayback()) {
+         unsigned int messages = 0;
+         rtn = true;
+
+         while (rtn && (messages < message)) {
+            long last_end = currentPulseEndTime;
+            rtn = readNextPulse();
+
+            if (rtn && ((currentPulseStartTime - last_end) >= PLAYBACK_MESSAGE_GAP_MILS)) {
+               ++messages;
+            }
+         }
+      }
+
+      if (rtn) {
+         restartPlayback();
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * moves playback to the first pulse of a segment, which then plays
+ * after the usual delay; playback ends with the segment
+ *
+ * @param  segment  segment number, counting from 0
+ *
+ * @return true if playback active at the new place
+ */
+bool PulseTrainRecorder::playSegment(unsigned int segment) {
+   bool rtn = false;
+
+   if (isOpenForRead && (segment < playbackSegments)) {
+      playbackSegmentOnly = false;
+
+      if (1 == playbackSegments) {
+         // the file is the segment
+         rtn = isPlaybackActive;
+      }
+      else if (0 == segment) {
+         leaveCachedPlayback();
+         rtn = rewindPlayback();
+      }
+      else {
+         // segment table entry in the header sector
+         uint8_t entry[PULSE_SEGMENT_ENTRY_SIZE];
+         PulseBlockHeader hdr;
+         leaveCachedPlayback();
+
+         rtn =  PTRFile
+             && PTRFile.seek(PULSE_SEGMENT_TABLE + segment * PULSE_SEGMENT_ENTRY_SIZE)
+             && (PTRFile.read(entry, PULSE_SEGMENT_ENTRY_SIZE) == PULSE_SEGMENT_ENTRY_SIZE)
+             && seekPlayback(PulseCodec::readSegmentEntry(entry) + PULSE_BLOCK_HEADER_SIZE)
+             && PulseCodec::readBlockHeader(sectorBuffer, PULSE_BLOCK_HEADER_SIZE, hdr);
+
+         // block loaded from its start, marker comes first
+         if (rtn) {
+            decoder.resumeAt(hdr.resumeTime);
+            rtn = readNextBinaryPulse();
+            isPlaybackActive = rtn;
+         }
+      }
+
+      if (rtn) {
+         playbackSegmentOnly = true;
+         playbackMarkerCount = decoder.getMarkerCount();
+         restartPlayback();
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * gets place reached by playback, for use with seek()
+ *
+ * @return milliseconds from the first pulse of the file
+ */
+long PulseTrainRecorder::getPlaybackPosition() const {
+   long elapsed = millis() - playbackStartTime;
+   long rtn = currentPulseStartTime - firstPulseStartTime;
+
+   // time played only matches time recorded at the recorded speed
+   if (PLAYBACK_RATE_UNITY == playbackRate) {
+      rtn = pulseTrainStartTime - firstPulseStartTime 
+          + ((elapsed > 0) ? elapsed : 0);
+   }
+
+   return rtn;
+}
+
+/**
+ * reads the next chunk of the playback file into the ring,
+ * if there is room for it
+ *
+ * @return true if any bytes were read
+ */
+bool PulseTrainRecorder::fillReadAhead() {
+   bool rtn = false;
+
+   // ring follows file position within the sector, so reads
+   // stop at chunk boundaries and never wrap
+   unsigned int tail = (readAheadHead + readAheadCount) % RECORD_SECTOR_SIZE;
+   unsigned int want = PLAYBACK_READ_CHUNK - (tail % PLAYBACK_READ_CHUNK);
+
+   if (   isOpenForRead
+       && (readAheadCount <= RECORD_SECTOR_SIZE - want)
+       && PTRFile.available()) {
+      int len = PTRFile.read(sectorBuffer + tail, want);
+
+      if (len > 0) {
+         readAheadCount += len;
+         ++readAheadFills;
+         rtn = true;
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * takes the next byte of the playback file from the ring,
+ * reading from the card only if the ring is empty
+ *
+ * @return next byte, or -1 at end of file
+ */
+int PulseTrainRecorder::readAheadByte() {
+   int rtn = -1;
+
+   if ((readAheadCount > 0) || fillReadAhead()) {
+      rtn = sectorBuffer[readAheadHead];
+
+      if (++readAheadHead >= RECORD_SECTOR_SIZE) {
+         readAheadHead = 0;
+      }
+      --readAheadCount;
+   }
+
+   return rtn;
+}
+
+/**
+ * takes the next byte of pulse records from the ring, passing
+ * over block headers and padding in blocked files
+ *
+ * @return next byte, or -1 at the end of the pulse records
+ */
+int PulseTrainRecorder::readPulseByte() {
+   int rtn = -1;
+   bool more = true;
+
+   // padding runs to the end of the sector, and the 
+   // next block starts on a sector boundary
+   while (blockedFile && more && (0 == blockRemaining)) {
+      more = (0 == readAheadHead) 
+           ? loadBlockHeader() 
+           : (readAheadByte() >= 0);
+   }
+
+   if (more) {
+      rtn = readAheadByte();
+
+      if (blockedFile && (rtn >= 0)) {
+         --blockRemaining;
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * reads the header of the next playback block; a block that
+ * is not committed ends the pulse train
+ *
+ * @return true if the block holds pulse records
+ */
+bool PulseTrainRecorder::loadBlockHeader() {
+   uint8_t header[PULSE_BLOCK_HEADER_SIZE];
+   PulseBlockHeader hdr;
+   int len = 0;
+   int next = 0;
+
+   while ((len < PULSE_BLOCK_HEADER_SIZE) && ((next = readAheadByte()) >= 0)) {
+      header[len++] = next;
+   }
+
+   bool rtn = PulseCodec::readBlockHeader(header, len, hdr);
+
+   if (rtn) {
+      blockRemaining = hdr.length;
+      decoder.startBlock(hdr.unit);
+   }
+   else {
+      // nothing more to read
+      readAheadCount = 0;
+      PTRFile.seek(PTRFile.size());
+   }
+
+   return rtn;
+}
+
+/**
+ * moves the playback file and ring to a file position; in blocked
+ * files the block holding it is read up to the position first, for
+ * its header and to bring the decoder model up to it
+ *
+ * @param  position  file position of a pulse record
+ *
+ * @return true if the file holds the position
+ */
+bool PulseTrainRecorder::seekPlayback(unsigned long position) {
+   bool rtn = false;
+   unsigned int offset = position % RECORD_SECTOR_SIZE;
+
+   readAheadCount = 0;
+   blockRemaining = 0;
+
+   if (blockedFile && (offset > 0)) {
+      PulseBlockHeader hdr;
+
+      // load the block up to the position
+      readAheadHead = 0;
+      rtn = PTRFile.seek(position - offset);
+
+      while (rtn && (readAheadCount < offset) && fillReadAhead()) {
+      }
+
+      rtn =  rtn
+          && (readAheadCount >= offset)
+          && PulseCodec::readBlockHeader(sectorBuffer, readAheadCount, hdr)
+          && (offset >= PULSE_BLOCK_HEADER_SIZE)
+          && (offset <= PULSE_BLOCK_HEADER_SIZE + hdr.length);
+
+      if (rtn) {
+         blockRemaining = PULSE_BLOCK_HEADER_SIZE + hdr.length - offset;
+         readAheadHead = offset;
+         readAheadCount -= offset;
+
+         // bring the symbol model up to the position; the
+         // caller then sets the time to carry on from
+         decoder.startBlock(hdr.unit);
+         for (unsigned int ii=PULSE_BLOCK_HEADER_SIZE; ii<offset; ++ii) {
+            decoder.decodeByte(sectorBuffer[ii]);
+         }
+      }
+   }
+   else {
+      // ring follows file position within the sector; 
+      // a block header there is read when it is reached
+      rtn = PTRFile.seek(position);
+      readAheadHead = offset;
+   }
+
+   return rtn;
+}
+
+/**
+ * tops up the playback read-ahead ring from the card; called 
+ * while the key is up, so the card is not read when an edge is due
+ *
+ * @return true if any bytes were read
+ */
+bool PulseTrainRecorder::serviceReadAhead() {
+   bool rtn = false;
+
+   if (playbackOpenPending) {
+      openDeferredPlayback();
+   }
+
+   while (fillReadAhead()) {
+      rtn = true;
+   }
+
+   return rtn;
+}
+
+/**
+ * reads next pulse description from SD card
+ *
+ * @return true if pulse successfully read and playback active
+ */
+bool PulseTrainRecorder::readNextPulse(){
+   if (isOpenForRead && playbackHead && (playbackHeadIndex < playbackHead->count)) {
+      // still playing from the cached head
+      currentPulseStartTime = playbackHead->startTime[playbackHeadIndex];
+      currentPulseEndTime   = playbackHead->endTime[playbackHeadIndex];
+      ++playbackHeadIndex;
+   }
+   else {
+      if (playbackOpenPending) {
+         // cache ran out before the file was opened
+         openDeferredPlayback();
+      }
+
+      if (isOpenForRead && PTRFile && readAheadAvailable()) {
+         switch (fileFormat) {
+            case PULSE_FORMAT_BINARY:
+               isPlaybackActive = readNextBinaryPulse();
+               break;
+
+            case PULSE_FORMAT_TEXT:
+               isPlaybackActive = readNextTextPulse();
+               break;
+
+            default:
+               isPlaybackActive = false;
+               break;
+         };
+
+         /* 
+         Serial.print("pulse: ");
+         Serial.print(currentPulseStartTime);
+         Serial.print(" ");
+         Serial.print(currentPulseEndTime);
+         Serial.println("!");
+         */
+      }
+      else {
+         // failure to read the next pulse cancels playback
+         isPlaybackActive = false;
+      }
+   }
+
+   // time the pulse to the playback rate
+   if (isPlaybackActive) {
+      scalePulse(false);
+   }
+   
+   return isPlaybackActive;
+}
+
+/**
+ * reads next pulse from a binary channel file
+ *
+ * @return true if pulse successfully read
+ */
+bool PulseTrainRecorder::readNextBinaryPulse() {
+   bool rtn = false;
+
+   int next = 0;
+
+   while (!rtn && !decoder.hasError() && ((next = readPulseByte()) >= 0)) {
+      rtn = decoder.decodeByte(next);
+   }
+
+   // a marker has been passed, the segment is over
+   if (playbackSegmentOnly && (decoder.getMarkerCount() != playbackMarkerCount)) {
+      rtn = false;
+   }
+
+   if (rtn) {
+      currentPulseStartTime = decoder.getPulseStart();
+      currentPulseEndTime   = decoder.getPulseEnd();
+   }
+
+   return rtn;
+}
+
+/**
+ * reads next pulse from a legacy text channel file
+ *
+ * @return true if pulse successfully read
+ */
+bool PulseTrainRecorder::readNextTextPulse() {
+   // set up parsing buffers
+   int buf_idx[] = {0,0};
+   int buf_sel = 0;
+   char input_char = 0;
+   
+   char nextPulseBuffer[PULSE_VALUE_BUFFER_CT][PULSE_VALUE_BUFFER_MAX];
+   memset(nextPulseBuffer, 0, PULSE_VALUE_BUFFER_CT*PULSE_VALUE_BUFFER_MAX);
+   
+   while (    readAheadAvailable() 
+           && (         buf_sel < PULSE_VALUE_BUFFER_CT)
+           && (buf_idx[buf_sel] < PULSE_VALUE_BUFFER_MAX)) {
+      input_char = readAheadByte();
+      
+      if ('\n' == input_char) {
+         // end of line we are done
+         break;
+      }
+      else if (PULSE_DESCRIPTION_VALUE_DELIMITER == input_char) {
+         // hit the value delimiter - switch buffers
+         ++buf_sel;
+      }
+      else {
+         // put character into correct buffer
+         // and increment buffer index
+         nextPulseBuffer[buf_sel][buf_idx[buf_sel]++] = input_char;
+      }
+   }
+   
+   currentPulseStartTime = atol(nextPulseBuffer[0]);
+   currentPulseEndTime   = atol(nextPulseBuffer[1]);
+   
+   // reading a bad pulse description cancels playback
+   return (   (currentPulseEndTime>currentPulseStartTime) 
+           && (currentPulseStartTime >= 0));
+}
+
+/**
+ * determines state of keying output by comparing 
+ * time since playback started to 
+ * offset from beginning and ending of the current pulse description
+ *
+ * @return keying output state value in {LOW,HIGH}
+ */
+int PulseTrainRecorder::getPlaybackLogicalState() {
+   int rtnState = LOW;
+
+   if (isPlaybackActive) {
+      // key down for this pulse is the playback start time
+      // plus the offset from the start of the first pulse
+      // to the start of the current pulse, as played
+      long keyStartTime = playbackStartTime + playedStartTime;
+
+
+      // key up for this pulse is the playback start time
+      // plus the offset from the start of the first pulse
+      // to the end of the current pulse, as played
+      long keyEndTime = playbackStartTime + playedEndTime;
+                      
+      long timeNow = millis();
+                      
+      // past the end of the current pulse?
+      // get the next pulse
+      if (timeNow >= keyEndTime){
+         rtnState = LOW;
+         readNextPulse();
+      }
+      // after the start of the current pulse
+      // key should be high
+      else if ((timeNow >= keyStartTime)) {
+        rtnState = HIGH;
+      }
+      // current pulse hasn't started yet
+      else {
+          rtnState = LOW;
+
+          // long space, time to read ahead
+          if ((keyStartTime - timeNow) >= PLAYBACK_REFILL_SPACE_MILS) {
+             serviceReadAhead();
+          }
       }
    }
 
@@ -29,21 +29,181 @@
  * @section DESCRIPTION
  *
  * This file contains class definitions for PulseTrainRecorder
- * This class reads and writes pulse train descriptions to text
- * files on an SD card.
+ * This class reads and writes pulse train descriptions to channel
+ * files on an SD card. New recordings use the binary format defined
+ * in PulseCodec.h; legacy text files can still be played back.
  */
  
 
 #include <Arduino.h>
 #include <SD.h>
 
+#include <ChannelStore.h>
 #include <DigitalPulse.h>
 #include <DigitalPin.h>
+#include <PulseCodec.h>
 
 #define CHANNEL_FILENAME_MAX   16
 #define PULSE_VALUE_BUFFER_CT   2
 #define PLAYBACK_DELAY_MILS   100
 
+/**
+ * recording write buffer
+ * <p>
+ * RECORD_SECTOR_SIZE is the SD card sector size, which is also the
+ * size of a channel file block. Encoded pulses are staged in RAM and
+ * committed to the card a whole block at a time.
+ * <p>
+ * RECORD_IDLE_FLUSH_MILS is the longest time staged pulses are held
+ * in RAM when no new pulse arrives. This bounds the amount of keying 
+ * lost if power is removed while recording. A block committed early
+ * is written again, in place, as it fills.
+ * <p>
+ * RECORD_JOURNAL_NAME is a stream naming the channel being recorded,
+ * present only while recording. If it is found at reset, the 
+ * recording was cut off, and its channel is repaired.
+ * <p>
+ * RECORD_STORE_NAME is the container file on the SD card holding
+ * every channel, its seek index and the journal, as streams.
+ */
+#define RECORD_SECTOR_SIZE      PULSE_BLOCK_SIZE
+#define RECORD_IDLE_FLUSH_MILS  2000
+#define RECORD_JOURNAL_NAME     "journal.dfr"
+#define RECORD_STORE_NAME       "channels.dfr"
+
+/**
+ * playback read-ahead
+ * <p>
+ * The sector buffer is used as a ring during playback, filled from
+ * the card PLAYBACK_READ_CHUNK bytes at a time. Chunks divide the
+ * sector evenly, so every read stays within one card sector.
+ * <p>
+ * PLAYBACK_REFILL_SPACE_MILS is the shortest key up time in which
+ * the ring is topped up ahead of need. Pulses are then decoded from
+ * memory, and the card is only read while the key is waiting.
+ */
+#define PLAYBACK_READ_CHUNK         (RECORD_SECTOR_SIZE / 2)
+#define PLAYBACK_REFILL_SPACE_MILS  20
+
+/**
+ * cached pulse train heads
+ * <p>
+ * PLAYBACK_HEAD_PULSES is the number of pulses at the start of a
+ * channel kept in RAM, so playback can begin before the card is read.
+ * <p>
+ * PLAYBACK_CACHED_DELAY_MILS replaces PLAYBACK_DELAY_MILS as the wait
+ * before the first pulse when playback starts from a cached head.
+ */
+#define PLAYBACK_HEAD_PULSES         4
+#define PLAYBACK_CACHED_DELAY_MILS  10
+
+/**
+ * seek index
+ * <p>
+ * PLAYBACK_INDEX_INTERVAL is the usual number of pulses between 
+ * entries of the seek index written alongside a recording.
+ * <p>
+ * PLAYBACK_MESSAGE_GAP_MILS is the shortest space taken as the end of
+ * a message. The first pulse of every message is indexed as well.
+ * <p>
+ * PLAYBACK_INDEX_BUFFER_ENTRIES is the number of index entries staged
+ * in RAM before they are written to the index file.
+ */
+#define PLAYBACK_INDEX_INTERVAL        32
+#define PLAYBACK_MESSAGE_GAP_MILS    3000
+#define PLAYBACK_INDEX_BUFFER_ENTRIES   2
+
+/**
+ * playback rate
+ * <p>
+ * Rates are in 256ths of the recorded speed, PLAYBACK_RATE_UNITY 
+ * playing as recorded, and are held between PLAYBACK_RATE_MIN and
+ * PLAYBACK_RATE_MAX, half and three times the recorded speed.
+ * <p>
+ * When only spaces are scaled, a space over PLAYBACK_SPACE_DITS dit 
+ * lengths is taken as the end of a character, and scaled, though
+ * never to less than a dit over that; shorter spaces, within 
+ * characters, play as recorded. A space over PLAYBACK_WORD_DITS dit
+ * lengths is taken as the end of a word, and is never scaled to 
+ * less than PLAYBACK_WORD_SPACE_DITS dit lengths, or its recorded
+ * length if that is shorter.
+ * <p>
+ * Playback keys from the played pulse times at every rate, so the
+ * scaling state, about 20 bytes, is kept whether or not the sketch
+ * lets the rate be changed.
+ */
+#define PLAYBACK_RATE_UNITY          256
+#define PLAYBACK_RATE_MIN            128
+#define PLAYBACK_RATE_MAX            768
+#define PLAYBACK_SPACE_DITS            2
+#define PLAYBACK_WORD_DITS             5
+#define PLAYBACK_WORD_SPACE_DITS       7
+
+/**
+ * struct holding the first pulses of a channel file, and where in
+ * the file to carry on reading after them
+ */
+struct PulseTrainHead {
+  /**
+   * pulse start times, milliseconds relative to train start
+   */
+   long startTime[PLAYBACK_HEAD_PULSES];
+
+  /**
+   * pulse end times, milliseconds relative to train start
+   */
+   long endTime[PLAYBACK_HEAD_PULSES];
+
+  /**
+   * file position of the first pulse not cached
+   */
+   unsigned long resumePosition;
+
+  /**
+   * number of pulses cached, 0 if the head is not loaded
+   */
+   uint8_t count;
+
+  /**
+   * flag is true if the file holds more pulses than are cached
+   */
+   bool more;
+
+  /**
+   * format of the channel file
+   */
+   PulseFileFormat format;
+
+  /**
+   * format version of a binary channel file
+   */
+   uint8_t version;
+
+  /**
+   * flag is true if the channel file holds its pulses in blocks
+   */
+   bool blocked;
+
+  /**
+   * number of segments in the channel file
+   */
+   unsigned int segments;
+
+  /**
+   * PulseTrainHead constructor
+   * creates empty head
+   */
+   PulseTrainHead()
+   : resumePosition(0)
+   , count(0)
+   , more(false)
+   , format(PULSE_FORMAT_UNKNOWN)
+   , version(0)
+   , blocked(false)
+   , segments(1)
+   {}
+};
+
 
 /* -----------------------------------------------------------
  * 
@@ -89,8 +249,394 @@ protected:
   /** flag indicating if playback is active  */
    bool isPlaybackActive;  
 
-  /** file object on SD card  */
-   File PTRFile;  
+  /** container of channel streams on SD card  */
+   ChannelStore channelStore;
+
+  /** channel stream open for recording or playback  */
+   ChannelStream PTRFile;  
+
+  /** format of file open for playback  */
+   PulseFileFormat fileFormat;
+
+  /** converts recorded pulses to binary pulse records  */
+   PulseEncoder encoder;
+
+  /** converts binary pulse records back to pulses  */
+   PulseDecoder decoder;
+
+  /** staging buffer for the block currently being recorded,
+   *  and read-ahead ring during playback
+   */
+   uint8_t sectorBuffer[RECORD_SECTOR_SIZE];
+
+  /** number of bytes of the block staged in sectorBuffer, 
+   *  including its header
+   */
+   unsigned int recordBufferCount;
+
+  /** file position of the block being recorded  */
+   unsigned long recordFileSize;
+
+  /** value of recordBufferCount when the block was last committed  */
+   unsigned int recordBlockCommitted;
+
+  /** header of the block being recorded  */
+   PulseBlockHeader recordBlock;
+
+  /** flag is true if the file open for playback holds blocks  */
+   bool blockedFile;
+
+  /** bytes of pulse records left in the playback block  */
+   unsigned int blockRemaining;
+
+  /** time of last write to the staging buffer, milliseconds since reset  */
+   unsigned long lastRecordTime;
+
+  /** total number of bytes passed through the staging buffer  */
+   unsigned long bytesBuffered;
+
+  /** number of commits of the staging buffer to the card  */
+   unsigned long flushCount;
+
+  /** index of next unread byte in the read-ahead ring  */
+   unsigned int readAheadHead;
+
+  /** number of unread bytes in the read-ahead ring  */
+   unsigned int readAheadCount;
+
+  /** number of chunks read from the card for playback  */
+   unsigned long readAheadFills;
+
+  /** head being filled by the recording in progress, or 0  */
+   PulseTrainHead *recordHead;
+
+  /** cached head being played back, or 0  */
+   const PulseTrainHead *playbackHead;
+
+  /** index of next pulse to play from the cached head  */
+   uint8_t playbackHeadIndex;
+
+  /** flag is true while playback from a cached head has not
+   *  yet opened the file
+   */
+   bool playbackOpenPending;
+
+  /** wait before the first pulse of playback, milliseconds  */
+   unsigned long playbackDelay;
+
+  /** summary of the recording in progress, for the file header  */
+   PulseTrainStats recordStats;
+
+  /** seek index stream written alongside the recording  */
+   ChannelStream indexFile;
+
+  /** pulses between seek index entries, 0 for no index  */
+   uint8_t indexInterval;
+
+  /** pulses recorded since the last seek index entry  */
+   uint8_t pulsesSinceIndex;
+
+  /** staging buffer for seek index entries  */
+   uint8_t indexBuffer[PLAYBACK_INDEX_BUFFER_ENTRIES * PULSE_INDEX_ENTRY_SIZE];
+
+  /** number of bytes staged in indexBuffer  */
+   uint8_t indexBufferCount;
+
+  /** start time of the first pulse of the file open for playback  */
+   long firstPulseStartTime;
+
+  /** number of segments in the file open for playback  */
+   unsigned int playbackSegments;
+
+  /** flag is true if playback ends with the current segment  */
+   bool playbackSegmentOnly;
+
+  /** segment markers decoded before the current segment  */
+   unsigned int playbackMarkerCount;
+
+  /** flag is true while an appended segment has no pulses  */
+   bool appendPending;
+
+  /** playback rate, 256ths of the recorded speed  */
+   uint16_t playbackRate;
+
+  /** recorded lengths are played this long, 256ths  */
+   uint16_t playbackScale;
+
+  /** flag is true if only the spaces between characters are scaled  */
+   bool playbackSpacesOnly;
+
+  /** current pulse start time as played, milliseconds from the
+   *  start of the pulse train
+   */
+   long playedStartTime;
+
+  /** current pulse end time as played, milliseconds from the
+   *  start of the pulse train
+   */
+   long playedEndTime;
+
+  /** part of a millisecond carried to the next scaled length, 256ths  */
+   uint8_t playedFraction;
+
+  /** end time of the pulse before the current one, as recorded  */
+   long priorPulseEndTime;
+
+  /** running dit length, milliseconds, to tell spaces within
+   *  characters from those between them
+   */
+   uint16_t playbackDit;
+
+  /**
+   * copies bytes to the staging buffer, committing each sector
+   * to the card as it fills
+   *
+   * @param  buf    bytes to record
+   * @param  len    number of bytes in buf
+   *
+   * @return true if all bytes were staged or written
+   */
+   bool bufferRecordBytes(const uint8_t *buf, unsigned int len);
+
+  /**
+   * writes staged bytes to the card and commits the file
+   *
+   * @return true if the write succeeded
+   */
+   bool commitRecordBuffer();
+
+  /**
+   * starts a new block, taking the summary so far for its header
+   */
+   void startRecordBlock();
+
+  /**
+   * writes the start of the block being recorded to the card,
+   * with its header
+   *
+   * @param  count  bytes of the block to write
+   *
+   * @return true if the write succeeded
+   */
+   bool writeRecordBlock(unsigned int count);
+
+  /**
+   * pads out the block being recorded, writes it whole 
+   * and starts the next
+   *
+   * @return true if the write succeeded
+   */
+   bool completeRecordBlock();
+
+  /**
+   * writes the summary of the recording in progress over the
+   * empty header written when the file was opened
+   *
+   * @param  recovered  true if the recording was cut off
+   *
+   * @return true if the header was written
+   */
+   bool finalizeRecording(bool recovered);
+
+  /**
+   * repairs any recording cut off by a power failure, named in
+   * the journal
+   *
+   * @return false if a recording could not be repaired
+   */
+   bool recoverRecording();
+
+  /**
+   * summarizes the recording open in PTRFile from its last good 
+   * block, and voids any torn block after it; only the end of the 
+   * file is read, however long the recording
+   *
+   * @return true if the header was written
+   */
+   bool repairRecording();
+
+  /**
+   * names the file being recorded in the journal, so it can be
+   * repaired if power fails part way
+   */
+   void writeJournal();
+
+  /**
+   * writes the start of a segment opened by openForAppend() when its
+   * first pulse is recorded, so a session that records nothing leaves
+   * the channel as it was
+   *
+   * @return true if the segment was started
+   */
+   bool startAppendSegment();
+
+  /**
+   * makes the name of the seek index of the current channel file,
+   * the file name with its extension replaced by .idx
+   *
+   * @param  name   destination, CHANNEL_FILENAME_MAX characters
+   */
+   void makeIndexName(char *name) const;
+
+  /**
+   * starts the seek index for a new recording, or removes the
+   * index of an earlier recording if indexing is off
+   *
+   * @param  append   true to add to the index of the channel; a
+   *                  channel without one is left without
+   */
+   void openIndexForRecording(bool append);
+
+  /**
+   * adds the pulse just recorded to the seek index, if it starts
+   * a message or is due an entry
+   *
+   * @param  position     file position of the pulse record
+   * @param  resume_time  time the decoder carries on from to read it
+   * @param  last_end     end time of the pulse before
+   */
+   void indexPulse(unsigned long position, long resume_time, long last_end);
+
+  /**
+   * writes staged seek index entries to the index file
+   *
+   * @return true if the write succeeded
+   */
+   bool commitIndexBuffer();
+
+  /**
+   * looks up the seek index of the current channel file
+   *
+   * @param  time_ms  if message is negative, find the last entry
+   *                  starting at or before this time
+   * @param  message  if not negative, find the first pulse of this
+   *                  message, counting from 0
+   * @param  entry    receives the entry found
+   *
+   * @return true if an entry was found
+   */
+   bool findIndexEntry(long time_ms, int message, PulseIndexEntry &entry);
+
+  /**
+   * moves playback to the pulse of a seek index entry
+   *
+   * @param  entry  seek index entry
+   *
+   * @return true if the pulse was read
+   */
+   bool resumeFromIndex(const PulseIndexEntry &entry);
+
+  /**
+   * prepares to move playback; opens the file if playback started
+   * from a cached head, and stops using the head
+   *
+   * @return true if playback had been using a cached head
+   */
+   bool leaveCachedPlayback();
+
+  /**
+   * reopens the file open for playback at its first pulse
+   *
+   * @return true if playback active
+   */
+   bool rewindPlayback();
+
+  /**
+   * starts playback timing over at the current pulse
+   */
+   void restartPlayback();
+
+  /**
+   * scales a recorded length to the playback rate, carrying
+   * the part of a millisecond left over to the next length
+   *
+   * @param  len    length as recorded, milliseconds
+   *
+   * @return length as played, milliseconds
+   */
+   long scaleLength(long len);
+
+  /**
+   * works out when the current pulse plays, from the space before
+   * it and its length scaled to the playback rate
+   *
+   * @param  first  true if the pulse starts the pulse train
+   */
+   void scalePulse(bool first);
+
+  /**
+   * reads the next chunk of the playback file into the ring,
+   * if there is room for it
+   *
+   * @return true if any bytes were read
+   */
+   bool fillReadAhead();
+
+  /**
+   * opens the file of a playback started from a cached head,
+   * positioned after the cached pulses
+   *
+   * @return true if the file was opened
+   */
+   bool openDeferredPlayback();
+
+  /**
+   * takes the next byte of the playback file from the ring,
+   * reading from the card only if the ring is empty
+   *
+   * @return next byte, or -1 at end of file
+   */
+   int readAheadByte();
+
+  /**
+   * takes the next byte of pulse records from the ring, passing
+   * over block headers and padding in blocked files
+   *
+   * @return next byte, or -1 at the end of the pulse records
+   */
+   int readPulseByte();
+
+  /**
+   * reads the header of the next playback block; a block that
+   * is not committed ends the pulse train
+   *
+   * @return true if the block holds pulse records
+   */
+   bool loadBlockHeader();
+
+  /**
+   * moves the playback file and ring to a file position; in blocked
+   * files the block holding it is read up to the position first, for
+   * its header and to bring the decoder model up to it
+   *
+   * @param  position  file position of a pulse record
+   *
+   * @return true if the file holds the position
+   */
+   bool seekPlayback(unsigned long position);
+
+  /**
+   * tests for unread bytes of the playback file
+   *
+   * @return true if bytes remain in the ring or on the card
+   */
+   bool readAheadAvailable() {
+      return (readAheadCount > 0) || PTRFile.available();
+   }
+
+  /**
+   * reads next pulse from a legacy text channel file
+   *
+   * @return true if pulse successfully read
+   */
+   bool readNextTextPulse();
+
+  /**
+   * reads next pulse from a binary channel file
+   *
+   * @return true if pulse successfully read
+   */
+   bool readNextBinaryPulse();
 
   /**
    * determines state of keying output by comparing 
@@ -113,13 +659,47 @@ public:
    , currentPulseStartTime(0)
    , currentPulseEndTime(0)
    , isPlaybackActive(false)
+   , fileFormat(PULSE_FORMAT_UNKNOWN)
+   , recordBufferCount(0)
+   , recordFileSize(0)
+   , recordBlockCommitted(0)
+   , blockedFile(false)
+   , blockRemaining(0)
+   , lastRecordTime(0)
+   , bytesBuffered(0)
+   , flushCount(0)
+   , readAheadHead(0)
+   , readAheadCount(0)
+   , readAheadFills(0)
+   , recordHead(0)
+   , playbackHead(0)
+   , playbackHeadIndex(0)
+   , playbackOpenPending(false)
+   , playbackDelay(PLAYBACK_DELAY_MILS)
+   , indexInterval(0)
+   , pulsesSinceIndex(0)
+   , indexBufferCount(0)
+   , firstPulseStartTime(0)
+   , playbackSegments(1)
+   , playbackSegmentOnly(false)
+   , playbackMarkerCount(0)
+   , appendPending(false)
+   , playbackRate(PLAYBACK_RATE_UNITY)
+   , playbackScale(PLAYBACK_RATE_UNITY)
+   , playbackSpacesOnly(false)
+   , playedStartTime(0)
+   , playedEndTime(0)
+   , playedFraction(0)
+   , priorPulseEndTime(0)
+   , playbackDit(0)
    {
     // empty text fields
     currentFileName[0] = 0;
    }
     
   /**
-   * initializes SD card hardware
+   * initializes SD card hardware, opens the channel container,
+   * and repairs any recording cut off by a power failure
    *
    * @param  sd_reserved_pin       SD reserved output pin number
    * @param  sd_cs_pin             SD CS pin number
@@ -127,6 +707,17 @@ public:
    * @return true if SD card reports successful initialization
    */
    bool initialize(int sd_reserved_pin, int sd_cs_pin);
+
+  /**
+   * copies a channel file left on the card by an earlier version
+   * into the channel container, unless the channel already holds
+   * a recording
+   *
+   * @param  fn     channel file name
+   *
+   * @return true if a file was copied
+   */
+   bool importChannel(char *fn);
     
   /**
    * PulseTrainRecorder Constructor
@@ -137,9 +728,27 @@ public:
   /**
    * opens file for recording to SD card
    *
+   * @param  fn     channel file name
+   * @param  head   if not 0, filled with the first pulses recorded
+   *
    * @return true if file successfully opened for writing
    */
-   bool openForRecording(char *fn);
+   bool openForRecording(char *fn, PulseTrainHead *head = 0);
+
+  /**
+   * opens file for recording a new segment at the end of a channel,
+   * leaving what is already recorded untouched; nothing is written
+   * until the first pulse. Falls back to openForRecording() if the
+   * channel is empty, was not recorded in blocks, or its segment
+   * table is full.
+   *
+   * @param  fn     channel file name
+   * @param  head   if not 0, the cached head of the channel, which 
+   *                is refilled if the channel is started over
+   *
+   * @return true if file successfully opened for writing
+   */
+   bool openForAppend(char *fn, PulseTrainHead *head = 0);
     
   /**
    * writes pulse description to SD card
@@ -147,6 +756,41 @@ public:
    * @return true if pulse successfully read and playback active
    */
    bool recordPulse(DigitalPulse dp);
+
+  /**
+   * commits staged pulses to the card if no pulse
+   * has been recorded for RECORD_IDLE_FLUSH_MILS
+   *
+   * @return false if writing is not possible, otherwise true
+   */
+   bool serviceRecording();
+
+  /**
+   * gets number of bytes waiting in the staging buffer
+   *
+   * @return bytes not yet written to the card
+   */
+   unsigned int getPendingByteCount() const {
+      return recordBufferCount - recordBlockCommitted;
+   }
+
+  /**
+   * gets total number of bytes passed through the staging buffer
+   *
+   * @return bytes buffered since reset
+   */
+   unsigned long getBytesBuffered() const {
+      return bytesBuffered;
+   }
+
+  /**
+   * gets number of times the staging buffer was committed to the card
+   *
+   * @return flushes performed since reset
+   */
+   unsigned long getFlushCount() const {
+      return flushCount;
+   }
     
   /**
    * opens file for playback from SD card
@@ -154,6 +798,169 @@ public:
    * @return true if file successfully opened and playback active
    */
    bool openForPlayback(char *fn);
+
+  /**
+   * starts playback from a cached head; the file is opened later,
+   * by serviceReadAhead() or when the cached pulses run out. 
+   * Falls back to openForPlayback() if the head is not loaded.
+   *
+   * @param  fn     channel file name
+   * @param  head   first pulses of the file
+   *
+   * @return true if playback active
+   */
+   bool openCachedPlayback(char *fn, const PulseTrainHead &head);
+
+  /**
+   * reads the first pulses of a channel file into a head
+   *
+   * @param  fn     channel file name
+   * @param  head   receives the first pulses
+   *
+   * @return true if at least one pulse was cached
+   */
+   bool loadHead(char *fn, PulseTrainHead &head);
+
+  /**
+   * reads the summary from a channel file header; only the header
+   * is read, however long the recording
+   *
+   * @param  fn     channel file name
+   * @param  info   receives the summary
+   *
+   * @return true if the file holds a finalized summary
+   */
+   bool getChannelInfo(char *fn, PulseChannelInfo &info);
+
+  /**
+   * writes a fist summary into a channel file header, keeping the
+   * rest of the summary; the channel must not be open for recording
+   *
+   * @param  fn     channel file name
+   * @param  fist   fist summary
+   *
+   * @return true if the file held a finalized summary and was updated
+   */
+   bool writeFistSummary(char *fn, const PulseFistSummary &fist);
+
+  /**
+   * tests whether a channel holds a recording; a channel without
+   * a file, or whose summary counts no pulses, is empty. Files
+   * without a summary are assumed to hold one.
+   *
+   * @param  fn     channel file name
+   *
+   * @return true if the channel is empty
+   */
+   bool isChannelEmpty(char *fn);
+
+  /**
+   * sets number of pulses between seek index entries; recordings 
+   * made with indexing on have a seek index file alongside them
+   *
+   * @param  pulses   pulses between entries, 0 for no index
+   */
+   void setIndexInterval(uint8_t pulses) {
+      indexInterval = pulses;
+   }
+
+  /**
+   * gets number of pulses between seek index entries
+   *
+   * @return pulses between entries, 0 for no index
+   */
+   uint8_t getIndexInterval() const {
+      return indexInterval;
+   }
+
+  /**
+   * moves playback to the first pulse ending after a given time,
+   * which then plays after the usual delay. The seek index is used
+   * if there is one, otherwise the file is read up to the place.
+   *
+   * @param  offset_ms  milliseconds from the first pulse of the file
+   *
+   * @return true if playback active at the new place
+   */
+   bool seek(long offset_ms);
+
+  /**
+   * moves playback to the first pulse of a message, which then
+   * plays after the usual delay. Messages are separated by spaces of
+   * at least PLAYBACK_MESSAGE_GAP_MILS. The seek index is used if 
+   * there is one, otherwise the file is read up to the message.
+   *
+   * @param  message  message number, counting from 0
+   *
+   * @return true if playback active at the new place
+   */
+   bool skipToMessage(unsigned int message);
+
+  /**
+   * moves playback to the first pulse of a segment, which then plays
+   * after the usual delay; playback ends with the segment
+   *
+   * @param  segment  segment number, counting from 0
+   *
+   * @return true if playback active at the new place
+   */
+   bool playSegment(unsigned int segment);
+
+  /**
+   * gets number of segments in the file open for playback; all
+   * of them are played unless playSegment() is called
+   *
+   * @return number of segments, at least 1
+   */
+   unsigned int getSegmentCount() const {
+      return playbackSegments;
+   }
+
+  /**
+   * gets place reached by playback, for use with seek(); away 
+   * from the recorded speed, the start of the pulse playing
+   *
+   * @return milliseconds from the first pulse of the file
+   */
+   long getPlaybackPosition() const;
+
+  /**
+   * sets the playback rate; takes effect from the next pulse,
+   * so it can be changed while playing
+   *
+   * @param  rate         256ths of the recorded speed
+   * @param  spaces_only  true to scale only the spaces between
+   *                      characters, as in Farnsworth timing
+   */
+   void setPlaybackRate(uint16_t rate, bool spaces_only = false);
+
+  /**
+   * gets the playback rate
+   *
+   * @return 256ths of the recorded speed
+   */
+   uint16_t getPlaybackRate() const {
+      return playbackRate;
+   }
+
+  /**
+   * tests whether only spaces between characters are scaled
+   *
+   * @return true if marks and spaces within characters
+   *         play as recorded
+   */
+   bool isSpacesOnlyRate() const {
+      return playbackSpacesOnly;
+   }
+
+  /**
+   * gets wait before the first pulse of the current playback
+   *
+   * @return milliseconds from the start of playback
+   */
+   unsigned long getPlaybackDelay() const {
+      return playbackDelay;
+   }
     
   /**
    * reads next pulse description from SD card
@@ -161,12 +968,59 @@ public:
    * @return true if pulse successfully read and playback active
    */
    bool readNextPulse();
+
+  /**
+   * tops up the playback read-ahead ring from the card, first
+   * opening the file if playback started from a cached head; called 
+   * while the key is up, so the card is not read when an edge is due
+   *
+   * @return true if any bytes were read
+   */
+   bool serviceReadAhead();
+
+  /**
+   * gets number of chunks read from the card for playback
+   *
+   * @return reads performed since reset
+   */
+   unsigned long getReadAheadFills() const {
+      return readAheadFills;
+   }
     
   /**
    * closes any file open on SD card
    */
    void close();
 
+  /**
+   * gets start time of the current playback pulse, as played
+   * at the playback rate
+   *
+   * @return milliseconds from the start of the pulse train
+   */
+   long getPulseStartOffset() const {
+      return playedStartTime;
+   }
+
+  /**
+   * gets end time of the current playback pulse, as played
+   * at the playback rate
+   *
+   * @return milliseconds from the start of the pulse train
+   */
+   long getPulseEndOffset() const {
+      return playedEndTime;
+   }
+
+  /**
+   * gets value of recording active flag
+   *
+   * @return true if a file is open for recording
+   */
+   bool recordingActive()  const {
+      return isOpenForWrite;
+   }
+
   /**
    * gets value of playback active flag
    *
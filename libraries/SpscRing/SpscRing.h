@@ -0,0 +1,200 @@
+#ifndef _SPSC_RING_H_
+#define _SPSC_RING_H_
+
+/**
+ * @file    SpscRing.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains the template class SpscRing, a fixed size
+ * lock-free queue for passing data between one producer and one
+ * consumer, typically an interrupt handler and the main loop.
+ */
+
+#include <Arduino.h>
+
+/**
+ * compiler barrier, keeps item stores and loads on the correct
+ * side of the index update that publishes them
+ */
+#define SPSC_RING_BARRIER()  __asm__ __volatile__ ("" ::: "memory")
+
+/**
+ * Single producer, single consumer ring buffer.
+ *
+ * The producer only writes head and the consumer only writes tail.
+ * Both indices are single bytes, so they are read and written
+ * atomically on the AVR without disabling interrupts. One slot is
+ * always left empty to tell a full ring from an empty one, so the
+ * ring holds SIZE - 1 items.
+ *
+ * SIZE must be a power of two no larger than 128.
+ */
+template <typename T, uint8_t SIZE>
+class SpscRing {
+protected:
+  /** item storage */
+   T items[SIZE];
+
+  /** index of next slot to write, owned by producer */
+   volatile uint8_t head;
+
+  /** index of next slot to read, owned by consumer */
+   volatile uint8_t tail;
+
+  /** number of items refused because the ring was full */
+   volatile uint16_t overruns;
+
+  /**
+   * returns index following idx, wrapping at SIZE
+   */
+   static uint8_t nextIndex(uint8_t idx) {
+      return (idx + 1) & (SIZE - 1);
+   }
+
+public:
+  /**
+   * SpscRing constructor
+   */
+   SpscRing()
+   : head(0)
+   , tail(0)
+   , overruns(0)
+   {}
+
+  /**
+   * adds item to ring, producer side only
+   *
+   * @param  item   item to add
+   *
+   * @return true if item added, false if ring was full
+   */
+   bool push(const T &item) {
+      bool rtn = false;
+      uint8_t h = head;
+      uint8_t next = nextIndex(h);
+
+      if (next != tail) {
+         items[h] = item;
+         SPSC_RING_BARRIER();
+         head = next;
+         rtn = true;
+      }
+      else {
+         ++overruns;
+      }
+
+      return rtn;
+   }
+
+  /**
+   * returns pointer to oldest item without removing it,
+   * consumer side only
+   *
+   * @return pointer to item, or 0 if ring is empty
+   */
+   const T *peek() const {
+      const T *rtn = 0;
+      uint8_t t = tail;
+
+      if (t != head) {
+         SPSC_RING_BARRIER();
+         rtn = &items[t];
+      }
+
+      return rtn;
+   }
+
+  /**
+   * removes oldest item from ring, consumer side only
+   *
+   * @param  item   receives the removed item
+   *
+   * @return true if item removed, false if ring was empty
+   */
+   bool pop(T &item) {
+      bool rtn = false;
+      uint8_t t = tail;
+
+      if (t != head) {
+         SPSC_RING_BARRIER();
+         item = items[t];
+         SPSC_RING_BARRIER();
+         tail = nextIndex(t);
+         rtn = true;
+      }
+
+      return rtn;
+   }
+
+  /**
+   * removes oldest item from ring without copying it,
+   * consumer side only
+   */
+   void drop() {
+      uint8_t t = tail;
+
+      if (t != head) {
+         SPSC_RING_BARRIER();
+         tail = nextIndex(t);
+      }
+   }
+
+  /**
+   * removes all items from ring, consumer side only
+   */
+   void discard() {
+      tail = head;
+   }
+
+  /**
+   * returns number of items in ring
+   *
+   * @return item count
+   */
+   uint8_t count() const {
+      return (head - tail) & (SIZE - 1);
+   }
+
+  /**
+   * returns number of free slots in ring
+   *
+   * @return free slot count
+   */
+   uint8_t space() const {
+      return (SIZE - 1) - count();
+   }
+
+  /**
+   * returns number of items refused because the ring was full
+   *
+   * @return overrun count
+   */
+   uint16_t getOverrunCount() const {
+      return overruns;
+   }
+};
+
+#endif // _SPSC_RING_H_
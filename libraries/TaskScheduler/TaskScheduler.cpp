@@ -0,0 +1,177 @@
+/**
+ * @file    TaskScheduler.cpp
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class implementations for ScheduledTask and
+ * TaskScheduler. These classes implement a small cooperative
+ * scheduler that runs tasks from the main loop when their
+ * deadlines fall due.
+ */
+
+#include <Arduino.h>
+#include <TaskScheduler.h>
+
+/**
+ * schedules task to run after a delay, replacing
+ * any deadline it already has
+ *
+ * @param  task         task to run
+ * @param  delay_mils   time until the task is due, milliseconds
+ */
+void TaskScheduler::schedule(ScheduledTask &task, unsigned long delay_mils) {
+   remove(task);
+
+   // a task rescheduling itself waits at least until the
+   // next millisecond, or it would run again at once
+   if ((&task == runningTask) && (0 == delay_mils)) {
+      delay_mils = 1;
+   }
+
+   task.deadline = millis() + delay_mils;
+   insert(task);
+}
+
+/**
+ * removes task from the schedule
+ *
+ * @param  task         task to cancel
+ */
+void TaskScheduler::cancel(ScheduledTask &task) {
+   remove(task);
+
+   // stop a periodic task rescheduling itself
+   if (&task == runningTask) {
+      runningCancelled = true;
+   }
+}
+
+/**
+ * runs every task whose deadline has arrived; called from loop()
+ *
+ * @return number of tasks run
+ */
+uint8_t TaskScheduler::run() {
+   uint8_t rtn = 0;
+   unsigned long tm = millis();
+   unsigned long elapsed = tm - lastRunTime;
+
+   if (elapsed >= TASK_WHEEL_SLOTS) {
+      // been away a full turn, every slot may have work
+      for (uint8_t ii=0; ii<TASK_WHEEL_SLOTS; ++ii) {
+         rtn += runSlot(ii, tm);
+      }
+   }
+   else {
+      // slots from the last run up to now, the last run's
+      // slot again for anything scheduled since
+      for (unsigned long t = lastRunTime; t != tm + 1; ++t) {
+         rtn += runSlot(t & (TASK_WHEEL_SLOTS - 1), tm);
+      }
+   }
+
+   lastRunTime = tm;
+
+   return rtn;
+}
+
+/**
+ * runs due tasks from one wheel slot
+ *
+ * @return number of tasks run
+ */
+uint8_t TaskScheduler::runSlot(uint8_t slot, unsigned long tm) {
+   uint8_t rtn = 0;
+   bool found = true;
+
+   // a task may schedule or cancel any other task while it
+   // runs, so the slot is searched again after each one
+   while (found) {
+      found = false;
+      ScheduledTask *task = wheel[slot];
+
+      // skip tasks due on a later turn of the wheel
+      while (task && ((long)(tm - task->deadline) < 0)) {
+         task = task->next;
+      }
+
+      if (task) {
+         found = true;
+         remove(*task);
+
+         runningTask = task;
+         runningCancelled = false;
+
+         task->function();
+         ++rtn;
+
+         // periodic tasks go round again unless the task
+         // rescheduled or cancelled itself; a late task
+         // is not run twice to catch up
+         if (!runningCancelled && !task->scheduled && (task->period > 0)) {
+            task->deadline += task->period;
+            if ((long)(tm - task->deadline) >= 0) {
+               task->deadline = tm + task->period;
+            }
+            insert(*task);
+         }
+
+         runningTask = 0;
+      }
+   }
+
+   return rtn;
+}
+
+/**
+ * adds task to the wheel slot for its deadline
+ */
+void TaskScheduler::insert(ScheduledTask &task) {
+   uint8_t slot = task.deadline & (TASK_WHEEL_SLOTS - 1);
+
+   task.next = wheel[slot];
+   wheel[slot] = &task;
+   task.scheduled = true;
+}
+
+/**
+ * removes task from its wheel slot
+ */
+void TaskScheduler::remove(ScheduledTask &task) {
+   if (task.scheduled) {
+      ScheduledTask **link = &wheel[task.deadline & (TASK_WHEEL_SLOTS - 1)];
+
+      while (*link && (*link != &task)) {
+         link = &(*link)->next;
+      }
+
+      if (*link) {
+         *link = task.next;
+      }
+
+      task.next = 0;
+      task.scheduled = false;
+   }
+}
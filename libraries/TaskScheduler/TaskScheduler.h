@@ -0,0 +1,202 @@
+#ifndef _TASK_SCHEDULER_H_
+#define _TASK_SCHEDULER_H_
+
+/**
+ * @file    TaskScheduler.h
+ * @author  Mike Aiello N2HTT <n2htt@arrl.net>
+ * @version 1.0
+ *
+ * Copyright (C) 2014 Michael Aiello N2HTT
+ *
+ * @section LICENSE
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+ * General Public License for more details at
+ * http://www.gnu.org/licenses/old-licenses/gpl-2.0.html
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the
+ * Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+ *
+ * @section DESCRIPTION
+ *
+ * This file contains class definitions for ScheduledTask and
+ * TaskScheduler. These classes implement a small cooperative
+ * scheduler that runs tasks from the main loop when their
+ * deadlines fall due.
+ */
+
+#include <Arduino.h>
+
+/**
+ * number of slots in the timer wheel, must be a power of two;
+ * each slot covers one millisecond
+ */
+#define TASK_WHEEL_SLOTS  8
+
+/**
+ * type of function run by a task
+ */
+typedef void (*TaskFunction)();
+
+/**
+ * A task run by TaskScheduler.
+ *
+ * A task with a period is rescheduled automatically each time it
+ * runs, unless it reschedules or cancels itself while running. A
+ * task without a period runs once each time it is scheduled.
+ */
+class ScheduledTask {
+   friend class TaskScheduler;
+
+protected:
+  /**
+   * function run when the deadline falls due
+   */
+   TaskFunction function;
+
+  /**
+   * time between runs, milliseconds, or 0 for a one-shot task
+   */
+   unsigned long period;
+
+  /**
+   * time the task is next due, milliseconds since reset
+   */
+   unsigned long deadline;
+
+  /**
+   * next task in the same timer wheel slot
+   */
+   ScheduledTask *next;
+
+  /**
+   * flag is true while the task is in the timer wheel
+   */
+   bool scheduled;
+
+public:
+  /**
+   * ScheduledTask constructor
+   *
+   * @param  fn           function to run
+   * @param  period_mils  time between runs, milliseconds,
+   *                      or 0 for a one-shot task
+   */
+   ScheduledTask(TaskFunction fn, unsigned long period_mils = 0)
+   : function(fn)
+   , period(period_mils)
+   , deadline(0)
+   , next(0)
+   , scheduled(false)
+   {}
+
+  /**
+   * returns scheduled state
+   *
+   * @return true if task is waiting to run
+   */
+   bool isScheduled() const {
+      return scheduled;
+   }
+};
+
+/**
+ * The Task Scheduler keeps tasks on a hashed timer wheel.
+ *
+ * Each task is kept in the slot given by its deadline in milliseconds,
+ * modulo the number of slots. Each call to run() visits only the slots
+ * for the milliseconds that have passed since the last call, and runs
+ * the tasks there whose deadlines have arrived; tasks due on a later
+ * turn of the wheel are left in place. Tasks with nothing due cost no
+ * time at all.
+ *
+ * Tasks are run to completion one at a time from the main loop, and
+ * never interrupt each other.
+ */
+class TaskScheduler {
+protected:
+  /**
+   * lists of tasks, by deadline modulo TASK_WHEEL_SLOTS
+   */
+   ScheduledTask *wheel[TASK_WHEEL_SLOTS];
+
+  /**
+   * time of the last call to run(), milliseconds since reset
+   */
+   unsigned long lastRunTime;
+
+  /**
+   * task currently running, if any
+   */
+   ScheduledTask *runningTask;
+
+  /**
+   * flag is set if the running task is cancelled while it runs
+   */
+   bool runningCancelled;
+
+  /**
+   * adds task to the wheel slot for its deadline
+   */
+   void insert(ScheduledTask &task);
+
+  /**
+   * removes task from its wheel slot
+   */
+   void remove(ScheduledTask &task);
+
+  /**
+   * runs due tasks from one wheel slot
+   *
+   * @return number of tasks run
+   */
+   uint8_t runSlot(uint8_t slot, unsigned long tm);
+
+public:
+  /**
+   * TaskScheduler constructor
+   */
+   TaskScheduler()
+   : lastRunTime(0)
+   , runningTask(0)
+   , runningCancelled(false)
+   {
+      for (uint8_t ii=0; ii<TASK_WHEEL_SLOTS; ++ii) {
+         wheel[ii] = 0;
+      }
+   }
+
+  /**
+   * schedules task to run after a delay, replacing
+   * any deadline it already has
+   *
+   * @param  task         task to run
+   * @param  delay_mils   time until the task is due, milliseconds
+   */
+   void schedule(ScheduledTask &task, unsigned long delay_mils);
+
+  /**
+   * removes task from the schedule
+   *
+   * @param  task         task to cancel
+   */
+   void cancel(ScheduledTask &task);
+
+  /**
+   * runs every task whose deadline has arrived; called from loop()
+   *
+   * @return number of tasks run
+   */
+   uint8_t run();
+};
+
+#endif // _TASK_SCHEDULER_H_